@@ -7,14 +7,38 @@
 #include "errors.h"
 #include "protocol.h"
 #include "network.h"
+#include "location_cache.h"
+#include "hedge.h"
+#include "server_rtt.h"
+
+struct PendingMutation;
 
 // Opaque client handle
 typedef struct Client {
-    NetworkSocket *naming_server_sock;
+    NetworkSocket *naming_server_socks[MAX_SHARDS]; // One per naming server shard, NULL until reconnected
+    NetworkSocket *standby_socks[MAX_SHARDS];       // The shard's hot standby, NULL if none
+    ShardAddress naming_server_addresses[MAX_SHARDS];
+    ShardAddress standby_addresses[MAX_SHARDS];     // Empty host if the shard has no standby
+    uint32_t naming_server_count;
     NetworkSocket *storage_server_sock; // Current storage server connection
-    pthread_mutex_t mutex;
+    LocationCache *locations;           // Leased locations from the naming server
+    HedgePolicy *hedge;                 // When to repeat a slow read elsewhere
+    ServerRtt *rtt;                     // How quickly each storage server answers
+    struct PendingMutation *mutations;  // Accepted CREATEs and DELETEs awaiting their outcome
+    pthread_mutex_t mutex;              // Recursive: exchanges run under a caller's lock
 } Client;
 
+// Location of a file as resolved by the naming server
+typedef struct {
+    ErrorCode status;
+    char host[INET_ADDRSTRLEN];
+    char port[32];
+} StorageLocation;
+
+// Servers a read considers; unreachable ones are skipped and at most one
+// hedge is sent
+#define MAX_READ_TARGETS LOCATION_MAX_REPLICAS
+
 // Initialize the client library
 ErrorCode client_init(Client **client, const char *naming_server_host, const char *naming_server_port);
 
@@ -27,6 +51,37 @@ ErrorCode client_write(Client *client, const char *filepath, uint64_t offset, co
 ErrorCode client_create(Client *client, const char *filepath, uint32_t mode);
 ErrorCode client_delete(Client *client, const char *filepath);
 
+// Copy a file or a whole directory tree to a destination that does not exist
+// yet. Storage servers move the data between themselves; both paths must
+// belong to the same naming server.
+ErrorCode client_copy(Client *client, const char *source, const char *destination);
+
+// Move a file or a whole directory tree to a destination that does not
+// exist yet. Only names change, so it takes the same time at any size.
+ErrorCode client_rename(Client *client, const char *source, const char *destination);
+
+// Resolve the storage server of many files in as few round trips as possible
+ErrorCode client_locate_many(Client *client, const char **filepaths, size_t count, StorageLocation *locations);
+
+// Fetch one page of a directory listing. Pass an empty cursor for the first
+// page and next_cursor for the following ones; entries are in host order.
+ErrorCode client_list_page(Client *client, const char *path, int recursive, const char *cursor,
+                           ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                           char *next_cursor, int *has_more);
+
+// Stream a whole directory listing page by page through callback
+typedef void (*client_list_callback_t)(const ListEntry *entry, void *user_data);
+ErrorCode client_list(Client *client, const char *path, int recursive, client_list_callback_t callback, void *user_data);
+
+// Stream every entry in the namespace whose name (last path component)
+// matches pattern through callback, shard by shard in no particular order
+ErrorCode client_search(Client *client, const char *pattern, SearchMode mode, client_list_callback_t callback,
+                        void *user_data);
+
+// Progress of the naming servers restoring copies lost with failed storage
+// servers, summed over every shard, in host order
+ErrorCode client_repair_status(Client *client, RepairStatus *status);
+
 // Asynchronous operation callback
 typedef void (*client_callback_t)(ErrorCode code, void *user_data);
 
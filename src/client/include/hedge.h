@@ -0,0 +1,33 @@
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#include <stdint.h>
+
+// Decides when a read waiting on a slow storage server should be repeated
+// against another copy of the file. The wait is an adaptive percentile of
+// recently observed read latencies, and hedges draw on a budget earned by
+// ordinary reads so they add at most a fixed fraction of extra load.
+typedef struct HedgePolicy HedgePolicy;
+
+#define HEDGE_PERCENTILE 95             // Hedge reads slower than this percentile
+#define HEDGE_MIN_SAMPLES 20            // Below this, wait HEDGE_DEFAULT_DELAY_MS
+#define HEDGE_DEFAULT_DELAY_MS 50
+#define HEDGE_MIN_DELAY_MS 2
+#define HEDGE_MAX_DELAY_MS 2000
+#define HEDGE_DECAY_SAMPLES 1024        // Halve the history this often
+#define HEDGE_BUDGET_PERCENT 5          // Hedges allowed per 100 reads
+#define HEDGE_BUDGET_BURST 10           // Hedges that may be saved up
+
+HedgePolicy *hedge_policy_create();
+void hedge_policy_destroy(HedgePolicy *policy);
+
+// How long a read should wait before hedging, in milliseconds
+uint32_t hedge_delay_ms(HedgePolicy *policy);
+
+// Record the latency of a completed read; each read also earns budget
+void hedge_record(HedgePolicy *policy, uint64_t latency_us);
+
+// Take one hedge from the budget. Returns 1 if the hedge may go out.
+int hedge_try_acquire(HedgePolicy *policy);
+
+#endif // HEDGE_H
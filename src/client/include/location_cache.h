@@ -0,0 +1,45 @@
+#ifndef LOCATION_CACHE_H
+#define LOCATION_CACHE_H
+
+#include "errors.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+// Leased file locations handed out by the naming server, keyed by path
+typedef struct LocationCache LocationCache;
+
+// Copies of a file kept per location, best first as the naming server sent them
+#define LOCATION_MAX_REPLICAS 4
+
+// A server holding a copy of a file, with the naming server's hints
+typedef struct {
+    char host[INET_ADDRSTRLEN];
+    char port[32];
+    int healthy;
+    uint32_t load;              // Placement cost in thousandths
+} ReplicaHint;
+
+LocationCache *location_cache_create();
+void location_cache_destroy(LocationCache *cache);
+
+// Copy the cached location of path if its lease is still valid.
+// host holds at least 256 bytes, port at least 32. If replicas is not NULL
+// it receives up to LOCATION_MAX_REPLICAS copies and *replica_count their
+// number.
+ErrorCode location_cache_get(LocationCache *cache, const char *path, char *host, char *port,
+                             ReplicaHint *replicas, size_t *replica_count);
+
+// Remember a location and the copies of the file for ttl_ms (a zero ttl is
+// not cached)
+void location_cache_put(LocationCache *cache, const char *path, const char *host, const char *port,
+                        const ReplicaHint *replicas, size_t replica_count,
+                        uint32_t ttl_ms, uint64_t version);
+
+// Drop the entry of path if its version is not newer than version
+void location_cache_invalidate(LocationCache *cache, const char *path, uint64_t version);
+
+// Drop the entries of prefix and of every path below it
+void location_cache_invalidate_prefix(LocationCache *cache, const char *prefix);
+
+#endif // LOCATION_CACHE_H
@@ -0,0 +1,29 @@
+#ifndef SERVER_RTT_H
+#define SERVER_RTT_H
+
+#include <stdint.h>
+
+// Moving average of the time storage servers take to answer reads, as seen
+// by this client, and the reads outstanding on each, keyed by host:port.
+// Used to steer reads to quicker, less busy copies.
+typedef struct ServerRtt ServerRtt;
+
+#define SERVER_RTT_SLOTS 256            // Servers tracked at once
+#define SERVER_RTT_STALE_MS 2000        // Older averages count as unmeasured
+
+ServerRtt *server_rtt_create();
+void server_rtt_destroy(ServerRtt *rtt);
+
+// A read to host:port was sent
+void server_rtt_start(ServerRtt *rtt, const char *host, const char *port);
+
+// That read completed or was abandoned after latency_us; fold it into the
+// average of host:port
+void server_rtt_finish(ServerRtt *rtt, const char *host, const char *port, uint64_t latency_us);
+
+// Expected wait for one more read on host:port in microseconds: the average
+// scaled by the reads already outstanding. 0 if there is no recent average,
+// so unmeasured servers get tried.
+uint64_t server_rtt_score(ServerRtt *rtt, const char *host, const char *port);
+
+#endif // SERVER_RTT_H
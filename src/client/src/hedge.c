@@ -0,0 +1,97 @@
+#include "hedge.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Latencies land in log-linear buckets: four per power of two microseconds,
+// which keeps the percentile within 25% of the true value
+#define HEDGE_BUCKETS 128
+#define HEDGE_TOKEN 1000                // Budget units per hedge
+
+struct HedgePolicy {
+    uint32_t counts[HEDGE_BUCKETS];
+    uint32_t samples;                   // Sum of counts
+    uint32_t since_decay;
+    uint32_t tokens;
+    pthread_mutex_t lock;
+};
+
+static int bucket_of(uint64_t us) {
+    if (us < 4) return (int)us;
+    int msb = 63 - __builtin_clzll(us);
+    int index = (msb - 1) * 4 + (int)((us >> (msb - 2)) & 3);
+    return index < HEDGE_BUCKETS ? index : HEDGE_BUCKETS - 1;
+}
+
+// Smallest latency above every sample in bucket index
+static uint64_t bucket_limit(int index) {
+    if (index < 4) return index + 1;
+    int msb = index / 4 + 1;
+    uint64_t lower = (uint64_t)(4 + index % 4) << (msb - 2);
+    return lower + ((uint64_t)1 << (msb - 2));
+}
+
+HedgePolicy *hedge_policy_create() {
+    HedgePolicy *policy = calloc(1, sizeof(HedgePolicy));
+    if (!policy) return NULL;
+    policy->tokens = HEDGE_TOKEN;
+    pthread_mutex_init(&policy->lock, NULL);
+    return policy;
+}
+
+void hedge_policy_destroy(HedgePolicy *policy) {
+    if (!policy) return;
+    pthread_mutex_destroy(&policy->lock);
+    free(policy);
+}
+
+uint32_t hedge_delay_ms(HedgePolicy *policy) {
+    pthread_mutex_lock(&policy->lock);
+    if (policy->samples < HEDGE_MIN_SAMPLES) {
+        pthread_mutex_unlock(&policy->lock);
+        return HEDGE_DEFAULT_DELAY_MS;
+    }
+
+    uint64_t rank = ((uint64_t)policy->samples * HEDGE_PERCENTILE + 99) / 100;
+    uint64_t seen = 0;
+    int index = 0;
+    for (; index < HEDGE_BUCKETS - 1; index++) {
+        seen += policy->counts[index];
+        if (seen >= rank) break;
+    }
+    pthread_mutex_unlock(&policy->lock);
+
+    uint64_t delay = (bucket_limit(index) + 999) / 1000;
+    if (delay < HEDGE_MIN_DELAY_MS) delay = HEDGE_MIN_DELAY_MS;
+    if (delay > HEDGE_MAX_DELAY_MS) delay = HEDGE_MAX_DELAY_MS;
+    return (uint32_t)delay;
+}
+
+void hedge_record(HedgePolicy *policy, uint64_t latency_us) {
+    pthread_mutex_lock(&policy->lock);
+    policy->counts[bucket_of(latency_us)]++;
+    policy->samples++;
+
+    // Halving old samples lets the percentile follow a changing cluster
+    if (++policy->since_decay >= HEDGE_DECAY_SAMPLES) {
+        policy->samples = 0;
+        for (int i = 0; i < HEDGE_BUCKETS; i++) {
+            policy->counts[i] /= 2;
+            policy->samples += policy->counts[i];
+        }
+        policy->since_decay = 0;
+    }
+
+    policy->tokens += HEDGE_TOKEN * HEDGE_BUDGET_PERCENT / 100;
+    if (policy->tokens > HEDGE_TOKEN * HEDGE_BUDGET_BURST) {
+        policy->tokens = HEDGE_TOKEN * HEDGE_BUDGET_BURST;
+    }
+    pthread_mutex_unlock(&policy->lock);
+}
+
+int hedge_try_acquire(HedgePolicy *policy) {
+    pthread_mutex_lock(&policy->lock);
+    int granted = policy->tokens >= HEDGE_TOKEN;
+    if (granted) policy->tokens -= HEDGE_TOKEN;
+    pthread_mutex_unlock(&policy->lock);
+    return granted;
+}
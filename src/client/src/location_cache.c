@@ -0,0 +1,203 @@
+#include "location_cache.h"
+#include "hash.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOCATION_CACHE_BUCKETS 1024
+#define LOCATION_CACHE_MAX_ENTRIES 16384
+
+typedef struct LocationEntry {
+    char *path;
+    char host[256];
+    char port[32];
+    ReplicaHint replicas[LOCATION_MAX_REPLICAS];
+    size_t replica_count;
+    uint64_t version;
+    uint64_t expires_ms;
+    struct LocationEntry *next;
+} LocationEntry;
+
+struct LocationCache {
+    LocationEntry *buckets[LOCATION_CACHE_BUCKETS];
+    size_t size;
+    pthread_mutex_t lock;
+};
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Keys carry no leading slashes, matching the naming server's leases
+static const char *cache_key(const char *path) {
+    while (*path == '/') path++;
+    return path;
+}
+
+static uint32_t hash_path(const char *path) {
+    return fnv_hash(path) % LOCATION_CACHE_BUCKETS;
+}
+
+static void free_entry(LocationEntry *entry) {
+    free(entry->path);
+    free(entry);
+}
+
+// Drop every expired entry; caller holds the lock
+static void purge_expired(LocationCache *cache, uint64_t now) {
+    for (int i = 0; i < LOCATION_CACHE_BUCKETS; i++) {
+        LocationEntry **link = &cache->buckets[i];
+        while (*link) {
+            LocationEntry *entry = *link;
+            if (entry->expires_ms <= now) {
+                *link = entry->next;
+                free_entry(entry);
+                cache->size--;
+                continue;
+            }
+            link = &entry->next;
+        }
+    }
+}
+
+LocationCache *location_cache_create() {
+    LocationCache *cache = calloc(1, sizeof(LocationCache));
+    if (!cache) return NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void location_cache_destroy(LocationCache *cache) {
+    if (!cache) return;
+    for (int i = 0; i < LOCATION_CACHE_BUCKETS; i++) {
+        LocationEntry *entry = cache->buckets[i];
+        while (entry) {
+            LocationEntry *next = entry->next;
+            free_entry(entry);
+            entry = next;
+        }
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+ErrorCode location_cache_get(LocationCache *cache, const char *path, char *host, char *port,
+                             ReplicaHint *replicas, size_t *replica_count) {
+    if (!cache) return ERR_NOT_FOUND;
+    path = cache_key(path);
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&cache->lock);
+    LocationEntry **link = &cache->buckets[hash_path(path)];
+    while (*link) {
+        LocationEntry *entry = *link;
+        if (strcmp(entry->path, path) == 0) {
+            if (entry->expires_ms <= now) {
+                *link = entry->next;
+                free_entry(entry);
+                cache->size--;
+                break;
+            }
+            strcpy(host, entry->host);
+            strcpy(port, entry->port);
+            if (replicas) {
+                memcpy(replicas, entry->replicas, entry->replica_count * sizeof(ReplicaHint));
+                *replica_count = entry->replica_count;
+            }
+            pthread_mutex_unlock(&cache->lock);
+            return ERR_SUCCESS;
+        }
+        link = &entry->next;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ERR_NOT_FOUND;
+}
+
+void location_cache_put(LocationCache *cache, const char *path, const char *host, const char *port,
+                        const ReplicaHint *replicas, size_t replica_count,
+                        uint32_t ttl_ms, uint64_t version) {
+    if (!cache || ttl_ms == 0) return;
+    path = cache_key(path);
+    uint32_t bucket = hash_path(path);
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&cache->lock);
+
+    LocationEntry *entry = cache->buckets[bucket];
+    while (entry && strcmp(entry->path, path) != 0) entry = entry->next;
+
+    if (!entry) {
+        if (cache->size >= LOCATION_CACHE_MAX_ENTRIES) purge_expired(cache, now);
+        if (cache->size >= LOCATION_CACHE_MAX_ENTRIES) {
+            pthread_mutex_unlock(&cache->lock);
+            return;
+        }
+        entry = calloc(1, sizeof(LocationEntry));
+        if (entry) entry->path = strdup(path);
+        if (!entry || !entry->path) {
+            free(entry);
+            pthread_mutex_unlock(&cache->lock);
+            return;
+        }
+        entry->next = cache->buckets[bucket];
+        cache->buckets[bucket] = entry;
+        cache->size++;
+    }
+
+    strncpy(entry->host, host, sizeof(entry->host) - 1);
+    strncpy(entry->port, port, sizeof(entry->port) - 1);
+    if (replica_count > LOCATION_MAX_REPLICAS) replica_count = LOCATION_MAX_REPLICAS;
+    if (replica_count > 0) memcpy(entry->replicas, replicas, replica_count * sizeof(ReplicaHint));
+    entry->replica_count = replica_count;
+    entry->version = version;
+    entry->expires_ms = now + ttl_ms;
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void location_cache_invalidate(LocationCache *cache, const char *path, uint64_t version) {
+    if (!cache) return;
+    path = cache_key(path);
+
+    pthread_mutex_lock(&cache->lock);
+    LocationEntry **link = &cache->buckets[hash_path(path)];
+    while (*link) {
+        LocationEntry *entry = *link;
+        if (strcmp(entry->path, path) == 0) {
+            if (entry->version <= version) {
+                *link = entry->next;
+                free_entry(entry);
+                cache->size--;
+            }
+            break;
+        }
+        link = &entry->next;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void location_cache_invalidate_prefix(LocationCache *cache, const char *prefix) {
+    if (!cache) return;
+    prefix = cache_key(prefix);
+    size_t prefix_len = strlen(prefix);
+
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < LOCATION_CACHE_BUCKETS; i++) {
+        LocationEntry **link = &cache->buckets[i];
+        while (*link) {
+            LocationEntry *entry = *link;
+            if (prefix_len == 0 || (strncmp(entry->path, prefix, prefix_len) == 0 &&
+                                    (entry->path[prefix_len] == '\0' || entry->path[prefix_len] == '/'))) {
+                *link = entry->next;
+                free_entry(entry);
+                cache->size--;
+                continue;
+            }
+            link = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -33,8 +33,14 @@ static void print_help() {
         "  write <path> <offset> <data>   Write data to file\n"
         "  read <path> <offset> <length>  Read data from file\n"
         "  delete <path>                  Delete a file\n"
+        "  copy <source> <destination>    Copy a file or directory tree\n"
+        "  rename <source> <destination>  Move a file or directory tree\n"
         "  stream <path>                  Stream audio file\n"
         "  info <path>                    Get file size and permissions\n"
+        "  locate <path> [path...]        Show the storage server of each path\n"
+        "  ls [-r] [path]                 List a directory (-r for the whole subtree)\n"
+        "  find [-p|-g] <pattern>         Find entries by name (substring, -p prefix, -g glob)\n"
+        "  repair                         Show progress restoring lost copies\n"
         "  help                           Show this help\n"
         "  exit                           Exit the program\n");
 }
@@ -119,6 +125,34 @@ static void handle_delete_command(Client *client, char **args, int argc) {
     }
 }
 
+static void handle_copy_command(Client *client, char **args, int argc) {
+    if (argc != 3) {
+        printf("Usage: copy <source> <destination>\n");
+        return;
+    }
+
+    ErrorCode err = client_copy(client, args[1], args[2]);
+    if (err == ERR_SUCCESS) {
+        printf("Copied %s to %s\n", args[1], args[2]);
+    } else {
+        printf("Failed to copy %s: Error %d\n", args[1], err);
+    }
+}
+
+static void handle_rename_command(Client *client, char **args, int argc) {
+    if (argc != 3) {
+        printf("Usage: rename <source> <destination>\n");
+        return;
+    }
+
+    ErrorCode err = client_rename(client, args[1], args[2]);
+    if (err == ERR_SUCCESS) {
+        printf("Renamed %s to %s\n", args[1], args[2]);
+    } else {
+        printf("Failed to rename %s: Error %d\n", args[1], err);
+    }
+}
+
 static void handle_stream_data(const uint8_t *data, size_t length, void *user_data) {
     printf("Received %zu bytes of streaming data\n", length);
     // Process streaming data as needed
@@ -170,6 +204,97 @@ static void handle_info_command(Client *client, char **args, int argc) {
     }
 }
 
+static void handle_locate_command(Client *client, char **args, int argc) {
+    if (argc < 2) {
+        printf("Usage: locate <path> [path...]\n");
+        return;
+    }
+
+    size_t count = argc - 1;
+    StorageLocation locations[MAX_ARGS];
+    ErrorCode err = client_locate_many(client, (const char **)&args[1], count, locations);
+    if (err != ERR_SUCCESS) {
+        printf("Error locating files: %d\n", err);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (locations[i].status == ERR_SUCCESS) {
+            printf("%s -> %s:%s\n", args[i + 1], locations[i].host, locations[i].port);
+        } else {
+            printf("%s -> error %d\n", args[i + 1], locations[i].status);
+        }
+    }
+}
+
+static void print_list_entry(const ListEntry *entry, void *user_data) {
+    (void)user_data;
+    if (entry->is_directory) {
+        printf("d %s/\n", entry->path);
+    } else {
+        printf("- %04o %10llu %s:%u %s\n", entry->permissions, (unsigned long long)entry->size,
+               entry->storage_server_ip, entry->storage_server_port, entry->path);
+    }
+}
+
+static void handle_ls_command(Client *client, char **args, int argc) {
+    int recursive = 0;
+    const char *path = "/";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "-r") == 0) {
+            recursive = 1;
+        } else {
+            path = args[i];
+        }
+    }
+
+    ErrorCode err = client_list(client, path, recursive, print_list_entry, NULL);
+    if (err != ERR_SUCCESS) {
+        printf("Error listing %s: %d\n", path, err);
+    }
+}
+
+static void handle_find_command(Client *client, char **args, int argc) {
+    SearchMode mode = SEARCH_SUBSTRING;
+    const char *pattern = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "-p") == 0) {
+            mode = SEARCH_PREFIX;
+        } else if (strcmp(args[i], "-g") == 0) {
+            mode = SEARCH_GLOB;
+        } else {
+            pattern = args[i];
+        }
+    }
+    if (!pattern) {
+        printf("Usage: find [-p|-g] <pattern>\n");
+        return;
+    }
+
+    ErrorCode err = client_search(client, pattern, mode, print_list_entry, NULL);
+    if (err != ERR_SUCCESS) {
+        printf("Error searching for %s: %d\n", pattern, err);
+    }
+}
+
+static void handle_repair_command(Client *client, char **args, int argc) {
+    (void)args;
+    (void)argc;
+    RepairStatus status;
+    ErrorCode err = client_repair_status(client, &status);
+    if (err != ERR_SUCCESS) {
+        printf("Error reading repair status: %d\n", err);
+        return;
+    }
+    printf("Target copies:  %u\n", status.target_copies);
+    printf("Queued files:   %u (%u down to one copy)\n", status.queued, status.critical);
+    printf("Copying:        %u\n", status.copying);
+    printf("Copies made:    %u\n", status.copies_made);
+    printf("Files restored: %u\n", status.restored);
+    printf("Failed:         %u\n", status.failed);
+    printf("Unrecoverable:  %u\n", status.unrecoverable);
+}
+
 static void parse_and_execute(Client *client, char *line) {
     if (!line) return;
 
@@ -195,10 +320,22 @@ static void parse_and_execute(Client *client, char *line) {
         handle_read_command(client, args, argc);
     } else if (strcmp(args[0], "delete") == 0) {
         handle_delete_command(client, args, argc);
+    } else if (strcmp(args[0], "copy") == 0) {
+        handle_copy_command(client, args, argc);
+    } else if (strcmp(args[0], "rename") == 0) {
+        handle_rename_command(client, args, argc);
     } else if (strcmp(args[0], "stream") == 0) {
         handle_stream_command(client, args, argc);
     } else if (strcmp(args[0], "info") == 0) {
         handle_info_command(client, args, argc);
+    } else if (strcmp(args[0], "ls") == 0) {
+        handle_ls_command(client, args, argc);
+    } else if (strcmp(args[0], "find") == 0) {
+        handle_find_command(client, args, argc);
+    } else if (strcmp(args[0], "repair") == 0) {
+        handle_repair_command(client, args, argc);
+    } else if (strcmp(args[0], "locate") == 0) {
+        handle_locate_command(client, args, argc);
     } else if (strcmp(args[0], "exit") == 0) {
         running = 0;
     } else {
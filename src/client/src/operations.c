@@ -1,5 +1,7 @@
 #include "client.h"
 #include "network.h"
+#include "inventory.h"
+#include "shard.h"
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
@@ -8,7 +10,11 @@
 #include <stdio.h> //! debug
 #include <stdio.h>
 #include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
 
 uint32_t generate_request_id(Client *client) {
     static uint32_t request_counter = 1;
@@ -19,39 +25,288 @@ uint32_t generate_request_id(Client *client) {
     return request_id;
 }
 
-// Internal function to connect to naming server
+// Give up on a shard whose primary and standby both stay unreachable this
+// long; a standby takes over well within it
+#define NAMING_RECONNECT_ATTEMPTS 40
+#define NAMING_RECONNECT_MS 50
+
+// How long an accepted mutation waits on an idle connection before
+// checking whether another request came across its outcome
+#define MUTATION_POLL_MS 50
+
+// Connect to a naming server and learn its primary or standby partner.
+// Returns NULL if it cannot be reached.
+static NetworkSocket *connect_naming_server(const ShardAddress *address, uint32_t request_id, ShardPeer *peer) {
+    NetworkSocket *sock = network_socket_create(address->host, address->port);
+    if (!sock) return NULL;
+
+    ShardAddress shards[MAX_SHARDS];
+    uint32_t count;
+    if (shard_fetch_map(sock, request_id, shards, MAX_SHARDS, &count, peer) != ERR_SUCCESS) {
+        network_socket_close(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+// Set up shard from a connection to one of its naming servers, whichever of
+// the pair it is
+static void attach_shard(Client *client, uint32_t shard, const ShardAddress *address, NetworkSocket *sock,
+                         const ShardPeer *peer) {
+    memset(&client->standby_addresses[shard], 0, sizeof(ShardAddress));
+    client->standby_socks[shard] = NULL;
+
+    if (peer->peer.host[0] != '\0' && peer->standby) {
+        client->naming_server_addresses[shard] = peer->peer;
+        client->standby_addresses[shard] = *address;
+        client->standby_socks[shard] = sock;
+        client->naming_server_socks[shard] = network_socket_create(peer->peer.host, peer->peer.port);
+        return;
+    }
+
+    client->naming_server_addresses[shard] = *address;
+    client->naming_server_socks[shard] = sock;
+    if (peer->peer.host[0] != '\0') {
+        client->standby_addresses[shard] = peer->peer;
+        client->standby_socks[shard] = network_socket_create(peer->peer.host, peer->peer.port);
+    }
+}
+
+// Internal function to connect to naming server. If it shares the namespace
+// with other naming servers, connect to each of them instead.
 static ErrorCode connect_to_naming_server(Client *client, const char *host, const char *port) {
-    client->naming_server_sock = network_socket_create(host, port);
-    if (!client->naming_server_sock) {
+    ShardAddress address;
+    memset(&address, 0, sizeof(address));
+    strncpy(address.host, host, sizeof(address.host) - 1);
+    strncpy(address.port, port, sizeof(address.port) - 1);
+
+    NetworkSocket *sock = network_socket_create(host, port);
+    if (!sock) {
         return ERR_NETWORK_FAILURE;
     }
+
+    ShardAddress shards[MAX_SHARDS];
+    uint32_t shard_count = 0;
+    ShardPeer peer;
+    ErrorCode err = shard_fetch_map(sock, generate_request_id(client), shards, MAX_SHARDS, &shard_count, &peer);
+    if (err == ERR_SUCCESS && shard_count == 0) {
+        attach_shard(client, 0, &address, sock, &peer);
+        client->naming_server_count = 1;
+        return ERR_SUCCESS;
+    }
+    network_socket_close(sock);
+    if (err != ERR_SUCCESS) {
+        return err;
+    }
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+        sock = connect_naming_server(&shards[i], generate_request_id(client), &peer);
+        if (!sock) {
+            while (i > 0) {
+                i--;
+                network_socket_close(client->naming_server_socks[i]);
+                network_socket_close(client->standby_socks[i]);
+            }
+            return ERR_NETWORK_FAILURE;
+        }
+        attach_shard(client, i, &shards[i], sock, &peer);
+    }
+    client->naming_server_count = shard_count;
     return ERR_SUCCESS;
 }
 
-// Helper function to get storage server info
-static ErrorCode get_storage_server(Client *client, const char *filepath, char *host, char *port) {
+// Reconnect to the primary of shard. Once its standby has taken over, the
+// standby becomes the primary. Caller holds client->mutex.
+static ErrorCode reconnect_shard(Client *client, uint32_t shard) {
+    for (int attempt = 0; attempt < NAMING_RECONNECT_ATTEMPTS; attempt++) {
+        ShardPeer peer;
+        NetworkSocket *sock = connect_naming_server(&client->naming_server_addresses[shard], 0, &peer);
+        if (sock && !peer.standby) {
+            client->naming_server_socks[shard] = sock;
+            return ERR_SUCCESS;
+        }
+        network_socket_close(sock);
+
+        ShardAddress *standby = &client->standby_addresses[shard];
+        sock = standby->host[0] != '\0' ? connect_naming_server(standby, 0, &peer) : NULL;
+        if (sock && !peer.standby) {
+            client->naming_server_addresses[shard] = *standby;
+            memset(standby, 0, sizeof(*standby));
+            network_socket_close(client->standby_socks[shard]);
+            client->standby_socks[shard] = NULL;
+            client->naming_server_socks[shard] = sock;
+            return ERR_SUCCESS;
+        }
+        network_socket_close(sock);
+        usleep(NAMING_RECONNECT_MS * 1000);
+    }
+    return ERR_NETWORK_FAILURE;
+}
+
+// Close a naming server connection that broke; the primary's is reopened on
+// next use. The leases granted on it went with it, and any invalidation
+// still in flight is lost, so no cached location is trusted any more.
+// Caller holds client->mutex.
+static void naming_server_failed(Client *client, NetworkSocket *sock) {
+    for (uint32_t i = 0; i < client->naming_server_count; i++) {
+        if (client->naming_server_socks[i] == sock) client->naming_server_socks[i] = NULL;
+        if (client->standby_socks[i] == sock) client->standby_socks[i] = NULL;
+    }
+    network_socket_close(sock);
+    location_cache_invalidate_prefix(client->locations, "/");
+}
+
+// Whether shard's lookups currently go to a standby
+static int has_standby(Client *client, uint32_t shard) {
+    pthread_mutex_lock(&client->mutex);
+    int has = client->standby_socks[shard] != NULL;
+    pthread_mutex_unlock(&client->mutex);
+    return has;
+}
+
+// Modes of a naming_exchange
+#define NAMING_STANDBY_OK 1     // A lookup the standby may answer
+#define NAMING_REPEATABLE 2     // Safe to send again after a broken connection
+
+typedef ErrorCode (*naming_exchange_t)(Client *client, NetworkSocket *sock, void *ctx);
+
+// Run one request/reply exchange with the naming servers of shard. Lookups
+// go to the standby when there is one, sparing the primary. A broken
+// connection is dropped and, for repeatable exchanges, the exchange is
+// retried on the other server or a fresh connection.
+static ErrorCode naming_exchange(Client *client, uint32_t shard, int mode, naming_exchange_t exchange, void *ctx) {
+    pthread_mutex_lock(&client->mutex);
+    ErrorCode err = ERR_NETWORK_FAILURE;
+    for (int attempt = 0; attempt < 3; attempt++) {
+        NetworkSocket *sock = (mode & NAMING_STANDBY_OK) ? client->standby_socks[shard] : NULL;
+        if (!sock && !client->naming_server_socks[shard]) reconnect_shard(client, shard);
+        if (!sock) sock = client->naming_server_socks[shard];
+        if (!sock) break;
+
+        err = exchange(client, sock, ctx);
+        if (err != ERR_NETWORK_FAILURE) break;
+        naming_server_failed(client, sock);
+        if (!(mode & NAMING_REPEATABLE)) break;
+    }
+    pthread_mutex_unlock(&client->mutex);
+    return err;
+}
+
+// Apply a LOCATION_INVALIDATE pushed by the naming server on sock whose
+// header has already been read. Caller holds client->mutex.
+static ErrorCode apply_invalidation(Client *client, NetworkSocket *sock, MessageHeader *header) {
+    LocationInvalidation push;
+    if (ntohl(header->payload_size) != sizeof(push))
+        return ERR_PROTOCOL_ERROR;
+    if (network_socket_receive(sock, &push, sizeof(push)) != sizeof(push))
+        return ERR_NETWORK_FAILURE;
+    push.path[sizeof(push.path) - 1] = '\0';
+    location_cache_invalidate(client->locations, push.path, network_ntoh64(push.version));
+    return ERR_SUCCESS;
+}
+
+// A mutation accepted by a naming server, awaiting its OP_COMPLETE
+typedef struct PendingMutation {
+    NetworkSocket *sock;        // Connection it was accepted on
+    uint32_t shard;
+    uint64_t operation_id;
+    int done;
+    ErrorCode status;
+    struct PendingMutation *next;
+} PendingMutation;
+
+// Record the outcome of an accepted mutation pushed by the naming server on
+// sock whose header has already been read. Caller holds client->mutex.
+static ErrorCode apply_completion(Client *client, NetworkSocket *sock, MessageHeader *header) {
+    OperationResult result;
+    if (ntohl(header->payload_size) != sizeof(result))
+        return ERR_PROTOCOL_ERROR;
+    if (network_socket_receive(sock, &result, sizeof(result)) != sizeof(result))
+        return ERR_NETWORK_FAILURE;
+    uint64_t operation_id = network_ntoh64(result.operation_id);
+    for (PendingMutation *pending = client->mutations; pending; pending = pending->next) {
+        if (pending->sock == sock && pending->operation_id == operation_id) {
+            pending->status = (ErrorCode)(int32_t)ntohl(result.status);
+            pending->done = 1;
+            break;
+        }
+    }
+    return ERR_SUCCESS;
+}
+
+// Apply a frame the naming server pushed rather than sent in reply
+static ErrorCode apply_push(Client *client, NetworkSocket *sock, MessageHeader *header) {
+    switch (header->type) {
+        case MSG_TYPE_LOCATION_INVALIDATE:
+            return apply_invalidation(client, sock, header);
+        case MSG_TYPE_OP_COMPLETE:
+            return apply_completion(client, sock, header);
+        default:
+            return ERR_PROTOCOL_ERROR;
+    }
+}
+
+static int is_push(const MessageHeader *header) {
+    return header->type == MSG_TYPE_LOCATION_INVALIDATE || header->type == MSG_TYPE_OP_COMPLETE;
+}
+
+// Receive the header of the next reply from the naming server on sock,
+// applying any pushes ahead of it. Caller holds client->mutex.
+static ErrorCode receive_reply_header(Client *client, NetworkSocket *sock, MessageHeader *header) {
+    for (;;) {
+        ssize_t received = network_socket_receive(sock, header, sizeof(*header));
+        if (received != sizeof(*header))
+            return ERR_NETWORK_FAILURE;
+        if (!is_push(header))
+            return ERR_SUCCESS;
+        ErrorCode err = apply_push(client, sock, header);
+        if (err != ERR_SUCCESS)
+            return err;
+    }
+}
+
+// Apply the pushes that arrived while no request was outstanding, so a
+// revoked lease is never used
+static void drain_invalidations(Client *client) {
+    pthread_mutex_lock(&client->mutex);
+    for (uint32_t i = 0; i < client->naming_server_count * 2; i++) {
+        NetworkSocket *sock = i % 2 ? client->standby_socks[i / 2] : client->naming_server_socks[i / 2];
+        if (!sock) continue;
+        // Only pushes are consumed here; anything else is left for the
+        // exchange that expects it
+        MessageHeader header;
+        while (recv(network_socket_get_fd(sock), &header, sizeof(header), MSG_PEEK | MSG_DONTWAIT) == sizeof(header) &&
+               is_push(&header)) {
+            if (network_socket_receive(sock, &header, sizeof(header)) != sizeof(header) ||
+                apply_push(client, sock, &header) != ERR_SUCCESS)
+                break;
+        }
+    }
+    pthread_mutex_unlock(&client->mutex);
+}
+
+// Ask the naming server on sock for the location of a file
+static ErrorCode locate_on(Client *client, NetworkSocket *sock, const char *filepath, char *host, char *port,
+                           ReplicaHint *replicas, size_t *replica_count) {
     // Prepare location request
     MessageHeader request = {
         .request_id = generate_request_id(client),
         .type = MSG_TYPE_GET_LOCATION,
-        // .payload_size = htonl(strlen(filepath) + 1)
     };
-    // request.request_id = generate_request_id(client);
-    // request.type = MSG_TYPE_GET_LOCATION;
     uint32_t path_len = strlen(filepath) + 1; // Include null terminator
     request.payload_size = htonl(path_len);
 
     pthread_mutex_lock(&client->mutex);
 
     // Send the header
-    ssize_t sent = network_socket_send(client->naming_server_sock, &request, sizeof(request));
+    ssize_t sent = network_socket_send(sock, &request, sizeof(request));
     if (sent != sizeof(request)) {
         pthread_mutex_unlock(&client->mutex);
         return ERR_NETWORK_FAILURE;
     }
 
     // Send the file path
-    sent = network_socket_send(client->naming_server_sock, filepath, path_len);
+    sent = network_socket_send(sock, filepath, path_len);
     if (sent != path_len) {
         pthread_mutex_unlock(&client->mutex);
         return ERR_NETWORK_FAILURE;
@@ -59,8 +314,7 @@ static ErrorCode get_storage_server(Client *client, const char *filepath, char *
 
     // Receive the response header
     MessageHeader response_header;
-    ssize_t received = network_socket_receive(client->naming_server_sock, &response_header, sizeof(response_header));
-    if (received != sizeof(response_header)) {
+    if (receive_reply_header(client, sock, &response_header) != ERR_SUCCESS) {
         pthread_mutex_unlock(&client->mutex);
         return ERR_NETWORK_FAILURE;
     }
@@ -68,41 +322,605 @@ static ErrorCode get_storage_server(Client *client, const char *filepath, char *
 
     // Check for error response
     if (response_header.type == MSG_TYPE_ERROR) {
-        ErrorCode error_code;
-        received = network_socket_receive(client->naming_server_sock, &error_code, sizeof(error_code));
+        uint32_t error_code;
+        ssize_t received = network_socket_receive(sock, &error_code, sizeof(error_code));
         pthread_mutex_unlock(&client->mutex);
         if (received != sizeof(error_code))
             return ERR_NETWORK_FAILURE;
-        return error_code;
+        return (ErrorCode)(int32_t)ntohl(error_code);
     }
 
-    
-    // Receive storage server IP and port
-    char response_host[32];
-    received = network_socket_receive(client->naming_server_sock, response_host, INET_ADDRSTRLEN);
-    if (received != INET_ADDRSTRLEN) {
+    // Storage server IP, port and the lease on them, then the copies
+    struct {
+        char host[INET_ADDRSTRLEN];
+        uint16_t port;
+        LocationLease lease;
+        uint16_t replica_count;
+        LocationReplica replicas[LOCATION_MAX_REPLICAS];
+    } __attribute__((packed)) location;
+    memset(&location, 0, sizeof(location));
+    size_t legacy = INET_ADDRSTRLEN + sizeof(uint16_t);
+    size_t with_lease = legacy + sizeof(LocationLease);
+    size_t listed = with_lease + sizeof(uint16_t);
+    if (response_header.type != MSG_TYPE_LOCATION ||
+        (payload_size != legacy && payload_size != with_lease &&
+         (payload_size < listed || (payload_size - listed) % sizeof(LocationReplica) != 0))) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_PROTOCOL_ERROR;
+    }
+
+    // Keep the best LOCATION_MAX_REPLICAS copies and drop the rest
+    size_t keep = payload_size < sizeof(location) ? payload_size : sizeof(location);
+    ssize_t received = network_socket_receive(sock, &location, keep);
+    for (size_t skipped = keep; received == (ssize_t)keep && skipped < payload_size; ) {
+        uint8_t discard[sizeof(LocationReplica)];
+        if (network_socket_receive(sock, discard, sizeof(discard)) != sizeof(discard))
+            received = -1;
+        skipped += sizeof(discard);
+    }
+    pthread_mutex_unlock(&client->mutex);
+    if (received != (ssize_t)keep)
+        return ERR_NETWORK_FAILURE;
+    location.host[INET_ADDRSTRLEN - 1] = '\0';
+
+    // Copy the received host and port
+    strcpy(host, location.host);
+    sprintf(port, "%d", ntohs(location.port));
+
+    ReplicaHint hints[LOCATION_MAX_REPLICAS];
+    size_t hint_count = payload_size >= listed ? ntohs(location.replica_count) : 0;
+    if (hint_count > LOCATION_MAX_REPLICAS)
+        hint_count = LOCATION_MAX_REPLICAS;
+    for (size_t i = 0; i < hint_count; i++) {
+        memcpy(hints[i].host, location.replicas[i].ip, INET_ADDRSTRLEN);
+        hints[i].host[INET_ADDRSTRLEN - 1] = '\0';
+        snprintf(hints[i].port, sizeof(hints[i].port), "%d", ntohs(location.replicas[i].port));
+        hints[i].healthy = location.replicas[i].healthy;
+        hints[i].load = ntohl(location.replicas[i].load);
+    }
+    if (replicas) {
+        memcpy(replicas, hints, hint_count * sizeof(ReplicaHint));
+        *replica_count = hint_count;
+    }
+
+    location_cache_put(client->locations, filepath, host, port, hints, hint_count,
+                       ntohl(location.lease.ttl_ms), network_ntoh64(location.lease.version));
+    return ERR_SUCCESS;
+}
+
+typedef struct {
+    const char *filepath;
+    char *host;
+    char *port;
+    ReplicaHint *replicas;
+    size_t *replica_count;
+} LocateRequest;
+
+static ErrorCode locate_exchange(Client *client, NetworkSocket *sock, void *ctx) {
+    LocateRequest *request = ctx;
+    return locate_on(client, sock, request->filepath, request->host, request->port,
+                     request->replicas, request->replica_count);
+}
+
+// Resolve the primary storage server of a file and, if replicas is not
+// NULL, the servers holding copies of it
+static ErrorCode locate(Client *client, const char *filepath, char *host, char *port,
+                        ReplicaHint *replicas, size_t *replica_count) {
+    // A location under a live lease needs no naming server round trip
+    drain_invalidations(client);
+    if (location_cache_get(client->locations, filepath, host, port, replicas, replica_count) == ERR_SUCCESS)
+        return ERR_SUCCESS;
+
+    LocateRequest request = {filepath, host, port, replicas, replica_count};
+    uint32_t shard = shard_for_path(filepath, client->naming_server_count);
+    ErrorCode err = naming_exchange(client, shard, NAMING_STANDBY_OK | NAMING_REPEATABLE, locate_exchange, &request);
+
+    // The standby trails the primary, which may hold a file created a
+    // moment ago
+    if (err == ERR_FILE_NOT_FOUND && has_standby(client, shard))
+        err = naming_exchange(client, shard, NAMING_REPEATABLE, locate_exchange, &request);
+    return err;
+}
+
+// Helper function to get storage server info
+static ErrorCode get_storage_server(Client *client, const char *filepath, char *host, char *port) {
+    return locate(client, filepath, host, port, NULL, NULL);
+}
+
+// Resolve one GET_LOCATION_BATCH round trip of at most MAX_LOCATION_BATCH
+// paths, all held by the naming server on sock
+static ErrorCode locate_batch(Client *client, NetworkSocket *sock, const char **filepaths, size_t count,
+                              StorageLocation *locations) {
+    size_t payload_size = sizeof(uint32_t);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(filepaths[i]);
+        if (len > UINT16_MAX) return ERR_INVALID_ARGUMENT;
+        payload_size += sizeof(uint16_t) + len;
+    }
+
+    // Header and all paths go out in a single send
+    uint8_t *request = malloc(sizeof(MessageHeader) + payload_size);
+    if (!request) return ERR_INTERNAL_ERROR;
+
+    MessageHeader *header = (MessageHeader *)request;
+    header->request_id = generate_request_id(client);
+    header->type = MSG_TYPE_GET_LOCATION_BATCH;
+    header->payload_size = htonl(payload_size);
+
+    uint8_t *cursor = request + sizeof(MessageHeader);
+    uint32_t count_net = htonl(count);
+    memcpy(cursor, &count_net, sizeof(count_net));
+    cursor += sizeof(count_net);
+    for (size_t i = 0; i < count; i++) {
+        uint16_t len = strlen(filepaths[i]);
+        uint16_t len_net = htons(len);
+        memcpy(cursor, &len_net, sizeof(len_net));
+        cursor += sizeof(len_net);
+        memcpy(cursor, filepaths[i], len);
+        cursor += len;
+    }
+
+    pthread_mutex_lock(&client->mutex);
+
+    size_t request_size = sizeof(MessageHeader) + payload_size;
+    ssize_t sent = network_socket_send(sock, request, request_size);
+    free(request);
+    if (sent != (ssize_t)request_size) {
         pthread_mutex_unlock(&client->mutex);
         return ERR_NETWORK_FAILURE;
     }
-    response_host[16] = '\0';
 
-    // Receive storage server port
-    uint16_t response_port_net;
-    received = network_socket_receive(client->naming_server_sock, &response_port_net, sizeof(response_port_net));
-    uint16_t response_port = ntohs(response_port_net);
-    // printf("storage_server: %s:%d\n", response_host, response_port); //!debug
-    // printf("received: %ld\nsizeof(response_port_net): %ld\n", received, sizeof(response_port_net)); //!debug
-    if (received != sizeof(response_port_net)) {
+    MessageHeader response_header;
+    if (receive_reply_header(client, sock, &response_header) != ERR_SUCCESS) {
         pthread_mutex_unlock(&client->mutex);
         return ERR_NETWORK_FAILURE;
     }
+    ssize_t received;
+
+    if (response_header.type == MSG_TYPE_ERROR) {
+        uint32_t error_code;
+        received = network_socket_receive(sock, &error_code, sizeof(error_code));
+        pthread_mutex_unlock(&client->mutex);
+        if (received != sizeof(error_code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(error_code);
+    }
+
+    uint32_t response_size = ntohl(response_header.payload_size);
+    if (response_header.type != MSG_TYPE_LOCATION_BATCH ||
+        response_size != sizeof(uint32_t) + count * sizeof(LocationBatchEntry)) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_PROTOCOL_ERROR;
+    }
 
+    uint8_t *response = malloc(response_size);
+    if (!response) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_INTERNAL_ERROR;
+    }
+    received = network_socket_receive(sock, response, response_size);
     pthread_mutex_unlock(&client->mutex);
+    if (received != (ssize_t)response_size) {
+        free(response);
+        return ERR_NETWORK_FAILURE;
+    }
 
-    // Copy the received host and port
-    strcpy(host, response_host);
-    sprintf(port, "%d", response_port);
+    LocationBatchEntry *entries = (LocationBatchEntry *)(response + sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++) {
+        locations[i].status = (ErrorCode)(int32_t)ntohl(entries[i].status);
+        if (locations[i].status == ERR_SUCCESS) {
+            memcpy(locations[i].host, entries[i].storage_server_ip, INET_ADDRSTRLEN);
+            locations[i].host[INET_ADDRSTRLEN - 1] = '\0';
+            snprintf(locations[i].port, sizeof(locations[i].port), "%d", ntohs(entries[i].storage_server_port));
+            location_cache_put(client->locations, filepaths[i], locations[i].host, locations[i].port, NULL, 0,
+                               ntohl(entries[i].lease.ttl_ms), network_ntoh64(entries[i].lease.version));
+        } else {
+            locations[i].host[0] = '\0';
+            locations[i].port[0] = '\0';
+        }
+    }
+
+    free(response);
+    return ERR_SUCCESS;
+}
+
+typedef struct {
+    const char **filepaths;
+    size_t count;
+    StorageLocation *locations;
+} LocateBatchRequest;
+
+static ErrorCode locate_batch_exchange(Client *client, NetworkSocket *sock, void *ctx) {
+    LocateBatchRequest *request = ctx;
+    return locate_batch(client, sock, request->filepaths, request->count, request->locations);
+}
+
+// Resolve a batch of paths all held by shard
+static ErrorCode locate_batch_on_shard(Client *client, uint32_t shard, const char **filepaths, size_t count,
+                                       StorageLocation *locations) {
+    LocateBatchRequest request = {filepaths, count, locations};
+    ErrorCode err = naming_exchange(client, shard, NAMING_STANDBY_OK | NAMING_REPEATABLE, locate_batch_exchange, &request);
+    if (err != ERR_SUCCESS || !has_standby(client, shard)) return err;
+
+    // As in locate, paths the standby did not know yet go to the primary
+    const char *missing[MAX_LOCATION_BATCH];
+    size_t missing_index[MAX_LOCATION_BATCH];
+    StorageLocation missing_locations[MAX_LOCATION_BATCH];
+    size_t missing_count = 0;
+    for (size_t i = 0; i < count && missing_count < MAX_LOCATION_BATCH; i++) {
+        if (locations[i].status != ERR_FILE_NOT_FOUND) continue;
+        missing[missing_count] = filepaths[i];
+        missing_index[missing_count++] = i;
+    }
+    if (missing_count == 0) return ERR_SUCCESS;
+
+    LocateBatchRequest retry = {missing, missing_count, missing_locations};
+    err = naming_exchange(client, shard, NAMING_REPEATABLE, locate_batch_exchange, &retry);
+    for (size_t i = 0; i < missing_count && err == ERR_SUCCESS; i++) {
+        locations[missing_index[i]] = missing_locations[i];
+    }
+    return err;
+}
+
+ErrorCode client_locate_many(Client *client, const char **filepaths, size_t count, StorageLocation *locations) {
+    if (!client || !filepaths || !locations) return ERR_INVALID_ARGUMENT;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!filepaths[i]) return ERR_INVALID_ARGUMENT;
+    }
+
+    if (client->naming_server_count == 1) {
+        for (size_t done = 0; done < count; ) {
+            size_t chunk = count - done;
+            if (chunk > MAX_LOCATION_BATCH) chunk = MAX_LOCATION_BATCH;
+            ErrorCode err = locate_batch_on_shard(client, 0, filepaths + done, chunk, locations + done);
+            if (err != ERR_SUCCESS)
+                return err;
+            done += chunk;
+        }
+        return ERR_SUCCESS;
+    }
+
+    // Each naming server resolves the paths of its own shard; the answers
+    // are put back in request order
+    const char **shard_paths = malloc(sizeof(char *) * (count ? count : 1));
+    size_t *shard_index = malloc(sizeof(size_t) * (count ? count : 1));
+    StorageLocation *shard_locations = malloc(sizeof(StorageLocation) * (count ? count : 1));
+    ErrorCode err = shard_paths && shard_index && shard_locations ? ERR_SUCCESS : ERR_INTERNAL_ERROR;
+
+    for (uint32_t shard = 0; shard < client->naming_server_count && err == ERR_SUCCESS; shard++) {
+        size_t shard_count = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (shard_for_path(filepaths[i], client->naming_server_count) != shard) continue;
+            shard_paths[shard_count] = filepaths[i];
+            shard_index[shard_count++] = i;
+        }
+
+        for (size_t done = 0; done < shard_count && err == ERR_SUCCESS; ) {
+            size_t chunk = shard_count - done;
+            if (chunk > MAX_LOCATION_BATCH) chunk = MAX_LOCATION_BATCH;
+            err = locate_batch_on_shard(client, shard, shard_paths + done, chunk, shard_locations + done);
+            done += chunk;
+        }
+        for (size_t i = 0; i < shard_count && err == ERR_SUCCESS; i++) {
+            locations[shard_index[i]] = shard_locations[i];
+        }
+    }
+
+    free(shard_paths);
+    free(shard_index);
+    free(shard_locations);
+    return err;
+}
+
+// Send a LIST or SEARCH request on sock and read back its LIST_PAGE
+static ErrorCode page_exchange(Client *client, NetworkSocket *sock, const void *request, size_t request_size,
+                               ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                               char *next_cursor, int *has_more) {
+    pthread_mutex_lock(&client->mutex);
+
+    ssize_t sent = network_socket_send(sock, request, request_size);
+    if (sent != (ssize_t)request_size) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_NETWORK_FAILURE;
+    }
+
+    MessageHeader response_header;
+    if (receive_reply_header(client, sock, &response_header) != ERR_SUCCESS) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_NETWORK_FAILURE;
+    }
+    ssize_t received;
+
+    if (response_header.type == MSG_TYPE_ERROR) {
+        uint32_t error_code;
+        received = network_socket_receive(sock, &error_code, sizeof(error_code));
+        pthread_mutex_unlock(&client->mutex);
+        if (received != sizeof(error_code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(error_code);
+    }
+
+    ListPageHeader page;
+    uint32_t payload_size = ntohl(response_header.payload_size);
+    if (response_header.type != MSG_TYPE_LIST_PAGE || payload_size < sizeof(page)) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_PROTOCOL_ERROR;
+    }
+    received = network_socket_receive(sock, &page, sizeof(page));
+    if (received != sizeof(page)) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_NETWORK_FAILURE;
+    }
+
+    uint32_t page_count = ntohl(page.count);
+    if (page_count > max_entries || payload_size != sizeof(page) + page_count * sizeof(ListEntry)) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_PROTOCOL_ERROR;
+    }
+    received = network_socket_receive(sock, entries, page_count * sizeof(ListEntry));
+    pthread_mutex_unlock(&client->mutex);
+    if (received != (ssize_t)(page_count * sizeof(ListEntry)))
+        return ERR_NETWORK_FAILURE;
+
+    for (uint32_t i = 0; i < page_count; i++) {
+        entries[i].path[sizeof(entries[i].path) - 1] = '\0';
+        entries[i].storage_server_ip[sizeof(entries[i].storage_server_ip) - 1] = '\0';
+        entries[i].size = network_ntoh64(entries[i].size);
+        entries[i].permissions = ntohl(entries[i].permissions);
+        entries[i].storage_server_port = ntohs(entries[i].storage_server_port);
+    }
 
+    *count = page_count;
+    *has_more = page.has_more;
+    memcpy(next_cursor, page.next_cursor, sizeof(page.next_cursor));
+    next_cursor[sizeof(page.next_cursor) - 1] = '\0';
+    return ERR_SUCCESS;
+}
+
+// Fetch one listing page from the naming server on sock
+static ErrorCode list_page(Client *client, NetworkSocket *sock, const char *path, int recursive, const char *cursor,
+                           ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                           char *next_cursor, int *has_more) {
+    struct {
+        MessageHeader header;
+        ListRequest body;
+    } __attribute__((packed)) request;
+    memset(&request, 0, sizeof(request));
+    request.header.request_id = generate_request_id(client);
+    request.header.type = MSG_TYPE_LIST;
+    request.header.payload_size = htonl(sizeof(ListRequest));
+    strncpy(request.body.path, path, sizeof(request.body.path) - 1);
+    if (cursor) strncpy(request.body.cursor, cursor, sizeof(request.body.cursor) - 1);
+    request.body.max_entries = htonl(max_entries);
+    request.body.recursive = recursive ? 1 : 0;
+
+    return page_exchange(client, sock, &request, sizeof(request), entries, max_entries, count, next_cursor, has_more);
+}
+
+typedef struct {
+    const char *path;
+    int recursive;
+    const char *cursor;
+    ListEntry *entries;
+    uint32_t max_entries;
+    uint32_t *count;
+    char *next_cursor;
+    int *has_more;
+} ListPageRequest;
+
+static ErrorCode list_page_exchange(Client *client, NetworkSocket *sock, void *ctx) {
+    ListPageRequest *request = ctx;
+    return list_page(client, sock, request->path, request->recursive, request->cursor, request->entries,
+                     request->max_entries, request->count, request->next_cursor, request->has_more);
+}
+
+// Fetch one listing page from the naming servers of shard
+static ErrorCode list_page_on_shard(Client *client, uint32_t shard, const char *path, int recursive,
+                                    const char *cursor, ListEntry *entries, uint32_t max_entries,
+                                    uint32_t *count, char *next_cursor, int *has_more) {
+    ListPageRequest request = {path, recursive, cursor, entries, max_entries, count, next_cursor, has_more};
+    return naming_exchange(client, shard, NAMING_STANDBY_OK | NAMING_REPEATABLE, list_page_exchange, &request);
+}
+
+// The root is split across every shard: ask each for a page after the same
+// cursor and merge them in tree order. Entries not taken are fetched again
+// with the next page, so no state is kept between pages.
+static ErrorCode list_root_page(Client *client, int recursive, const char *cursor,
+                                ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                                char *next_cursor, int *has_more) {
+    uint32_t shards = client->naming_server_count;
+    ListEntry *pages = malloc(sizeof(ListEntry) * max_entries * shards);
+    if (!pages) return ERR_INTERNAL_ERROR;
+
+    uint32_t page_counts[MAX_SHARDS];
+    uint32_t taken[MAX_SHARDS];
+    int more = 0;
+    for (uint32_t i = 0; i < shards; i++) {
+        char shard_cursor[sizeof(((ListPageHeader *)0)->next_cursor)];
+        int shard_more = 0;
+        ErrorCode err = list_page_on_shard(client, i, "/", recursive, cursor,
+                                           pages + i * max_entries, max_entries, &page_counts[i], shard_cursor, &shard_more);
+        if (err != ERR_SUCCESS) {
+            free(pages);
+            return err;
+        }
+        more |= shard_more;
+        taken[i] = 0;
+    }
+
+    uint32_t merged = 0;
+    while (merged < max_entries) {
+        const ListEntry *best = NULL;
+        uint32_t best_shard = 0;
+        for (uint32_t i = 0; i < shards; i++) {
+            if (taken[i] == page_counts[i]) continue;
+            const ListEntry *candidate = &pages[i * max_entries + taken[i]];
+            if (!best || inventory_path_compare(candidate->path, best->path) < 0) {
+                best = candidate;
+                best_shard = i;
+            }
+        }
+        if (!best) break;
+        entries[merged++] = *best;
+        taken[best_shard]++;
+    }
+    for (uint32_t i = 0; i < shards; i++) {
+        if (taken[i] < page_counts[i]) more = 1;
+    }
+    free(pages);
+
+    *count = merged;
+    *has_more = more;
+    if (merged > 0) {
+        memcpy(next_cursor, entries[merged - 1].path, sizeof(entries[merged - 1].path));
+    } else {
+        next_cursor[0] = '\0';
+    }
+    return ERR_SUCCESS;
+}
+
+ErrorCode client_list_page(Client *client, const char *path, int recursive, const char *cursor,
+                           ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                           char *next_cursor, int *has_more) {
+    if (!client || !path || !entries || !count || !next_cursor || !has_more || max_entries == 0)
+        return ERR_INVALID_ARGUMENT;
+    if (max_entries > LIST_MAX_PAGE) max_entries = LIST_MAX_PAGE;
+
+    if (client->naming_server_count > 1 && shard_is_root(path))
+        return list_root_page(client, recursive, cursor, entries, max_entries, count, next_cursor, has_more);
+    return list_page_on_shard(client, shard_for_path(path, client->naming_server_count), path, recursive, cursor,
+                              entries, max_entries, count, next_cursor, has_more);
+}
+
+// Number of entries fetched per round trip by client_list
+#define CLIENT_LIST_PAGE 128
+
+ErrorCode client_list(Client *client, const char *path, int recursive, client_list_callback_t callback, void *user_data) {
+    if (!client || !path || !callback) return ERR_INVALID_ARGUMENT;
+
+    // Only one page is ever held, however large the directory is
+    ListEntry *entries = malloc(sizeof(ListEntry) * CLIENT_LIST_PAGE);
+    if (!entries) return ERR_INTERNAL_ERROR;
+
+    char cursor[sizeof(((ListPageHeader *)0)->next_cursor)] = "";
+    int has_more;
+    ErrorCode err;
+    do {
+        uint32_t count = 0;
+        err = client_list_page(client, path, recursive, cursor, entries, CLIENT_LIST_PAGE, &count, cursor, &has_more);
+        if (err != ERR_SUCCESS) break;
+        for (uint32_t i = 0; i < count; i++) {
+            callback(&entries[i], user_data);
+        }
+    } while (has_more);
+
+    free(entries);
+    return err;
+}
+
+typedef struct {
+    const char *pattern;
+    SearchMode mode;
+    const char *cursor;
+    ListEntry *entries;
+    uint32_t max_entries;
+    uint32_t *count;
+    char *next_cursor;
+    int *has_more;
+} SearchPageRequest;
+
+static ErrorCode search_page_exchange(Client *client, NetworkSocket *sock, void *ctx) {
+    SearchPageRequest *page = ctx;
+    struct {
+        MessageHeader header;
+        SearchRequest body;
+    } __attribute__((packed)) request;
+    memset(&request, 0, sizeof(request));
+    request.header.request_id = generate_request_id(client);
+    request.header.type = MSG_TYPE_SEARCH;
+    request.header.payload_size = htonl(sizeof(SearchRequest));
+    strncpy(request.body.pattern, page->pattern, sizeof(request.body.pattern) - 1);
+    strncpy(request.body.cursor, page->cursor, sizeof(request.body.cursor) - 1);
+    request.body.max_entries = htonl(page->max_entries);
+    request.body.mode = (uint8_t)page->mode;
+
+    return page_exchange(client, sock, &request, sizeof(request), page->entries, page->max_entries, page->count,
+                         page->next_cursor, page->has_more);
+}
+
+ErrorCode client_search(Client *client, const char *pattern, SearchMode mode, client_list_callback_t callback,
+                        void *user_data) {
+    if (!client || !pattern || !pattern[0] || !callback) return ERR_INVALID_ARGUMENT;
+    if (strlen(pattern) >= sizeof(((SearchRequest *)0)->pattern)) return ERR_INVALID_ARGUMENT;
+
+    ListEntry *entries = malloc(sizeof(ListEntry) * CLIENT_LIST_PAGE);
+    if (!entries) return ERR_INTERNAL_ERROR;
+
+    // Every shard indexes only its own names, so each is searched in turn
+    ErrorCode err = ERR_SUCCESS;
+    for (uint32_t shard = 0; shard < client->naming_server_count && err == ERR_SUCCESS; shard++) {
+        char cursor[sizeof(((ListPageHeader *)0)->next_cursor)] = "";
+        int has_more;
+        do {
+            uint32_t count = 0;
+            SearchPageRequest request = {pattern, mode, cursor, entries, CLIENT_LIST_PAGE, &count, cursor, &has_more};
+            err = naming_exchange(client, shard, NAMING_STANDBY_OK | NAMING_REPEATABLE, search_page_exchange, &request);
+            if (err != ERR_SUCCESS) break;
+            for (uint32_t i = 0; i < count; i++) {
+                callback(&entries[i], user_data);
+            }
+        } while (has_more);
+    }
+
+    free(entries);
+    return err;
+}
+
+static ErrorCode repair_status_exchange(Client *client, NetworkSocket *sock, void *ctx) {
+    RepairStatus *status = ctx;
+    MessageHeader request;
+    request.request_id = generate_request_id(client);
+    request.type = MSG_TYPE_REPAIR_STATUS;
+    request.payload_size = 0;
+
+    pthread_mutex_lock(&client->mutex);
+    if (network_socket_send(sock, &request, sizeof(request)) != sizeof(request)) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_NETWORK_FAILURE;
+    }
+    MessageHeader response_header;
+    if (receive_reply_header(client, sock, &response_header) != ERR_SUCCESS) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_NETWORK_FAILURE;
+    }
+    if (response_header.type != MSG_TYPE_REPAIR_STATUS || ntohl(response_header.payload_size) != sizeof(*status)) {
+        pthread_mutex_unlock(&client->mutex);
+        return ERR_PROTOCOL_ERROR;
+    }
+    ssize_t received = network_socket_receive(sock, status, sizeof(*status));
+    pthread_mutex_unlock(&client->mutex);
+    return received == sizeof(*status) ? ERR_SUCCESS : ERR_NETWORK_FAILURE;
+}
+
+ErrorCode client_repair_status(Client *client, RepairStatus *status) {
+    if (!client || !status) return ERR_INVALID_ARGUMENT;
+    memset(status, 0, sizeof(*status));
+
+    // Each shard's primary repairs its own files; the counts add up
+    for (uint32_t shard = 0; shard < client->naming_server_count; shard++) {
+        RepairStatus shard_status;
+        ErrorCode err = naming_exchange(client, shard, NAMING_REPEATABLE, repair_status_exchange, &shard_status);
+        if (err != ERR_SUCCESS) return err;
+        status->target_copies = ntohl(shard_status.target_copies);
+        status->queued += ntohl(shard_status.queued);
+        status->critical += ntohl(shard_status.critical);
+        status->copying += ntohl(shard_status.copying);
+        status->copies_made += ntohl(shard_status.copies_made);
+        status->restored += ntohl(shard_status.restored);
+        status->failed += ntohl(shard_status.failed);
+        status->unrecoverable += ntohl(shard_status.unrecoverable);
+    }
     return ERR_SUCCESS;
 }
 
@@ -129,9 +947,22 @@ ErrorCode client_init(Client **client, const char *naming_server_host, const cha
     Client *new_client = malloc(sizeof(Client));
     if (!new_client) return ERR_INTERNAL_ERROR;
 
-    pthread_mutex_init(&new_client->mutex, NULL);
-    ErrorCode err = connect_to_naming_server(new_client, naming_server_host, naming_server_port);
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&new_client->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    new_client->storage_server_sock = NULL;
+    new_client->mutations = NULL;
+    new_client->locations = location_cache_create();
+    new_client->hedge = hedge_policy_create();
+    new_client->rtt = server_rtt_create();
+    ErrorCode err = new_client->locations && new_client->hedge && new_client->rtt ? connect_to_naming_server(new_client, naming_server_host, naming_server_port)
+                                          : ERR_INTERNAL_ERROR;
     if (err != ERR_SUCCESS) {
+        location_cache_destroy(new_client->locations);
+        hedge_policy_destroy(new_client->hedge);
+        server_rtt_destroy(new_client->rtt);
         pthread_mutex_destroy(&new_client->mutex);
         free(new_client);
         return err;
@@ -144,80 +975,216 @@ ErrorCode client_init(Client **client, const char *naming_server_host, const cha
 // Clean up the client library
 void client_cleanup(Client *client) {
     if (client) {
-        network_socket_close(client->naming_server_sock);
+        for (uint32_t i = 0; i < client->naming_server_count; i++) {
+            network_socket_close(client->naming_server_socks[i]);
+            network_socket_close(client->standby_socks[i]);
+        }
+        location_cache_destroy(client->locations);
+        hedge_policy_destroy(client->hedge);
+        server_rtt_destroy(client->rtt);
         pthread_mutex_destroy(&client->mutex);
         free(client);
     }
 }
 
-// Synchronous file operations
-ErrorCode client_read(Client *client, const char *filepath, uint64_t offset, uint8_t *buffer, size_t length, size_t *bytes_read) {
-    if (!client || !filepath || !buffer || !bytes_read) return ERR_INVALID_ARGUMENT;
-
-    ErrorCode err = ensure_storage_connection(client, filepath);
-    if (err != ERR_SUCCESS)
-        return err;
-
-    // Prepare primary MessageHeader for READ
-    MessageHeader header = {
-        .type = MSG_TYPE_READ,
-        .request_id = generate_request_id(client),
-        .payload_size = sizeof(ReadRequest)
-    };
-
-    // Prepare ReadRequest with its own MessageHeader
-    ReadRequest read_request;
-    read_request.header.type = MSG_TYPE_READ;
-    read_request.header.request_id = header.request_id; // Use the same request ID
-    read_request.header.payload_size = htonl(sizeof(ReadRequest));
-    strncpy(read_request.filepath, filepath, sizeof(read_request.filepath) - 1);
-    read_request.offset = htonl(offset);
-    read_request.length = htonl(length);
+// Connect to a storage server and send it a READ. The socket is left
+// non-blocking so the caller can wait on several at once.
+static NetworkSocket *send_read(Client *client, const char *host, const char *port,
+                                const char *filepath, uint64_t offset, size_t length) {
+    NetworkSocket *sock = network_socket_create(host, port);
+    if (!sock)
+        return NULL;
+
+    struct {
+        MessageHeader header;
+        ReadRequest body;
+    } __attribute__((packed)) request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = MSG_TYPE_READ;
+    request.header.request_id = generate_request_id(client);
+    request.header.payload_size = htonl(sizeof(ReadRequest));
+    request.body.header.type = MSG_TYPE_READ;
+    request.body.header.request_id = request.header.request_id;
+    request.body.header.payload_size = htonl(sizeof(ReadRequest));
+    strncpy(request.body.filepath, filepath, sizeof(request.body.filepath) - 1);
+    request.body.offset = network_hton64(offset);
+    request.body.length = htonl(length);
+
+    if (network_socket_send(sock, &request, sizeof(request)) != sizeof(request)) {
+        network_socket_close(sock);
+        return NULL;
+    }
+    return sock;
+}
 
-    // Send primary MessageHeader
-    pthread_mutex_lock(&client->mutex);
-    ssize_t sent = network_socket_send(client->storage_server_sock, &header, sizeof(header));
-    if (sent != sizeof(header)) {
-        pthread_mutex_unlock(&client->mutex);
+// Receive the reply to a READ: a header, then the data or an error code
+static ErrorCode receive_read(NetworkSocket *sock, uint8_t *buffer, size_t length, size_t *bytes_read) {
+    MessageHeader response;
+    if (network_socket_receive(sock, &response, sizeof(response)) != sizeof(response))
         return ERR_NETWORK_FAILURE;
+
+    if (response.type == MSG_TYPE_ERROR) {
+        uint32_t error_code;
+        if (network_socket_receive(sock, &error_code, sizeof(error_code)) != sizeof(error_code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(error_code);
     }
 
-    // Send ReadRequest
-    sent = network_socket_send(client->storage_server_sock, &read_request, sizeof(read_request));
-    if (sent != sizeof(read_request)) {
-        pthread_mutex_unlock(&client->mutex);
+    size_t expected = ntohl(response.payload_size);
+    if (expected == 0 || expected > length)
+        expected = length;
+    ssize_t received = network_socket_receive(sock, buffer, expected);
+    if (received < 0)
         return ERR_NETWORK_FAILURE;
+    *bytes_read = received;
+    return ERR_SUCCESS;
+}
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Servers that may answer a read of filepath, preferred first. With several
+// healthy copies, two are drawn at random and the one with the shorter
+// expected wait, by observed RTT and reads outstanding, goes first. An
+// unmeasured server wins, so every copy gets tried. The rest follow in the
+// naming server's order as hedge targets.
+static ErrorCode get_read_targets(Client *client, const char *filepath, StorageLocation *targets, size_t *count) {
+    char host[256], port[32];
+    ReplicaHint replicas[LOCATION_MAX_REPLICAS];
+    size_t replica_count = 0;
+    ErrorCode err = locate(client, filepath, host, port, replicas, &replica_count);
+    if (err != ERR_SUCCESS)
+        return err;
+
+    if (replica_count == 0) {
+        targets[0].status = ERR_SUCCESS;
+        strncpy(targets[0].host, host, sizeof(targets[0].host) - 1);
+        targets[0].host[sizeof(targets[0].host) - 1] = '\0';
+        snprintf(targets[0].port, sizeof(targets[0].port), "%s", port);
+        *count = 1;
+        return ERR_SUCCESS;
     }
-    printf("Sent request with %ld bytes\n", sent); //!debug
 
-    // Receive response header
-    MessageHeader response;
-    ssize_t received = network_socket_receive(client->storage_server_sock,
-                                            &response, sizeof(response));
-    if (received != sizeof(response)) {
-        pthread_mutex_unlock(&client->mutex);
-        return ERR_NETWORK_FAILURE;
+    // Healthy copies come first in the naming server's order
+    size_t healthy = 0;
+    while (healthy < replica_count && replicas[healthy].healthy)
+        healthy++;
+
+    size_t first = 0;
+    if (healthy >= 2) {
+        static __thread unsigned int seed = 0;
+        if (seed == 0)
+            seed = (unsigned int)now_us() ^ (unsigned int)(uintptr_t)&seed;
+        size_t a = rand_r(&seed) % healthy;
+        size_t b = (a + 1 + rand_r(&seed) % (healthy - 1)) % healthy;
+        uint64_t rtt_a = server_rtt_score(client->rtt, replicas[a].host, replicas[a].port);
+        uint64_t rtt_b = server_rtt_score(client->rtt, replicas[b].host, replicas[b].port);
+        if (rtt_a != rtt_b)
+            first = rtt_a < rtt_b ? a : b;
+        else
+            first = replicas[a].load <= replicas[b].load ? a : b;
     }
 
-    // Check for error response
-    if (response.type == MSG_TYPE_ERROR) {
-        ErrorCode error_code;
-        received = network_socket_receive(client->storage_server_sock,
-                                       &error_code, sizeof(error_code));
-        pthread_mutex_unlock(&client->mutex);
-        return error_code;
+    size_t n = 0;
+    for (size_t i = 0; i < replica_count && n < MAX_READ_TARGETS; i++) {
+        size_t index = i == 0 ? first : (i <= first ? i - 1 : i);
+        targets[n].status = ERR_SUCCESS;
+        snprintf(targets[n].host, sizeof(targets[n].host), "%s", replicas[index].host);
+        snprintf(targets[n].port, sizeof(targets[n].port), "%s", replicas[index].port);
+        n++;
     }
+    *count = n;
+    return ERR_SUCCESS;
+}
 
-    // Receive data
-    received = network_socket_receive(client->storage_server_sock, 
-                                   buffer, length);
-    pthread_mutex_unlock(&client->mutex);
+// Synchronous file operations
 
-    if (received < 0)
+// Reads go to the first target. If it has not answered within the hedge
+// delay and the budget allows, the same READ goes to the next target too;
+// whichever answers first wins and the other connection is closed.
+ErrorCode client_read(Client *client, const char *filepath, uint64_t offset, uint8_t *buffer, size_t length, size_t *bytes_read) {
+    if (!client || !filepath || !buffer || !bytes_read) return ERR_INVALID_ARGUMENT;
+
+    StorageLocation targets[MAX_READ_TARGETS];
+    size_t target_count = 0;
+    ErrorCode err = get_read_targets(client, filepath, targets, &target_count);
+    if (err != ERR_SUCCESS)
+        return err;
+
+    // A target that cannot be reached at all is skipped without hedging
+    NetworkSocket *socks[2] = {NULL, NULL};
+    uint64_t started[2] = {0, 0};
+    size_t target_of[2] = {0, 0};
+    size_t next = 0;
+    while (!socks[0] && next < target_count) {
+        started[0] = now_us();
+        target_of[0] = next;
+        socks[0] = send_read(client, targets[next].host, targets[next].port, filepath, offset, length);
+        if (socks[0])
+            server_rtt_start(client->rtt, targets[next].host, targets[next].port);
+        next++;
+    }
+    if (!socks[0])
         return ERR_NETWORK_FAILURE;
 
-    *bytes_read = received;
-    return ERR_SUCCESS;
+    struct pollfd pfds[2] = {
+        {.fd = network_socket_get_fd(socks[0]), .events = POLLIN},
+        {.fd = -1, .events = POLLIN},
+    };
+    int timeout = (int)hedge_delay_ms(client->hedge);
+    err = ERR_NETWORK_FAILURE;
+    for (;;) {
+        int ready = poll(pfds, 2, timeout);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (ready == 0) {
+            // The primary is slow: hedge once, then wait on both
+            timeout = -1;
+            if (next < target_count && hedge_try_acquire(client->hedge)) {
+                started[1] = now_us();
+                target_of[1] = next;
+                socks[1] = send_read(client, targets[next].host, targets[next].port, filepath, offset, length);
+                if (socks[1]) {
+                    server_rtt_start(client->rtt, targets[next].host, targets[next].port);
+                    pfds[1].fd = network_socket_get_fd(socks[1]);
+                }
+            }
+            continue;
+        }
+
+        int winner = pfds[0].revents ? 0 : 1;
+        err = receive_read(socks[winner], buffer, length, bytes_read);
+        uint64_t latency = now_us() - started[winner];
+        StorageLocation *target = &targets[target_of[winner]];
+        server_rtt_finish(client->rtt, target->host, target->port, latency);
+        if (err == ERR_SUCCESS)
+            hedge_record(client->hedge, latency);
+        network_socket_close(socks[winner]);
+        socks[winner] = NULL;
+        pfds[winner].fd = -1;
+
+        // A broken connection leaves the other attempt, if any, to answer
+        if (err != ERR_NETWORK_FAILURE || !socks[1 - winner])
+            break;
+        timeout = -1;
+    }
+
+    // A cancelled attempt took at least this long, which still tells
+    // replica selection something
+    for (int i = 0; i < 2; i++) {
+        if (socks[i]) {
+            StorageLocation *target = &targets[target_of[i]];
+            server_rtt_finish(client->rtt, target->host, target->port, now_us() - started[i]);
+            network_socket_close(socks[i]);
+        }
+    }
+    return err;
 }
 
 ErrorCode client_write(Client *client, const char *filepath, uint64_t offset, const uint8_t *buffer, size_t length) {
@@ -263,6 +1230,95 @@ ErrorCode client_write(Client *client, const char *filepath, uint64_t offset, co
     return response_code;
 }
 
+typedef struct {
+    const void *request;
+    size_t size;
+    PendingMutation *pending;   // Filled in and listed if the request is accepted
+} MutationRequest;
+
+// Wait for the naming server's first answer to a mutation: an empty
+// frame of the request's type or an error frame settle it, OP_ACCEPTED
+// lists it as pending until its OP_COMPLETE
+static ErrorCode mutation_exchange(Client *client, NetworkSocket *sock, void *ctx) {
+    MutationRequest *mutation = ctx;
+    if (network_socket_send(sock, mutation->request, mutation->size) != (ssize_t)mutation->size)
+        return ERR_NETWORK_FAILURE;
+
+    MessageHeader header;
+    if (receive_reply_header(client, sock, &header) != ERR_SUCCESS)
+        return ERR_NETWORK_FAILURE;
+    if (header.type == MSG_TYPE_ERROR) {
+        uint32_t error_code;
+        if (network_socket_receive(sock, &error_code, sizeof(error_code)) != sizeof(error_code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(error_code);
+    }
+    if (header.type == MSG_TYPE_OP_ACCEPTED) {
+        OperationAccepted accepted;
+        if (ntohl(header.payload_size) != sizeof(accepted))
+            return ERR_PROTOCOL_ERROR;
+        if (network_socket_receive(sock, &accepted, sizeof(accepted)) != sizeof(accepted))
+            return ERR_NETWORK_FAILURE;
+        PendingMutation *pending = mutation->pending;
+        pending->sock = sock;
+        pending->operation_id = network_ntoh64(accepted.operation_id);
+        pending->next = client->mutations;
+        client->mutations = pending;
+        return ERR_SUCCESS;
+    }
+    return ntohl(header.payload_size) == 0 ? ERR_SUCCESS : ERR_PROTOCOL_ERROR;
+}
+
+// Wait for the outcome of an accepted mutation. Any exchange reading from
+// the connection records outcomes it comes across; between exchanges this
+// reads them itself, dropping the lock while the connection is idle so
+// other requests, and other mutations, go ahead meanwhile.
+static ErrorCode wait_for_completion(Client *client, PendingMutation *pending) {
+    pthread_mutex_lock(&client->mutex);
+    while (!pending->done) {
+        NetworkSocket *sock = pending->sock;
+        if (client->naming_server_socks[pending->shard] != sock) {
+            pending->status = ERR_NETWORK_FAILURE;
+            break;
+        }
+        struct pollfd pfd = {.fd = network_socket_get_fd(sock), .events = POLLIN};
+        pthread_mutex_unlock(&client->mutex);
+        poll(&pfd, 1, MUTATION_POLL_MS);
+        pthread_mutex_lock(&client->mutex);
+        if (pending->done || client->naming_server_socks[pending->shard] != sock) continue;
+
+        // No exchange runs while we hold the lock, so anything waiting is a push
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            MessageHeader header;
+            if (network_socket_receive(sock, &header, sizeof(header)) != sizeof(header) ||
+                !is_push(&header) || apply_push(client, sock, &header) != ERR_SUCCESS) {
+                naming_server_failed(client, sock);
+            }
+        }
+    }
+
+    PendingMutation **link = &client->mutations;
+    while (*link && *link != pending) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = pending->next;
+    pthread_mutex_unlock(&client->mutex);
+    return pending->status;
+}
+
+// Send a CREATE, DELETE, COPY or RENAME to the primary holding filepath and wait for its
+// outcome. It is not repeated if the connection breaks, since it may have
+// been applied.
+static ErrorCode send_mutation(Client *client, const char *filepath, const void *request, size_t size) {
+    PendingMutation pending;
+    memset(&pending, 0, sizeof(pending));
+    pending.shard = shard_for_path(filepath, client->naming_server_count);
+    MutationRequest mutation = {request, size, &pending};
+    ErrorCode err = naming_exchange(client, pending.shard, 0, mutation_exchange, &mutation);
+    if (err != ERR_SUCCESS || !pending.sock) return err;
+    return wait_for_completion(client, &pending);
+}
+
 ErrorCode client_create(Client *client, const char *filepath, uint32_t mode) {
     if (!client || !filepath) return ERR_INVALID_ARGUMENT;
 
@@ -270,22 +1326,17 @@ ErrorCode client_create(Client *client, const char *filepath, uint32_t mode) {
     CreateRequest request = {0};
     request.header.request_id = generate_request_id(client);
     request.header.type = MSG_TYPE_CREATE;
+    request.header.payload_size = htonl(sizeof(request) - sizeof(MessageHeader));
     strncpy(request.filepath, filepath, sizeof(request.filepath) - 1);
     request.mode = mode;
 
-    // Send request to naming server
-    pthread_mutex_lock(&client->mutex);
-    ssize_t sent = network_socket_send(client->naming_server_sock, &request, sizeof(request));
-    pthread_mutex_unlock(&client->mutex);
-    if (sent != sizeof(request)) return ERR_NETWORK_FAILURE;
+    // Send request to naming server and wait for the storage server to
+    // have created the file
+    ErrorCode err = send_mutation(client, filepath, &request, sizeof(request));
 
-    // Receive response (error code)
-    ErrorCode response_code;
-    ssize_t received = network_socket_receive(client->naming_server_sock, &response_code, sizeof(response_code));
-    printf("Received: %d\n", response_code); //! debug
-    if (received != sizeof(response_code)) return ERR_NETWORK_FAILURE;
-
-    return response_code;
+    // A location cached before the path was taken is stale now
+    if (err == ERR_SUCCESS) location_cache_invalidate(client->locations, filepath, UINT64_MAX);
+    return err;
 }
 
 ErrorCode client_delete(Client *client, const char *filepath) {
@@ -295,20 +1346,53 @@ ErrorCode client_delete(Client *client, const char *filepath) {
     DeleteRequest request = {0};
     request.header.request_id = generate_request_id(client);
     request.header.type = MSG_TYPE_DELETE;
+    request.header.payload_size = htonl(sizeof(request) - sizeof(MessageHeader));
     strncpy(request.filepath, filepath, sizeof(request.filepath) - 1);
 
     // Send request to naming server
-    pthread_mutex_lock(&client->mutex);
-    ssize_t sent = network_socket_send(client->naming_server_sock, &request, sizeof(request));
-    pthread_mutex_unlock(&client->mutex);
-    if (sent != sizeof(request)) return ERR_NETWORK_FAILURE;
+    ErrorCode err = send_mutation(client, filepath, &request, sizeof(request));
 
-    // Receive response (error code)
-    ErrorCode response_code;
-    ssize_t received = network_socket_receive(client->naming_server_sock, &response_code, sizeof(response_code));
-    if (received != sizeof(response_code)) return ERR_NETWORK_FAILURE;
+    if (err == ERR_SUCCESS) location_cache_invalidate(client->locations, filepath, UINT64_MAX);
+    return err;
+}
 
-    return response_code;
+ErrorCode client_copy(Client *client, const char *source, const char *destination) {
+    if (!client || !source || !destination) return ERR_INVALID_ARGUMENT;
+
+    CopyRequest request;
+    memset(&request, 0, sizeof(request));
+    request.header.request_id = generate_request_id(client);
+    request.header.type = MSG_TYPE_COPY;
+    request.header.payload_size = htonl(sizeof(request) - sizeof(MessageHeader));
+    strncpy(request.source, source, sizeof(request.source) - 1);
+    strncpy(request.destination, destination, sizeof(request.destination) - 1);
+
+    // The naming server owning the destination runs the copy
+    ErrorCode err = send_mutation(client, destination, &request, sizeof(request));
+
+    if (err == ERR_SUCCESS) location_cache_invalidate(client->locations, destination, UINT64_MAX);
+    return err;
+}
+
+ErrorCode client_rename(Client *client, const char *source, const char *destination) {
+    if (!client || !source || !destination) return ERR_INVALID_ARGUMENT;
+
+    RenameRequest request;
+    memset(&request, 0, sizeof(request));
+    request.header.request_id = generate_request_id(client);
+    request.header.type = MSG_TYPE_RENAME;
+    request.header.payload_size = htonl(sizeof(request) - sizeof(MessageHeader));
+    strncpy(request.source, source, sizeof(request.source) - 1);
+    strncpy(request.destination, destination, sizeof(request.destination) - 1);
+
+    ErrorCode err = send_mutation(client, destination, &request, sizeof(request));
+
+    // Everything cached below either path is stale now
+    if (err == ERR_SUCCESS) {
+        location_cache_invalidate_prefix(client->locations, source);
+        location_cache_invalidate_prefix(client->locations, destination);
+    }
+    return err;
 }
 
 // Async operation wrapper
@@ -452,10 +1536,12 @@ ErrorCode client_stream_audio(Client *client, const char *filepath,
 
     // Check for error response
     if (response.type == MSG_TYPE_ERROR) {
-        ErrorCode error_code;
+        uint32_t error_code;
         received = network_socket_receive(client->storage_server_sock, &error_code, sizeof(error_code));
         pthread_mutex_unlock(&client->mutex);
-        return error_code;
+        if (received != sizeof(error_code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(error_code);
     }
 
     // Start receiving audio stream data
@@ -515,10 +1601,12 @@ ErrorCode client_get_file_info(Client *client, const char *filepath, uint64_t *f
     }
 
     if (response_header.type == MSG_TYPE_ERROR) {
-        ErrorCode error_code;
+        uint32_t error_code;
         received = network_socket_receive(client->storage_server_sock, &error_code, sizeof(error_code));
         pthread_mutex_unlock(&client->mutex);
-        return error_code;
+        if (received != sizeof(error_code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(error_code);
     }
 
     if (response_header.type != MSG_TYPE_GET_FILE_INFO_RESPONSE) {
@@ -534,7 +1622,7 @@ ErrorCode client_get_file_info(Client *client, const char *filepath, uint64_t *f
         return ERR_NETWORK_FAILURE;
     }
 
-    *file_size = ntohl(response.file_size);
+    *file_size = network_ntoh64(response.file_size);
     *permissions = ntohl(response.permissions);
 
     pthread_mutex_unlock(&client->mutex);
@@ -0,0 +1,104 @@
+#include "server_rtt.h"
+#include "hash.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Weight of a new observation, in eighths
+#define SERVER_RTT_ALPHA 2
+
+typedef struct {
+    char key[96];               // "host:port", empty when unused
+    uint64_t average_us;
+    uint64_t updated_ms;        // When average_us last changed
+    uint32_t outstanding;
+} RttSlot;
+
+struct ServerRtt {
+    RttSlot slots[SERVER_RTT_SLOTS];
+    pthread_mutex_t lock;
+};
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Open addressing; when the table is full the home slot is recycled, so
+// only an old server's history is lost. Caller holds the lock.
+static RttSlot *find_slot(ServerRtt *rtt, const char *key, int create) {
+    uint32_t home = fnv_hash(key) % SERVER_RTT_SLOTS;
+    for (uint32_t i = 0; i < SERVER_RTT_SLOTS; i++) {
+        RttSlot *slot = &rtt->slots[(home + i) % SERVER_RTT_SLOTS];
+        if (strcmp(slot->key, key) == 0) return slot;
+        if (slot->key[0] == '\0') {
+            if (!create) return NULL;
+            memset(slot, 0, sizeof(*slot));
+            snprintf(slot->key, sizeof(slot->key), "%s", key);
+            return slot;
+        }
+    }
+    if (!create) return NULL;
+    RttSlot *slot = &rtt->slots[home];
+    memset(slot, 0, sizeof(*slot));
+    snprintf(slot->key, sizeof(slot->key), "%s", key);
+    return slot;
+}
+
+ServerRtt *server_rtt_create() {
+    ServerRtt *rtt = calloc(1, sizeof(ServerRtt));
+    if (!rtt) return NULL;
+    pthread_mutex_init(&rtt->lock, NULL);
+    return rtt;
+}
+
+void server_rtt_destroy(ServerRtt *rtt) {
+    if (!rtt) return;
+    pthread_mutex_destroy(&rtt->lock);
+    free(rtt);
+}
+
+void server_rtt_start(ServerRtt *rtt, const char *host, const char *port) {
+    char key[96];
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+
+    pthread_mutex_lock(&rtt->lock);
+    find_slot(rtt, key, 1)->outstanding++;
+    pthread_mutex_unlock(&rtt->lock);
+}
+
+void server_rtt_finish(ServerRtt *rtt, const char *host, const char *port, uint64_t latency_us) {
+    char key[96];
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+    if (latency_us == 0) latency_us = 1;
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&rtt->lock);
+    RttSlot *slot = find_slot(rtt, key, 1);
+    if (slot->outstanding > 0) slot->outstanding--;
+    if (slot->average_us == 0 || now - slot->updated_ms > SERVER_RTT_STALE_MS) {
+        slot->average_us = latency_us;
+    } else {
+        slot->average_us = (slot->average_us * (8 - SERVER_RTT_ALPHA) + latency_us * SERVER_RTT_ALPHA) / 8;
+    }
+    slot->updated_ms = now;
+    pthread_mutex_unlock(&rtt->lock);
+}
+
+uint64_t server_rtt_score(ServerRtt *rtt, const char *host, const char *port) {
+    char key[96];
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&rtt->lock);
+    RttSlot *slot = find_slot(rtt, key, 0);
+    uint64_t score = 0;
+    if (slot && slot->average_us && now - slot->updated_ms <= SERVER_RTT_STALE_MS) {
+        score = slot->average_us * (slot->outstanding + 1);
+    }
+    pthread_mutex_unlock(&rtt->lock);
+    return score;
+}
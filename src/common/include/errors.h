@@ -13,6 +13,10 @@ typedef enum {
     ERR_PROTOCOL_ERROR = -8,
     ERR_INTERNAL_ERROR = -9,
     ERR_FILE_NOT_FOUND = -10,
+    ERR_ALREADY_EXISTS = -11,
+    ERR_WRONG_SHARD = -12,
+    ERR_READ_ONLY = -13,
+    ERR_BUSY = -14,
 } ErrorCode;
 
 const char *error_string(ErrorCode code);
@@ -0,0 +1,18 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a, the hash behind every path and server keyed table
+#define FNV_OFFSET 2166136261u
+
+// Fold length bytes of data into hash
+uint32_t fnv_update(uint32_t hash, const void *data, size_t length);
+
+uint32_t fnv_hash(const char *s);
+
+// Hash of "host:port", without building the string
+uint32_t fnv_hash_server(const char *host, const char *port);
+
+#endif // HASH_H
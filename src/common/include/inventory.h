@@ -0,0 +1,82 @@
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "errors.h"
+
+// Storage server inventory blob used for bulk registration.
+//
+// The blob is an InventoryHeader followed by one record per path, sorted in
+// tree order (see inventory_path_compare). A full inventory lists every
+// path; a delta (base_generation != 0) lists only the paths created or
+// deleted since base_generation, deletions carrying INVENTORY_FLAG_DELETED.
+// Each record is front-coded against the previous path:
+//   varint shared      bytes shared with the previous path
+//   varint suffix_len  length of the remaining bytes
+//   suffix bytes
+//   uint8  flags       INVENTORY_FLAG_*
+//   varint size
+//   varint permissions
+
+#define INVENTORY_MAGIC 0x4e465349 // "NFSI"
+#define INVENTORY_VERSION 2
+#define INVENTORY_MAX_PATH 256
+
+#define INVENTORY_FLAG_DIRECTORY 0x01
+#define INVENTORY_FLAG_DELETED 0x02
+
+typedef struct {
+    uint32_t magic;             // Network order
+    uint16_t version;           // Network order
+    uint16_t client_port;       // Network order
+    uint32_t count;             // Network order
+    uint64_t base_generation;   // Network order, 0 for a full inventory
+    uint64_t generation;        // Network order, generation after applying
+} __attribute__((packed)) InventoryHeader;
+
+// One decoded inventory record; path stays valid until the next call
+typedef struct {
+    const char *path;
+    size_t shared;              // Bytes of path shared with the previous record
+    uint8_t flags;
+    uint64_t size;
+    uint32_t permissions;
+} InventoryRecord;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint32_t count;
+    char last_path[INVENTORY_MAX_PATH];
+} InventoryWriter;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    uint32_t count;
+    uint32_t index;
+    uint16_t client_port;
+    uint64_t base_generation;
+    uint64_t generation;
+    char path[INVENTORY_MAX_PATH];
+} InventoryReader;
+
+// Tree order: like strcmp, but '/' sorts before every other character so a
+// directory's entries directly follow the directory itself
+int inventory_path_compare(const char *a, const char *b);
+
+ErrorCode inventory_writer_init(InventoryWriter *writer, uint16_t client_port, uint64_t base_generation, uint64_t generation);
+// Paths must be added in increasing tree order
+ErrorCode inventory_writer_add(InventoryWriter *writer, const char *path, uint8_t flags, uint64_t size, uint32_t permissions);
+// Hand the finished blob to the caller, who frees it with free()
+ErrorCode inventory_writer_finish(InventoryWriter *writer, uint8_t **blob, size_t *blob_size);
+void inventory_writer_free(InventoryWriter *writer);
+
+ErrorCode inventory_reader_init(InventoryReader *reader, const uint8_t *blob, size_t blob_size);
+// Returns ERR_NOT_FOUND once all records have been read
+ErrorCode inventory_reader_next(InventoryReader *reader, InventoryRecord *record);
+
+#endif // INVENTORY_H
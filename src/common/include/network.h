@@ -2,18 +2,40 @@
 #define NETWORK_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 typedef struct NetworkSocket NetworkSocket;
 
 int network_socket_get_fd(NetworkSocket *sock);
 NetworkSocket *network_socket_create(const char *host, const char *port);
+// Keep sock allocated for another thread that may still use it after its
+// owner closes it; each hold is released by one more network_socket_close
+void network_socket_hold(NetworkSocket *sock);
 void network_socket_close(NetworkSocket *sock);
 NetworkSocket *network_socket_accept(NetworkSocket *server_sock);
 
+// One send is never interleaved with another send on the same socket, so a
+// frame written with a single call can safely share the socket with pushes
+// from other threads
 ssize_t network_socket_send(NetworkSocket *sock, const void *buffer, size_t length);
 ssize_t network_socket_receive(NetworkSocket *sock, void *buffer, size_t length);
 
+// Send a frame pushed to a peer that may have stopped reading, giving up
+// after timeout_ms. A frame that does not go out whole leaves the peer
+// behind, so the connection is shut down. Returns length or -1.
+ssize_t network_socket_send_within(NetworkSocket *sock, const void *buffer, size_t length, int timeout_ms);
+
+// Byte order helpers for 64-bit fields
+uint64_t network_hton64(uint64_t value);
+uint64_t network_ntoh64(uint64_t value);
+
+// Copy length bytes from one socket to another inside the kernel, through a
+// pipe of NETWORK_RELAY_PIPE_SIZE bytes, with no user-space buffer. Returns
+// the bytes relayed, short if from closed early, or -1 on error.
+#define NETWORK_RELAY_PIPE_SIZE (64 * 1024)
+ssize_t network_socket_relay(NetworkSocket *from, NetworkSocket *to, uint64_t length);
+
 // Asynchronous operations
 typedef void (*network_callback_t)(NetworkSocket *sock, void *user_data, ssize_t result);
 
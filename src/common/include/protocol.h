@@ -2,13 +2,26 @@
 #define PROTOCOL_H
 
 #include <stdint.h>
+#include <netinet/in.h>
+
+// Another storage server holding a copy of a file
+typedef struct FileReplica {
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;
+} FileReplica;
+
+#define MAX_FILE_REPLICAS 8
 
 // File metadata structure
 typedef struct FileMetadata {
-    char *storage_server_ip;
+    char *storage_server_ip;    // The primary: writes go here
     uint16_t storage_server_port;
     uint64_t size;
     uint32_t permissions;
+    uint64_t version;           // Changes whenever the file moves to another
+                                // server or a copy goes away
+    FileReplica *replicas;      // Other servers holding a copy
+    uint32_t replica_count;
     // Additional metadata fields
 } FileMetadata;
 
@@ -32,12 +45,46 @@ typedef enum {
     MSG_TYPE_STREAM_CONTROL = 23,
     MSG_TYPE_STREAM_METADATA = 24,
     MSG_TYPE_STREAM_END = 25,
+    MSG_TYPE_GET_LOCATION_BATCH = 26,
+    MSG_TYPE_LOCATION_BATCH = 27,
+    MSG_TYPE_LIST = 28,
+    MSG_TYPE_LIST_PAGE = 29,
+    MSG_TYPE_SS_REGISTER_BULK = 30,        // Payload is an inventory blob (inventory.h)
+    MSG_TYPE_SS_REGISTER_DELTA = 31,       // Payload is a delta inventory blob
+    MSG_TYPE_SS_REGISTER_RESYNC = 32,      // Delta refused, send a full inventory
+    MSG_TYPE_SS_REGISTER_PREFIX = 33,      // Payload is a DelegationRequest
+    MSG_TYPE_LOCATION_INVALIDATE = 34,     // Pushed to clients, payload is a LocationInvalidation
+    MSG_TYPE_SS_COMMAND_BATCH = 35,        // Naming server to storage server, see StorageCommand
+    MSG_TYPE_SS_COMMAND_RESULTS = 36,      // Storage server completions, see StorageCommandResult
+    MSG_TYPE_GET_SHARD_MAP = 37,           // No payload
+    MSG_TYPE_SHARD_MAP = 38,               // See ShardAddress
+    MSG_TYPE_LOG_SUBSCRIBE = 39,           // Standby naming server to primary, see log_shipping.h
+    MSG_TYPE_LOG_RECORDS = 40,             // Primary to standby, a run of namespace log records
+    MSG_TYPE_OP_ACCEPTED = 41,             // Mutation under way, payload is an OperationAccepted
+    MSG_TYPE_OP_COMPLETE = 42,             // Pushed to clients, payload is an OperationResult
+    MSG_TYPE_COPY = 43,                    // See CopyRequest, answered like a CREATE
+    MSG_TYPE_FETCH_RANGE = 44,             // Storage server to storage server, see FetchRangeRequest
+    MSG_TYPE_RENAME = 45,                  // See RenameRequest, answered like a CREATE
+    MSG_TYPE_SEARCH = 46,                  // See SearchRequest, answered with a LIST_PAGE
+    MSG_TYPE_REPAIR_STATUS = 47,           // No payload, answered with a RepairStatus
+    MSG_TYPE_SS_FILE_WRITTEN = 48,         // Storage server to naming server on the command channel, see FileWritten
 } MessageType;
 
+// How often storage servers send a heartbeat down their control connection
+#define HEARTBEAT_INTERVAL_MS 500
+
 typedef struct {
     char host[256];
     char port[32];
-    int load;
+    int load;                   // Storage operations in flight
+    uint32_t capacity_mb;       // Size of the data directory's filesystem
+    uint32_t free_mb;           // Space left on it
+    uint32_t read_latency_us;   // Moving averages of completed operations
+    uint32_t write_latency_us;
+    uint64_t bytes_in_per_sec;  // Since the previous heartbeat
+    uint64_t bytes_out_per_sec;
+    uint32_t queue_depth;       // Connections waiting to be accepted
+    uint32_t open_streams;
 } HeartbeatMessage;
 
 typedef struct {
@@ -46,6 +93,188 @@ typedef struct {
     uint32_t payload_size;
 } MessageHeader;
 
+// Lease attached to a resolved location: the client may reuse it for ttl_ms
+// unless a LOCATION_INVALIDATE for the path arrives first. A LOCATION reply
+// payload is the server ip (INET_ADDRSTRLEN bytes), its port (network
+// order) and this lease.
+typedef struct {
+    uint32_t ttl_ms;            // Network order, 0 means do not cache
+    uint64_t version;           // Network order
+} __attribute__((packed)) LocationLease;
+
+// After the lease, a LOCATION reply lists every server holding the file as a
+// uint16_t count (network order) and that many records, best first: healthy
+// before unhealthy, then by load. Reads may use any of them; writes go to
+// the primary named before the lease.
+typedef struct {
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;              // Network order
+    uint8_t healthy;            // Heartbeating and not short of space
+    uint32_t load;              // Placement cost in thousandths, network order
+} __attribute__((packed)) LocationReplica;
+
+// LOCATION_INVALIDATE payload, pushed by the naming server with request_id 0
+// when a leased path is deleted, moved or its server fails
+typedef struct {
+    uint64_t version;           // Network order, lease versions up to this one are void
+    char path[256];
+} __attribute__((packed)) LocationInvalidation;
+
+// A CREATE, DELETE, COPY or RENAME the naming server cannot settle on its own
+// is answered at once with OP_ACCEPTED; OP_COMPLETE follows, carrying the
+// same request_id, once the storage servers have carried it out. Either may
+// instead be answered by an error frame, or by an empty frame of the
+// request's type when it succeeded without a storage server.
+typedef struct {
+    uint64_t operation_id;      // Network order
+} __attribute__((packed)) OperationAccepted;
+
+typedef struct {
+    uint64_t operation_id;      // Network order
+    int32_t status;             // ErrorCode, network order
+} __attribute__((packed)) OperationResult;
+
+// Maximum number of paths resolved by a single GET_LOCATION_BATCH request
+#define MAX_LOCATION_BATCH 1024
+
+// Largest payloads accepted from a peer. Anything bigger is refused before
+// a buffer is allocated for it.
+#define MAX_PATH_PAYLOAD 4096
+#define MAX_LOCATION_BATCH_PAYLOAD (sizeof(uint32_t) + MAX_LOCATION_BATCH * (sizeof(uint16_t) + MAX_PATH_PAYLOAD))
+#define MAX_INVENTORY_PAYLOAD (256u * 1024 * 1024)
+
+// GET_LOCATION_BATCH payload: uint32_t count (network order) followed by
+// count records of { uint16_t path_len (network order), path bytes }.
+// The reply is a LOCATION_BATCH payload: uint32_t count (network order)
+// followed by count LocationBatchEntry records, in request order.
+typedef struct {
+    int32_t status;                            // ErrorCode, network order
+    char storage_server_ip[INET_ADDRSTRLEN];
+    uint16_t storage_server_port;              // Network order
+    LocationLease lease;
+} __attribute__((packed)) LocationBatchEntry;
+
+// SS_REGISTER_PREFIX payload: the storage server owns every path below
+// prefix; the naming server resolves them on first use
+typedef struct {
+    char prefix[256];           // "/" delegates the whole namespace
+    uint16_t client_port;       // Network order
+} __attribute__((packed)) DelegationRequest;
+
+// Namespace mutations the naming server asks a storage server to carry out
+typedef enum {
+    STORAGE_COMMAND_CREATE = 1,         // Create an empty file (and its parents)
+    STORAGE_COMMAND_DELETE = 2,
+    STORAGE_COMMAND_COPY = 3,           // Pull source_path from another server
+    STORAGE_COMMAND_RENAME = 4,         // Move source_path, a file or directory, to path
+    STORAGE_COMMAND_WATCH = 5,          // Report the next write to path with SS_FILE_WRITTEN, every write if path is empty
+} StorageCommandOp;
+
+// Maximum number of commands in one SS_COMMAND_BATCH frame
+#define MAX_COMMAND_BATCH 512
+
+// SS_COMMAND_BATCH payload: uint32_t count (network order) followed by count
+// of these. The connection stays open; every command is answered by id in a
+// later SS_COMMAND_RESULTS frame, whose payload is uint32_t count followed
+// by count StorageCommandResult records.
+typedef struct {
+    uint32_t command_id;        // Network order
+    uint8_t op;                 // StorageCommandOp
+    uint32_t mode;              // Network order, permissions for CREATE
+    char path[256];
+    char source_ip[INET_ADDRSTRLEN];
+    uint16_t source_port;       // Network order
+    char source_path[256];
+} __attribute__((packed)) StorageCommand;
+
+typedef struct {
+    uint32_t command_id;        // Network order
+    int32_t status;             // ErrorCode, network order
+} __attribute__((packed)) StorageCommandResult;
+
+// SS_FILE_WRITTEN payload, sent unasked on the command channel once a path
+// under a WATCH is written. A watch reports one write and is gone.
+typedef struct {
+    char path[256];             // As given in the WATCH, or as written for a WATCH of every path
+} __attribute__((packed)) FileWritten;
+
+// Most naming servers the namespace can be split across
+#define MAX_SHARDS 16
+
+// SHARD_MAP payload: uint32_t count (network order) followed by count of
+// these, in shard order. Each top-level directory belongs to one shard (see
+// shard.h); count is 0 when the naming server holds the whole namespace.
+// A ShardPeer follows when the answering server has a hot standby or is one.
+typedef struct {
+    char host[256];
+    char port[32];
+} __attribute__((packed)) ShardAddress;
+
+// The other half of a primary/standby naming server pair
+typedef struct {
+    uint8_t standby;            // The answering server is the read-only standby
+    ShardAddress peer;          // Its primary if standby is set, else its standby
+} __attribute__((packed)) ShardPeer;
+
+// Maximum number of entries in one LIST page
+#define LIST_MAX_PAGE 256
+
+// LIST request: one page of the entries below path, resuming after cursor
+typedef struct {
+    char path[256];
+    char cursor[256];           // Last path of the previous page, empty to start
+    uint32_t max_entries;       // Network order, clamped to LIST_MAX_PAGE
+    uint8_t recursive;          // Walk the whole subtree instead of one level
+} __attribute__((packed)) ListRequest;
+
+// One LIST entry with its attributes (readdirplus style)
+typedef struct {
+    char path[256];
+    uint8_t is_directory;
+    uint64_t size;              // Network order on the wire
+    uint32_t permissions;       // Network order on the wire
+    char storage_server_ip[INET_ADDRSTRLEN];
+    uint16_t storage_server_port; // Network order on the wire
+} __attribute__((packed)) ListEntry;
+
+// LIST_PAGE payload: this header followed by count ListEntry records
+typedef struct {
+    uint32_t count;             // Network order
+    uint8_t has_more;
+    char next_cursor[256];
+} __attribute__((packed)) ListPageHeader;
+
+// How a SEARCH pattern is matched against each entry's own name
+typedef enum {
+    SEARCH_SUBSTRING = 1,
+    SEARCH_PREFIX = 2,
+    SEARCH_GLOB = 3,            // fnmatch(3) syntax
+} SearchMode;
+
+// SEARCH request: one page of the entries anywhere in the namespace whose
+// name (last path component) matches pattern. Answered with a LIST_PAGE;
+// the naming server may end a page early, even empty, with has_more set.
+typedef struct {
+    char pattern[256];
+    char cursor[256];           // next_cursor of the previous page, empty to start
+    uint32_t max_entries;       // Network order, clamped to LIST_MAX_PAGE
+    uint8_t mode;               // SearchMode
+} __attribute__((packed)) SearchRequest;
+
+// REPAIR_STATUS reply: how far the naming server got restoring the copies
+// failed storage servers took with them. Network order; the last four
+// count since the naming server started.
+typedef struct {
+    uint32_t target_copies;     // Live copies a file is repaired back to
+    uint32_t queued;            // Files waiting for a copy
+    uint32_t critical;          // Of those, files down to one live copy
+    uint32_t copying;           // Copies under way
+    uint32_t copies_made;
+    uint32_t restored;          // Files brought back to target_copies
+    uint32_t failed;            // Files given up on after repeated failures
+    uint32_t unrecoverable;     // Files no live server holds any more
+} __attribute__((packed)) RepairStatus;
+
 // Storage Server Registration Message
 typedef struct {
     uint16_t port;
@@ -79,6 +308,31 @@ typedef struct {
     char filepath[256];
 } DeleteRequest;
 
+// Copy the file or directory tree at source to destination, which must not
+// exist yet. Storage servers move the data between themselves.
+typedef struct {
+    MessageHeader header;
+    char source[256];
+    char destination[256];
+} __attribute__((packed)) CopyRequest;
+
+// Move the file or directory tree at source to destination, which must not
+// exist yet. Only names change; no data moves between servers.
+typedef struct {
+    MessageHeader header;
+    char source[256];
+    char destination[256];
+} __attribute__((packed)) RenameRequest;
+
+// FETCH_RANGE payload: the reply is a FETCH_RANGE frame carrying length
+// bytes of path from offset, fewer at the end of the file, or an error
+// frame. The connection stays open for further ranges.
+typedef struct {
+    char path[256];
+    uint64_t offset;            // Network order
+    uint32_t length;            // Network order
+} __attribute__((packed)) FetchRangeRequest;
+
 
 
 // Structure for get_file_info request
@@ -0,0 +1,96 @@
+#ifndef REQUEST_LOG_H
+#define REQUEST_LOG_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "errors.h"
+
+// Structured request log.
+//
+// Every request handled is recorded as one fixed-size binary record. A
+// thread writes its records into a ring of its own without taking any lock;
+// a background thread drains every ring to a file and rotates it once it
+// reaches REQUEST_LOG_FILE_BYTES. A record that finds its ring full is
+// dropped and counted rather than making the request wait.
+//
+// Levels below REQUEST_LOG_LEVEL compile to nothing; build with, say,
+// -DREQUEST_LOG_LEVEL=REQUEST_LOG_DEBUG to keep per-path records too.
+
+#define REQUEST_LOG_DEBUG 0
+#define REQUEST_LOG_INFO 1
+#define REQUEST_LOG_WARN 2
+#define REQUEST_LOG_OFF 3
+
+#ifndef REQUEST_LOG_LEVEL
+#define REQUEST_LOG_LEVEL REQUEST_LOG_INFO
+#endif
+
+#define REQUEST_LOG_RING_RECORDS 1024           // Per thread, a power of two
+#define REQUEST_LOG_DRAIN_MS 50
+#define REQUEST_LOG_FILE_BYTES (16 * 1024 * 1024)
+#define REQUEST_LOG_FILES 4                     // path, then path.1 to path.3 as they rotate out
+
+#define REQUEST_LOG_MAGIC 0x4c53464eu           // "NFSL"
+#define REQUEST_LOG_VERSION 1
+
+typedef enum {
+    REQUEST_EVENT_LOOKUP = 1,       // Location of path resolved
+    REQUEST_EVENT_LOOKUP_BATCH,     // value: paths resolved
+    REQUEST_EVENT_LIST,             // value: entries returned
+    REQUEST_EVENT_CREATE,
+    REQUEST_EVENT_DELETE,
+    REQUEST_EVENT_REGISTER,         // Storage server registered; value: paths
+    REQUEST_EVENT_REGISTER_PATH,    // One path of a registration
+    REQUEST_EVENT_READ,             // value: bytes
+    REQUEST_EVENT_WRITE,            // value: bytes
+    REQUEST_EVENT_STREAM,
+    REQUEST_EVENT_REPLICATE_WRITE,  // value: bytes
+    REQUEST_EVENT_REPLICATE_DELETE,
+    REQUEST_EVENT_DROPPED,          // value: records a full ring lost
+    REQUEST_EVENT_COPY,             // value: files copied
+    REQUEST_EVENT_RENAME,           // value: storage servers involved
+    REQUEST_EVENT_SEARCH,           // value: entries returned
+} RequestLogEvent;
+
+// Written at the start of every log file. Both this and the records are in
+// host byte order.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+} __attribute__((packed)) RequestLogFileHeader;
+
+typedef struct {
+    uint64_t timestamp_us;          // Wall clock
+    uint64_t value;                 // Per event, see RequestLogEvent
+    uint32_t request_id;
+    int32_t status;                 // ErrorCode
+    uint32_t thread;                // Numbered in order of first record
+    uint16_t event;                 // RequestLogEvent
+    uint16_t port;                  // Peer port, 0 if unknown
+    uint8_t level;
+    char ip[INET_ADDRSTRLEN];       // Peer address, empty if unknown
+    char path[79];                  // Truncated if longer
+} __attribute__((packed)) RequestLogRecord;
+
+// Open path (appending) and start draining. Records written before, or
+// after a failure to open it, are discarded.
+ErrorCode request_log_init(const char *path);
+
+// Drain what is left and close the file
+void request_log_cleanup();
+
+// Set the peer the calling thread's following records are about
+void request_log_set_peer(const char *ip, uint16_t port);
+
+// Use REQUEST_LOG instead, so disabled levels cost nothing
+void request_log_write(uint8_t level, uint16_t event, uint32_t request_id, const char *path,
+                       int32_t status, uint64_t value);
+
+#define REQUEST_LOG(level, event, request_id, path, status, value)                    \
+    do {                                                                              \
+        if ((level) >= REQUEST_LOG_LEVEL)                                             \
+            request_log_write((level), (event), (request_id), (path), (status), (value)); \
+    } while (0)
+
+#endif // REQUEST_LOG_H
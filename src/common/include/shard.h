@@ -0,0 +1,32 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include "errors.h"
+#include "network.h"
+#include "protocol.h"
+
+// The namespace can be split across several naming servers. Each top-level
+// directory (or top-level file) belongs to exactly one of them, picked by a
+// hash of its name, so a whole subtree always lives on one shard. The root
+// itself is held by every shard. The shard map is static: every naming
+// server is started with the same list, and clients and storage servers
+// fetch it once from whichever server they were pointed at.
+
+// Whether path names the root ("", "/", "//", ...)
+int shard_is_root(const char *path);
+
+// Index of the shard holding path among count shards. The root and any path
+// with fewer than two shards map to 0.
+uint32_t shard_for_path(const char *path, uint32_t count);
+
+// Parse a comma separated "host:port,host:port" list
+ErrorCode shard_parse_list(const char *list, ShardAddress *shards, uint32_t max, uint32_t *count);
+
+// Ask the naming server on sock for its shard map. count is set to 0 when
+// that server holds the whole namespace. If peer is not NULL it receives the
+// server's primary/standby partner, with an empty host when it has none.
+ErrorCode shard_fetch_map(NetworkSocket *sock, uint32_t request_id, ShardAddress *shards, uint32_t max,
+                          uint32_t *count, ShardPeer *peer);
+
+#endif // SHARD_H
@@ -22,6 +22,16 @@ const char *error_string(ErrorCode code) {
             return "Protocol error";
         case ERR_INTERNAL_ERROR:
             return "Internal error";
+        case ERR_FILE_NOT_FOUND:
+            return "File not found";
+        case ERR_ALREADY_EXISTS:
+            return "Already exists";
+        case ERR_WRONG_SHARD:
+            return "Path belongs to another naming server";
+        case ERR_READ_ONLY:
+            return "Naming server is a read-only standby";
+        case ERR_BUSY:
+            return "Another operation on the path is in progress";
         default:
             return "Unrecognized error code";
     }
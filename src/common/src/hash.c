@@ -0,0 +1,23 @@
+#include "hash.h"
+#include <string.h>
+
+#define FNV_PRIME 16777619u
+
+uint32_t fnv_update(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint32_t fnv_hash(const char *s) {
+    return fnv_update(FNV_OFFSET, s, strlen(s));
+}
+
+uint32_t fnv_hash_server(const char *host, const char *port) {
+    uint32_t hash = fnv_update(FNV_OFFSET, host, strlen(host));
+    hash = fnv_update(hash, ":", 1);
+    return fnv_update(hash, port, strlen(port));
+}
@@ -0,0 +1,166 @@
+#include "inventory.h"
+#include "network.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+int inventory_path_compare(const char *a, const char *b) {
+    const unsigned char *pa = (const unsigned char *)a;
+    const unsigned char *pb = (const unsigned char *)b;
+    while (*pa && *pa == *pb) {
+        pa++;
+        pb++;
+    }
+    if (*pa == *pb) return 0;
+    if (*pa == '\0') return -1;
+    if (*pb == '\0') return 1;
+    if (*pa == '/') return -1;
+    if (*pb == '/') return 1;
+    return *pa < *pb ? -1 : 1;
+}
+
+static ErrorCode writer_reserve(InventoryWriter *writer, size_t extra) {
+    if (writer->size + extra <= writer->capacity) return ERR_SUCCESS;
+
+    size_t new_capacity = writer->capacity ? writer->capacity * 2 : 4096;
+    while (new_capacity < writer->size + extra) new_capacity *= 2;
+    uint8_t *new_data = realloc(writer->data, new_capacity);
+    if (!new_data) return ERR_INTERNAL_ERROR;
+    writer->data = new_data;
+    writer->capacity = new_capacity;
+    return ERR_SUCCESS;
+}
+
+static void put_varint(InventoryWriter *writer, uint64_t value) {
+    while (value >= 0x80) {
+        writer->data[writer->size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    writer->data[writer->size++] = (uint8_t)value;
+}
+
+static int get_varint(InventoryReader *reader, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->offset >= reader->size) return -1;
+        uint8_t byte = reader->data[reader->offset++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+ErrorCode inventory_writer_init(InventoryWriter *writer, uint16_t client_port, uint64_t base_generation, uint64_t generation) {
+    if (!writer) return ERR_INVALID_ARGUMENT;
+    memset(writer, 0, sizeof(*writer));
+    if (writer_reserve(writer, sizeof(InventoryHeader)) != ERR_SUCCESS) return ERR_INTERNAL_ERROR;
+
+    InventoryHeader header = {
+        .magic = htonl(INVENTORY_MAGIC),
+        .version = htons(INVENTORY_VERSION),
+        .client_port = htons(client_port),
+        .count = 0,
+        .base_generation = network_hton64(base_generation),
+        .generation = network_hton64(generation)
+    };
+    memcpy(writer->data, &header, sizeof(header));
+    writer->size = sizeof(header);
+    return ERR_SUCCESS;
+}
+
+ErrorCode inventory_writer_add(InventoryWriter *writer, const char *path, uint8_t flags, uint64_t size, uint32_t permissions) {
+    if (!writer || !path) return ERR_INVALID_ARGUMENT;
+
+    size_t len = strlen(path);
+    if (len == 0 || len >= INVENTORY_MAX_PATH) return ERR_INVALID_ARGUMENT;
+    if (writer->count > 0 && inventory_path_compare(writer->last_path, path) >= 0) return ERR_INVALID_ARGUMENT;
+
+    size_t shared = 0;
+    while (shared < len && writer->last_path[shared] == path[shared]) shared++;
+
+    // Worst case: three 10-byte varints, the suffix and the flags byte
+    if (writer_reserve(writer, 3 * 10 + (len - shared) + 1) != ERR_SUCCESS) return ERR_INTERNAL_ERROR;
+    put_varint(writer, shared);
+    put_varint(writer, len - shared);
+    memcpy(writer->data + writer->size, path + shared, len - shared);
+    writer->size += len - shared;
+    writer->data[writer->size++] = flags;
+    put_varint(writer, size);
+    put_varint(writer, permissions);
+
+    memcpy(writer->last_path, path, len + 1);
+    writer->count++;
+    return ERR_SUCCESS;
+}
+
+ErrorCode inventory_writer_finish(InventoryWriter *writer, uint8_t **blob, size_t *blob_size) {
+    if (!writer || !blob || !blob_size) return ERR_INVALID_ARGUMENT;
+
+    InventoryHeader *header = (InventoryHeader *)writer->data;
+    header->count = htonl(writer->count);
+
+    *blob = writer->data;
+    *blob_size = writer->size;
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+    return ERR_SUCCESS;
+}
+
+void inventory_writer_free(InventoryWriter *writer) {
+    if (!writer) return;
+    free(writer->data);
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+}
+
+ErrorCode inventory_reader_init(InventoryReader *reader, const uint8_t *blob, size_t blob_size) {
+    if (!reader || !blob || blob_size < sizeof(InventoryHeader)) return ERR_INVALID_ARGUMENT;
+
+    InventoryHeader header;
+    memcpy(&header, blob, sizeof(header));
+    if (ntohl(header.magic) != INVENTORY_MAGIC || ntohs(header.version) != INVENTORY_VERSION)
+        return ERR_PROTOCOL_ERROR;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->data = blob;
+    reader->size = blob_size;
+    reader->offset = sizeof(header);
+    reader->count = ntohl(header.count);
+    reader->client_port = ntohs(header.client_port);
+    reader->base_generation = network_ntoh64(header.base_generation);
+    reader->generation = network_ntoh64(header.generation);
+    return ERR_SUCCESS;
+}
+
+ErrorCode inventory_reader_next(InventoryReader *reader, InventoryRecord *record) {
+    if (!reader || !record) return ERR_INVALID_ARGUMENT;
+    if (reader->index >= reader->count) return ERR_NOT_FOUND;
+
+    uint64_t shared, suffix_len, size, permissions;
+    if (get_varint(reader, &shared) != 0 || get_varint(reader, &suffix_len) != 0)
+        return ERR_PROTOCOL_ERROR;
+    if (shared > strlen(reader->path) || shared + suffix_len >= INVENTORY_MAX_PATH ||
+        reader->offset + suffix_len + 1 > reader->size)
+        return ERR_PROTOCOL_ERROR;
+
+    memcpy(reader->path + shared, reader->data + reader->offset, suffix_len);
+    reader->path[shared + suffix_len] = '\0';
+    reader->offset += suffix_len;
+    uint8_t flags = reader->data[reader->offset++];
+
+    if (get_varint(reader, &size) != 0 || get_varint(reader, &permissions) != 0)
+        return ERR_PROTOCOL_ERROR;
+
+    record->path = reader->path;
+    record->shared = shared;
+    record->flags = flags;
+    record->size = size;
+    record->permissions = (uint32_t)permissions;
+    reader->index++;
+    return ERR_SUCCESS;
+}
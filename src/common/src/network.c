@@ -9,10 +9,16 @@
 #include <netdb.h>
 #include <sys/socket.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <time.h>
 
 struct NetworkSocket {
     int fd;
-    pthread_mutex_t mutex;
+    pthread_mutex_t mutex;          // Serializes receives (and accept)
+    pthread_mutex_t send_mutex;     // Serializes sends, so another thread can
+                                    // write while a receive is blocked
+    uint32_t refs;                  // Owner plus network_socket_hold callers
 };
 
 static int set_nonblocking(int fd) {
@@ -87,7 +93,9 @@ NetworkSocket *network_socket_create(const char *host, const char *port) {
     }
 
     pthread_mutex_init(&sock->mutex, NULL);
+    pthread_mutex_init(&sock->send_mutex, NULL);
     sock->fd = sockfd;
+    sock->refs = 1;
     return sock;
 }
 
@@ -109,20 +117,27 @@ NetworkSocket *network_socket_accept(NetworkSocket *server_sock) {
     }
 
     pthread_mutex_init(&client_sock->mutex, NULL);
+    pthread_mutex_init(&client_sock->send_mutex, NULL);
     client_sock->fd = client_fd;
+    client_sock->refs = 1;
     return client_sock;
 }
 
+void network_socket_hold(NetworkSocket *sock) {
+    __atomic_add_fetch(&sock->refs, 1, __ATOMIC_RELAXED);
+}
+
 void network_socket_close(NetworkSocket *sock) {
-    if (sock) {
+    if (sock && __atomic_sub_fetch(&sock->refs, 1, __ATOMIC_ACQ_REL) == 0) {
         close(sock->fd);
         pthread_mutex_destroy(&sock->mutex);
+        pthread_mutex_destroy(&sock->send_mutex);
         free(sock);
     }
 }
 
 ssize_t network_socket_send(NetworkSocket *sock, const void *buffer, size_t length) {
-    pthread_mutex_lock(&sock->mutex);
+    pthread_mutex_lock(&sock->send_mutex);
 
     size_t total_sent = 0;
     const uint8_t *buf = buffer;
@@ -131,16 +146,51 @@ ssize_t network_socket_send(NetworkSocket *sock, const void *buffer, size_t leng
         ssize_t sent = send(sock->fd, buf + total_sent, length - total_sent, 0);
         if (sent <= 0) {
             // Error occurred
-            pthread_mutex_unlock(&sock->mutex);
+            pthread_mutex_unlock(&sock->send_mutex);
             return -1;
         }
         total_sent += sent;
     }
 
-    pthread_mutex_unlock(&sock->mutex);
+    pthread_mutex_unlock(&sock->send_mutex);
     return total_sent;
 }
 
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+ssize_t network_socket_send_within(NetworkSocket *sock, const void *buffer, size_t length, int timeout_ms) {
+    uint64_t deadline = now_ms() + timeout_ms;
+    struct timespec lock_deadline;
+    clock_gettime(CLOCK_REALTIME, &lock_deadline);
+    lock_deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    lock_deadline.tv_sec += timeout_ms / 1000 + lock_deadline.tv_nsec / 1000000000L;
+    lock_deadline.tv_nsec %= 1000000000L;
+
+    // A send blocked on the same peer holds send_mutex
+    size_t total_sent = 0;
+    int locked = pthread_mutex_timedlock(&sock->send_mutex, &lock_deadline) == 0;
+    const uint8_t *buf = buffer;
+    while (locked && total_sent < length) {
+        ssize_t sent = send(sock->fd, buf + total_sent, length - total_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent > 0) {
+            total_sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        uint64_t now = now_ms();
+        if (sent == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) || now >= deadline) break;
+        struct pollfd pfd = { .fd = sock->fd, .events = POLLOUT };
+        poll(&pfd, 1, (int)(deadline - now));
+    }
+    if (total_sent < length) shutdown(sock->fd, SHUT_RDWR);
+    if (locked) pthread_mutex_unlock(&sock->send_mutex);
+    return total_sent == length ? (ssize_t)total_sent : -1;
+}
+
 ssize_t network_socket_receive(NetworkSocket *sock, void *buffer, size_t length) {
      pthread_mutex_lock(&sock->mutex);
     
@@ -173,6 +223,76 @@ ssize_t network_socket_receive(NetworkSocket *sock, void *buffer, size_t length)
     return total_received;
 }
 
+uint64_t network_hton64(uint64_t value) {
+    if (htonl(1) == 1) return value;
+    return ((uint64_t)htonl((uint32_t)value) << 32) | htonl((uint32_t)(value >> 32));
+}
+
+uint64_t network_ntoh64(uint64_t value) {
+    return network_hton64(value);
+}
+
+// Wait until fd is ready for events; non-blocking client sockets report
+// EAGAIN from splice just as they do from recv and send
+static int wait_ready(int fd, short events) {
+    struct pollfd pfd = { .fd = fd, .events = events };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, -1);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0 ? 0 : -1;
+}
+
+// Move up to len bytes from fd_in to fd_out, waiting on fd when it would block
+static ssize_t splice_some(int fd_in, int fd_out, size_t len, int wait_fd, short events) {
+    while (1) {
+        ssize_t moved = splice(fd_in, NULL, fd_out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved >= 0) return moved;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN || wait_ready(wait_fd, events) != 0) return -1;
+    }
+}
+
+ssize_t network_socket_relay(NetworkSocket *from, NetworkSocket *to, uint64_t length) {
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) return -1;
+    // The pipe is the only buffer, so its size bounds the bytes in flight
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, NETWORK_RELAY_PIPE_SIZE);
+
+    pthread_mutex_lock(&from->mutex);
+    pthread_mutex_lock(&to->send_mutex);
+
+    uint64_t relayed = 0;
+    int failed = 0;
+    while (relayed < length) {
+        size_t want = length - relayed < NETWORK_RELAY_PIPE_SIZE ? (size_t)(length - relayed) : NETWORK_RELAY_PIPE_SIZE;
+        ssize_t in_pipe = splice_some(from->fd, pipe_fds[1], want, from->fd, POLLIN);
+        if (in_pipe <= 0) {
+            // Peer closed or failed
+            failed = in_pipe < 0;
+            break;
+        }
+
+        // Drain the pipe completely before reading more
+        while (in_pipe > 0) {
+            ssize_t out = splice_some(pipe_fds[0], to->fd, in_pipe, to->fd, POLLOUT);
+            if (out <= 0) {
+                failed = 1;
+                break;
+            }
+            in_pipe -= out;
+            relayed += out;
+        }
+        if (failed) break;
+    }
+
+    pthread_mutex_unlock(&to->send_mutex);
+    pthread_mutex_unlock(&from->mutex);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return failed ? -1 : (ssize_t)relayed;
+}
+
 // Asynchronous operations
 struct async_op {
     NetworkSocket *sock;
@@ -0,0 +1,237 @@
+#include "request_log.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// One thread's records. Only the owner advances head and only the drain
+// thread advances tail, so neither needs a lock.
+typedef struct LogRing {
+    RequestLogRecord records[REQUEST_LOG_RING_RECORDS];
+    uint64_t head;              // Next slot the owner fills
+    uint64_t tail;              // Next slot the drain thread reads
+    uint64_t dropped;           // Records lost to a full ring
+    uint64_t reported;          // Of those, already logged as dropped
+    uint32_t thread;
+    int orphaned;               // The owner exited; freed once drained
+    struct LogRing *next;
+} LogRing;
+
+static LogRing *rings = NULL;
+static uint32_t ring_count = 0;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+
+static __thread LogRing *local_ring = NULL;
+static __thread char local_ip[INET_ADDRSTRLEN];
+static __thread uint16_t local_port = 0;
+
+static int logging = 0;
+static FILE *log_file = NULL;
+static char log_path[512];
+static long log_bytes = 0;
+static pthread_t drain_thread;
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_cond = PTHREAD_COND_INITIALIZER;
+
+static void release_ring(void *arg) {
+    LogRing *ring = arg;
+    __atomic_store_n(&ring->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+// The calling thread's ring, registered on first use
+static LogRing *thread_ring() {
+    if (local_ring) return local_ring;
+    LogRing *ring = calloc(1, sizeof(LogRing));
+    if (!ring) return NULL;
+
+    pthread_mutex_lock(&rings_mutex);
+    ring->thread = ++ring_count;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_mutex);
+
+    pthread_setspecific(ring_key, ring);
+    local_ring = ring;
+    return ring;
+}
+
+void request_log_set_peer(const char *ip, uint16_t port) {
+    snprintf(local_ip, sizeof(local_ip), "%s", ip ? ip : "");
+    local_port = port;
+}
+
+void request_log_write(uint8_t level, uint16_t event, uint32_t request_id, const char *path,
+                       int32_t status, uint64_t value) {
+    if (!__atomic_load_n(&logging, __ATOMIC_ACQUIRE)) return;
+    LogRing *ring = thread_ring();
+    if (!ring) return;
+
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == REQUEST_LOG_RING_RECORDS) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    RequestLogRecord *record = &ring->records[head & (REQUEST_LOG_RING_RECORDS - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record->timestamp_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    record->value = value;
+    record->request_id = request_id;
+    record->status = status;
+    record->thread = ring->thread;
+    record->event = event;
+    record->port = local_port;
+    record->level = level;
+    memcpy(record->ip, local_ip, sizeof(record->ip));
+    strncpy(record->path, path ? path : "", sizeof(record->path) - 1);
+    record->path[sizeof(record->path) - 1] = '\0';
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Open log_path for appending, starting it with a header if it is new
+static ErrorCode open_log_file() {
+    log_file = fopen(log_path, "ab");
+    if (!log_file) return ERR_IO_ERROR;
+    fseek(log_file, 0, SEEK_END);
+    log_bytes = ftell(log_file);
+    if (log_bytes <= 0) {
+        RequestLogFileHeader header = {REQUEST_LOG_MAGIC, REQUEST_LOG_VERSION, sizeof(RequestLogRecord)};
+        fwrite(&header, sizeof(header), 1, log_file);
+        log_bytes = sizeof(header);
+    }
+    return ERR_SUCCESS;
+}
+
+// path.2 becomes path.3, path.1 path.2, and so on; the oldest is dropped
+static void rotate_log_file() {
+    fclose(log_file);
+    log_file = NULL;
+    for (int i = REQUEST_LOG_FILES - 1; i > 0; i--) {
+        char from[sizeof(log_path) + 16], to[sizeof(log_path) + 16];
+        if (i == 1) {
+            snprintf(from, sizeof(from), "%s", log_path);
+        } else {
+            snprintf(from, sizeof(from), "%s.%d", log_path, i - 1);
+        }
+        snprintf(to, sizeof(to), "%s.%d", log_path, i);
+        rename(from, to);
+    }
+    if (open_log_file() != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to reopen request log %s\n", log_path);
+    }
+}
+
+static void write_records(const RequestLogRecord *records, size_t count) {
+    if (!log_file || count == 0) return;
+    fwrite(records, sizeof(RequestLogRecord), count, log_file);
+    log_bytes += count * sizeof(RequestLogRecord);
+    if (log_bytes >= REQUEST_LOG_FILE_BYTES) rotate_log_file();
+}
+
+// Move every ring's records to the file. Caller holds rings_mutex.
+static void drain_rings() {
+    LogRing **link = &rings;
+    while (*link) {
+        LogRing *ring = *link;
+        // Read orphaned first: a ring seen orphaned and then empty stays empty
+        int orphaned = __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = ring->tail;
+
+        while (tail < head) {
+            size_t start = tail & (REQUEST_LOG_RING_RECORDS - 1);
+            size_t count = head - tail;
+            if (count > REQUEST_LOG_RING_RECORDS - start) count = REQUEST_LOG_RING_RECORDS - start;
+            write_records(&ring->records[start], count);
+            tail += count;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->reported) {
+            RequestLogRecord record;
+            memset(&record, 0, sizeof(record));
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            record.timestamp_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+            record.value = dropped - ring->reported;
+            record.thread = ring->thread;
+            record.event = REQUEST_EVENT_DROPPED;
+            record.level = REQUEST_LOG_WARN;
+            write_records(&record, 1);
+            ring->reported = dropped;
+        }
+
+        if (orphaned) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+    if (log_file) fflush(log_file);
+}
+
+static void *drain_loop(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&drain_mutex);
+    while (__atomic_load_n(&logging, __ATOMIC_ACQUIRE)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += REQUEST_LOG_DRAIN_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&drain_cond, &drain_mutex, &deadline);
+
+        pthread_mutex_lock(&rings_mutex);
+        drain_rings();
+        pthread_mutex_unlock(&rings_mutex);
+    }
+    pthread_mutex_unlock(&drain_mutex);
+    return NULL;
+}
+
+ErrorCode request_log_init(const char *path) {
+    if (!path) return ERR_INVALID_ARGUMENT;
+    if (__atomic_load_n(&logging, __ATOMIC_ACQUIRE)) return ERR_SUCCESS;
+
+    snprintf(log_path, sizeof(log_path), "%s", path);
+    if (open_log_file() != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to open request log %s\n", path);
+        return ERR_IO_ERROR;
+    }
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        fclose(log_file);
+        log_file = NULL;
+        return ERR_INTERNAL_ERROR;
+    }
+
+    __atomic_store_n(&logging, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&drain_thread, NULL, drain_loop, NULL) != 0) {
+        __atomic_store_n(&logging, 0, __ATOMIC_RELEASE);
+        fclose(log_file);
+        log_file = NULL;
+        return ERR_INTERNAL_ERROR;
+    }
+    return ERR_SUCCESS;
+}
+
+void request_log_cleanup() {
+    if (!__atomic_load_n(&logging, __ATOMIC_ACQUIRE)) return;
+
+    pthread_mutex_lock(&drain_mutex);
+    __atomic_store_n(&logging, 0, __ATOMIC_RELEASE);
+    pthread_cond_signal(&drain_cond);
+    pthread_mutex_unlock(&drain_mutex);
+    pthread_join(drain_thread, NULL);
+
+    // Rings stay registered with their threads, which may still be running
+    pthread_mutex_lock(&rings_mutex);
+    drain_rings();
+    if (log_file) fclose(log_file);
+    log_file = NULL;
+    pthread_mutex_unlock(&rings_mutex);
+}
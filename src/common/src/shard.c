@@ -0,0 +1,89 @@
+#include "shard.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+int shard_is_root(const char *path) {
+    return !path || path[strspn(path, "/")] == '\0';
+}
+
+// Hash of the first path component
+uint32_t shard_for_path(const char *path, uint32_t count) {
+    if (count < 2 || shard_is_root(path)) return 0;
+
+    const char *component = path + strspn(path, "/");
+    return fnv_update(FNV_OFFSET, component, strcspn(component, "/")) % count;
+}
+
+ErrorCode shard_parse_list(const char *list, ShardAddress *shards, uint32_t max, uint32_t *count) {
+    if (!list || !shards || !count) return ERR_INVALID_ARGUMENT;
+
+    *count = 0;
+    const char *item = list;
+    while (*item) {
+        size_t len = strcspn(item, ",");
+        const char *colon = memchr(item, ':', len);
+        if (!colon || colon == item || colon + 1 == item + len || *count >= max) return ERR_INVALID_ARGUMENT;
+
+        size_t host_len = colon - item;
+        size_t port_len = item + len - (colon + 1);
+        if (host_len >= sizeof(shards->host) || port_len >= sizeof(shards->port)) return ERR_INVALID_ARGUMENT;
+
+        ShardAddress *shard = &shards[(*count)++];
+        memset(shard, 0, sizeof(*shard));
+        memcpy(shard->host, item, host_len);
+        memcpy(shard->port, colon + 1, port_len);
+
+        item += len;
+        if (*item == ',') item++;
+    }
+    return *count > 0 ? ERR_SUCCESS : ERR_INVALID_ARGUMENT;
+}
+
+ErrorCode shard_fetch_map(NetworkSocket *sock, uint32_t request_id, ShardAddress *shards, uint32_t max,
+                          uint32_t *count, ShardPeer *peer) {
+    if (!sock || !shards || !count) return ERR_INVALID_ARGUMENT;
+
+    MessageHeader request = {request_id, MSG_TYPE_GET_SHARD_MAP, 0};
+    if (network_socket_send(sock, &request, sizeof(request)) != sizeof(request)) return ERR_NETWORK_FAILURE;
+
+    MessageHeader reply;
+    if (network_socket_receive(sock, &reply, sizeof(reply)) != sizeof(reply)) return ERR_NETWORK_FAILURE;
+    uint32_t payload_size = ntohl(reply.payload_size);
+
+    if (reply.type == MSG_TYPE_ERROR) {
+        uint32_t code;
+        if (payload_size != sizeof(code) || network_socket_receive(sock, &code, sizeof(code)) != sizeof(code))
+            return ERR_NETWORK_FAILURE;
+        return (ErrorCode)(int32_t)ntohl(code);
+    }
+
+    uint32_t count_net;
+    if (reply.request_id != request_id || reply.type != MSG_TYPE_SHARD_MAP || payload_size < sizeof(count_net))
+        return ERR_PROTOCOL_ERROR;
+    if (network_socket_receive(sock, &count_net, sizeof(count_net)) != sizeof(count_net)) return ERR_NETWORK_FAILURE;
+
+    uint32_t shard_count = ntohl(count_net);
+    size_t listed = sizeof(count_net) + (size_t)shard_count * sizeof(ShardAddress);
+    if (shard_count > max || (payload_size != listed && payload_size != listed + sizeof(ShardPeer)))
+        return ERR_PROTOCOL_ERROR;
+    if (shard_count > 0 &&
+        network_socket_receive(sock, shards, shard_count * sizeof(ShardAddress)) != (ssize_t)(shard_count * sizeof(ShardAddress)))
+        return ERR_NETWORK_FAILURE;
+
+    ShardPeer paired;
+    memset(&paired, 0, sizeof(paired));
+    if (payload_size > listed && network_socket_receive(sock, &paired, sizeof(paired)) != sizeof(paired))
+        return ERR_NETWORK_FAILURE;
+    paired.peer.host[sizeof(paired.peer.host) - 1] = '\0';
+    paired.peer.port[sizeof(paired.peer.port) - 1] = '\0';
+    if (peer) *peer = paired;
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+        shards[i].host[sizeof(shards[i].host) - 1] = '\0';
+        shards[i].port[sizeof(shards[i].port) - 1] = '\0';
+    }
+    *count = shard_count;
+    return ERR_SUCCESS;
+}
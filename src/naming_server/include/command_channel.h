@@ -0,0 +1,53 @@
+// src/naming_server/include/command_channel.h
+
+#ifndef COMMAND_CHANNEL_H
+#define COMMAND_CHANNEL_H
+
+#include "protocol.h"
+#include "errors.h"
+
+// Persistent command connections from the naming server to storage servers.
+// Each server gets one connection, dialed on first use. Commands queue up
+// per server and a writer thread sends everything queued as one
+// SS_COMMAND_BATCH frame, so a burst of mutations costs one round trip.
+// A reader thread matches SS_COMMAND_RESULTS back to commands by id and
+// passes on the SS_FILE_WRITTEN reports of watched paths. Callbacks run on
+// a few shared completion workers, so one that updates the tree or pushes
+// to clients does not hold up the replies read after it.
+
+// How long command_execute waits for a completion
+#define COMMAND_TIMEOUT_MS 10000
+
+// Threads running command callbacks
+#define COMMAND_COMPLETION_WORKERS 4
+
+// Called once per command with its outcome, from a completion worker. If
+// the channel fails first, a command never sent gets
+// ERR_NETWORK_FAILURE and one already sent gets ERR_TIMEOUT: the server may
+// or may not have carried it out.
+typedef void (*command_callback_t)(ErrorCode status, void *arg);
+
+// Called from the reader thread when the server at host:port reports a write
+// to a path under STORAGE_COMMAND_WATCH, and with path NULL once the channel
+// closed, taking every watch on that server with it
+typedef void (*write_notice_t)(const char *host, const char *port, const char *path);
+
+void command_channel_init();
+void command_channel_cleanup();
+
+// Where write reports go; none are passed on until this is set
+void command_channel_set_write_notice(write_notice_t notice);
+
+// Queue command for the storage server at host:port. The command_id field is
+// assigned here; every other field is in wire format. If the server cannot
+// be reached an error is returned and callback is never called.
+ErrorCode command_submit(const char *host, const char *port, const StorageCommand *command,
+                         command_callback_t callback, void *arg);
+
+// Submit and wait for the outcome
+ErrorCode command_execute(const char *host, const char *port, const StorageCommand *command);
+
+// Close the channel to a server, failing everything still outstanding on it
+void command_channel_drop(const char *host, const char *port);
+
+#endif // COMMAND_CHANNEL_H
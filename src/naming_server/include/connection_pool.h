@@ -0,0 +1,39 @@
+// src/naming_server/include/connection_pool.h
+
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include "network.h"
+
+// Pooled connections from the naming server to storage servers, keyed by
+// host:port. Each host has a fixed set of slots; idle connections sit on a
+// lock-free freelist so checkout and release never take a lock once the host
+// is known. A connection is checked for a closed or errored peer before it is
+// handed out again, and a sweeper closes connections idle for longer than
+// POOL_IDLE_TIMEOUT_MS while keeping POOL_MIN_IDLE per host.
+
+#define POOL_MAX_PER_HOST 64        // Pooled connections per host, idle or in use
+#define POOL_MAX_IDLE 16            // Idle connections kept per host
+#define POOL_MIN_IDLE 2             // Idle connections the sweeper never evicts
+#define POOL_IDLE_TIMEOUT_MS 30000
+#define POOL_SWEEP_MS 1000
+
+typedef struct PooledConnection PooledConnection;
+
+void connection_pool_init();
+void connection_pool_cleanup();
+
+// Reuse an idle connection to host:port or dial a new one. Returns NULL if
+// the server cannot be reached.
+PooledConnection *connection_pool_checkout(const char *host, const char *port);
+
+NetworkSocket *connection_pool_socket(PooledConnection *conn);
+
+// Hand a connection back. Pass reusable = 0 when a request failed midway and
+// the connection's framing can no longer be trusted; it is closed instead.
+void connection_pool_release(PooledConnection *conn, int reusable);
+
+// Close every idle connection to a server, e.g. once it is declared dead
+void connection_pool_drop_host(const char *host, const char *port);
+
+#endif // CONNECTION_POOL_H
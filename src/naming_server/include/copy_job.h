@@ -0,0 +1,27 @@
+// src/naming_server/include/copy_job.h
+
+#ifndef COPY_JOB_H
+#define COPY_JOB_H
+
+#include "operation_table.h"
+#include "errors.h"
+
+// Copies of files and directory trees, carried out by the storage servers.
+//
+// A COPY becomes a job of one task per file. The directories of the new tree
+// are made first; every file then gets a placement of its own and is pulled
+// by the chosen storage server straight from the one holding the source, so
+// a large tree spreads over every link at once instead of funnelling
+// through a single server or the naming server. At most COPY_JOB_WINDOW
+// tasks of a job are in flight; each file shows up in the tree as soon as
+// its copy lands.
+
+#define COPY_JOB_WINDOW 256
+
+// Copy source, a file or directory, to operation->path, which must not
+// exist. The operation is accepted once the copy is under way and finished
+// with the first failure, if any. On error nothing was started and the
+// operation is left to the caller.
+ErrorCode copy_job_start(Operation *operation, const char *source);
+
+#endif // COPY_JOB_H
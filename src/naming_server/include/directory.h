@@ -8,18 +8,33 @@
 #include <pthread.h>
 #include "errors.h"
 #include "protocol.h"
+#include "inventory.h"
+#include "server_index.h"
 
 // Directory entry structure
 typedef struct DirectoryEntry {
     char *name;
     int is_directory;
     FileMetadata *metadata;
+    FileMetadata *delegation;         // Owner of the whole subtree, if delegated
     struct DirectoryEntry *parent;
-    struct DirectoryEntry **children;
+    struct DirectoryEntry **children; // Sorted by name
     size_t child_count;
+    size_t child_capacity;
     pthread_rwlock_t lock;
+    uint32_t name_id;                 // Node in the name index (name_index.h)
+    HolderLink *holders;              // Reverse index links (server_index.h)
 } DirectoryEntry;
 
+// Called with the path of every file entry deleted or moved to another server
+typedef void (*directory_change_callback_t)(const char *path);
+void directory_set_change_callback(directory_change_callback_t callback);
+
+// Decides whether a path belongs in this tree; inventory records it rejects
+// are skipped. Used by sharded naming servers to keep only their own paths.
+typedef int (*directory_path_filter_t)(const char *path);
+void directory_set_path_filter(directory_path_filter_t filter);
+
 // Initialize the directory manager
 ErrorCode directory_init();
 
@@ -29,6 +44,17 @@ void directory_cleanup();
 // Lookup a path and return the corresponding directory entry
 ErrorCode directory_lookup(const char *path, DirectoryEntry **entry);
 
+// Lookup several paths at once, walking shared prefixes only once.
+// entries[i] and results[i] receive the outcome for paths[i].
+ErrorCode directory_lookup_batch(const char **paths, size_t count, DirectoryEntry **entries, ErrorCode *results);
+
+// List up to max_entries entries of a directory (or of its whole subtree when
+// recursive is set) in name order, starting after cursor. An empty cursor
+// starts from the beginning; next_cursor receives the cursor for the next page.
+ErrorCode directory_list(const char *path, int recursive, const char *cursor,
+                         ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                         char *next_cursor, size_t next_cursor_size, int *has_more);
+
 // Create a directory at the given path
 ErrorCode directory_create(const char *path);
 
@@ -38,6 +64,94 @@ ErrorCode directory_delete(const char *path);
 // Register a file with metadata at the given path
 ErrorCode directory_register_file(const char *path, FileMetadata *metadata);
 
+// Register every path of a storage server inventory owned by ip. The sorted
+// input lets consecutive paths reuse the entries of their common prefix.
+// A path another server already holds records ip as a copy. Records flagged
+// INVENTORY_FLAG_DELETED drop ip from the servers holding the path. A full
+// inventory replaces what ip holds: files it does not list drop ip, and
+// dropped counts them.
+ErrorCode directory_bulk_load(InventoryReader *reader, const char *ip, uint32_t *loaded, uint32_t *dropped);
+
+// Record that ip:port now holds a copy of the file at path, made for it by
+// the naming server. Leases on path are revoked so readers see the copy.
+// ERR_BUSY if the file already lists MAX_FILE_REPLICAS copies; the copy is
+// then the caller's to delete.
+ErrorCode directory_add_copy(const char *path, const char *ip, uint16_t port);
+
+// Forget the copy ip:port holds of path. ERR_NOT_FOUND if ip:port holds no
+// copy, including when it is the primary.
+ErrorCode directory_drop_copy(const char *path, const char *ip, uint16_t port);
+
+// Every server holding the file at path, the primary first. holders must
+// have room for MAX_FILE_REPLICAS + 1 records.
+ErrorCode directory_get_holders(const char *path, FileReplica *holders, uint32_t *count);
+
+// Make ip:port, which holds a copy of path, its primary. The old primary
+// keeps a copy.
+ErrorCode directory_promote(const char *path, const char *ip, uint16_t port);
+
+// What directory_fail_over did about the files of a failed server
+typedef struct {
+    uint32_t promoted;          // A copy took over as primary
+    uint32_t stranded;          // Primary with no usable copy
+    uint32_t copies_lost;       // Files that just lost one copy
+} DirectoryFailover;
+
+// Decides whether a holder may take over as primary
+typedef int (*directory_holder_usable_t)(const char *ip, uint16_t port);
+
+// Called for each file whose primary directory_fail_over moved
+typedef void (*directory_promoted_t)(const char *path, const char *ip, uint16_t port, void *ctx);
+
+// ip:port stopped answering: every file it is primary of hands over to its
+// first copy usable accepts, which takes O(files on ip:port). Leases on
+// the files that moved are revoked.
+ErrorCode directory_fail_over(const char *ip, uint16_t port, directory_holder_usable_t usable,
+                              directory_promoted_t promoted, void *ctx, DirectoryFailover *result);
+
+// Called for each file directory_drop_server took ip:port off
+typedef void (*directory_dropped_t)(const char *path, const char *ip, uint16_t port, void *ctx);
+
+// Forget every copy ip:port holds, such as those of a failed server that
+// will have missed writes by the time it returns. Files it is still primary
+// of keep it. *count is the number of files that lost it.
+ErrorCode directory_drop_server(const char *ip, uint16_t port, directory_dropped_t dropped, void *ctx,
+                                uint32_t *count);
+
+// Move the entry at source, with everything below it, to destination in
+// constant time; missing parents of destination are created. Leases are
+// left to the caller, who knows the prefix that moved.
+ErrorCode directory_rename(const char *source, const char *destination);
+
+// Collect the distinct servers holding any file at or below path, copies and
+// delegation owners included. ERR_INTERNAL_ERROR if there are more than
+// max_holders.
+ErrorCode directory_holders(const char *path, FileReplica *holders, uint32_t max_holders, uint32_t *count);
+
+// Delegate the subtree at prefix ("/" for everything) to a storage server.
+// Paths below it are resolved lazily instead of being registered up front.
+ErrorCode directory_delegate(const char *prefix, const char *ip, uint16_t port);
+
+// Longest-prefix match: find the owner of the deepest delegated subtree
+// containing path. ip must hold INET_ADDRSTRLEN bytes.
+ErrorCode directory_find_delegate(const char *path, char *ip, uint16_t *port);
+
+// Create (or refresh) the entry of a file discovered under a delegation
+ErrorCode directory_populate(const char *path, const char *ip, uint16_t port, uint64_t size, uint32_t permissions);
+
+// Visit every entry below the root in pre-order with its path (no leading
+// slash, "" for the root itself, which is visited first). The entry is
+// read-locked for the duration of the call, as are its ancestors.
+typedef void (*directory_visit_t)(const char *path, DirectoryEntry *entry, void *ctx);
+void directory_walk(directory_visit_t visit, void *ctx);
+
+// Drop every entry and delegation, leaving an empty root. Each file removed
+// is reported to the change callback.
+void directory_reset();
+
+// Fill out with the attributes of the entry at path, as LIST reports them
+ErrorCode directory_stat(const char *path, ListEntry *out);
+
 // Retrieve metadata for a file at the given path
 ErrorCode directory_get_metadata(const char *path, FileMetadata **metadata);
 
@@ -4,6 +4,8 @@
 #define HEALTH_H
 
 #include "errors.h"
+#include "protocol.h"
+#include <stdint.h>
 #include <time.h>
 
 // Structure to represent a storage server
@@ -13,8 +15,22 @@ typedef struct {
     time_t last_heartbeat;
     int load;
     int active; // 1 if active, 0 if inactive
+    uint32_t capacity_mb; // Reported storage capacity, 0 if unknown
+    uint32_t free_mb;
+    uint32_t read_latency_us;
+    uint32_t write_latency_us;
+    uint64_t bytes_in_per_sec;
+    uint64_t bytes_out_per_sec;
+    uint32_t queue_depth;
+    uint32_t open_streams;
+    uint64_t inventory_generation; // Last registered inventory, 0 if none
 } StorageServer;
 
+// A server is declared failed once a heartbeat is HEALTH_GRACE_MS overdue;
+// deadlines are checked every HEALTH_TICK_MS
+#define HEALTH_TICK_MS 100
+#define HEALTH_GRACE_MS 1500
+
 // Initialize the health monitoring system
 void health_init();
 
@@ -22,12 +38,42 @@ void health_init();
 void health_cleanup();
 
 // Receive a heartbeat from a storage server
-void health_receive_heartbeat(const char *host, const char *port, int load);
+void health_receive_heartbeat(const char *host, const char *port, const HeartbeatMessage *hb);
+
+// A heartbeat along with the peer address it arrived from
+typedef struct {
+    char host[64];
+    HeartbeatMessage message;
+} HeartbeatReport;
+
+// Apply a batch of heartbeats under a single acquisition of the registry
+void health_receive_heartbeats(const HeartbeatReport *reports, int count);
+
+// Servers with less free space than this take no new files
+#define HEALTH_MIN_FREE_MB 1024
+
+// Relative cost of sending more work to a server, lower is better; a server
+// that is nearly full costs HEALTH_COST_EXCLUDED
+#define HEALTH_COST_EXCLUDED 1e9
+double health_server_cost(const StorageServer *server);
+
+// Copy the registry record of host:port
+ErrorCode health_get_server(const char *host, const char *port, StorageServer *server);
+
+// Inventory generation last registered by a storage server (0 if unknown)
+uint64_t health_get_generation(const char *host, const char *port);
+
+// Record a successful registration of the given inventory generation
+void health_set_generation(const char *host, const char *port, uint64_t generation);
 
 // Get the list of all storage servers
 ErrorCode health_get_servers(StorageServer **servers_out, int *count_out);
 
-// Check for inactive servers periodically
+// Called for every server that stops sending heartbeats
+typedef void (*health_failure_callback_t)(const char *host, const char *port);
+void health_set_failure_callback(health_failure_callback_t callback);
+
+// Expire missed heartbeat deadlines as they fall due
 void *health_monitor(void *arg);
 
 #endif // HEALTH_H
\ No newline at end of file
@@ -0,0 +1,28 @@
+// src/naming_server/include/heartbeat_channel.h
+
+#ifndef HEARTBEAT_CHANNEL_H
+#define HEARTBEAT_CHANNEL_H
+
+#include "network.h"
+#include "protocol.h"
+#include "errors.h"
+
+// Storage servers keep one control connection open and stream heartbeats
+// down it. Once a connection has sent its first heartbeat it is handed to a
+// single epoll thread, which reads every ready connection and applies the
+// heartbeats it collected to the health registry in one batch.
+
+#define HEARTBEAT_CHANNEL_MAX_EVENTS 256
+// A channel silent for this long is closed; the server will reconnect
+#define HEARTBEAT_CHANNEL_IDLE_MS (HEARTBEAT_INTERVAL_MS * 4 + 5000)
+
+// Start the channel thread
+ErrorCode heartbeat_channel_init();
+
+// Take ownership of the connection of the storage server at ip:port
+ErrorCode heartbeat_channel_adopt(NetworkSocket *sock, const char *ip, const char *port);
+
+// Stop the thread and close every channel
+void heartbeat_channel_cleanup();
+
+#endif // HEARTBEAT_CHANNEL_H
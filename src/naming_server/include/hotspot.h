@@ -0,0 +1,49 @@
+// src/naming_server/include/hotspot.h
+
+#ifndef HOTSPOT_H
+#define HOTSPOT_H
+
+#include "errors.h"
+#include <stdint.h>
+
+// Hot-file detection and extra copies.
+//
+// Every location lookup feeds a space-saving sketch that keeps exponentially
+// decayed counts for the HOTSPOT_COUNTERS most looked-up paths. Once a file
+// is looked up at HOTSPOT_HOT_RATE or more, the naming server has the least
+// loaded storage servers not already holding it pull HOTSPOT_EXTRA_COPIES
+// copies and lists them as replicas, so readers spread across them. When the
+// rate falls to HOTSPOT_COOL_RATE the copies leave the replica set and are
+// deleted a tick later, once readers told about them had a chance to finish.
+//
+// Copies are one-time pulls, so they are only made while the primary
+// watches the file for writes. The first write it reports (or the loss of
+// its command channel) takes the copies out of the replica set at once, and
+// no new ones are made for HOTSPOT_WRITE_QUIET_TICKS.
+
+#define HOTSPOT_COUNTERS 256                // Paths tracked by the sketch
+#define HOTSPOT_TICK_MS 1000                // Decay and promotion interval
+#define HOTSPOT_DECAY 0.875                 // Share of a count kept each tick, a half-life of ~5 ticks
+#define HOTSPOT_HOT_RATE 20.0               // Lookups per second to gain copies
+#define HOTSPOT_COOL_RATE 5.0               // Lookups per second to lose them
+#define HOTSPOT_EXTRA_COPIES 2              // Copies made of a hot file
+#define HOTSPOT_MAX_PROMOTED 64             // Hot files holding copies at once
+#define HOTSPOT_WRITE_QUIET_TICKS 5         // Ticks without copies after a write
+
+// Start the decay and promotion thread
+void hotspot_init();
+
+// Stop it. Copies already made stay listed as replicas.
+void hotspot_cleanup();
+
+// Count a location lookup of path
+void hotspot_record(const char *path);
+
+// Whether ip:port holds a hot copy of path, made here rather than placed
+int hotspot_holds_copy(const char *path, const char *ip, uint16_t port);
+
+// The primary at host:port reported a write to the watched path, or lost its
+// command channel if path is NULL. Matches write_notice_t.
+void hotspot_file_written(const char *host, const char *port, const char *path);
+
+#endif // HOTSPOT_H
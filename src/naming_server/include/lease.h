@@ -0,0 +1,39 @@
+// src/naming_server/include/lease.h
+
+#ifndef LEASE_H
+#define LEASE_H
+
+#include "network.h"
+#include "errors.h"
+#include <stdint.h>
+
+// Location lease lifetime handed to clients
+#define LEASE_TTL_MS 30000
+
+// How long an invalidation waits for a holder that stopped reading before
+// the holder is disconnected
+#define LEASE_PUSH_TIMEOUT_MS 100
+
+// Initialize the lease table
+void lease_init();
+
+// Drop every outstanding lease
+void lease_cleanup();
+
+// Record that holder was told path lives on host:port at version; returns
+// the lease lifetime to put in the reply
+uint32_t lease_grant(const char *path, NetworkSocket *holder, const char *host, uint16_t port, uint64_t version);
+
+// Push LOCATION_INVALIDATE to every live holder of path and forget its leases
+void lease_invalidate(const char *path);
+
+// Same for every lease on prefix or a path below it
+void lease_invalidate_prefix(const char *prefix);
+
+// Same for every lease pointing at a storage server
+void lease_invalidate_server(const char *host, const char *port);
+
+// Forget the leases of a connection that is about to close
+void lease_release_holder(NetworkSocket *holder);
+
+#endif // LEASE_H
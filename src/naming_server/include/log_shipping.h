@@ -0,0 +1,111 @@
+// src/naming_server/include/log_shipping.h
+
+#ifndef LOG_SHIPPING_H
+#define LOG_SHIPPING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "network.h"
+#include "protocol.h"
+#include "errors.h"
+
+// Hot standby through log shipping.
+//
+// The primary appends every namespace mutation it applies (a file placed or
+// removed, an inventory registered, a subtree delegated) to an in-memory
+// log. A standby naming server subscribes over TCP with the last record it
+// applied and the primary streams every record after it; if those are no
+// longer held, or the standby followed another primary, it first sends a
+// snapshot of the whole tree and registry. The standby applies the records
+// to its own tree, answers lookups read-only, and takes over once the
+// primary has been silent for LOG_TAKEOVER_MS.
+
+#define LOG_MAX_BYTES (64 * 1024 * 1024)    // Log kept for standbys that reconnect
+#define LOG_FRAME_BYTES (256 * 1024)        // Records batched into one LOG_RECORDS frame
+#define LOG_KEEPALIVE_MS 100                // An idle primary sends a keepalive this often
+#define LOG_TAKEOVER_MS 500                 // Silence after which the standby takes over
+#define LOG_RETRY_MS 50                     // Standby reconnect interval
+
+typedef enum {
+    LOG_OP_POPULATE = 1,        // LogPlacement: ip:port holds path
+    LOG_OP_DELETE = 2,          // LogPlacement, path only
+    LOG_OP_MKDIR = 3,           // LogPlacement, path only
+    LOG_OP_DELEGATE = 4,        // LogPlacement: ip:port owns the subtree at path
+    LOG_OP_INVENTORY = 5,       // Registering server ip (INET_ADDRSTRLEN bytes), then an inventory blob
+    LOG_OP_GENERATION = 6,      // LogGeneration
+    LOG_OP_SNAPSHOT_BEGIN = 7,  // uint64_t epoch (network order); the standby empties its tree
+    LOG_OP_SNAPSHOT_END = 8,    // The snapshot stands for every record up to seq
+    LOG_OP_KEEPALIVE = 9,       // Nothing new; seq is the last record
+    LOG_OP_DROP_COPY = 10,      // LogPlacement: ip:port no longer holds a copy of path
+    LOG_OP_RENAME = 11,         // LogRename
+    LOG_OP_PROMOTE = 12,        // LogPlacement: ip:port, a copy of path, becomes its primary
+} LogOp;
+
+// Every record starts with this header; length bytes of body follow
+typedef struct {
+    uint64_t seq;               // Network order, 0 for snapshot contents
+    uint8_t op;                 // LogOp
+    uint32_t length;            // Network order
+} __attribute__((packed)) LogRecordHeader;
+
+typedef struct {
+    char path[256];
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;              // Network order
+    uint64_t size;              // Network order
+    uint32_t permissions;       // Network order
+} __attribute__((packed)) LogPlacement;
+
+typedef struct {
+    char source[256];
+    char destination[256];
+} __attribute__((packed)) LogRename;
+
+typedef struct {
+    char ip[INET_ADDRSTRLEN];
+    char port[32];
+    uint64_t generation;        // Network order
+} __attribute__((packed)) LogGeneration;
+
+// LOG_SUBSCRIBE payload. Records are only resumed within the same epoch,
+// which a primary draws at startup; any other epoch gets a snapshot.
+typedef struct {
+    uint64_t epoch;             // Network order, 0 before the first snapshot
+    uint64_t last_seq;          // Network order, last record applied
+    uint16_t client_port;       // Network order, where the standby serves clients
+} __attribute__((packed)) LogSubscribe;
+
+// Start the log. Mutations are recorded from then on, whatever the role.
+ErrorCode log_shipping_init();
+
+// Stop shipping and drop the log
+void log_shipping_cleanup();
+
+// Records must reach the log in the order their mutations reached the
+// tree. Take this before applying a mutation, ahead of any tree lock, and
+// release it once the mutation's record is appended.
+void log_shipping_begin_mutation();
+void log_shipping_end_mutation();
+
+// Record a namespace mutation just applied to the tree
+void log_shipping_append_placement(LogOp op, const char *path, const char *ip, uint16_t port,
+                                   uint64_t size, uint32_t permissions);
+void log_shipping_append_rename(const char *source, const char *destination);
+void log_shipping_append_inventory(const char *ip, const uint8_t *blob, size_t blob_size);
+
+// Serve a LOG_SUBSCRIBE from the standby at ip on its own thread. Returns
+// ERR_SUCCESS once the connection was taken over and must not be touched.
+ErrorCode log_shipping_adopt(NetworkSocket *sock, MessageHeader *header, const char *ip);
+
+// Become the standby of the primary at host:port; client_port is where this
+// server answers clients, advertised to them by the primary
+ErrorCode log_shipping_follow(const char *host, const char *port, uint16_t client_port);
+
+// 1 while this server is a standby, 0 once it is (or took over as) primary
+int log_shipping_is_standby();
+
+// The other half of this server's primary/standby pair. ERR_NOT_FOUND if it
+// has no standby subscribed and follows no primary.
+ErrorCode log_shipping_get_peer(ShardPeer *peer);
+
+#endif // LOG_SHIPPING_H
@@ -0,0 +1,57 @@
+// src/naming_server/include/name_index.h
+
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include "errors.h"
+#include "protocol.h"
+#include <stddef.h>
+#include <stdint.h>
+
+struct DirectoryEntry;
+
+// Name search over the directory tree.
+//
+// Every entry's own name, one path component, is indexed by the trigrams it
+// contains. Nodes get increasing ids, so each trigram's list of ids stays
+// sorted and a query walks the shortest list among its trigrams, probing
+// the others, before checking the survivors against the pattern. Nodes keep
+// their parent's id rather than a path, so a rename only touches the moved
+// entry; paths are rebuilt from the parent links for results. Removed
+// nodes linger in the trigram lists until they outnumber the live ones
+// and the index is rebuilt.
+//
+// The tree keeps the index current as entries come and go (directory.c);
+// the root is node NAME_INDEX_ROOT and never indexed itself.
+
+#define NAME_INDEX_ROOT 0
+#define NAME_INDEX_BUCKETS 65536
+#define NAME_INDEX_SCAN_BUDGET 65536        // Candidates checked per page at most
+#define NAME_INDEX_MIN_REBUILD 4096         // Removed nodes before a rebuild is worth it
+
+void name_index_init();
+void name_index_cleanup();
+
+// Index entry, a new child of parent, under its name; sets entry->name_id
+void name_index_add(struct DirectoryEntry *entry, struct DirectoryEntry *parent);
+
+// entry is about to be freed. Its children must have gone first.
+void name_index_remove(struct DirectoryEntry *entry);
+
+// entry was renamed or moved under another parent
+void name_index_move(struct DirectoryEntry *entry);
+
+// Write the path of entry, without a leading slash, into path. Returns 0
+// if it is not indexed or does not fit.
+int name_index_path(struct DirectoryEntry *entry, char *path, size_t size);
+
+// Fill the path of up to max_entries entries whose name matches pattern,
+// resuming after cursor (0 to start). Results come in node order. A page
+// may stop short of max_entries, with *has_more set, once
+// NAME_INDEX_SCAN_BUDGET candidates have been checked. A rebuild between
+// pages renumbers the nodes, so a search spanning one may repeat or miss
+// entries.
+ErrorCode name_index_search(const char *pattern, SearchMode mode, uint32_t cursor, ListEntry *entries,
+                            uint32_t max_entries, uint32_t *count, uint32_t *next_cursor, int *has_more);
+
+#endif // NAME_INDEX_H
@@ -0,0 +1,55 @@
+// src/naming_server/include/operation_table.h
+
+#ifndef OPERATION_TABLE_H
+#define OPERATION_TABLE_H
+
+#include "network.h"
+#include "errors.h"
+#include <stdint.h>
+
+// Namespace mutations accepted from clients and still being carried out by
+// a storage server. The client is told right away that its request was
+// accepted and gets the outcome pushed as OP_COMPLETE once the storage
+// server answers, so no connection thread waits on a storage server. At
+// most one operation runs on a path at a time, and a COPY or RENAME holds
+// every path below its own as well.
+
+// How long an OP_COMPLETE push waits for a client that stopped reading
+// before the client is disconnected
+#define OPERATION_PUSH_TIMEOUT_MS 1000
+
+typedef struct Operation {
+    uint64_t id;
+    uint32_t request_id;
+    uint8_t type;               // MSG_TYPE_CREATE, MSG_TYPE_DELETE, MSG_TYPE_COPY or MSG_TYPE_RENAME
+    char path[256];             // Destination of a COPY or RENAME
+    char source[256];           // Source of a COPY or RENAME, empty otherwise
+    char host[256];             // Storage server carrying it out
+    char port[32];
+    uint32_t mode;              // Permissions of a CREATE
+    ErrorCode status;           // Outcome held back while a failed CREATE is undone
+    NetworkSocket *holder;      // NULL once the client disconnected
+    struct Operation *next;
+} Operation;
+
+// Claim path, and source unless NULL, for a new operation of holder's.
+// ERR_BUSY if another operation in flight holds either of them, or for a
+// COPY or RENAME, any path below them.
+ErrorCode operation_begin(NetworkSocket *holder, uint32_t request_id, uint8_t type, const char *path,
+                          const char *source, Operation **operation);
+
+// Answer the request with OP_ACCEPTED; operation_finish must follow
+ErrorCode operation_accept(Operation *operation);
+
+// Push the outcome of an accepted operation to its client, if still
+// connected, and release its path. A client that cannot take the push
+// within OPERATION_PUSH_TIMEOUT_MS is disconnected.
+void operation_finish(Operation *operation, ErrorCode status);
+
+// Release the path of an operation that was never accepted
+void operation_abandon(Operation *operation);
+
+// The holder is about to close; the outcomes of its operations are dropped
+void operation_release_holder(NetworkSocket *holder);
+
+#endif // OPERATION_TABLE_H
@@ -0,0 +1,41 @@
+// src/naming_server/include/placement.h
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "health.h"
+#include "errors.h"
+
+// Consistent-hash placement of new files over the active storage servers.
+// Every server owns virtual nodes on a 64-bit ring in proportion to its
+// capacity; a path goes to the first virtual node at or after its hash, so
+// adding or removing a server only moves the paths on its own arcs.
+
+#define PLACEMENT_VNODES_PER_UNIT 160       // Virtual nodes per capacity unit
+#define PLACEMENT_CAPACITY_UNIT_MB 65536    // 64 GiB per unit
+#define PLACEMENT_MAX_UNITS 16              // Caps a server's share of the ring
+#define PLACEMENT_CHOICES 2                 // Successors weighed by load
+
+typedef struct PlacementRing PlacementRing;
+
+// Build a ring over the active entries of servers
+PlacementRing *placement_ring_build(const StorageServer *servers, int count);
+void placement_ring_free(PlacementRing *ring);
+
+// Index into the build-time servers array of the owner of key, or -1 if the
+// ring is empty
+int placement_ring_lookup(const PlacementRing *ring, const char *key);
+
+// Up to max distinct owners of key in clockwise order from its hash, as
+// indices into the build-time servers array. Returns how many were found.
+int placement_ring_candidates(const PlacementRing *ring, const char *key, int *out, int max);
+
+// Pick the storage server for a new file at path among the servers that are
+// currently active: the least loaded of the first PLACEMENT_CHOICES owners
+// clockwise on the ring. The ring is rebuilt only when membership changes.
+ErrorCode placement_select(const char *path, char *host, size_t host_size, char *port, size_t port_size);
+
+// Release the cached ring
+void placement_cleanup();
+
+#endif // PLACEMENT_H
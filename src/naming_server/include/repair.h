@@ -0,0 +1,53 @@
+// src/naming_server/include/repair.h
+
+#ifndef REPAIR_H
+#define REPAIR_H
+
+#include "errors.h"
+#include "protocol.h"
+#include <stdint.h>
+
+// Re-replication of files that lost copies with a storage server.
+//
+// When a server fails, every file it held (found through its reverse index,
+// server_index.h) that is left with fewer than the target number of live
+// copies is queued, the ones with the fewest live copies first. A scheduler
+// thread has storage servers pull copies from a live holder, at most
+// REPAIR_PER_SOURCE copies reading from and REPAIR_PER_DESTINATION writing
+// to any one server at a time, and lists each finished copy as a replica.
+// Files are looked at afresh before every copy, so one that got its copies
+// back some other way, or went away, simply leaves the queue. Hot copies
+// (hotspot.h) do not count toward the target.
+//
+// Repair copies are one-time pulls, so they are only made from a primary
+// that reports every write (a WATCH of every path). A write to a file drops
+// its repair copies and queues it again; a copy of a file written while it
+// was made is deleted unlisted. When a primary's command channel closes,
+// every file copied from it counts as written once it is watched again.
+
+#define REPAIR_TARGET_COPIES 2              // Default live copies to restore, the primary included
+#define REPAIR_TICK_MS 100                  // Retry interval for files waiting on busy servers
+#define REPAIR_MAX_COPYING 64               // Copies under way at once
+#define REPAIR_PER_SOURCE 4                 // Copies read from one server at once
+#define REPAIR_PER_DESTINATION 4            // Copies written to one server at once
+#define REPAIR_SCAN_LIMIT 1024              // Queued files considered per tick
+#define REPAIR_MAX_ATTEMPTS 3               // Failed copies before a file is given up on
+#define REPAIR_PROGRESS_MS 1000             // Progress line interval while repairing
+
+// Start the scheduler, restoring files to target_copies live copies
+void repair_init(uint32_t target_copies);
+
+// Stop it. Copies under way complete on their storage servers unlisted.
+void repair_cleanup();
+
+// ip:port failed: queue every file it held that is now short of copies
+void repair_server_lost(const char *ip, uint16_t port);
+
+// host:port reported a write to path, or lost its command channel if path
+// is NULL. Matches write_notice_t.
+void repair_file_written(const char *host, const char *port, const char *path);
+
+// Current progress, in host order
+void repair_get_status(RepairStatus *status);
+
+#endif // REPAIR_H
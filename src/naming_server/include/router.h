@@ -13,7 +13,16 @@ void router_init();
 // Clean up the router module
 void router_cleanup();
 
-// Forward a client request to a storage server
+// Select the storage server that should hold a new file at path
+ErrorCode router_select_server(const char *path, char *host, size_t host_size, char *port, size_t port_size);
+
+// Forward a client READ or WRITE to the primary the tree records for its
+// file. Returns ERR_SUCCESS once the client has its answer, an error reply
+// included; anything else leaves the client connection out of step, so it
+// must be closed.
 ErrorCode router_forward_request(NetworkSocket *client_sock, MessageHeader *header);
 
+// Ask a storage server whether it holds path and fetch its size and permissions
+ErrorCode router_probe_file(const char *host, const char *port, const char *path, uint64_t *size, uint32_t *permissions);
+
 #endif // ROUTER_H
\ No newline at end of file
@@ -0,0 +1,56 @@
+// src/naming_server/include/server_index.h
+
+#ifndef SERVER_INDEX_H
+#define SERVER_INDEX_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+struct DirectoryEntry;
+struct ServerFiles;
+
+// Reverse index from storage servers to the files they hold.
+//
+// Each file entry carries one HolderLink per server holding it, primary
+// and copies alike, threaded onto that server's list. Finding what a
+// server held is then O(files on that server) rather than a walk of the
+// whole tree. The tree resyncs an entry's links whenever its set of holders
+// changes (directory.c).
+
+typedef struct HolderLink {
+    struct DirectoryEntry *entry;
+    struct ServerFiles *server;
+    struct HolderLink *entry_next;  // Next holder of the same entry
+    struct HolderLink *prev;        // Neighbours on the server's list
+    struct HolderLink *next;
+    uint32_t visit;                 // Last server_index_visit pass to see it
+    uint32_t mark;                  // Last server_index_mark stamp it got
+} HolderLink;
+
+// Relink entry to the servers its metadata names now. Caller holds the
+// entry's write lock, or the entry is not in the tree.
+void server_index_sync(struct DirectoryEntry *entry);
+
+// Unlink entry from every server; it is about to be freed
+void server_index_remove(struct DirectoryEntry *entry);
+
+// Number of files ip:port holds
+uint32_t server_index_count(const char *ip, uint16_t port);
+
+// Call visit for every file ip:port holds, with the entry write-locked.
+// Entries busy elsewhere are retried until each was visited once. visit
+// may reorder the entry's holders but must not change who they are.
+typedef void (*server_index_visit_t)(struct DirectoryEntry *entry, void *ctx);
+void server_index_visit(const char *ip, uint16_t port, server_index_visit_t visit, void *ctx);
+
+// A full inventory replaces what a server holds: each file it reports is
+// marked with a fresh stamp, and the ones left unmarked are then visited,
+// the same way as server_index_visit, to be dropped. server_index_mark
+// needs the entry's write lock.
+uint32_t server_index_new_stamp();
+void server_index_mark(struct DirectoryEntry *entry, const char *ip, uint16_t port, uint32_t stamp);
+void server_index_visit_unmarked(const char *ip, uint16_t port, uint32_t stamp, server_index_visit_t visit, void *ctx);
+
+void server_index_cleanup();
+
+#endif // SERVER_INDEX_H
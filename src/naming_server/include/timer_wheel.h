@@ -0,0 +1,47 @@
+// src/naming_server/include/timer_wheel.h
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// Hierarchical timer wheel: TIMER_WHEEL_LEVELS rings of TIMER_WHEEL_SLOTS
+// slots, each level's slot spanning a whole turn of the level below.
+// Scheduling and cancelling are O(1); a timer far out sits in a coarse slot
+// and is cascaded down as its deadline comes near. Not thread safe, callers
+// serialize access themselves.
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+// Embedded in whatever is being timed
+typedef struct TimerEntry {
+    struct TimerEntry *next;
+    struct TimerEntry *prev;
+    uint64_t expires_tick;
+    void *data;                 // Owner, handed back on expiry
+} TimerEntry;
+
+typedef struct TimerWheel TimerWheel;
+
+typedef void (*timer_expired_t)(TimerEntry *entry, void *arg);
+
+// A wheel whose ticks are tick_ms long, starting at now_ms
+TimerWheel *timer_wheel_create(uint64_t tick_ms, uint64_t now_ms);
+void timer_wheel_destroy(TimerWheel *wheel);
+
+// Arm entry to expire at expires_ms, moving it if it was already armed
+void timer_wheel_schedule(TimerWheel *wheel, TimerEntry *entry, uint64_t expires_ms);
+
+// Disarm entry; a no-op if it is not armed
+void timer_wheel_cancel(TimerWheel *wheel, TimerEntry *entry);
+
+// Whether entry is armed
+int timer_wheel_pending(const TimerEntry *entry);
+
+// Run every tick up to now_ms, calling expired for each timer that falls due.
+// Entries are disarmed before the call and may be rescheduled from it.
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms, timer_expired_t expired, void *arg);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,483 @@
+// src/naming_server/src/command_channel.c
+
+#include "command_channel.h"
+#include "hash.h"
+#include "network.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define CHANNEL_BUCKETS 256
+#define INFLIGHT_BUCKETS 1024
+
+typedef struct PendingCommand {
+    StorageCommand command;
+    uint32_t id;
+    command_callback_t callback;
+    void *arg;
+    ErrorCode status;           // Set once it completes
+    struct PendingCommand *next;
+} PendingCommand;
+
+typedef struct CommandChannel {
+    char host[64];
+    char port[32];
+    NetworkSocket *sock;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;                        // Signals the writer
+    PendingCommand *queue_head;                 // Waiting to be sent
+    PendingCommand *queue_tail;
+    PendingCommand *inflight[INFLIGHT_BUCKETS]; // Sent, keyed by id
+    int closed;
+    pthread_t writer;
+    struct CommandChannel *next;                // Bucket chain
+} CommandChannel;
+
+static CommandChannel *channels[CHANNEL_BUCKETS];
+static pthread_rwlock_t channels_lock = PTHREAD_RWLOCK_INITIALIZER;
+static uint32_t next_command_id = 0;
+static write_notice_t write_notice = NULL;
+
+// Completed commands waiting for a completion worker to run their callback
+static PendingCommand *completed_head = NULL;
+static PendingCommand *completed_tail = NULL;
+static pthread_mutex_t completed_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t completed_cond = PTHREAD_COND_INITIALIZER;
+static int completion_workers = 0;
+
+static uint32_t hash_server(const char *host, const char *port) {
+    return fnv_hash_server(host, port) % CHANNEL_BUCKETS;
+}
+
+// Caller holds channels_lock. Channels being torn down are skipped; they
+// leave the table on their own.
+static CommandChannel *find_channel(const char *host, const char *port) {
+    for (CommandChannel *channel = channels[hash_server(host, port)]; channel; channel = channel->next) {
+        if (!__atomic_load_n(&channel->closed, __ATOMIC_ACQUIRE) && strcmp(channel->host, host) == 0 && strcmp(channel->port, port) == 0) {
+            return channel;
+        }
+    }
+    return NULL;
+}
+
+// Queue pending on channel unless it is closing. Returns 1 if queued.
+static int enqueue(CommandChannel *channel, PendingCommand *pending) {
+    pthread_mutex_lock(&channel->mutex);
+    int queued = !channel->closed;
+    if (queued) {
+        if (channel->queue_tail) {
+            channel->queue_tail->next = pending;
+        } else {
+            channel->queue_head = pending;
+        }
+        channel->queue_tail = pending;
+        pthread_cond_signal(&channel->cond);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return queued;
+}
+
+static void *channel_writer(void *arg) {
+    CommandChannel *channel = arg;
+    size_t frame_capacity = sizeof(MessageHeader) + sizeof(uint32_t) + MAX_COMMAND_BATCH * sizeof(StorageCommand);
+    uint8_t *frame = malloc(frame_capacity);
+    if (!frame) {
+        shutdown(network_socket_get_fd(channel->sock), SHUT_RDWR);
+        return NULL;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&channel->mutex);
+        while (!channel->queue_head && !channel->closed) {
+            pthread_cond_wait(&channel->cond, &channel->mutex);
+        }
+        if (channel->closed) {
+            pthread_mutex_unlock(&channel->mutex);
+            break;
+        }
+
+        // Everything queued while the previous frame was in flight goes out
+        // together; commands move to the in-flight table before the send so
+        // a fast reply always finds them
+        uint32_t count = 0;
+        uint8_t *cursor = frame + sizeof(MessageHeader) + sizeof(uint32_t);
+        uint32_t first_id = channel->queue_head->id;
+        while (channel->queue_head && count < MAX_COMMAND_BATCH) {
+            PendingCommand *pending = channel->queue_head;
+            channel->queue_head = pending->next;
+            memcpy(cursor, &pending->command, sizeof(StorageCommand));
+            cursor += sizeof(StorageCommand);
+            count++;
+
+            PendingCommand **bucket = &channel->inflight[pending->id % INFLIGHT_BUCKETS];
+            pending->next = *bucket;
+            *bucket = pending;
+        }
+        if (!channel->queue_head) channel->queue_tail = NULL;
+        pthread_mutex_unlock(&channel->mutex);
+
+        MessageHeader *header = (MessageHeader *)frame;
+        header->request_id = first_id;
+        header->type = MSG_TYPE_SS_COMMAND_BATCH;
+        header->payload_size = htonl((uint32_t)(cursor - frame - sizeof(MessageHeader)));
+        uint32_t count_net = htonl(count);
+        memcpy(frame + sizeof(MessageHeader), &count_net, sizeof(count_net));
+
+        size_t frame_size = cursor - frame;
+        if (network_socket_send(channel->sock, frame, frame_size) != (ssize_t)frame_size) {
+            // The reader notices the dead socket and fails what is left
+            shutdown(network_socket_get_fd(channel->sock), SHUT_RDWR);
+            break;
+        }
+    }
+
+    free(frame);
+    return NULL;
+}
+
+// Hand pending to the completion workers, which run its callback and free
+// it. Without any workers the callback runs here.
+static void complete(PendingCommand *pending, ErrorCode status) {
+    pending->status = status;
+    pending->next = NULL;
+    pthread_mutex_lock(&completed_mutex);
+    int queued = completion_workers > 0;
+    if (queued) {
+        if (completed_tail) {
+            completed_tail->next = pending;
+        } else {
+            completed_head = pending;
+        }
+        completed_tail = pending;
+        pthread_cond_signal(&completed_cond);
+    }
+    pthread_mutex_unlock(&completed_mutex);
+    if (!queued) {
+        pending->callback(status, pending->arg);
+        free(pending);
+    }
+}
+
+static void *completion_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&completed_mutex);
+        while (!completed_head) {
+            pthread_cond_wait(&completed_cond, &completed_mutex);
+        }
+        PendingCommand *pending = completed_head;
+        completed_head = pending->next;
+        if (!completed_head) completed_tail = NULL;
+        pthread_mutex_unlock(&completed_mutex);
+
+        pending->callback(pending->status, pending->arg);
+        free(pending);
+    }
+    return NULL;
+}
+
+// Take the command with the given id out of the in-flight table
+static PendingCommand *take_inflight(CommandChannel *channel, uint32_t id) {
+    pthread_mutex_lock(&channel->mutex);
+    PendingCommand **link = &channel->inflight[id % INFLIGHT_BUCKETS];
+    while (*link && (*link)->id != id) {
+        link = &(*link)->next;
+    }
+    PendingCommand *pending = *link;
+    if (pending) *link = pending->next;
+    pthread_mutex_unlock(&channel->mutex);
+    return pending;
+}
+
+void command_channel_set_write_notice(write_notice_t notice) {
+    __atomic_store_n(&write_notice, notice, __ATOMIC_RELEASE);
+}
+
+static void report_write(CommandChannel *channel, const char *path) {
+    write_notice_t notice = __atomic_load_n(&write_notice, __ATOMIC_ACQUIRE);
+    if (notice) notice(channel->host, channel->port, path);
+}
+
+// Receive completions until the connection fails, then tear the channel down
+static void *channel_reader(void *arg) {
+    CommandChannel *channel = arg;
+
+    while (1) {
+        MessageHeader header;
+        if (network_socket_receive(channel->sock, &header, sizeof(header)) != sizeof(header)) break;
+
+        uint32_t payload_size = ntohl(header.payload_size);
+        if (header.type == MSG_TYPE_SS_FILE_WRITTEN && payload_size == sizeof(FileWritten)) {
+            FileWritten written;
+            if (network_socket_receive(channel->sock, &written, sizeof(written)) != sizeof(written)) break;
+            written.path[sizeof(written.path) - 1] = '\0';
+            report_write(channel, written.path);
+            continue;
+        }
+        if (header.type != MSG_TYPE_SS_COMMAND_RESULTS || payload_size < sizeof(uint32_t) ||
+            payload_size > sizeof(uint32_t) + MAX_COMMAND_BATCH * sizeof(StorageCommandResult)) {
+            fprintf(stderr, "Unexpected reply on command channel to %s:%s\n", channel->host, channel->port);
+            break;
+        }
+
+        uint8_t *payload = malloc(payload_size);
+        if (!payload || network_socket_receive(channel->sock, payload, payload_size) != payload_size) {
+            free(payload);
+            break;
+        }
+
+        uint32_t count;
+        memcpy(&count, payload, sizeof(count));
+        count = ntohl(count);
+        for (uint32_t i = 0; i < count && sizeof(uint32_t) + (i + 1) * sizeof(StorageCommandResult) <= payload_size; i++) {
+            StorageCommandResult result;
+            memcpy(&result, payload + sizeof(uint32_t) + i * sizeof(result), sizeof(result));
+            PendingCommand *pending = take_inflight(channel, ntohl(result.command_id));
+            if (pending) complete(pending, (ErrorCode)(int32_t)ntohl(result.status));
+        }
+        free(payload);
+    }
+
+    // Stop the writer and unhook the channel so no new commands find it
+    pthread_mutex_lock(&channel->mutex);
+    __atomic_store_n(&channel->closed, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&channel->cond);
+    pthread_mutex_unlock(&channel->mutex);
+    shutdown(network_socket_get_fd(channel->sock), SHUT_RDWR);
+    pthread_join(channel->writer, NULL);
+
+    pthread_rwlock_wrlock(&channels_lock);
+    CommandChannel **link = &channels[hash_server(channel->host, channel->port)];
+    while (*link && *link != channel) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = channel->next;
+    pthread_rwlock_unlock(&channels_lock);
+
+    // Nothing else can reach the channel now; fail whatever it still holds.
+    // Commands never sent did not happen, but the server may have carried
+    // out those in flight.
+    while (channel->queue_head) {
+        PendingCommand *pending = channel->queue_head;
+        channel->queue_head = pending->next;
+        complete(pending, ERR_NETWORK_FAILURE);
+    }
+    for (int i = 0; i < INFLIGHT_BUCKETS; i++) {
+        while (channel->inflight[i]) {
+            PendingCommand *pending = channel->inflight[i];
+            channel->inflight[i] = pending->next;
+            complete(pending, ERR_TIMEOUT);
+        }
+    }
+
+    // The server forgets this channel's watches with it
+    report_write(channel, NULL);
+
+    printf("Command channel to %s:%s closed\n", channel->host, channel->port);
+    network_socket_close(channel->sock);
+    pthread_mutex_destroy(&channel->mutex);
+    pthread_cond_destroy(&channel->cond);
+    free(channel);
+    return NULL;
+}
+
+// Dial a storage server for a new channel. This runs without channels_lock,
+// so a server that cannot be reached only holds up its own commands.
+static NetworkSocket *dial_channel(const char *host, const char *port) {
+    NetworkSocket *sock = network_socket_create(host, port);
+    if (!sock) {
+        fprintf(stderr, "Failed to open command channel to %s:%s\n", host, port);
+        return NULL;
+    }
+
+    // Whole frames are written at once, so the socket has to block
+    int fd = network_socket_get_fd(sock);
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags != -1) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    return sock;
+}
+
+// Start the threads of a channel over sock, which it takes over. Caller
+// holds channels_lock for writing.
+static CommandChannel *open_channel(const char *host, const char *port, NetworkSocket *sock) {
+    CommandChannel *channel = calloc(1, sizeof(CommandChannel));
+    if (!channel) {
+        network_socket_close(sock);
+        return NULL;
+    }
+    snprintf(channel->host, sizeof(channel->host), "%s", host);
+    snprintf(channel->port, sizeof(channel->port), "%s", port);
+    channel->sock = sock;
+    pthread_mutex_init(&channel->mutex, NULL);
+    pthread_cond_init(&channel->cond, NULL);
+
+    pthread_t reader;
+    if (pthread_create(&channel->writer, NULL, channel_writer, channel) != 0) {
+        goto fail;
+    }
+    if (pthread_create(&reader, NULL, channel_reader, channel) != 0) {
+        pthread_mutex_lock(&channel->mutex);
+        channel->closed = 1;
+        pthread_cond_signal(&channel->cond);
+        pthread_mutex_unlock(&channel->mutex);
+        pthread_join(channel->writer, NULL);
+        goto fail;
+    }
+    pthread_detach(reader);
+
+    uint32_t bucket = hash_server(host, port);
+    channel->next = channels[bucket];
+    channels[bucket] = channel;
+    printf("Command channel to %s:%s opened\n", host, port);
+    return channel;
+
+fail:
+    network_socket_close(sock);
+    pthread_mutex_destroy(&channel->mutex);
+    pthread_cond_destroy(&channel->cond);
+    free(channel);
+    return NULL;
+}
+
+void command_channel_init() {
+    pthread_rwlock_wrlock(&channels_lock);
+    memset(channels, 0, sizeof(channels));
+    pthread_rwlock_unlock(&channels_lock);
+
+    for (int i = 0; i < COMMAND_COMPLETION_WORKERS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, completion_worker, NULL) != 0) {
+            fprintf(stderr, "Failed to start command completion worker\n");
+            break;
+        }
+        pthread_detach(thread);
+        pthread_mutex_lock(&completed_mutex);
+        completion_workers++;
+        pthread_mutex_unlock(&completed_mutex);
+    }
+}
+
+void command_channel_cleanup() {
+    // Readers tear their channels down once the sockets are shut
+    pthread_rwlock_rdlock(&channels_lock);
+    for (int i = 0; i < CHANNEL_BUCKETS; i++) {
+        for (CommandChannel *channel = channels[i]; channel; channel = channel->next) {
+            shutdown(network_socket_get_fd(channel->sock), SHUT_RDWR);
+        }
+    }
+    pthread_rwlock_unlock(&channels_lock);
+}
+
+ErrorCode command_submit(const char *host, const char *port, const StorageCommand *command,
+                         command_callback_t callback, void *arg) {
+    PendingCommand *pending = malloc(sizeof(PendingCommand));
+    if (!pending) return ERR_INTERNAL_ERROR;
+    pending->command = *command;
+    pending->id = __atomic_add_fetch(&next_command_id, 1, __ATOMIC_RELAXED);
+    pending->command.command_id = htonl(pending->id);
+    pending->callback = callback;
+    pending->arg = arg;
+    pending->next = NULL;
+
+    // Common case: the channel is already open
+    pthread_rwlock_rdlock(&channels_lock);
+    CommandChannel *channel = find_channel(host, port);
+    int queued = channel && enqueue(channel, pending);
+    pthread_rwlock_unlock(&channels_lock);
+    if (queued) return ERR_SUCCESS;
+
+    // Connect before taking the lock; if another submitter got there
+    // first, its channel is used and this connection dropped
+    NetworkSocket *sock = dial_channel(host, port);
+    if (sock) {
+        pthread_rwlock_wrlock(&channels_lock);
+        channel = find_channel(host, port);
+        if (channel) {
+            network_socket_close(sock);
+        } else {
+            channel = open_channel(host, port, sock);
+        }
+        queued = channel && enqueue(channel, pending);
+        pthread_rwlock_unlock(&channels_lock);
+        if (queued) return ERR_SUCCESS;
+    }
+
+    free(pending);
+    return ERR_NETWORK_FAILURE;
+}
+
+// Shared by command_execute and the completion it waits for; whichever
+// lets go last frees it, so a timed-out waiter can leave early
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int done;
+    ErrorCode status;
+    int refs;
+} CommandWaiter;
+
+static void waiter_release(CommandWaiter *waiter) {
+    if (__atomic_sub_fetch(&waiter->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_destroy(&waiter->mutex);
+        pthread_cond_destroy(&waiter->cond);
+        free(waiter);
+    }
+}
+
+static void waiter_complete(ErrorCode status, void *arg) {
+    CommandWaiter *waiter = arg;
+    pthread_mutex_lock(&waiter->mutex);
+    waiter->status = status;
+    waiter->done = 1;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->mutex);
+    waiter_release(waiter);
+}
+
+ErrorCode command_execute(const char *host, const char *port, const StorageCommand *command) {
+    CommandWaiter *waiter = calloc(1, sizeof(CommandWaiter));
+    if (!waiter) return ERR_INTERNAL_ERROR;
+    pthread_mutex_init(&waiter->mutex, NULL);
+    pthread_cond_init(&waiter->cond, NULL);
+    waiter->refs = 2;
+
+    ErrorCode err = command_submit(host, port, command, waiter_complete, waiter);
+    if (err != ERR_SUCCESS) {
+        waiter_release(waiter);
+        waiter_release(waiter);
+        return err;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += COMMAND_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (COMMAND_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&waiter->mutex);
+    while (!waiter->done) {
+        if (pthread_cond_timedwait(&waiter->cond, &waiter->mutex, &deadline) == ETIMEDOUT) break;
+    }
+    err = waiter->done ? waiter->status : ERR_TIMEOUT;
+    pthread_mutex_unlock(&waiter->mutex);
+    waiter_release(waiter);
+    return err;
+}
+
+void command_channel_drop(const char *host, const char *port) {
+    pthread_rwlock_rdlock(&channels_lock);
+    CommandChannel *channel = find_channel(host, port);
+    if (channel) {
+        shutdown(network_socket_get_fd(channel->sock), SHUT_RDWR);
+    }
+    pthread_rwlock_unlock(&channels_lock);
+}
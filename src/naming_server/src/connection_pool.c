@@ -0,0 +1,276 @@
+// src/naming_server/src/connection_pool.c
+
+#define _GNU_SOURCE
+#include "connection_pool.h"
+#include "hash.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#define POOL_BUCKETS 256
+#define SLOT_NONE 0xffffffffu
+
+struct PooledConnection {
+    NetworkSocket *sock;
+    struct HostPool *pool;      // NULL for overflow connections
+    uint32_t slot;
+    uint32_t next;              // Freelist link, a slot index
+    uint32_t generation;        // Host generation at checkout
+    uint64_t idle_since;
+};
+
+// A Treiber stack of slot indices. The head packs a change counter in its
+// high half with the top slot + 1 in its low half (0 when empty), so a slot
+// popped and pushed back between another thread's load and CAS fails the CAS.
+typedef uint64_t SlotStack;
+
+typedef struct HostPool {
+    char host[256];
+    char port[32];
+    PooledConnection slots[POOL_MAX_PER_HOST];
+    SlotStack idle;             // Slots holding an idle connection
+    SlotStack empty;            // Slots with no connection
+    uint32_t idle_count;
+    uint32_t generation;        // Bumped when the host's connections are dropped
+    struct HostPool *next;      // Bucket chain
+} HostPool;
+
+// Hosts are only ever added while the pool runs, so lookups walk the chains
+// without a lock and pool_mutex only orders insertions
+static HostPool *buckets[POOL_BUCKETS];
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t sweeper;
+static int running = 0;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t hash_server(const char *host, const char *port) {
+    return fnv_hash_server(host, port) % POOL_BUCKETS;
+}
+
+static void stack_push(HostPool *pool, SlotStack *stack, uint32_t slot) {
+    SlotStack head = __atomic_load_n(stack, __ATOMIC_RELAXED);
+    SlotStack next;
+    do {
+        __atomic_store_n(&pool->slots[slot].next, (uint32_t)head, __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | (slot + 1);
+    } while (!__atomic_compare_exchange_n(stack, &head, next, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Returns the popped slot or SLOT_NONE
+static uint32_t stack_pop(HostPool *pool, SlotStack *stack) {
+    SlotStack head = __atomic_load_n(stack, __ATOMIC_ACQUIRE);
+    SlotStack next;
+    do {
+        uint32_t top = (uint32_t)head;
+        if (top == 0) return SLOT_NONE;
+        uint32_t below = __atomic_load_n(&pool->slots[top - 1].next, __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | below;
+    } while (!__atomic_compare_exchange_n(stack, &head, next, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    return (uint32_t)head - 1;
+}
+
+static uint32_t idle_pop(HostPool *pool) {
+    uint32_t slot = stack_pop(pool, &pool->idle);
+    if (slot != SLOT_NONE) __atomic_sub_fetch(&pool->idle_count, 1, __ATOMIC_RELAXED);
+    return slot;
+}
+
+static void idle_push(HostPool *pool, uint32_t slot) {
+    __atomic_add_fetch(&pool->idle_count, 1, __ATOMIC_RELAXED);
+    stack_push(pool, &pool->idle, slot);
+}
+
+// Close the connection in slot and return the slot to the empty list
+static void discard_slot(HostPool *pool, uint32_t slot) {
+    network_socket_close(pool->slots[slot].sock);
+    pool->slots[slot].sock = NULL;
+    stack_push(pool, &pool->empty, slot);
+}
+
+static HostPool *find_pool(const char *host, const char *port) {
+    HostPool *pool = __atomic_load_n(&buckets[hash_server(host, port)], __ATOMIC_ACQUIRE);
+    for (; pool; pool = pool->next) {
+        if (strcmp(pool->host, host) == 0 && strcmp(pool->port, port) == 0) return pool;
+    }
+    return NULL;
+}
+
+static HostPool *find_or_add_pool(const char *host, const char *port) {
+    HostPool *pool = find_pool(host, port);
+    if (pool) return pool;
+
+    pthread_mutex_lock(&pool_mutex);
+    pool = find_pool(host, port);
+    if (!pool) {
+        pool = calloc(1, sizeof(HostPool));
+        if (pool) {
+            strncpy(pool->host, host, sizeof(pool->host) - 1);
+            strncpy(pool->port, port, sizeof(pool->port) - 1);
+            for (uint32_t i = 0; i < POOL_MAX_PER_HOST; i++) {
+                pool->slots[i].pool = pool;
+                pool->slots[i].slot = i;
+            }
+            for (uint32_t i = POOL_MAX_PER_HOST; i > 0; i--) {
+                stack_push(pool, &pool->empty, i - 1);
+            }
+            uint32_t bucket = hash_server(host, port);
+            pool->next = buckets[bucket];
+            __atomic_store_n(&buckets[bucket], pool, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return pool;
+}
+
+// An idle connection has nothing to read: if it polls readable the peer
+// closed it or sent something unsolicited, and either way it is unusable
+static int connection_usable(NetworkSocket *sock) {
+    int fd = network_socket_get_fd(sock);
+    struct pollfd pfd = { .fd = fd, .events = POLLIN | POLLRDHUP };
+    if (poll(&pfd, 1, 0) != 0) return 0;
+    int error = 0;
+    socklen_t len = sizeof(error);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+}
+
+PooledConnection *connection_pool_checkout(const char *host, const char *port) {
+    HostPool *pool = find_or_add_pool(host, port);
+    if (!pool) return NULL;
+    uint32_t generation = __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE);
+
+    uint32_t slot;
+    while ((slot = idle_pop(pool)) != SLOT_NONE) {
+        if (connection_usable(pool->slots[slot].sock)) {
+            pool->slots[slot].generation = generation;
+            return &pool->slots[slot];
+        }
+        discard_slot(pool, slot);
+    }
+
+    NetworkSocket *sock = network_socket_create(host, port);
+    if (!sock) return NULL;
+
+    slot = stack_pop(pool, &pool->empty);
+    if (slot == SLOT_NONE) {
+        // Every slot is busy: serve this request on a connection of its own
+        PooledConnection *conn = calloc(1, sizeof(PooledConnection));
+        if (!conn) {
+            network_socket_close(sock);
+            return NULL;
+        }
+        conn->sock = sock;
+        conn->slot = SLOT_NONE;
+        return conn;
+    }
+    pool->slots[slot].sock = sock;
+    pool->slots[slot].generation = generation;
+    return &pool->slots[slot];
+}
+
+NetworkSocket *connection_pool_socket(PooledConnection *conn) {
+    return conn->sock;
+}
+
+void connection_pool_release(PooledConnection *conn, int reusable) {
+    HostPool *pool = conn->pool;
+    if (!pool) {
+        network_socket_close(conn->sock);
+        free(conn);
+        return;
+    }
+
+    if (reusable && conn->generation == __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&pool->idle_count, __ATOMIC_RELAXED) < POOL_MAX_IDLE) {
+        conn->idle_since = now_ms();
+        idle_push(pool, conn->slot);
+    } else {
+        discard_slot(pool, conn->slot);
+    }
+}
+
+void connection_pool_drop_host(const char *host, const char *port) {
+    HostPool *pool = find_pool(host, port);
+    if (!pool) return;
+
+    // Connections still checked out are closed when they come back
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_RELEASE);
+    uint32_t slot;
+    while ((slot = idle_pop(pool)) != SLOT_NONE) {
+        discard_slot(pool, slot);
+    }
+}
+
+// Close connections idle past the timeout, keeping the POOL_MIN_IDLE most
+// recently used. Idle slots are popped off and pushed back around the scan,
+// so a checkout racing the sweep may dial rather than reuse but never blocks.
+static void sweep_pool(HostPool *pool, uint64_t now) {
+    uint32_t kept[POOL_MAX_PER_HOST];
+    int kept_count = 0;
+    uint32_t slot;
+    while ((slot = idle_pop(pool)) != SLOT_NONE) {
+        // The freelist is LIFO, so slots arrive most recently used first
+        if (kept_count < POOL_MIN_IDLE || now - pool->slots[slot].idle_since < POOL_IDLE_TIMEOUT_MS) {
+            kept[kept_count++] = slot;
+        } else {
+            discard_slot(pool, slot);
+        }
+    }
+    while (kept_count > 0) {
+        idle_push(pool, kept[--kept_count]);
+    }
+}
+
+static void *sweeper_thread(void *arg) {
+    (void)arg;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        struct timespec delay = { POOL_SWEEP_MS / 1000, (POOL_SWEEP_MS % 1000) * 1000000L };
+        nanosleep(&delay, NULL);
+
+        uint64_t now = now_ms();
+        for (int i = 0; i < POOL_BUCKETS; i++) {
+            for (HostPool *pool = __atomic_load_n(&buckets[i], __ATOMIC_ACQUIRE); pool; pool = pool->next) {
+                sweep_pool(pool, now);
+            }
+        }
+    }
+    return NULL;
+}
+
+void connection_pool_init() {
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&sweeper, NULL, sweeper_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to start connection pool sweeper\n");
+        running = 0;
+    }
+}
+
+void connection_pool_cleanup() {
+    if (__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL)) {
+        pthread_join(sweeper, NULL);
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    for (int i = 0; i < POOL_BUCKETS; i++) {
+        HostPool *pool = buckets[i];
+        while (pool) {
+            HostPool *next = pool->next;
+            uint32_t slot;
+            while ((slot = idle_pop(pool)) != SLOT_NONE) {
+                network_socket_close(pool->slots[slot].sock);
+            }
+            free(pool);
+            pool = next;
+        }
+        buckets[i] = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
@@ -0,0 +1,249 @@
+// src/naming_server/src/copy_job.c
+
+#include "copy_job.h"
+#include "command_channel.h"
+#include "directory.h"
+#include "log_shipping.h"
+#include "request_log.h"
+#include "router.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+typedef struct CopyJob CopyJob;
+
+// One file of a job
+typedef struct {
+    char source[256];
+    char destination[256];
+    char source_ip[INET_ADDRSTRLEN];
+    uint16_t source_port;
+    uint64_t size;
+    uint32_t permissions;
+    char host[256];             // Server making the copy
+    char port[32];
+    CopyJob *job;
+    ErrorCode failure;          // Outcome held back while a failed copy is undone
+} CopyTask;
+
+struct CopyJob {
+    Operation *operation;
+    char source[256];
+    CopyTask *tasks;
+    uint32_t task_count;
+    uint32_t task_capacity;
+    uint32_t next_task;         // Tasks below this have been handed out
+    uint32_t in_flight;
+    uint32_t finished;
+    uint32_t copied;
+    ErrorCode status;           // First failure
+    pthread_mutex_t mutex;
+};
+
+// Paths are compared without leading slashes, the way the tree lists them
+static const char *copy_key(const char *path) {
+    while (*path == '/') path++;
+    return path;
+}
+
+static ErrorCode add_task(CopyJob *job, const char *source, const char *destination, const char *ip,
+                          uint16_t port, uint64_t size, uint32_t permissions) {
+    if (job->task_count == job->task_capacity) {
+        uint32_t capacity = job->task_capacity ? job->task_capacity * 2 : 16;
+        CopyTask *tasks = realloc(job->tasks, capacity * sizeof(CopyTask));
+        if (!tasks) return ERR_INTERNAL_ERROR;
+        job->tasks = tasks;
+        job->task_capacity = capacity;
+    }
+    CopyTask *task = &job->tasks[job->task_count++];
+    memset(task, 0, sizeof(*task));
+    snprintf(task->source, sizeof(task->source), "%s", source);
+    snprintf(task->destination, sizeof(task->destination), "%s", destination);
+    snprintf(task->source_ip, sizeof(task->source_ip), "%s", ip);
+    task->source_port = port;
+    task->size = size;
+    task->permissions = permissions;
+    task->job = job;
+    return ERR_SUCCESS;
+}
+
+// Make the directories of the new tree and turn its files into tasks
+static ErrorCode plan_tree(CopyJob *job, const char *source, const char *destination) {
+    ListEntry *entries = malloc(LIST_MAX_PAGE * sizeof(ListEntry));
+    if (!entries) return ERR_INTERNAL_ERROR;
+
+    log_shipping_begin_mutation();
+    ErrorCode err = directory_create(destination);
+    if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_MKDIR, destination, NULL, 0, 0, 0);
+    log_shipping_end_mutation();
+
+    size_t prefix = strlen(copy_key(source));
+    char cursor[256] = "";
+    int has_more = 1;
+    while (err == ERR_SUCCESS && has_more) {
+        uint32_t count = 0;
+        char next_cursor[256] = "";
+        err = directory_list(source, 1, cursor, entries, LIST_MAX_PAGE, &count, next_cursor,
+                             sizeof(next_cursor), &has_more);
+        for (uint32_t i = 0; err == ERR_SUCCESS && i < count; i++) {
+            // Listed paths are the source's followed by "/rest"
+            char target[256];
+            if (strlen(entries[i].path) <= prefix ||
+                (size_t)snprintf(target, sizeof(target), "%s%s", copy_key(destination),
+                                 entries[i].path + prefix) >= sizeof(target)) {
+                err = ERR_INVALID_ARGUMENT;
+            } else if (entries[i].is_directory) {
+                log_shipping_begin_mutation();
+                err = directory_create(target);
+                if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_MKDIR, target, NULL, 0, 0, 0);
+                log_shipping_end_mutation();
+            } else {
+                err = add_task(job, entries[i].path, target, entries[i].storage_server_ip,
+                               entries[i].storage_server_port, entries[i].size, entries[i].permissions);
+            }
+        }
+        snprintf(cursor, sizeof(cursor), "%s", next_cursor);
+    }
+    free(entries);
+    return err;
+}
+
+static void task_done(ErrorCode status, void *arg);
+
+// Place task and have the chosen server pull it
+static ErrorCode submit_task(CopyTask *task) {
+    ErrorCode err = router_select_server(task->destination, task->host, sizeof(task->host), task->port,
+                                         sizeof(task->port));
+    if (err != ERR_SUCCESS) return err;
+
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_COPY;
+    strncpy(command.path, task->destination, sizeof(command.path) - 1);
+    strncpy(command.source_ip, task->source_ip, sizeof(command.source_ip) - 1);
+    command.source_port = htons(task->source_port);
+    strncpy(command.source_path, task->source, sizeof(command.source_path) - 1);
+    return command_submit(task->host, task->port, &command, task_done, task);
+}
+
+// Count completed tasks, hand out more while the window allows, and report
+// the job once every task is done. Tasks that cannot even be submitted
+// complete right here, so this loops instead of recursing.
+static void job_advance(CopyJob *job, uint32_t completed, uint32_t copied, ErrorCode status) {
+    while (1) {
+        CopyTask *batch[COPY_JOB_WINDOW];
+        uint32_t count = 0;
+
+        pthread_mutex_lock(&job->mutex);
+        job->in_flight -= completed;
+        job->finished += completed;
+        job->copied += copied;
+        if (status != ERR_SUCCESS && job->status == ERR_SUCCESS) job->status = status;
+        while (job->in_flight < COPY_JOB_WINDOW && job->next_task < job->task_count) {
+            batch[count++] = &job->tasks[job->next_task++];
+            job->in_flight++;
+        }
+        int done = job->finished == job->task_count;
+        pthread_mutex_unlock(&job->mutex);
+
+        // Nothing else refers to the job once its last task completed
+        if (done) {
+            Operation *operation = job->operation;
+            printf("Copied %u of %u files from %s to %s\n", job->copied, job->task_count, job->source,
+                   operation->path);
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_COPY, operation->request_id, operation->path,
+                        job->status, job->copied);
+            operation_finish(operation, job->status);
+            pthread_mutex_destroy(&job->mutex);
+            free(job->tasks);
+            free(job);
+            return;
+        }
+
+        completed = 0;
+        copied = 0;
+        status = ERR_SUCCESS;
+        for (uint32_t i = 0; i < count; i++) {
+            ErrorCode err = submit_task(batch[i]);
+            if (err != ERR_SUCCESS) {
+                completed++;
+                status = err;
+            }
+        }
+        if (completed == 0) return;
+    }
+}
+
+// The storage server removed the copy of a failed task
+static void task_undone(ErrorCode status, void *arg) {
+    CopyTask *task = arg;
+    if (status != ERR_SUCCESS && status != ERR_FILE_NOT_FOUND) {
+        fprintf(stderr, "Could not remove %s from %s:%s; its next inventory will list it\n", task->destination,
+                task->host, task->port);
+    }
+    job_advance(task->job, 1, 0, task->failure);
+}
+
+// A storage server finished copying one file: list it under the new tree
+static void task_done(ErrorCode status, void *arg) {
+    CopyTask *task = arg;
+    uint16_t port = (uint16_t)atoi(task->port);
+    int undo = status == ERR_TIMEOUT;
+    if (status == ERR_SUCCESS) {
+        log_shipping_begin_mutation();
+        status = directory_populate(task->destination, task->host, port, task->size, task->permissions);
+        if (status == ERR_SUCCESS) {
+            log_shipping_append_placement(LOG_OP_POPULATE, task->destination, task->host, port, task->size,
+                                          task->permissions);
+        }
+        log_shipping_end_mutation();
+        undo = status != ERR_SUCCESS;
+    }
+
+    // The server may hold a copy the tree does not list; have it deleted
+    // before the job, and with it the destination's claim, completes
+    if (undo) {
+        StorageCommand command;
+        memset(&command, 0, sizeof(command));
+        command.op = STORAGE_COMMAND_DELETE;
+        strncpy(command.path, task->destination, sizeof(command.path) - 1);
+        task->failure = status;
+        if (command_submit(task->host, task->port, &command, task_undone, task) == ERR_SUCCESS) return;
+    }
+    job_advance(task->job, 1, status == ERR_SUCCESS, status);
+}
+
+ErrorCode copy_job_start(Operation *operation, const char *source) {
+    DirectoryEntry *entry;
+    if (directory_lookup(source, &entry) != ERR_SUCCESS) return ERR_FILE_NOT_FOUND;
+
+    CopyJob *job = calloc(1, sizeof(CopyJob));
+    if (!job) return ERR_INTERNAL_ERROR;
+    job->operation = operation;
+    snprintf(job->source, sizeof(job->source), "%s", source);
+    pthread_mutex_init(&job->mutex, NULL);
+
+    ErrorCode err = ERR_FILE_NOT_FOUND;
+    pthread_rwlock_rdlock(&entry->lock);
+    int is_directory = entry->is_directory;
+    if (!is_directory && entry->metadata) {
+        err = add_task(job, copy_key(source), copy_key(operation->path), entry->metadata->storage_server_ip,
+                       entry->metadata->storage_server_port, entry->metadata->size,
+                       entry->metadata->permissions);
+    }
+    pthread_rwlock_unlock(&entry->lock);
+    if (is_directory) err = plan_tree(job, source, operation->path);
+
+    if (err != ERR_SUCCESS) {
+        pthread_mutex_destroy(&job->mutex);
+        free(job->tasks);
+        free(job);
+        return err;
+    }
+
+    operation_accept(operation);
+    job_advance(job, 0, 0, ERR_SUCCESS);
+    return ERR_SUCCESS;
+}
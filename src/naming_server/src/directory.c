@@ -1,15 +1,40 @@
 #define __USE_GNU
 #define _GNU_SOURCE
 #include "directory.h"
+#include "name_index.h"
+#include "server_index.h"
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
-#include <stdio.h> //! debug
 
 // Root of the directory tree
 static DirectoryEntry *root = NULL;
 static pthread_rwlock_t tree_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+// Renames take several entry locks at once, so they go one at a time
+static pthread_mutex_t rename_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Source of FileMetadata versions and listener for deleted or moved paths
+static uint64_t version_counter = 0;
+static directory_change_callback_t change_callback = NULL;
+static directory_path_filter_t path_filter = NULL;
+
+static uint64_t next_version() {
+    return __atomic_add_fetch(&version_counter, 1, __ATOMIC_RELAXED);
+}
+
+static void notify_change(const char *path) {
+    if (change_callback) change_callback(path);
+}
+
+void directory_set_change_callback(directory_change_callback_t callback) {
+    change_callback = callback;
+}
+
+void directory_set_path_filter(directory_path_filter_t filter) {
+    path_filter = filter;
+}
+
 // Initialize the directory manager
 ErrorCode directory_init() {
     root = malloc(sizeof(DirectoryEntry));
@@ -18,14 +43,26 @@ ErrorCode directory_init() {
     root->name = strdup("/");
     root->is_directory = 1;
     root->metadata = NULL;
+    root->delegation = NULL;
     root->parent = NULL;
     root->children = NULL;
     root->child_count = 0;
+    root->child_capacity = 0;
     pthread_rwlock_init(&root->lock, NULL);
+    root->name_id = NAME_INDEX_ROOT;
+    root->holders = NULL;
+    name_index_init();
 
     return ERR_SUCCESS;
 }
 
+static void free_metadata(FileMetadata *metadata) {
+    if (!metadata) return;
+    free(metadata->storage_server_ip);
+    free(metadata->replicas);
+    free(metadata);
+}
+
 // Clean up a directory entry recursively
 static void directory_free(DirectoryEntry *entry) {
     if (!entry) return;
@@ -35,10 +72,13 @@ static void directory_free(DirectoryEntry *entry) {
         directory_free(entry->children[i]);
     }
     if (entry->children) free(entry->children);
+    name_index_remove(entry);
+    server_index_remove(entry);
     free(entry->name);
-    if (entry->metadata) {
-        free(entry->metadata->storage_server_ip);
-        free(entry->metadata);
+    free_metadata(entry->metadata);
+    if (entry->delegation) {
+        free(entry->delegation->storage_server_ip);
+        free(entry->delegation);
     }
     pthread_rwlock_unlock(&entry->lock);
     pthread_rwlock_destroy(&entry->lock);
@@ -52,6 +92,8 @@ void directory_cleanup() {
     root = NULL;
     pthread_rwlock_unlock(&tree_lock);
     pthread_rwlock_destroy(&tree_lock);
+    name_index_cleanup();
+    server_index_cleanup();
 }
 
 // Helper function to tokenize path
@@ -61,7 +103,8 @@ static char **split_path(const char *path, size_t *count) {
 
     char **tokens = NULL;
     size_t tokens_count = 0;
-    char *token = strtok(path_copy, "/");
+    char *saveptr = NULL;
+    char *token = strtok_r(path_copy, "/", &saveptr);
     while (token) {
         char **new_tokens = realloc(tokens, sizeof(char *) * (tokens_count + 1));
         if (!new_tokens) {
@@ -71,7 +114,7 @@ static char **split_path(const char *path, size_t *count) {
         }
         tokens = new_tokens;
         tokens[tokens_count++] = strdup(token);
-        token = strtok(NULL, "/");
+        token = strtok_r(NULL, "/", &saveptr);
     }
     free(path_copy);
     *count = tokens_count;
@@ -86,6 +129,73 @@ static void free_tokens(char **tokens, size_t count) {
     free(tokens);
 }
 
+// Position of the first child whose name is not less than name; the caller
+// holds dir->lock. *found is set when that child's name equals name.
+static size_t child_lower_bound(DirectoryEntry *dir, const char *name, int *found) {
+    size_t lo = 0, hi = dir->child_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(dir->children[mid]->name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = lo < dir->child_count && strcmp(dir->children[lo]->name, name) == 0;
+    return lo;
+}
+
+// Find a direct child of a directory by name; the caller holds dir->lock
+static DirectoryEntry *find_child(DirectoryEntry *dir, const char *name) {
+    int found;
+    size_t pos = child_lower_bound(dir, name, &found);
+    return found ? dir->children[pos] : NULL;
+}
+
+// Make room for one more child; the caller holds dir->lock for writing
+static ErrorCode reserve_child(DirectoryEntry *dir) {
+    if (dir->child_count == dir->child_capacity) {
+        size_t new_capacity = dir->child_capacity ? dir->child_capacity * 2 : 4;
+        DirectoryEntry **new_children = realloc(dir->children, sizeof(DirectoryEntry *) * new_capacity);
+        if (!new_children) return ERR_INTERNAL_ERROR;
+        dir->children = new_children;
+        dir->child_capacity = new_capacity;
+    }
+    return ERR_SUCCESS;
+}
+
+// Insert child at position pos, keeping children sorted; the caller holds
+// dir->lock for writing
+static ErrorCode insert_child(DirectoryEntry *dir, DirectoryEntry *child, size_t pos) {
+    if (reserve_child(dir) != ERR_SUCCESS) return ERR_INTERNAL_ERROR;
+    memmove(&dir->children[pos + 1], &dir->children[pos], sizeof(DirectoryEntry *) * (dir->child_count - pos));
+    dir->children[pos] = child;
+    dir->child_count++;
+    return ERR_SUCCESS;
+}
+
+// Allocate a detached entry named name under parent
+static DirectoryEntry *new_entry(const char *name, DirectoryEntry *parent, int is_directory) {
+    DirectoryEntry *entry = malloc(sizeof(DirectoryEntry));
+    if (!entry) return NULL;
+    entry->name = strdup(name);
+    if (!entry->name) {
+        free(entry);
+        return NULL;
+    }
+    entry->is_directory = is_directory;
+    entry->metadata = NULL;
+    entry->delegation = NULL;
+    entry->parent = parent;
+    entry->children = NULL;
+    entry->child_count = 0;
+    entry->child_capacity = 0;
+    entry->holders = NULL;
+    pthread_rwlock_init(&entry->lock, NULL);
+    name_index_add(entry, parent);
+    return entry;
+}
+
 // Internal function for path lookup
 static ErrorCode directory_lookup_internal(const char *path, DirectoryEntry **result, int create, int is_directory) {
     if (!root || !path || !result) return ERR_INVALID_ARGUMENT;
@@ -100,59 +210,45 @@ static ErrorCode directory_lookup_internal(const char *path, DirectoryEntry **re
     DirectoryEntry *current = root;
 
     for (size_t i = 0; i < tokens_count; ++i) {
-        pthread_rwlock_wrlock(&current->lock); // Lock current node for write
-        DirectoryEntry *child = NULL;
-
-        // Search for the child
-        for (size_t j = 0; j < current->child_count; ++j) {
-            if (strcmp(current->children[j]->name, tokens[i]) == 0) {
-                child = current->children[j];
-                break;
-            }
+        // Only take the node exclusively when we may have to add a child
+        if (create) {
+            pthread_rwlock_wrlock(&current->lock);
+        } else {
+            pthread_rwlock_rdlock(&current->lock);
         }
 
+        int found;
+        size_t pos = child_lower_bound(current, tokens[i], &found);
+        DirectoryEntry *child = found ? current->children[pos] : NULL;
+
         if (!child) {
             if (create) {
                 // Create new entry
-                child = malloc(sizeof(DirectoryEntry));
+                child = new_entry(tokens[i], current, (i < tokens_count - 1) || is_directory);
                 if (!child) {
                     pthread_rwlock_unlock(&current->lock);
                     free_tokens(tokens, tokens_count);
                     return ERR_INTERNAL_ERROR;
                 }
-                child->name = strdup(tokens[i]);
-                child->is_directory = (i < tokens_count - 1) || is_directory;
-                child->metadata = NULL;
-                child->parent = current;
-                child->children = NULL;
-                child->child_count = 0;
-                pthread_rwlock_init(&child->lock, NULL);
 
                 // Add child to current
-                DirectoryEntry **new_children = realloc(current->children, sizeof(DirectoryEntry *) * (current->child_count + 1));
-                if (!new_children) {
-                    free(child->name);
-                    free(child);
+                if (insert_child(current, child, pos) != ERR_SUCCESS) {
+                    directory_free(child);
                     pthread_rwlock_unlock(&current->lock);
                     free_tokens(tokens, tokens_count);
                     return ERR_INTERNAL_ERROR;
                 }
-                current->children = new_children;
-                current->children[current->child_count++] = child;
             } else {
                 pthread_rwlock_unlock(&current->lock);
                 free_tokens(tokens, tokens_count);
                 return ERR_NOT_FOUND;
             }
-        } else {
-            pthread_rwlock_rdlock(&child->lock); // Lock child node
         }
 
         pthread_rwlock_unlock(&current->lock); // Unlock current node
         current = child; // Move to child
     }
 
-    pthread_rwlock_unlock(&current->lock); // Unlock the last node
     *result = current;
     free_tokens(tokens, tokens_count);
     return ERR_SUCCESS;
@@ -165,7 +261,6 @@ ErrorCode directory_lookup(const char *path, DirectoryEntry **entry) {
 }
 
 ErrorCode directory_create(const char *path) {
-    printf("Creating directory: %s\n", path); //! debug
     DirectoryEntry *entry;
     return directory_lookup_internal(path, &entry, 1, 1);
 }
@@ -175,17 +270,24 @@ ErrorCode directory_delete(const char *path) {
     ErrorCode err = directory_lookup(path, &entry);
     if (err != ERR_SUCCESS) return err;
 
-    pthread_rwlock_wrlock(&entry->lock);
+    // Parent before entry, the order renames and walks lock in. A rename
+    // may move the entry before both are held, so the parent is checked.
+    DirectoryEntry *parent;
+    for (;;) {
+        parent = entry->parent;
+        if (parent) pthread_rwlock_wrlock(&parent->lock);
+        pthread_rwlock_wrlock(&entry->lock);
+        if (entry->parent == parent) break;
+        pthread_rwlock_unlock(&entry->lock);
+        if (parent) pthread_rwlock_unlock(&parent->lock);
+    }
     if (entry->child_count > 0) {
         pthread_rwlock_unlock(&entry->lock);
+        if (parent) pthread_rwlock_unlock(&parent->lock);
         return ERR_INVALID_ARGUMENT;
     }
 
-    DirectoryEntry *parent = entry->parent;
     if (parent) {
-        // Lock parent before modifying
-        pthread_rwlock_wrlock(&parent->lock);
-
         // Find and remove entry from parent's children
         for (size_t i = 0; i < parent->child_count; ++i) {
             if (parent->children[i] == entry) {
@@ -194,38 +296,706 @@ ErrorCode directory_delete(const char *path) {
                     parent->children[j] = parent->children[j + 1];
                 }
                 parent->child_count--;
-                parent->children = realloc(parent->children, sizeof(DirectoryEntry *) * parent->child_count);
                 break;
             }
         }
-
-        pthread_rwlock_unlock(&parent->lock);
     }
 
     pthread_rwlock_unlock(&entry->lock);
+    if (parent) pthread_rwlock_unlock(&parent->lock);
     directory_free(entry);
+    notify_change(path);
     return ERR_SUCCESS;
 }
 
+static size_t entry_depth(DirectoryEntry *entry) {
+    size_t depth = 0;
+    for (DirectoryEntry *up = entry->parent; up; up = up->parent) depth++;
+    return depth;
+}
+
+ErrorCode directory_rename(const char *source, const char *destination) {
+    if (!root || !source || !destination) return ERR_INVALID_ARGUMENT;
+
+    // Split destination into its parent directory and new name
+    char parent_path[256];
+    size_t length = strlen(destination);
+    while (length > 0 && destination[length - 1] == '/') length--;
+    size_t name_start = length;
+    while (name_start > 0 && destination[name_start - 1] != '/') name_start--;
+    if (name_start == length || length >= sizeof(parent_path)) return ERR_INVALID_ARGUMENT;
+    memcpy(parent_path, destination, name_start);
+    parent_path[name_start] = '\0';
+    if (parent_path[strspn(parent_path, "/")] == '\0') strcpy(parent_path, "/");
+    char *name = strndup(destination + name_start, length - name_start);
+    if (!name) return ERR_INTERNAL_ERROR;
+
+    DirectoryEntry *entry, *new_parent;
+    ErrorCode err = directory_lookup(source, &entry);
+    if (err == ERR_SUCCESS && entry == root) err = ERR_INVALID_ARGUMENT;
+    if (err == ERR_SUCCESS) err = directory_lookup_internal(parent_path, &new_parent, 1, 1);
+    if (err != ERR_SUCCESS) {
+        free(name);
+        return err;
+    }
+
+    pthread_mutex_lock(&rename_mutex);
+
+    // Moving a directory below itself would cut it off the tree
+    for (DirectoryEntry *up = new_parent; up; up = up->parent) {
+        if (up == entry) {
+            pthread_mutex_unlock(&rename_mutex);
+            free(name);
+            return ERR_INVALID_ARGUMENT;
+        }
+    }
+
+    // Parents before children, the order lookups and walks lock in
+    DirectoryEntry *old_parent = entry->parent;
+    DirectoryEntry *first = old_parent, *second = new_parent;
+    if (entry_depth(new_parent) < entry_depth(old_parent)) {
+        first = new_parent;
+        second = old_parent;
+    }
+    pthread_rwlock_wrlock(&first->lock);
+    if (second != first) pthread_rwlock_wrlock(&second->lock);
+    pthread_rwlock_wrlock(&entry->lock);
+
+    int found;
+    size_t pos = child_lower_bound(new_parent, name, &found);
+    if (found) {
+        err = ERR_ALREADY_EXISTS;
+    } else if (!new_parent->is_directory || new_parent->metadata) {
+        err = ERR_INVALID_ARGUMENT;
+    } else {
+        err = reserve_child(new_parent);
+    }
+    if (err == ERR_SUCCESS) {
+        // Only the links above the subtree change, whatever its size
+        size_t old_pos = child_lower_bound(old_parent, entry->name, &found);
+        memmove(&old_parent->children[old_pos], &old_parent->children[old_pos + 1],
+                sizeof(DirectoryEntry *) * (old_parent->child_count - old_pos - 1));
+        old_parent->child_count--;
+        if (old_parent == new_parent && old_pos < pos) pos--;
+
+        free(entry->name);
+        entry->name = name;
+        name = NULL;
+        entry->parent = new_parent;
+        insert_child(new_parent, entry, pos);
+        name_index_move(entry);
+    }
+
+    pthread_rwlock_unlock(&entry->lock);
+    if (second != first) pthread_rwlock_unlock(&second->lock);
+    pthread_rwlock_unlock(&first->lock);
+    pthread_mutex_unlock(&rename_mutex);
+    free(name);
+    return err;
+}
+
+// Add ip:port to holders unless already there
+static void add_distinct(FileReplica *holders, uint32_t *count, uint32_t max_holders, int *overflow,
+                         const char *ip, uint16_t port) {
+    for (uint32_t i = 0; i < *count; i++) {
+        if (holders[i].port == port && strcmp(holders[i].ip, ip) == 0) return;
+    }
+    if (*count == max_holders) {
+        *overflow = 1;
+        return;
+    }
+    memset(&holders[*count], 0, sizeof(FileReplica));
+    strncpy(holders[*count].ip, ip, sizeof(holders[*count].ip) - 1);
+    holders[*count].port = port;
+    (*count)++;
+}
+
+static void collect_holders(DirectoryEntry *entry, FileReplica *holders, uint32_t *count, uint32_t max_holders,
+                            int *overflow) {
+    pthread_rwlock_rdlock(&entry->lock);
+    if (entry->delegation) {
+        add_distinct(holders, count, max_holders, overflow, entry->delegation->storage_server_ip,
+                     entry->delegation->storage_server_port);
+    }
+    if (entry->metadata) {
+        add_distinct(holders, count, max_holders, overflow, entry->metadata->storage_server_ip,
+                     entry->metadata->storage_server_port);
+        for (uint32_t i = 0; i < entry->metadata->replica_count; i++) {
+            add_distinct(holders, count, max_holders, overflow, entry->metadata->replicas[i].ip,
+                         entry->metadata->replicas[i].port);
+        }
+    }
+    for (size_t i = 0; i < entry->child_count && !*overflow; ++i) {
+        collect_holders(entry->children[i], holders, count, max_holders, overflow);
+    }
+    pthread_rwlock_unlock(&entry->lock);
+}
+
+ErrorCode directory_holders(const char *path, FileReplica *holders, uint32_t max_holders, uint32_t *count) {
+    if (!holders || !count) return ERR_INVALID_ARGUMENT;
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+
+    int overflow = 0;
+    *count = 0;
+    collect_holders(entry, holders, count, max_holders, &overflow);
+    return overflow ? ERR_INTERNAL_ERROR : ERR_SUCCESS;
+}
+
 ErrorCode directory_register_file(const char *path, FileMetadata *metadata) {
     DirectoryEntry *entry;
     ErrorCode err = directory_lookup_internal(path, &entry, 1, 0);
     if (err != ERR_SUCCESS) return err;
-    printf("directory lookup successful\n"); //! debug
 
-    // pthread_rwlock_wrlock(&entry->lock);
-    if (entry->metadata) free(entry->metadata);
+    pthread_rwlock_wrlock(&entry->lock);
+    free_metadata(entry->metadata);
     entry->metadata = malloc(sizeof(FileMetadata));
     if (!entry->metadata) {
         pthread_rwlock_unlock(&entry->lock);
         return ERR_INTERNAL_ERROR;
     }
     memcpy(entry->metadata, metadata, sizeof(FileMetadata));
+    entry->metadata->version = next_version();
+    server_index_sync(entry);
+    pthread_rwlock_unlock(&entry->lock);
+
+    notify_change(path);
+    return ERR_SUCCESS;
+}
+
+// Find name under dir, creating it if missing; sorted input usually lands
+// past the last child so that case skips the binary search
+static DirectoryEntry *get_or_create_child(DirectoryEntry *dir, const char *name, int is_directory) {
+    pthread_rwlock_wrlock(&dir->lock);
+
+    int found = 0;
+    size_t pos = dir->child_count;
+    if (dir->child_count > 0 && strcmp(dir->children[dir->child_count - 1]->name, name) >= 0) {
+        pos = child_lower_bound(dir, name, &found);
+    }
+
+    DirectoryEntry *child;
+    if (found) {
+        child = dir->children[pos];
+        if (is_directory) child->is_directory = 1;
+    } else {
+        child = new_entry(name, dir, is_directory);
+        if (child && insert_child(dir, child, pos) != ERR_SUCCESS) {
+            directory_free(child);
+            child = NULL;
+        }
+    }
+
+    pthread_rwlock_unlock(&dir->lock);
+    return child;
+}
+
+static int holds_primary(const FileMetadata *metadata, const char *ip, uint16_t port) {
+    return metadata->storage_server_port == port && metadata->storage_server_ip &&
+           strcmp(metadata->storage_server_ip, ip) == 0;
+}
+
+// Index of ip:port among the replicas, or -1
+static int find_replica(const FileMetadata *metadata, const char *ip, uint16_t port) {
+    for (uint32_t i = 0; i < metadata->replica_count; i++) {
+        if (metadata->replicas[i].port == port && strcmp(metadata->replicas[i].ip, ip) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// Record that ip:port holds entry. The first server to report a file is its
+// primary; any other server reporting it holds a copy, unless the file
+// already lists MAX_FILE_REPLICAS (ERR_BUSY). Caller holds the entry's write
+// lock.
+static ErrorCode add_holder(DirectoryEntry *entry, const char *ip, uint16_t port, uint64_t size, uint32_t permissions) {
+    FileMetadata *metadata = entry->metadata;
+    if (metadata && !holds_primary(metadata, ip, port)) {
+        if (find_replica(metadata, ip, port) >= 0) return ERR_SUCCESS;
+        if (metadata->replica_count >= MAX_FILE_REPLICAS) return ERR_BUSY;
+        FileReplica *grown = realloc(metadata->replicas, (metadata->replica_count + 1) * sizeof(FileReplica));
+        if (!grown) return ERR_INTERNAL_ERROR;
+        metadata->replicas = grown;
+        FileReplica *replica = &grown[metadata->replica_count++];
+        memset(replica, 0, sizeof(*replica));
+        strncpy(replica->ip, ip, sizeof(replica->ip) - 1);
+        replica->port = port;
+        server_index_sync(entry);
+        return ERR_SUCCESS;
+    }
+
+    if (!metadata) {
+        metadata = calloc(1, sizeof(FileMetadata));
+        if (!metadata) return ERR_INTERNAL_ERROR;
+        metadata->storage_server_ip = strdup(ip);
+        if (!metadata->storage_server_ip) {
+            free(metadata);
+            return ERR_INTERNAL_ERROR;
+        }
+        metadata->storage_server_port = port;
+        metadata->version = next_version();
+        entry->metadata = metadata;
+        server_index_sync(entry);
+    }
+    metadata->size = size;
+    metadata->permissions = permissions;
+    return ERR_SUCCESS;
+}
+
+// stamp, when not 0, marks the entry as reported by a full inventory
+static ErrorCode set_entry_metadata(DirectoryEntry *entry, const char *ip, uint16_t port, uint64_t size,
+                                    uint32_t permissions, uint32_t stamp) {
+    pthread_rwlock_wrlock(&entry->lock);
+    ErrorCode err = add_holder(entry, ip, port, size, permissions);
+    if (err == ERR_SUCCESS && stamp) server_index_mark(entry, ip, port, stamp);
+    pthread_rwlock_unlock(&entry->lock);
+    return err;
+}
+
+// ip:port no longer holds path. A replica just leaves the list; the primary
+// hands over to the first replica, and a file nobody holds leaves the tree.
+static ErrorCode delete_owned_entry(const char *path, const char *ip, uint16_t port) {
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+
+    pthread_rwlock_wrlock(&entry->lock);
+    FileMetadata *metadata = entry->metadata;
+    if (!metadata) {
+        pthread_rwlock_unlock(&entry->lock);
+        return ERR_NOT_FOUND;
+    }
+
+    int index;
+    if (holds_primary(metadata, ip, port)) {
+        if (metadata->replica_count == 0) {
+            pthread_rwlock_unlock(&entry->lock);
+            return directory_delete(path);
+        }
+        char *promoted = strdup(metadata->replicas[0].ip);
+        if (!promoted) {
+            pthread_rwlock_unlock(&entry->lock);
+            return ERR_INTERNAL_ERROR;
+        }
+        free(metadata->storage_server_ip);
+        metadata->storage_server_ip = promoted;
+        metadata->storage_server_port = metadata->replicas[0].port;
+        index = 0;
+    } else if ((index = find_replica(metadata, ip, port)) < 0) {
+        pthread_rwlock_unlock(&entry->lock);
+        return ERR_NOT_FOUND;
+    }
+
+    memmove(&metadata->replicas[index], &metadata->replicas[index + 1],
+            (metadata->replica_count - index - 1) * sizeof(FileReplica));
+    metadata->replica_count--;
+    metadata->version = next_version();
+    server_index_sync(entry);
+    pthread_rwlock_unlock(&entry->lock);
+
+    // Locations handed out before may name the server that lost the file
+    notify_change(path);
+    return ERR_SUCCESS;
+}
+
+ErrorCode directory_add_copy(const char *path, const char *ip, uint16_t port) {
+    if (!path || !ip) return ERR_INVALID_ARGUMENT;
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+
+    pthread_rwlock_wrlock(&entry->lock);
+    FileMetadata *metadata = entry->metadata;
+    if (!metadata) {
+        pthread_rwlock_unlock(&entry->lock);
+        return ERR_NOT_FOUND;
+    }
+    err = add_holder(entry, ip, port, metadata->size, metadata->permissions);
+    pthread_rwlock_unlock(&entry->lock);
+
+    // Leaseholders come back for a location listing the new copy
+    if (err == ERR_SUCCESS) notify_change(path);
+    return err;
+}
+
+ErrorCode directory_drop_copy(const char *path, const char *ip, uint16_t port) {
+    if (!path || !ip) return ERR_INVALID_ARGUMENT;
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+
+    pthread_rwlock_wrlock(&entry->lock);
+    FileMetadata *metadata = entry->metadata;
+    int index = metadata ? find_replica(metadata, ip, port) : -1;
+    if (index < 0) {
+        pthread_rwlock_unlock(&entry->lock);
+        return ERR_NOT_FOUND;
+    }
+    memmove(&metadata->replicas[index], &metadata->replicas[index + 1],
+            (metadata->replica_count - index - 1) * sizeof(FileReplica));
+    metadata->replica_count--;
+    metadata->version = next_version();
+    server_index_sync(entry);
+    pthread_rwlock_unlock(&entry->lock);
+
+    notify_change(path);
+    return ERR_SUCCESS;
+}
+
+ErrorCode directory_get_holders(const char *path, FileReplica *holders, uint32_t *count) {
+    if (!path || !holders || !count) return ERR_INVALID_ARGUMENT;
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+
+    pthread_rwlock_rdlock(&entry->lock);
+    FileMetadata *metadata = entry->metadata;
+    if (!metadata || !metadata->storage_server_ip) {
+        pthread_rwlock_unlock(&entry->lock);
+        return ERR_NOT_FOUND;
+    }
+    memset(holders, 0, sizeof(FileReplica));
+    strncpy(holders[0].ip, metadata->storage_server_ip, INET_ADDRSTRLEN - 1);
+    holders[0].port = metadata->storage_server_port;
+    *count = 1;
+    for (uint32_t i = 0; i < metadata->replica_count && *count < MAX_FILE_REPLICAS + 1; i++) {
+        holders[(*count)++] = metadata->replicas[i];
+    }
+    pthread_rwlock_unlock(&entry->lock);
+    return ERR_SUCCESS;
+}
+
+// Swap the primary of metadata with its index-th copy. Caller holds the
+// entry's write lock; who holds the file does not change.
+static ErrorCode swap_primary(FileMetadata *metadata, uint32_t index) {
+    char *promoted = strdup(metadata->replicas[index].ip);
+    if (!promoted) return ERR_INTERNAL_ERROR;
+    FileReplica demoted;
+    memset(&demoted, 0, sizeof(demoted));
+    strncpy(demoted.ip, metadata->storage_server_ip, sizeof(demoted.ip) - 1);
+    demoted.port = metadata->storage_server_port;
+
+    free(metadata->storage_server_ip);
+    metadata->storage_server_ip = promoted;
+    metadata->storage_server_port = metadata->replicas[index].port;
+    metadata->replicas[index] = demoted;
+    metadata->version = next_version();
+    return ERR_SUCCESS;
+}
+
+ErrorCode directory_promote(const char *path, const char *ip, uint16_t port) {
+    if (!path || !ip) return ERR_INVALID_ARGUMENT;
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+
+    pthread_rwlock_wrlock(&entry->lock);
+    FileMetadata *metadata = entry->metadata;
+    int index = metadata ? find_replica(metadata, ip, port) : -1;
+    err = index < 0 ? ERR_NOT_FOUND : swap_primary(metadata, (uint32_t)index);
+    pthread_rwlock_unlock(&entry->lock);
+
+    if (err == ERR_SUCCESS) notify_change(path);
+    return err;
+}
+
+// A file whose primary moved, recorded while the entry was locked
+typedef struct {
+    char path[256];
+    FileReplica primary;
+} FailoverMove;
+
+typedef struct {
+    const char *ip;
+    uint16_t port;
+    directory_holder_usable_t usable;
+    FailoverMove *moves;
+    size_t move_count;
+    size_t move_capacity;
+    DirectoryFailover *result;
+} FailoverContext;
+
+static void fail_over_entry(DirectoryEntry *entry, void *ctx) {
+    FailoverContext *failover = ctx;
+    FileMetadata *metadata = entry->metadata;
+    if (!metadata) return;
+    if (!holds_primary(metadata, failover->ip, failover->port)) {
+        failover->result->copies_lost++;
+        return;
+    }
+
+    int index = -1;
+    for (uint32_t i = 0; i < metadata->replica_count && index < 0; i++) {
+        if (failover->usable(metadata->replicas[i].ip, metadata->replicas[i].port)) index = (int)i;
+    }
+    if (index < 0) {
+        failover->result->stranded++;
+        return;
+    }
+    if (failover->move_count == failover->move_capacity) {
+        size_t capacity = failover->move_capacity ? failover->move_capacity * 2 : 64;
+        FailoverMove *grown = realloc(failover->moves, capacity * sizeof(FailoverMove));
+        if (!grown) {
+            failover->result->stranded++;
+            return;
+        }
+        failover->moves = grown;
+        failover->move_capacity = capacity;
+    }
+
+    // The standby replays the move by path, so one that cannot be named stays put
+    FailoverMove *move = &failover->moves[failover->move_count];
+    if (!name_index_path(entry, move->path, sizeof(move->path)) ||
+        swap_primary(metadata, (uint32_t)index) != ERR_SUCCESS) {
+        failover->result->stranded++;
+        return;
+    }
+    memset(&move->primary, 0, sizeof(move->primary));
+    strncpy(move->primary.ip, metadata->storage_server_ip, sizeof(move->primary.ip) - 1);
+    move->primary.port = metadata->storage_server_port;
+    failover->move_count++;
+    failover->result->promoted++;
+}
+
+ErrorCode directory_fail_over(const char *ip, uint16_t port, directory_holder_usable_t usable,
+                              directory_promoted_t promoted, void *ctx, DirectoryFailover *result) {
+    if (!ip || !usable || !result) return ERR_INVALID_ARGUMENT;
+    memset(result, 0, sizeof(*result));
+
+    FailoverContext failover = {ip, port, usable, NULL, 0, 0, result};
+    server_index_visit(ip, port, fail_over_entry, &failover);
+
+    // Callbacks run with no tree locks held
+    for (size_t i = 0; i < failover.move_count; i++) {
+        FailoverMove *move = &failover.moves[i];
+        notify_change(move->path);
+        if (promoted) promoted(move->path, move->primary.ip, move->primary.port, ctx);
+    }
+    free(failover.moves);
+    return ERR_SUCCESS;
+}
+
+// Paths of files, collected while their entries were locked and acted on
+// once the server index is no longer being walked
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+static void collect_path(DirectoryEntry *entry, void *ctx) {
+    PathList *list = ctx;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **grown = realloc(list->paths, capacity * sizeof(char *));
+        if (!grown) return;
+        list->paths = grown;
+        list->capacity = capacity;
+    }
+    char path[256];
+    if (!name_index_path(entry, path, sizeof(path))) return;
+    char *copy = strdup(path);
+    if (copy) list->paths[list->count++] = copy;
+}
+
+// Drop ip:port from every file it holds that was not marked with stamp
+static uint32_t drop_unreported(const char *ip, uint16_t port, uint32_t stamp) {
+    PathList unreported = {NULL, 0, 0};
+    server_index_visit_unmarked(ip, port, stamp, collect_path, &unreported);
+
+    uint32_t dropped = 0;
+    for (size_t i = 0; i < unreported.count; i++) {
+        if (delete_owned_entry(unreported.paths[i], ip, port) == ERR_SUCCESS) dropped++;
+        free(unreported.paths[i]);
+    }
+    free(unreported.paths);
+    return dropped;
+}
+
+// The files a server holds a copy of, leaving out those it is primary of
+typedef struct {
+    const char *ip;
+    uint16_t port;
+    PathList copies;
+} DropContext;
+
+static void collect_copy(DirectoryEntry *entry, void *ctx) {
+    DropContext *drop = ctx;
+    if (entry->metadata && !holds_primary(entry->metadata, drop->ip, drop->port)) collect_path(entry, &drop->copies);
+}
+
+ErrorCode directory_drop_server(const char *ip, uint16_t port, directory_dropped_t dropped, void *ctx,
+                                uint32_t *count) {
+    if (!ip) return ERR_INVALID_ARGUMENT;
+    DropContext drop = {ip, port, {NULL, 0, 0}};
+    server_index_visit(ip, port, collect_copy, &drop);
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < drop.copies.count; i++) {
+        char *path = drop.copies.paths[i];
+        if (directory_drop_copy(path, ip, port) == ERR_SUCCESS) {
+            total++;
+            if (dropped) dropped(path, ip, port, ctx);
+        }
+        free(path);
+    }
+    free(drop.copies.paths);
+    if (count) *count = total;
+    return ERR_SUCCESS;
+}
+
+ErrorCode directory_bulk_load(InventoryReader *reader, const char *ip, uint32_t *loaded, uint32_t *dropped) {
+    if (!root || !reader || !ip) return ERR_INVALID_ARGUMENT;
+    if (dropped) *dropped = 0;
+
+    // A full inventory is everything the server holds; files it leaves out
+    // are gone from it
+    uint32_t stamp = reader->base_generation == 0 ? server_index_new_stamp() : 0;
+
+    // trail[k] is the entry of the (k+1)-th component of the previous path
+    // and ends[k] the offset just past that component
+    DirectoryEntry *trail[INVENTORY_MAX_PATH];
+    size_t ends[INVENTORY_MAX_PATH];
+    size_t depth = 0;
+    uint32_t count = 0;
+    char name[INVENTORY_MAX_PATH];
+
+    InventoryRecord record;
+    ErrorCode err;
+    while ((err = inventory_reader_next(reader, &record)) == ERR_SUCCESS) {
+        const char *path = record.path;
+
+        if (path_filter && !path_filter(path)) {
+            // The next record is front-coded against this one, not against
+            // the path the trail follows
+            depth = 0;
+            continue;
+        }
+
+        if (record.flags & INVENTORY_FLAG_DELETED) {
+            // The removed entry may be on the trail, so start the next path
+            // from the root
+            depth = 0;
+            if (delete_owned_entry(path, ip, reader->client_port) == ERR_SUCCESS) count++;
+            continue;
+        }
+
+        // Keep the components that are complete in both paths
+        while (depth > 0) {
+            size_t end = ends[depth - 1];
+            if (end <= record.shared && (path[end] == '/' || path[end] == '\0')) break;
+            depth--;
+        }
+
+        DirectoryEntry *current = depth > 0 ? trail[depth - 1] : root;
+        size_t pos = depth > 0 ? ends[depth - 1] : 0;
+        for (;;) {
+            while (path[pos] == '/') pos++;
+            if (path[pos] == '\0') break;
+
+            size_t start = pos;
+            while (path[pos] != '\0' && path[pos] != '/') pos++;
+            memcpy(name, path + start, pos - start);
+            name[pos - start] = '\0';
+
+            int last = path[pos + strspn(path + pos, "/")] == '\0';
+            int is_directory = !last || (record.flags & INVENTORY_FLAG_DIRECTORY);
+            DirectoryEntry *child = get_or_create_child(current, name, is_directory);
+            if (!child) {
+                err = ERR_INTERNAL_ERROR;
+                goto out;
+            }
+            trail[depth] = child;
+            ends[depth] = pos;
+            depth++;
+            current = child;
+        }
+
+        if (current == root) continue;
+        if (!(record.flags & INVENTORY_FLAG_DIRECTORY)) {
+            // A copy beyond MAX_FILE_REPLICAS stays on the server unlisted
+            err = set_entry_metadata(current, ip, reader->client_port, record.size, record.permissions, stamp);
+            if (err == ERR_BUSY) err = ERR_SUCCESS;
+            if (err != ERR_SUCCESS) goto out;
+        }
+        count++;
+    }
+
+out:
+    if (loaded) *loaded = count;
+    if (err != ERR_NOT_FOUND) return err;
+    if (stamp) {
+        uint32_t gone = drop_unreported(ip, reader->client_port, stamp);
+        if (dropped) *dropped = gone;
+    }
+    return ERR_SUCCESS;
+}
+
+ErrorCode directory_delegate(const char *prefix, const char *ip, uint16_t port) {
+    if (!prefix || !ip) return ERR_INVALID_ARGUMENT;
+    if (prefix[strspn(prefix, "/")] == '\0') prefix = "/";
+
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup_internal(prefix, &entry, 1, 1);
+    if (err != ERR_SUCCESS) return err;
+
+    FileMetadata *delegation = calloc(1, sizeof(FileMetadata));
+    if (!delegation) return ERR_INTERNAL_ERROR;
+    delegation->storage_server_ip = strdup(ip);
+    if (!delegation->storage_server_ip) {
+        free(delegation);
+        return ERR_INTERNAL_ERROR;
+    }
+    delegation->storage_server_port = port;
+
+    pthread_rwlock_wrlock(&entry->lock);
+    FileMetadata *old = entry->delegation;
+    entry->delegation = delegation;
+    entry->is_directory = 1;
     pthread_rwlock_unlock(&entry->lock);
 
+    if (old) {
+        free(old->storage_server_ip);
+        free(old);
+    }
     return ERR_SUCCESS;
 }
 
+ErrorCode directory_find_delegate(const char *path, char *ip, uint16_t *port) {
+    if (!root || !path || !ip || !port) return ERR_INVALID_ARGUMENT;
+
+    size_t tokens_count = 0;
+    char **tokens = split_path(path, &tokens_count);
+    if (!tokens && tokens_count > 0) return ERR_INTERNAL_ERROR;
+
+    // Walk as far down the tree as the path goes, remembering the deepest
+    // delegation passed on the way
+    ErrorCode err = ERR_NOT_FOUND;
+    DirectoryEntry *current = root;
+    for (size_t i = 0; current; ++i) {
+        pthread_rwlock_rdlock(&current->lock);
+        if (current->delegation) {
+            strncpy(ip, current->delegation->storage_server_ip, INET_ADDRSTRLEN - 1);
+            ip[INET_ADDRSTRLEN - 1] = '\0';
+            *port = current->delegation->storage_server_port;
+            err = ERR_SUCCESS;
+        }
+        DirectoryEntry *child = i < tokens_count ? find_child(current, tokens[i]) : NULL;
+        pthread_rwlock_unlock(&current->lock);
+        current = child;
+    }
+
+    free_tokens(tokens, tokens_count);
+    return err;
+}
+
+ErrorCode directory_populate(const char *path, const char *ip, uint16_t port, uint64_t size, uint32_t permissions) {
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup_internal(path, &entry, 1, 0);
+    if (err != ERR_SUCCESS) return err;
+    return set_entry_metadata(entry, ip, port, size, permissions, 0);
+}
+
 ErrorCode directory_get_metadata(const char *path, FileMetadata **metadata) {
     DirectoryEntry *entry;
     ErrorCode err = directory_lookup(path, &entry);
@@ -245,4 +1015,326 @@ ErrorCode directory_get_metadata(const char *path, FileMetadata **metadata) {
     pthread_rwlock_unlock(&entry->lock);
 
     return ERR_SUCCESS;
-}
\ No newline at end of file
+}
+
+// Batch lookup slot: a path and its position in the caller's arrays
+typedef struct {
+    const char *path;
+    size_t index;
+} BatchSlot;
+
+static int batch_slot_compare(const void *a, const void *b) {
+    return strcmp(((const BatchSlot *)a)->path, ((const BatchSlot *)b)->path);
+}
+
+ErrorCode directory_lookup_batch(const char **paths, size_t count, DirectoryEntry **entries, ErrorCode *results) {
+    if (!root || !paths || !entries || !results) return ERR_INVALID_ARGUMENT;
+    if (count == 0) return ERR_SUCCESS;
+
+    // Resolve in sorted order so paths sharing a prefix are adjacent
+    BatchSlot *slots = malloc(sizeof(BatchSlot) * count);
+    if (!slots) return ERR_INTERNAL_ERROR;
+    size_t slot_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        entries[i] = NULL;
+        if (!paths[i]) {
+            results[i] = ERR_INVALID_ARGUMENT;
+            continue;
+        }
+        slots[slot_count].path = paths[i];
+        slots[slot_count].index = i;
+        slot_count++;
+    }
+    qsort(slots, slot_count, sizeof(BatchSlot), batch_slot_compare);
+
+    // trail[k] is the entry reached after the first k components of the
+    // previous path; only its first prev_resolved + 1 slots are valid
+    DirectoryEntry **trail = NULL;
+    size_t trail_capacity = 0;
+    char **prev_tokens = NULL;
+    size_t prev_count = 0;
+    size_t prev_resolved = 0;
+    ErrorCode status = ERR_SUCCESS;
+    size_t s;
+
+    for (s = 0; s < slot_count; ++s) {
+        const char *path = slots[s].path;
+        size_t idx = slots[s].index;
+
+        size_t tokens_count = 0;
+        char **tokens = split_path(path, &tokens_count);
+        if ((!tokens && tokens_count > 0) || (tokens_count == 0 && strcmp(path, "/") != 0)) {
+            free_tokens(tokens, tokens_count);
+            results[idx] = ERR_INVALID_ARGUMENT;
+            continue;
+        }
+
+        if (tokens_count + 1 > trail_capacity) {
+            size_t new_capacity = trail_capacity ? trail_capacity * 2 : 16;
+            while (new_capacity < tokens_count + 1) new_capacity *= 2;
+            DirectoryEntry **new_trail = realloc(trail, sizeof(DirectoryEntry *) * new_capacity);
+            if (!new_trail) {
+                free_tokens(tokens, tokens_count);
+                status = ERR_INTERNAL_ERROR;
+                break;
+            }
+            trail = new_trail;
+            trail_capacity = new_capacity;
+        }
+        trail[0] = root;
+
+        // Skip the components already resolved for the previous path
+        size_t depth = 0;
+        while (depth < tokens_count && depth < prev_resolved &&
+               strcmp(tokens[depth], prev_tokens[depth]) == 0) {
+            depth++;
+        }
+
+        DirectoryEntry *current = trail[depth];
+        ErrorCode err = ERR_SUCCESS;
+        while (depth < tokens_count) {
+            pthread_rwlock_rdlock(&current->lock);
+            DirectoryEntry *child = find_child(current, tokens[depth]);
+            pthread_rwlock_unlock(&current->lock);
+            if (!child) {
+                err = ERR_NOT_FOUND;
+                break;
+            }
+            current = child;
+            trail[++depth] = current;
+        }
+
+        results[idx] = err;
+        entries[idx] = (err == ERR_SUCCESS) ? current : NULL;
+
+        free_tokens(prev_tokens, prev_count);
+        prev_tokens = tokens;
+        prev_count = tokens_count;
+        prev_resolved = depth;
+    }
+
+    // Paths left unresolved after an allocation failure get the error
+    for (; s < slot_count; ++s) {
+        results[slots[s].index] = status;
+    }
+
+    free_tokens(prev_tokens, prev_count);
+    free(trail);
+    free(slots);
+    return status;
+}
+
+// State of one directory_list call
+typedef struct {
+    int recursive;
+    ListEntry *entries;
+    uint32_t max_entries;
+    uint32_t count;
+    int has_more;
+} ListContext;
+
+// Append path to prefix in buf; returns the new length or 0 if it does not fit
+static size_t join_path(char *buf, size_t prefix_len, const char *name) {
+    size_t name_len = strlen(name);
+    size_t sep = prefix_len > 0 ? 1 : 0;
+    if (prefix_len + sep + name_len >= sizeof(((ListEntry *)0)->path)) return 0;
+    if (sep) buf[prefix_len] = '/';
+    memcpy(buf + prefix_len + sep, name, name_len + 1);
+    return prefix_len + sep + name_len;
+}
+
+static void fill_list_entry(ListEntry *out, DirectoryEntry *entry, const char *path) {
+    memset(out, 0, sizeof(*out));
+    strncpy(out->path, path, sizeof(out->path) - 1);
+    out->is_directory = entry->is_directory;
+    if (entry->metadata) {
+        out->size = entry->metadata->size;
+        out->permissions = entry->metadata->permissions;
+        if (entry->metadata->storage_server_ip) {
+            strncpy(out->storage_server_ip, entry->metadata->storage_server_ip, sizeof(out->storage_server_ip) - 1);
+        }
+        out->storage_server_port = entry->metadata->storage_server_port;
+    }
+}
+
+ErrorCode directory_stat(const char *path, ListEntry *out) {
+    if (!path || !out) return ERR_INVALID_ARGUMENT;
+    DirectoryEntry *entry;
+    ErrorCode err = directory_lookup(path, &entry);
+    if (err != ERR_SUCCESS) return err;
+    pthread_rwlock_rdlock(&entry->lock);
+    fill_list_entry(out, entry, path);
+    pthread_rwlock_unlock(&entry->lock);
+    return ERR_SUCCESS;
+}
+
+// Emit the children of dir in pre-order, skipping everything up to and
+// including the entry named by cursor. Returns 1 once the page is full.
+static int list_walk(DirectoryEntry *dir, char *path, size_t path_len, char **cursor, size_t cursor_count, ListContext *ctx) {
+    pthread_rwlock_rdlock(&dir->lock);
+
+    size_t start = 0;
+    if (cursor_count > 0) {
+        int found;
+        start = child_lower_bound(dir, cursor[0], &found);
+        if (found) {
+            // The cursor entry itself was already returned; resume inside it
+            DirectoryEntry *child = dir->children[start];
+            size_t child_len = join_path(path, path_len, child->name);
+            if (ctx->recursive && child->is_directory && child_len > 0 &&
+                list_walk(child, path, child_len, cursor + 1, cursor_count - 1, ctx)) {
+                pthread_rwlock_unlock(&dir->lock);
+                return 1;
+            }
+            start++;
+        }
+    }
+
+    for (size_t i = start; i < dir->child_count; ++i) {
+        DirectoryEntry *child = dir->children[i];
+        size_t child_len = join_path(path, path_len, child->name);
+        if (child_len == 0) continue; // Too long to report
+
+        if (ctx->count == ctx->max_entries) {
+            ctx->has_more = 1;
+            pthread_rwlock_unlock(&dir->lock);
+            return 1;
+        }
+        fill_list_entry(&ctx->entries[ctx->count++], child, path);
+
+        if (ctx->recursive && child->is_directory &&
+            list_walk(child, path, child_len, NULL, 0, ctx)) {
+            pthread_rwlock_unlock(&dir->lock);
+            return 1;
+        }
+    }
+
+    pthread_rwlock_unlock(&dir->lock);
+    return 0;
+}
+
+ErrorCode directory_list(const char *path, int recursive, const char *cursor,
+                         ListEntry *entries, uint32_t max_entries, uint32_t *count,
+                         char *next_cursor, size_t next_cursor_size, int *has_more) {
+    if (!path || !entries || !count || !next_cursor || !has_more || max_entries == 0)
+        return ERR_INVALID_ARGUMENT;
+
+    DirectoryEntry *dir;
+    ErrorCode err = directory_lookup(path, &dir);
+    if (err != ERR_SUCCESS) return err;
+
+    // Paths are reported relative to the root, without a leading slash
+    size_t path_tokens_count = 0;
+    char **path_tokens = split_path(path, &path_tokens_count);
+    char prefix[sizeof(((ListEntry *)0)->path)] = "";
+    size_t prefix_len = 0;
+    for (size_t i = 0; i < path_tokens_count; ++i) {
+        prefix_len = join_path(prefix, prefix_len, path_tokens[i]);
+        if (prefix_len == 0) {
+            free_tokens(path_tokens, path_tokens_count);
+            return ERR_INVALID_ARGUMENT;
+        }
+    }
+
+    // The cursor must name an entry below the listed directory
+    char **cursor_tokens = NULL;
+    size_t cursor_count = 0;
+    if (cursor && cursor[0] != '\0') {
+        cursor_tokens = split_path(cursor, &cursor_count);
+        int valid = cursor_tokens && cursor_count > path_tokens_count;
+        for (size_t i = 0; valid && i < path_tokens_count; ++i) {
+            valid = strcmp(cursor_tokens[i], path_tokens[i]) == 0;
+        }
+        if (!valid) {
+            free_tokens(cursor_tokens, cursor_count);
+            free_tokens(path_tokens, path_tokens_count);
+            return ERR_INVALID_ARGUMENT;
+        }
+    }
+
+    ListContext ctx = {
+        .recursive = recursive,
+        .entries = entries,
+        .max_entries = max_entries,
+        .count = 0,
+        .has_more = 0
+    };
+
+    if (!dir->is_directory) {
+        // Listing a file reports the file itself
+        if (!cursor_tokens) fill_list_entry(&entries[ctx.count++], dir, prefix);
+    } else {
+        list_walk(dir, prefix, prefix_len,
+                  cursor_tokens ? cursor_tokens + path_tokens_count : NULL,
+                  cursor_tokens ? cursor_count - path_tokens_count : 0, &ctx);
+    }
+
+    *count = ctx.count;
+    *has_more = ctx.has_more;
+    if (ctx.count > 0) {
+        strncpy(next_cursor, entries[ctx.count - 1].path, next_cursor_size - 1);
+        next_cursor[next_cursor_size - 1] = '\0';
+    } else {
+        next_cursor[0] = '\0';
+    }
+
+    free_tokens(cursor_tokens, cursor_count);
+    free_tokens(path_tokens, path_tokens_count);
+    return ERR_SUCCESS;
+}
+
+static void walk_entry(DirectoryEntry *entry, char *path, size_t path_len, directory_visit_t visit, void *ctx) {
+    pthread_rwlock_rdlock(&entry->lock);
+    visit(path, entry, ctx);
+    for (size_t i = 0; i < entry->child_count; ++i) {
+        DirectoryEntry *child = entry->children[i];
+        size_t child_len = join_path(path, path_len, child->name);
+        if (child_len == 0) continue; // Too long to report
+        walk_entry(child, path, child_len, visit, ctx);
+        path[path_len] = '\0';
+    }
+    pthread_rwlock_unlock(&entry->lock);
+}
+
+void directory_walk(directory_visit_t visit, void *ctx) {
+    if (!root || !visit) return;
+    char path[sizeof(((ListEntry *)0)->path)] = "";
+    walk_entry(root, path, 0, visit, ctx);
+}
+
+// Report every file below entry, which is no longer in the tree
+static void notify_subtree(DirectoryEntry *entry, char *path, size_t path_len) {
+    if (entry->metadata) notify_change(path);
+    for (size_t i = 0; i < entry->child_count; ++i) {
+        size_t child_len = join_path(path, path_len, entry->children[i]->name);
+        if (child_len == 0) continue;
+        notify_subtree(entry->children[i], path, child_len);
+        path[path_len] = '\0';
+    }
+}
+
+void directory_reset() {
+    if (!root) return;
+
+    pthread_rwlock_wrlock(&root->lock);
+    DirectoryEntry **children = root->children;
+    size_t child_count = root->child_count;
+    FileMetadata *delegation = root->delegation;
+    root->children = NULL;
+    root->child_count = 0;
+    root->child_capacity = 0;
+    root->delegation = NULL;
+    pthread_rwlock_unlock(&root->lock);
+
+    char path[sizeof(((ListEntry *)0)->path)];
+    for (size_t i = 0; i < child_count; ++i) {
+        size_t len = join_path(path, 0, children[i]->name);
+        if (len > 0) notify_subtree(children[i], path, len);
+        directory_free(children[i]);
+    }
+    free(children);
+    if (delegation) {
+        free(delegation->storage_server_ip);
+        free(delegation);
+    }
+}
@@ -1,6 +1,8 @@
 // src/naming_server/src/health.c
 
 #include "health.h"
+#include "hash.h"
+#include "timer_wheel.h"
 #include "network.h"
 #include "protocol.h"
 #include "errors.h"
@@ -11,15 +13,43 @@
 #include <time.h>
 #include <unistd.h>
 
-#define MAX_SERVERS 100
-#define HEARTBEAT_TIMEOUT 15 // Seconds
+#define HEALTH_BUCKETS 4096
 
-static StorageServer servers_list[MAX_SERVERS];
-static int server_count = 0;
+typedef struct HealthEntry {
+    StorageServer server;
+    TimerEntry deadline;        // Fires when the server misses its heartbeat
+    struct HealthEntry *next;   // Bucket chain
+} HealthEntry;
+
+// Registry keyed by host:port, plus a dense list for iteration
+static HealthEntry *buckets[HEALTH_BUCKETS];
+static HealthEntry **entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static int active_count = 0;
+static TimerWheel *deadlines = NULL;
 static pthread_mutex_t servers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static health_failure_callback_t failure_callback = NULL;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t hash_server(const char *host, const char *port) {
+    return fnv_hash_server(host, port) % HEALTH_BUCKETS;
+}
+
+void health_set_failure_callback(health_failure_callback_t callback) {
+    failure_callback = callback;
+}
 
 void health_init() {
-    pthread_mutex_init(&servers_mutex, NULL);
+    pthread_mutex_lock(&servers_mutex);
+    deadlines = timer_wheel_create(HEALTH_TICK_MS, now_ms());
+    pthread_mutex_unlock(&servers_mutex);
+
     // Start the health monitor thread
     pthread_t monitor_thread;
     pthread_create(&monitor_thread, NULL, health_monitor, NULL);
@@ -27,49 +57,156 @@ void health_init() {
 }
 
 void health_cleanup() {
-    pthread_mutex_destroy(&servers_mutex);
+    pthread_mutex_lock(&servers_mutex);
+    timer_wheel_destroy(deadlines);
+    deadlines = NULL;
+    for (int i = 0; i < entry_count; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = entry_capacity = active_count = 0;
+    memset(buckets, 0, sizeof(buckets));
+    pthread_mutex_unlock(&servers_mutex);
 }
 
-void health_receive_heartbeat(const char *host, const char *port, int load) {
-    pthread_mutex_lock(&servers_mutex);
+// Caller holds servers_mutex
+static HealthEntry *find_entry(const char *host, const char *port) {
+    for (HealthEntry *entry = buckets[hash_server(host, port)]; entry; entry = entry->next) {
+        if (strcmp(entry->server.host, host) == 0 && strcmp(entry->server.port, port) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Find a server, adding it if it is new. Caller holds servers_mutex.
+static HealthEntry *find_or_add_entry(const char *host, const char *port) {
+    HealthEntry *entry = find_entry(host, port);
+    if (entry) return entry;
 
-    // Check if the server is already in the list
-    for (int i = 0; i < server_count; i++) {
-        if (strcmp(servers_list[i].host, host) == 0 && strcmp(servers_list[i].port, port) == 0) {
-            // Update existing server's info
-            servers_list[i].last_heartbeat = time(NULL);
-            servers_list[i].load = load;
-            servers_list[i].active = 1;
-            pthread_mutex_unlock(&servers_mutex);
-            return;
+    if (entry_count == entry_capacity) {
+        int capacity = entry_capacity ? entry_capacity * 2 : 64;
+        HealthEntry **grown = realloc(entries, capacity * sizeof(HealthEntry *));
+        if (!grown) {
+            fprintf(stderr, "Out of memory adding storage server %s:%s\n", host, port);
+            return NULL;
         }
+        entries = grown;
+        entry_capacity = capacity;
+    }
+
+    entry = calloc(1, sizeof(HealthEntry));
+    if (!entry) {
+        fprintf(stderr, "Out of memory adding storage server %s:%s\n", host, port);
+        return NULL;
+    }
+    strncpy(entry->server.host, host, sizeof(entry->server.host) - 1);
+    strncpy(entry->server.port, port, sizeof(entry->server.port) - 1);
+    entry->deadline.data = entry;
+
+    uint32_t bucket = hash_server(host, port);
+    entry->next = buckets[bucket];
+    buckets[bucket] = entry;
+    entries[entry_count++] = entry;
+    return entry;
+}
+
+// The server was heard from: mark it alive and push its deadline out by one
+// heartbeat interval plus slack for jitter. Caller holds servers_mutex.
+static void mark_alive(HealthEntry *entry) {
+    if (!entry->server.active) {
+        entry->server.active = 1;
+        active_count++;
     }
+    entry->server.last_heartbeat = time(NULL);
+    if (deadlines) {
+        timer_wheel_schedule(deadlines, &entry->deadline, now_ms() + HEARTBEAT_INTERVAL_MS + HEALTH_GRACE_MS);
+    }
+}
 
-    // Add new server if there's space
-    if (server_count < MAX_SERVERS) {
-        strncpy(servers_list[server_count].host, host, sizeof(servers_list[server_count].host) - 1);
-        strncpy(servers_list[server_count].port, port, sizeof(servers_list[server_count].port) - 1);
-        servers_list[server_count].last_heartbeat = time(NULL);
-        servers_list[server_count].load = load;
-        servers_list[server_count].active = 1;
-        server_count++;
-    } else {
-        fprintf(stderr, "Server list full. Cannot add new server %s:%s\n", host, port);
+// Caller holds servers_mutex
+static void apply_heartbeat(const char *host, const char *port, const HeartbeatMessage *hb) {
+    HealthEntry *entry = find_or_add_entry(host, port);
+    if (entry) {
+        StorageServer *server = &entry->server;
+        server->load = hb->load;
+        server->capacity_mb = hb->capacity_mb;
+        server->free_mb = hb->free_mb;
+        server->read_latency_us = hb->read_latency_us;
+        server->write_latency_us = hb->write_latency_us;
+        server->bytes_in_per_sec = hb->bytes_in_per_sec;
+        server->bytes_out_per_sec = hb->bytes_out_per_sec;
+        server->queue_depth = hb->queue_depth;
+        server->open_streams = hb->open_streams;
+        mark_alive(entry);
     }
+}
 
+void health_receive_heartbeat(const char *host, const char *port, const HeartbeatMessage *hb) {
+    pthread_mutex_lock(&servers_mutex);
+    apply_heartbeat(host, port, hb);
     pthread_mutex_unlock(&servers_mutex);
 }
 
-ErrorCode health_get_servers(StorageServer **servers_out, int *count_out) {
+void health_receive_heartbeats(const HeartbeatReport *reports, int count) {
+    pthread_mutex_lock(&servers_mutex);
+    for (int i = 0; i < count; i++) {
+        apply_heartbeat(reports[i].host, reports[i].message.port, &reports[i].message);
+    }
+    pthread_mutex_unlock(&servers_mutex);
+}
+
+double health_server_cost(const StorageServer *server) {
+    // Only trust free space on servers that report a capacity at all
+    if (server->capacity_mb > 0 && server->free_mb < HEALTH_MIN_FREE_MB) {
+        return HEALTH_COST_EXCLUDED;
+    }
+
+    // Each waiting or in-flight request counts one, a millisecond of average
+    // latency one, every 64 MB/s of traffic one and an open stream a half
+    double latency_ms = (server->read_latency_us + server->write_latency_us) / 2000.0;
+    double throughput = (double)(server->bytes_in_per_sec + server->bytes_out_per_sec) / (64.0 * 1024 * 1024);
+    return server->queue_depth + server->load + latency_ms + throughput + server->open_streams * 0.5;
+}
+
+ErrorCode health_get_server(const char *host, const char *port, StorageServer *server) {
     pthread_mutex_lock(&servers_mutex);
+    HealthEntry *entry = find_entry(host, port);
+    if (entry) {
+        *server = entry->server;
+    }
+    pthread_mutex_unlock(&servers_mutex);
+    return entry ? ERR_SUCCESS : ERR_NOT_FOUND;
+}
 
-    int active_count = 0;
-    for (int i = 0; i < server_count; i++) {
-        if (servers_list[i].active) {
-            active_count++;
-        }
+uint64_t health_get_generation(const char *host, const char *port) {
+    uint64_t generation = 0;
+    pthread_mutex_lock(&servers_mutex);
+    HealthEntry *entry = find_entry(host, port);
+    if (entry) {
+        generation = entry->server.inventory_generation;
+    }
+    pthread_mutex_unlock(&servers_mutex);
+    return generation;
+}
+
+void health_set_generation(const char *host, const char *port, uint64_t generation) {
+    pthread_mutex_lock(&servers_mutex);
+
+    // A server that just registered counts as alive
+    HealthEntry *entry = find_or_add_entry(host, port);
+    if (entry) {
+        entry->server.inventory_generation = generation;
+        mark_alive(entry);
     }
 
+    pthread_mutex_unlock(&servers_mutex);
+}
+
+ErrorCode health_get_servers(StorageServer **servers_out, int *count_out) {
+    pthread_mutex_lock(&servers_mutex);
+
     if (active_count == 0) {
         pthread_mutex_unlock(&servers_mutex);
         return ERR_NOT_FOUND;
@@ -82,32 +219,62 @@ ErrorCode health_get_servers(StorageServer **servers_out, int *count_out) {
     }
 
     int idx = 0;
-    for (int i = 0; i < server_count; i++) {
-        if (servers_list[i].active) {
-            active_servers[idx++] = servers_list[i];
+    for (int i = 0; i < entry_count && idx < active_count; i++) {
+        if (entries[i]->server.active) {
+            active_servers[idx++] = entries[i]->server;
         }
     }
 
     *servers_out = active_servers;
-    *count_out = active_count;
+    *count_out = idx;
 
     pthread_mutex_unlock(&servers_mutex);
     return ERR_SUCCESS;
 }
 
+// Servers whose deadline passed during one advance of the wheel
+typedef struct {
+    StorageServer *servers;
+    int count;
+    int capacity;
+} FailedServers;
+
+// Timer wheel callback; runs under servers_mutex
+static void deadline_expired(TimerEntry *timer, void *arg) {
+    HealthEntry *entry = timer->data;
+    FailedServers *failed = arg;
+
+    entry->server.active = 0;
+    active_count--;
+    fprintf(stderr, "Storage server %s:%s is inactive\n", entry->server.host, entry->server.port);
+
+    if (failed->count == failed->capacity) {
+        int capacity = failed->capacity ? failed->capacity * 2 : 16;
+        StorageServer *grown = realloc(failed->servers, capacity * sizeof(StorageServer));
+        if (!grown) return; // Still marked inactive, just not reported
+        failed->servers = grown;
+        failed->capacity = capacity;
+    }
+    failed->servers[failed->count++] = entry->server;
+}
+
 void *health_monitor(void *arg) {
+    (void)arg;
     while (1) {
-        sleep(HEARTBEAT_TIMEOUT);
+        usleep(HEALTH_TICK_MS * 1000);
+        FailedServers failed = { NULL, 0, 0 };
+
         pthread_mutex_lock(&servers_mutex);
-        time_t now = time(NULL);
-        for (int i = 0; i < server_count; i++) {
-            if (servers_list[i].active && (now - servers_list[i].last_heartbeat) > HEARTBEAT_TIMEOUT) {
-                servers_list[i].active = 0;
-                fprintf(stderr, "Storage server %s:%s is inactive\n", servers_list[i].host, servers_list[i].port);
-                // Optionally trigger replication or failover mechanisms here
-            }
+        if (deadlines) {
+            timer_wheel_advance(deadlines, now_ms(), deadline_expired, &failed);
         }
         pthread_mutex_unlock(&servers_mutex);
+
+        // Run the callbacks without the lock so they may query the registry
+        for (int i = 0; i < failed.count && failure_callback; i++) {
+            failure_callback(failed.servers[i].host, failed.servers[i].port);
+        }
+        free(failed.servers);
     }
     return NULL;
-}
\ No newline at end of file
+}
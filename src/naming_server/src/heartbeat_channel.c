@@ -0,0 +1,220 @@
+// src/naming_server/src/heartbeat_channel.c
+
+#include "heartbeat_channel.h"
+#include "health.h"
+#include "protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define FRAME_SIZE (sizeof(MessageHeader) + sizeof(HeartbeatMessage))
+
+typedef struct {
+    NetworkSocket *sock;
+    char ip[INET_ADDRSTRLEN];
+    char port[32];              // Storage server port, for logging
+    uint8_t buffer[FRAME_SIZE]; // Partial frame carried between reads
+    size_t buffered;
+    uint64_t last_frame_ms;
+    int index;                  // Position in channels
+} Channel;
+
+static Channel **channels = NULL;
+static int channel_count = 0;
+static int channel_capacity = 0;
+static int epoll_fd = -1;
+static volatile int channel_running = 0;
+static pthread_t channel_thread;
+static pthread_mutex_t channel_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Caller holds channel_mutex
+static void close_channel(Channel *channel) {
+    int fd = network_socket_get_fd(channel->sock);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+    // Swap the last channel into the hole
+    channels[channel->index] = channels[--channel_count];
+    channels[channel->index]->index = channel->index;
+
+    network_socket_close(channel->sock);
+    free(channel);
+}
+
+// Pull whatever the connection has and append complete heartbeats to
+// reports. Returns 0 once the connection is drained, -1 if it must close.
+static int drain_channel(Channel *channel, HeartbeatReport **reports, int *count, int *capacity) {
+    int fd = network_socket_get_fd(channel->sock);
+    while (1) {
+        ssize_t received = recv(fd, channel->buffer + channel->buffered, FRAME_SIZE - channel->buffered, 0);
+        if (received == 0) return -1;
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        channel->buffered += received;
+        if (channel->buffered < FRAME_SIZE) continue;
+        channel->buffered = 0;
+        channel->last_frame_ms = now_ms();
+
+        MessageHeader *header = (MessageHeader *)channel->buffer;
+        if (header->type != MSG_TYPE_HEARTBEAT || ntohl(header->payload_size) != sizeof(HeartbeatMessage)) {
+            fprintf(stderr, "Unexpected message on heartbeat channel from %s\n", channel->ip);
+            return -1;
+        }
+
+        if (*count == *capacity) {
+            int grown_capacity = *capacity ? *capacity * 2 : 64;
+            HeartbeatReport *grown = realloc(*reports, grown_capacity * sizeof(HeartbeatReport));
+            if (!grown) return 0; // Drop this one; the next will do
+            *reports = grown;
+            *capacity = grown_capacity;
+        }
+        HeartbeatReport *report = &(*reports)[(*count)++];
+        snprintf(report->host, sizeof(report->host), "%s", channel->ip);
+        memcpy(&report->message, channel->buffer + sizeof(MessageHeader), sizeof(HeartbeatMessage));
+    }
+}
+
+static void *channel_loop(void *arg) {
+    (void)arg;
+    struct epoll_event events[HEARTBEAT_CHANNEL_MAX_EVENTS];
+    HeartbeatReport *reports = NULL;
+    int report_capacity = 0;
+    uint64_t last_sweep = now_ms();
+
+    while (channel_running) {
+        int ready = epoll_wait(epoll_fd, events, HEARTBEAT_CHANNEL_MAX_EVENTS, HEALTH_TICK_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        int report_count = 0;
+        pthread_mutex_lock(&channel_mutex);
+        for (int i = 0; i < ready; i++) {
+            Channel *channel = events[i].data.ptr;
+            if (drain_channel(channel, &reports, &report_count, &report_capacity) != 0) {
+                printf("Heartbeat channel from %s:%s closed\n", channel->ip, channel->port);
+                close_channel(channel);
+            }
+        }
+
+        // Close channels whose server went quiet without closing them; the
+        // registry has already declared the server failed by now
+        uint64_t now = now_ms();
+        if (now - last_sweep >= 1000) {
+            last_sweep = now;
+            for (int i = channel_count - 1; i >= 0; i--) {
+                if (now - channels[i]->last_frame_ms > HEARTBEAT_CHANNEL_IDLE_MS) {
+                    printf("Heartbeat channel from %s:%s timed out\n", channels[i]->ip, channels[i]->port);
+                    close_channel(channels[i]);
+                }
+            }
+        }
+        pthread_mutex_unlock(&channel_mutex);
+
+        if (report_count > 0) {
+            health_receive_heartbeats(reports, report_count);
+        }
+    }
+
+    free(reports);
+    return NULL;
+}
+
+ErrorCode heartbeat_channel_init() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return ERR_INTERNAL_ERROR;
+    }
+
+    channel_running = 1;
+    if (pthread_create(&channel_thread, NULL, channel_loop, NULL) != 0) {
+        channel_running = 0;
+        close(epoll_fd);
+        epoll_fd = -1;
+        return ERR_INTERNAL_ERROR;
+    }
+    return ERR_SUCCESS;
+}
+
+ErrorCode heartbeat_channel_adopt(NetworkSocket *sock, const char *ip, const char *port) {
+    int fd = network_socket_get_fd(sock);
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return ERR_NETWORK_FAILURE;
+    }
+
+    Channel *channel = calloc(1, sizeof(Channel));
+    if (!channel) return ERR_INTERNAL_ERROR;
+    channel->sock = sock;
+    snprintf(channel->ip, sizeof(channel->ip), "%s", ip);
+    snprintf(channel->port, sizeof(channel->port), "%s", port);
+    channel->last_frame_ms = now_ms();
+
+    pthread_mutex_lock(&channel_mutex);
+    if (channel_count == channel_capacity) {
+        int capacity = channel_capacity ? channel_capacity * 2 : 64;
+        Channel **grown = realloc(channels, capacity * sizeof(Channel *));
+        if (!grown) {
+            pthread_mutex_unlock(&channel_mutex);
+            free(channel);
+            return ERR_INTERNAL_ERROR;
+        }
+        channels = grown;
+        channel_capacity = capacity;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = channel;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        pthread_mutex_unlock(&channel_mutex);
+        free(channel);
+        return ERR_NETWORK_FAILURE;
+    }
+    channel->index = channel_count;
+    channels[channel_count++] = channel;
+    pthread_mutex_unlock(&channel_mutex);
+
+    printf("Heartbeat channel from %s:%s opened\n", ip, port);
+    return ERR_SUCCESS;
+}
+
+void heartbeat_channel_cleanup() {
+    if (channel_running) {
+        channel_running = 0;
+        pthread_join(channel_thread, NULL);
+    }
+
+    pthread_mutex_lock(&channel_mutex);
+    while (channel_count > 0) {
+        close_channel(channels[channel_count - 1]);
+    }
+    free(channels);
+    channels = NULL;
+    channel_capacity = 0;
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    pthread_mutex_unlock(&channel_mutex);
+}
@@ -0,0 +1,545 @@
+// src/naming_server/src/hotspot.c
+
+#include "hotspot.h"
+#include "hash.h"
+#include "directory.h"
+#include "health.h"
+#include "command_channel.h"
+#include "log_shipping.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SKETCH_BUCKETS 512
+#define SLOT_NONE 0xffffffffu
+
+// One space-saving counter. count overestimates the path's decayed lookups
+// by at most error, the count of the path it evicted.
+typedef struct {
+    char path[256];
+    double count;
+    double error;
+    uint32_t next;              // Bucket chain, a counter index
+} HotCounter;
+
+static HotCounter counters[HOTSPOT_COUNTERS];
+static uint32_t counter_count = 0;
+static uint32_t buckets[SKETCH_BUCKETS];
+static pthread_mutex_t sketch_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef enum {
+    COPY_EMPTY = 0,
+    COPY_PENDING,               // COPY command submitted
+    COPY_DONE,                  // The server has it, not yet listed
+    COPY_FAILED,
+    COPY_HELD,                  // Listed as a replica
+    COPY_RETIRING,              // Unlisted; deleted on the next tick
+} CopyState;
+
+typedef struct {
+    char ip[256];               // As the health registry names the server
+    char port[32];
+    int state;                  // CopyState, set by command callbacks too
+    uint32_t epoch;             // Promotion epoch the copy was made in
+} HotCopy;
+
+typedef enum {
+    WATCH_NONE = 0,
+    WATCH_PENDING,              // WATCH command submitted to the primary
+    WATCH_ARMED,                // The primary reports the next write
+} WatchState;
+
+// A hot file and the copies made of it. Only the monitor thread touches
+// the copies, apart from command callbacks completing a copy's state. The
+// rest is also read by write reports and watch callbacks, under
+// promotion_mutex.
+typedef struct {
+    char path[256];
+    int used;
+    int watch;                  // WatchState
+    char source_ip[INET_ADDRSTRLEN];    // Primary the watch is on
+    char source_port[16];
+    uint32_t epoch;             // Bumped whenever the file may have been written
+    int written;                // Copies to retire at once
+    uint32_t quiet;             // Ticks left before copies are made again after a write
+    HotCopy copies[HOTSPOT_EXTRA_COPIES];
+} Promotion;
+
+// What a WATCH command was submitted for
+typedef struct {
+    Promotion *promotion;
+    uint32_t epoch;
+} WatchArm;
+
+static Promotion promotions[HOTSPOT_MAX_PROMOTED];
+static pthread_mutex_t promotion_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t monitor;
+static int running = 0;
+
+// Wakes the monitor between ticks when a write was reported
+static pthread_mutex_t monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_wake;           // On CLOCK_MONOTONIC, set up by hotspot_init
+static int writes_reported = 0;
+
+// Rates as of the last tick, copied out of the sketch for the monitor
+typedef struct {
+    char path[256];
+    double rate;
+} HotRate;
+
+static HotRate rates[HOTSPOT_COUNTERS];
+static uint32_t rate_count = 0;
+
+static uint32_t hash_path(const char *path) {
+    return fnv_hash(path) % SKETCH_BUCKETS;
+}
+
+static void unlink_counter(uint32_t index) {
+    uint32_t *link = &buckets[hash_path(counters[index].path)];
+    while (*link != SLOT_NONE && *link != index) {
+        link = &counters[*link].next;
+    }
+    if (*link == index) *link = counters[index].next;
+}
+
+void hotspot_record(const char *path) {
+    if (!path || strlen(path) >= sizeof(counters[0].path)) return;
+    uint32_t bucket = hash_path(path);
+
+    pthread_mutex_lock(&sketch_mutex);
+    for (uint32_t i = buckets[bucket]; i != SLOT_NONE; i = counters[i].next) {
+        if (strcmp(counters[i].path, path) == 0) {
+            counters[i].count += 1;
+            pthread_mutex_unlock(&sketch_mutex);
+            return;
+        }
+    }
+
+    // Not tracked: take a free counter, or the smallest one, whose count
+    // the newcomer inherits as its error
+    uint32_t index;
+    double inherited = 0;
+    if (counter_count < HOTSPOT_COUNTERS) {
+        index = counter_count++;
+    } else {
+        index = 0;
+        for (uint32_t i = 1; i < HOTSPOT_COUNTERS; i++) {
+            if (counters[i].count < counters[index].count) index = i;
+        }
+        inherited = counters[index].count;
+        unlink_counter(index);
+    }
+    HotCounter *counter = &counters[index];
+    strcpy(counter->path, path);
+    counter->count = inherited + 1;
+    counter->error = inherited;
+    counter->next = buckets[bucket];
+    buckets[bucket] = index;
+    pthread_mutex_unlock(&sketch_mutex);
+}
+
+// Age every count by one tick and note the lookup rates it implies. A count
+// kept at HOTSPOT_DECAY per tick settles at rate * tick / (1 - HOTSPOT_DECAY),
+// and only the part of it the sketch guarantees is counted.
+static void decay_sketch() {
+    pthread_mutex_lock(&sketch_mutex);
+    rate_count = 0;
+    for (uint32_t i = 0; i < counter_count; i++) {
+        counters[i].count *= HOTSPOT_DECAY;
+        counters[i].error *= HOTSPOT_DECAY;
+        memcpy(rates[rate_count].path, counters[i].path, sizeof(rates[0].path));
+        rates[rate_count].rate = (counters[i].count - counters[i].error) * (1 - HOTSPOT_DECAY) * 1000.0 / HOTSPOT_TICK_MS;
+        rate_count++;
+    }
+    pthread_mutex_unlock(&sketch_mutex);
+}
+
+static double rate_of(const char *path) {
+    for (uint32_t i = 0; i < rate_count; i++) {
+        if (strcmp(rates[i].path, path) == 0) return rates[i].rate;
+    }
+    return 0;
+}
+
+static void copy_done(ErrorCode status, void *arg) {
+    HotCopy *copy = arg;
+    if (status != ERR_SUCCESS) {
+        fprintf(stderr, "Copy of hot file to %s:%s failed: %s\n", copy->ip, copy->port, error_string(status));
+    }
+    __atomic_store_n(&copy->state, status == ERR_SUCCESS ? COPY_DONE : COPY_FAILED, __ATOMIC_RELEASE);
+}
+
+static void retire_done(ErrorCode status, void *arg) {
+    (void)arg;
+    if (status != ERR_SUCCESS && status != ERR_FILE_NOT_FOUND) {
+        fprintf(stderr, "Failed to delete a retired copy: %s\n", error_string(status));
+    }
+}
+
+static int holds(const FileReplica *holders, uint32_t count, const char *ip, const char *port) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (holders[i].port == (uint16_t)atoi(port) && strcmp(holders[i].ip, ip) == 0) return 1;
+    }
+    return 0;
+}
+
+static uint32_t current_epoch(Promotion *promotion) {
+    pthread_mutex_lock(&promotion_mutex);
+    uint32_t epoch = promotion->epoch;
+    pthread_mutex_unlock(&promotion_mutex);
+    return epoch;
+}
+
+static void watch_done(ErrorCode status, void *arg) {
+    WatchArm *arm = arg;
+    Promotion *promotion = arm->promotion;
+    pthread_mutex_lock(&promotion_mutex);
+    if (promotion->used && promotion->epoch == arm->epoch && promotion->watch == WATCH_PENDING) {
+        promotion->watch = status == ERR_SUCCESS ? WATCH_ARMED : WATCH_NONE;
+    }
+    pthread_mutex_unlock(&promotion_mutex);
+    if (status != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to watch hot file %s for writes: %s\n", promotion->path, error_string(status));
+    }
+    free(arm);
+}
+
+// Copies are only made while the primary watches the file, so the first
+// write to it retires them. Returns 1 once that watch is in place, arming it
+// otherwise.
+static int watch_ready(Promotion *promotion, const FileReplica *primary) {
+    if (promotion->quiet > 0) return 0;
+    char port[16];
+    snprintf(port, sizeof(port), "%u", primary->port);
+
+    pthread_mutex_lock(&promotion_mutex);
+    int same = strcmp(promotion->source_ip, primary->ip) == 0 && strcmp(promotion->source_port, port) == 0;
+    if (same && promotion->watch != WATCH_NONE) {
+        int armed = promotion->watch == WATCH_ARMED;
+        pthread_mutex_unlock(&promotion_mutex);
+        return armed;
+    }
+    // The primary moved, so nothing tells of writes to copies made before
+    if (promotion->watch != WATCH_NONE) promotion->epoch++;
+    snprintf(promotion->source_ip, sizeof(promotion->source_ip), "%s", primary->ip);
+    snprintf(promotion->source_port, sizeof(promotion->source_port), "%s", port);
+    promotion->watch = WATCH_PENDING;
+    uint32_t epoch = promotion->epoch;
+    pthread_mutex_unlock(&promotion_mutex);
+
+    WatchArm *arm = malloc(sizeof(WatchArm));
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_WATCH;
+    strncpy(command.path, promotion->path, sizeof(command.path) - 1);
+    if (arm) {
+        arm->promotion = promotion;
+        arm->epoch = epoch;
+    }
+    if (!arm || command_submit(promotion->source_ip, promotion->source_port, &command, watch_done, arm) != ERR_SUCCESS) {
+        free(arm);
+        pthread_mutex_lock(&promotion_mutex);
+        if (promotion->epoch == epoch) promotion->watch = WATCH_NONE;
+        pthread_mutex_unlock(&promotion_mutex);
+    }
+    return 0;
+}
+
+// Order copies of a hot file onto the least loaded servers without one
+static void add_copies(Promotion *promotion, const FileReplica *holders, uint32_t holder_count,
+                       const StorageServer *servers, int server_count) {
+    for (int c = 0; c < HOTSPOT_EXTRA_COPIES; c++) {
+        HotCopy *copy = &promotion->copies[c];
+        if (__atomic_load_n(&copy->state, __ATOMIC_ACQUIRE) != COPY_EMPTY) continue;
+        if (holder_count >= MAX_FILE_REPLICAS + 1) return;
+
+        int best = -1;
+        double best_cost = HEALTH_COST_EXCLUDED;
+        for (int i = 0; i < server_count; i++) {
+            if (!servers[i].active || holds(holders, holder_count, servers[i].host, servers[i].port)) continue;
+            int taken = 0;
+            for (int k = 0; k < HOTSPOT_EXTRA_COPIES; k++) {
+                const HotCopy *other = &promotion->copies[k];
+                if (__atomic_load_n(&other->state, __ATOMIC_ACQUIRE) != COPY_EMPTY &&
+                    strcmp(other->ip, servers[i].host) == 0 && strcmp(other->port, servers[i].port) == 0) {
+                    taken = 1;
+                }
+            }
+            double cost = health_server_cost(&servers[i]);
+            if (!taken && cost < best_cost) {
+                best = i;
+                best_cost = cost;
+            }
+        }
+        if (best < 0) return;
+
+        StorageCommand command;
+        memset(&command, 0, sizeof(command));
+        command.op = STORAGE_COMMAND_COPY;
+        strncpy(command.path, promotion->path, sizeof(command.path) - 1);
+        memcpy(command.source_ip, holders[0].ip, INET_ADDRSTRLEN);
+        command.source_port = htons(holders[0].port);
+        strncpy(command.source_path, promotion->path, sizeof(command.source_path) - 1);
+
+        snprintf(copy->ip, sizeof(copy->ip), "%s", servers[best].host);
+        snprintf(copy->port, sizeof(copy->port), "%s", servers[best].port);
+        copy->epoch = current_epoch(promotion);
+        __atomic_store_n(&copy->state, COPY_PENDING, __ATOMIC_RELEASE);
+        if (command_submit(copy->ip, copy->port, &command, copy_done, copy) != ERR_SUCCESS) {
+            __atomic_store_n(&copy->state, COPY_EMPTY, __ATOMIC_RELEASE);
+            return;
+        }
+        printf("Hot file %s: copying to %s:%s\n", promotion->path, copy->ip, copy->port);
+    }
+}
+
+// Move a promotion's copies along: list finished ones, delete retired ones,
+// and unlist them all once the file cooled off, was written or went away.
+// Returns 1 while any copy remains.
+static int advance_copies(Promotion *promotion, int cooled) {
+    FileReplica holders[MAX_FILE_REPLICAS + 1];
+    uint32_t holder_count = 0;
+    int exists = directory_get_holders(promotion->path, holders, &holder_count) == ERR_SUCCESS;
+    uint32_t epoch = current_epoch(promotion);
+    int remaining = 0;
+
+    for (int c = 0; c < HOTSPOT_EXTRA_COPIES; c++) {
+        HotCopy *copy = &promotion->copies[c];
+        uint16_t port = (uint16_t)atoi(copy->port);
+        switch (__atomic_load_n(&copy->state, __ATOMIC_ACQUIRE)) {
+            case COPY_DONE: {
+                // A copy taken before the last write, or of a file deleted
+                // while it was being copied, is never listed. Neither is one
+                // the file has no room left for.
+                ErrorCode err = ERR_FILE_NOT_FOUND;
+                if (exists && copy->epoch == epoch) {
+                    log_shipping_begin_mutation();
+                    err = directory_add_copy(promotion->path, copy->ip, port);
+                    if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_POPULATE, promotion->path, copy->ip, port, 0, 0);
+                    log_shipping_end_mutation();
+                }
+                copy->state = err == ERR_SUCCESS ? COPY_HELD : COPY_RETIRING;
+                break;
+            }
+            case COPY_FAILED:
+                copy->state = COPY_EMPTY;
+                break;
+            case COPY_HELD:
+                if (!exists) {
+                    copy->state = COPY_RETIRING;
+                } else if (!holds(holders, holder_count, copy->ip, copy->port) || holds(holders, 1, copy->ip, copy->port)) {
+                    // Lost with its server, or promoted to primary: no longer ours
+                    copy->state = COPY_EMPTY;
+                } else if (cooled || copy->epoch != epoch) {
+                    log_shipping_begin_mutation();
+                    ErrorCode err = directory_drop_copy(promotion->path, copy->ip, port);
+                    if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_DROP_COPY, promotion->path, copy->ip, port, 0, 0);
+                    log_shipping_end_mutation();
+                    if (err == ERR_SUCCESS) {
+                        printf("File %s %s: retiring its copy on %s:%s\n", promotion->path,
+                               copy->epoch != epoch ? "was written" : "cooled off", copy->ip, copy->port);
+                        copy->state = COPY_RETIRING;
+                    } else {
+                        copy->state = COPY_EMPTY;
+                    }
+                }
+                break;
+            case COPY_RETIRING: {
+                StorageCommand command;
+                memset(&command, 0, sizeof(command));
+                command.op = STORAGE_COMMAND_DELETE;
+                strncpy(command.path, promotion->path, sizeof(command.path) - 1);
+                command_submit(copy->ip, copy->port, &command, retire_done, NULL);
+                copy->state = COPY_EMPTY;
+                break;
+            }
+            default:
+                break;
+        }
+        if (__atomic_load_n(&copy->state, __ATOMIC_ACQUIRE) != COPY_EMPTY) remaining = 1;
+    }
+    return remaining;
+}
+
+static Promotion *find_promotion(const char *path, int create) {
+    Promotion *free_slot = NULL;
+    for (int i = 0; i < HOTSPOT_MAX_PROMOTED; i++) {
+        if (promotions[i].used && strcmp(promotions[i].path, path) == 0) return &promotions[i];
+        if (!promotions[i].used && !free_slot) free_slot = &promotions[i];
+    }
+    if (!create || !free_slot) return NULL;
+
+    // The epoch carries on, so callbacks of the slot's last file miss
+    pthread_mutex_lock(&promotion_mutex);
+    uint32_t epoch = free_slot->epoch + 1;
+    memset(free_slot, 0, sizeof(*free_slot));
+    snprintf(free_slot->path, sizeof(free_slot->path), "%s", path);
+    free_slot->epoch = epoch;
+    free_slot->used = 1;
+    pthread_mutex_unlock(&promotion_mutex);
+    return free_slot;
+}
+
+// Pull the copies of files written since the last look out of the replica
+// sets, and hold off new ones for HOTSPOT_WRITE_QUIET_TICKS
+static void retire_written() {
+    for (int i = 0; i < HOTSPOT_MAX_PROMOTED; i++) {
+        Promotion *promotion = &promotions[i];
+        pthread_mutex_lock(&promotion_mutex);
+        int written = promotion->used && promotion->written;
+        promotion->written = 0;
+        pthread_mutex_unlock(&promotion_mutex);
+        if (!written) continue;
+        promotion->quiet = HOTSPOT_WRITE_QUIET_TICKS;
+        advance_copies(promotion, 0);
+    }
+}
+
+static void hotspot_tick() {
+    decay_sketch();
+
+    // A standby only counts; copies are the primary's to make
+    if (log_shipping_is_standby()) return;
+
+    retire_written();
+    for (int i = 0; i < HOTSPOT_MAX_PROMOTED; i++) {
+        Promotion *promotion = &promotions[i];
+        if (!promotion->used) continue;
+        int cooled = rate_of(promotion->path) <= HOTSPOT_COOL_RATE;
+        if (promotion->quiet > 0) promotion->quiet--;
+        if (!advance_copies(promotion, cooled) && cooled) {
+            pthread_mutex_lock(&promotion_mutex);
+            promotion->used = 0;
+            pthread_mutex_unlock(&promotion_mutex);
+        }
+    }
+
+    StorageServer *servers = NULL;
+    int server_count = 0;
+    for (uint32_t i = 0; i < rate_count; i++) {
+        if (rates[i].rate < HOTSPOT_HOT_RATE) continue;
+        FileReplica holders[MAX_FILE_REPLICAS + 1];
+        uint32_t holder_count = 0;
+        if (directory_get_holders(rates[i].path, holders, &holder_count) != ERR_SUCCESS) continue;
+
+        Promotion *promotion = find_promotion(rates[i].path, 1);
+        if (!promotion) break;
+        if (!watch_ready(promotion, &holders[0])) continue;
+        if (!servers && health_get_servers(&servers, &server_count) != ERR_SUCCESS) break;
+        add_copies(promotion, holders, holder_count, servers, server_count);
+    }
+    free(servers);
+}
+
+int hotspot_holds_copy(const char *path, const char *ip, uint16_t port) {
+    while (*path == '/') path++;
+    int held = 0;
+    pthread_mutex_lock(&promotion_mutex);
+    for (int i = 0; i < HOTSPOT_MAX_PROMOTED && !held; i++) {
+        Promotion *promotion = &promotions[i];
+        const char *hot = promotion->path;
+        while (*hot == '/') hot++;
+        if (!promotion->used || strcmp(hot, path) != 0) continue;
+        for (int c = 0; c < HOTSPOT_EXTRA_COPIES; c++) {
+            const HotCopy *copy = &promotion->copies[c];
+            int state = __atomic_load_n(&copy->state, __ATOMIC_ACQUIRE);
+            if ((state == COPY_DONE || state == COPY_HELD) && (uint16_t)atoi(copy->port) == port &&
+                strcmp(copy->ip, ip) == 0) {
+                held = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&promotion_mutex);
+    return held;
+}
+
+void hotspot_file_written(const char *host, const char *port, const char *path) {
+    int matched = 0;
+    pthread_mutex_lock(&promotion_mutex);
+    for (int i = 0; i < HOTSPOT_MAX_PROMOTED; i++) {
+        Promotion *promotion = &promotions[i];
+        if (!promotion->used || promotion->watch == WATCH_NONE || strcmp(promotion->source_ip, host) != 0 ||
+            strcmp(promotion->source_port, port) != 0 || (path && strcmp(promotion->path, path) != 0)) {
+            continue;
+        }
+        promotion->watch = WATCH_NONE;
+        promotion->epoch++;
+        promotion->written = 1;
+        matched = 1;
+    }
+    pthread_mutex_unlock(&promotion_mutex);
+
+    if (matched) {
+        pthread_mutex_lock(&monitor_mutex);
+        writes_reported = 1;
+        pthread_cond_signal(&monitor_wake);
+        pthread_mutex_unlock(&monitor_mutex);
+    }
+}
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Tick every HOTSPOT_TICK_MS, and retire the copies of a written file as
+// soon as the write is reported
+static void *monitor_thread(void *arg) {
+    (void)arg;
+    uint64_t next_tick = now_ms() + HOTSPOT_TICK_MS;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&monitor_mutex);
+        uint64_t now = now_ms();
+        if (!writes_reported && now < next_tick) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            uint64_t wait_ms = next_tick - now;
+            deadline.tv_sec += wait_ms / 1000;
+            deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&monitor_wake, &monitor_mutex, &deadline);
+        }
+        int written = writes_reported;
+        writes_reported = 0;
+        pthread_mutex_unlock(&monitor_mutex);
+
+        if (written && !log_shipping_is_standby()) retire_written();
+        if (now_ms() >= next_tick) {
+            hotspot_tick();
+            next_tick += HOTSPOT_TICK_MS;
+        }
+    }
+    return NULL;
+}
+
+void hotspot_init() {
+    for (int i = 0; i < SKETCH_BUCKETS; i++) {
+        buckets[i] = SLOT_NONE;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&monitor_wake, &attr);
+    pthread_condattr_destroy(&attr);
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&monitor, NULL, monitor_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to start hot file monitor\n");
+        running = 0;
+    }
+}
+
+void hotspot_cleanup() {
+    if (__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL)) {
+        pthread_mutex_lock(&monitor_mutex);
+        pthread_cond_signal(&monitor_wake);
+        pthread_mutex_unlock(&monitor_mutex);
+        pthread_join(monitor, NULL);
+    }
+}
@@ -0,0 +1,266 @@
+// src/naming_server/src/lease.c
+
+#include "lease.h"
+#include "hash.h"
+#include "protocol.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define LEASE_BUCKETS 4096
+
+typedef struct Lease {
+    char *path;
+    NetworkSocket *holder;
+    char host[INET_ADDRSTRLEN];
+    uint16_t port;
+    uint64_t version;
+    uint64_t expires_ms;
+    struct Lease *next;
+} Lease;
+
+static Lease *buckets[LEASE_BUCKETS];
+static pthread_mutex_t lease_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Leases are keyed without leading slashes, the way the tree splits paths
+static const char *lease_key(const char *path) {
+    while (*path == '/') path++;
+    return path;
+}
+
+static uint32_t hash_path(const char *path) {
+    return fnv_hash(path) % LEASE_BUCKETS;
+}
+
+static void free_lease(Lease *lease) {
+    free(lease->path);
+    free(lease);
+}
+
+// Invalidations gathered under lease_mutex and pushed once it is released,
+// so a holder that stopped reading stalls nobody else
+typedef struct {
+    NetworkSocket *holder;      // Held until the push is sent
+    LocationInvalidation body;
+} PendingPush;
+
+typedef struct {
+    PendingPush *pushes;
+    size_t count;
+    size_t capacity;
+} PushList;
+
+// Queue an invalidation for the holder of lease. Caller holds lease_mutex,
+// which keeps the holder from being closed until it is held.
+static void queue_invalidation(PushList *list, Lease *lease) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        PendingPush *grown = realloc(list->pushes, capacity * sizeof(PendingPush));
+        if (!grown) {
+            // The holder cannot be told, so it must not keep its cache
+            shutdown(network_socket_get_fd(lease->holder), SHUT_RDWR);
+            return;
+        }
+        list->pushes = grown;
+        list->capacity = capacity;
+    }
+    PendingPush *push = &list->pushes[list->count++];
+    memset(&push->body, 0, sizeof(push->body));
+    push->body.version = network_hton64(lease->version);
+    strncpy(push->body.path, lease->path, sizeof(push->body.path) - 1);
+    push->holder = lease->holder;
+    network_socket_hold(push->holder);
+}
+
+// Tell each holder its lease is void. A holder that cannot take the push
+// in LEASE_PUSH_TIMEOUT_MS is disconnected and drops its cache.
+static void send_invalidations(PushList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        struct {
+            MessageHeader header;
+            LocationInvalidation body;
+        } __attribute__((packed)) frame;
+        frame.header.request_id = 0;
+        frame.header.type = MSG_TYPE_LOCATION_INVALIDATE;
+        frame.header.payload_size = htonl(sizeof(frame.body));
+        frame.body = list->pushes[i].body;
+        network_socket_send_within(list->pushes[i].holder, &frame, sizeof(frame), LEASE_PUSH_TIMEOUT_MS);
+        network_socket_close(list->pushes[i].holder);
+    }
+    free(list->pushes);
+}
+
+void lease_init() {
+    pthread_mutex_lock(&lease_mutex);
+    memset(buckets, 0, sizeof(buckets));
+    pthread_mutex_unlock(&lease_mutex);
+}
+
+void lease_cleanup() {
+    pthread_mutex_lock(&lease_mutex);
+    for (int i = 0; i < LEASE_BUCKETS; i++) {
+        Lease *lease = buckets[i];
+        while (lease) {
+            Lease *next = lease->next;
+            free_lease(lease);
+            lease = next;
+        }
+        buckets[i] = NULL;
+    }
+    pthread_mutex_unlock(&lease_mutex);
+}
+
+uint32_t lease_grant(const char *path, NetworkSocket *holder, const char *host, uint16_t port, uint64_t version) {
+    path = lease_key(path);
+    uint32_t bucket = hash_path(path);
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&lease_mutex);
+
+    // Refresh the holder's existing lease, dropping expired ones on the way
+    Lease **link = &buckets[bucket];
+    Lease *found = NULL;
+    while (*link) {
+        Lease *lease = *link;
+        if (lease->holder == holder && strcmp(lease->path, path) == 0) {
+            found = lease;
+        } else if (lease->expires_ms <= now) {
+            *link = lease->next;
+            free_lease(lease);
+            continue;
+        }
+        link = &lease->next;
+    }
+
+    if (!found) {
+        found = calloc(1, sizeof(Lease));
+        if (found) found->path = strdup(path);
+        if (!found || !found->path) {
+            if (found) free(found);
+            pthread_mutex_unlock(&lease_mutex);
+            return 0; // Not tracked, so the client must not cache it
+        }
+        found->holder = holder;
+        found->next = buckets[bucket];
+        buckets[bucket] = found;
+    }
+    strncpy(found->host, host, sizeof(found->host) - 1);
+    found->port = port;
+    found->version = version;
+    found->expires_ms = now + LEASE_TTL_MS;
+
+    pthread_mutex_unlock(&lease_mutex);
+    return LEASE_TTL_MS;
+}
+
+void lease_invalidate(const char *path) {
+    path = lease_key(path);
+    uint32_t bucket = hash_path(path);
+    uint64_t now = now_ms();
+
+    PushList pushes = {NULL, 0, 0};
+    pthread_mutex_lock(&lease_mutex);
+    Lease **link = &buckets[bucket];
+    while (*link) {
+        Lease *lease = *link;
+        if (strcmp(lease->path, path) == 0) {
+            if (lease->expires_ms > now) queue_invalidation(&pushes, lease);
+            *link = lease->next;
+            free_lease(lease);
+            continue;
+        }
+        link = &lease->next;
+    }
+    pthread_mutex_unlock(&lease_mutex);
+    send_invalidations(&pushes);
+}
+
+void lease_invalidate_prefix(const char *prefix) {
+    prefix = lease_key(prefix);
+    size_t prefix_len = strlen(prefix);
+    uint64_t now = now_ms();
+    int pushed = 0;
+    PushList pushes = {NULL, 0, 0};
+
+    // Leases are hashed by whole path, so a prefix means visiting them all
+    pthread_mutex_lock(&lease_mutex);
+    for (int i = 0; i < LEASE_BUCKETS; i++) {
+        Lease **link = &buckets[i];
+        while (*link) {
+            Lease *lease = *link;
+            int below = prefix_len == 0 || (strncmp(lease->path, prefix, prefix_len) == 0 &&
+                                            (lease->path[prefix_len] == '\0' || lease->path[prefix_len] == '/'));
+            if (lease->expires_ms <= now || below) {
+                if (lease->expires_ms > now) {
+                    queue_invalidation(&pushes, lease);
+                    pushed++;
+                }
+                *link = lease->next;
+                free_lease(lease);
+                continue;
+            }
+            link = &lease->next;
+        }
+    }
+    pthread_mutex_unlock(&lease_mutex);
+    send_invalidations(&pushes);
+
+    if (pushed > 0) printf("Revoked %d location leases below /%s\n", pushed, prefix);
+}
+
+void lease_invalidate_server(const char *host, const char *port) {
+    uint16_t port_num = (uint16_t)atoi(port);
+    uint64_t now = now_ms();
+    int pushed = 0;
+    PushList pushes = {NULL, 0, 0};
+
+    pthread_mutex_lock(&lease_mutex);
+    for (int i = 0; i < LEASE_BUCKETS; i++) {
+        Lease **link = &buckets[i];
+        while (*link) {
+            Lease *lease = *link;
+            if (lease->expires_ms <= now ||
+                (lease->port == port_num && strcmp(lease->host, host) == 0)) {
+                if (lease->expires_ms > now) {
+                    queue_invalidation(&pushes, lease);
+                    pushed++;
+                }
+                *link = lease->next;
+                free_lease(lease);
+                continue;
+            }
+            link = &lease->next;
+        }
+    }
+    pthread_mutex_unlock(&lease_mutex);
+    send_invalidations(&pushes);
+
+    if (pushed > 0) printf("Revoked %d location leases on %s:%s\n", pushed, host, port);
+}
+
+void lease_release_holder(NetworkSocket *holder) {
+    pthread_mutex_lock(&lease_mutex);
+    for (int i = 0; i < LEASE_BUCKETS; i++) {
+        Lease **link = &buckets[i];
+        while (*link) {
+            Lease *lease = *link;
+            if (lease->holder == holder) {
+                *link = lease->next;
+                free_lease(lease);
+                continue;
+            }
+            link = &lease->next;
+        }
+    }
+    pthread_mutex_unlock(&lease_mutex);
+}
@@ -0,0 +1,677 @@
+// src/naming_server/src/log_shipping.c
+
+#include "log_shipping.h"
+#include "directory.h"
+#include "health.h"
+#include "lease.h"
+#include "inventory.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+typedef struct {
+    uint64_t seq;
+    size_t size;
+    uint8_t *data;              // LogRecordHeader and body, ready to ship
+} LogEntry;
+
+// Records in sequence order, in a ring that grows as needed and drops the
+// oldest once it holds more than LOG_MAX_BYTES
+static LogEntry *ring = NULL;
+static size_t ring_capacity = 0;
+static size_t ring_start = 0;
+static size_t ring_count = 0;
+static size_t log_bytes = 0;
+static uint64_t last_seq = 0;
+static uint64_t epoch = 0;
+static int shipping = 0;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+// Held from a mutation reaching the tree until its record is appended
+static pthread_mutex_t order_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The standby currently subscribed, advertised to clients. Guarded by
+// log_mutex; standby_token tells its shipper apart from a successor's.
+static ShardAddress standby_address;
+static uint64_t standby_token = 0;
+static int standby_subscribed = 0;
+
+// Standby side
+static ShardAddress primary_address;
+static uint16_t follow_client_port;
+static int following = 0;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} LogBuffer;
+
+typedef struct {
+    NetworkSocket *sock;
+    ShardAddress standby;       // Where the standby serves clients
+    uint64_t token;
+    uint64_t position;          // Last record sent
+    LogBuffer frame;            // MessageHeader and the records being batched
+    LogBuffer snapshot;         // Records gathered under the tree's locks
+    int failed;
+} Shipper;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void free_oldest() {
+    LogEntry *entry = &ring[ring_start];
+    log_bytes -= entry->size;
+    free(entry->data);
+    ring_start = (ring_start + 1) % ring_capacity;
+    ring_count--;
+}
+
+// Caller holds log_mutex
+static int grow_ring() {
+    size_t capacity = ring_capacity ? ring_capacity * 2 : 1024;
+    LogEntry *grown = malloc(capacity * sizeof(LogEntry));
+    if (!grown) return -1;
+    for (size_t i = 0; i < ring_count; i++) {
+        grown[i] = ring[(ring_start + i) % ring_capacity];
+    }
+    free(ring);
+    ring = grown;
+    ring_capacity = capacity;
+    ring_start = 0;
+    return 0;
+}
+
+static void append_record(LogOp op, const void *head, size_t head_size, const void *tail, size_t tail_size) {
+    size_t size = sizeof(LogRecordHeader) + head_size + tail_size;
+    uint8_t *data = malloc(size);
+    if (!data) {
+        fprintf(stderr, "Failed to log namespace mutation\n");
+        return;
+    }
+    memcpy(data + sizeof(LogRecordHeader), head, head_size);
+    if (tail_size > 0) memcpy(data + sizeof(LogRecordHeader) + head_size, tail, tail_size);
+
+    pthread_mutex_lock(&log_mutex);
+    if (ring_count == ring_capacity && grow_ring() != 0) {
+        // Losing a record would silently fork the standby; losing the
+        // oldest only sends it through a snapshot
+        if (ring_count == 0) {
+            pthread_mutex_unlock(&log_mutex);
+            free(data);
+            fprintf(stderr, "Failed to log namespace mutation\n");
+            return;
+        }
+        free_oldest();
+    }
+
+    LogRecordHeader *header = (LogRecordHeader *)data;
+    header->seq = network_hton64(++last_seq);
+    header->op = op;
+    header->length = htonl(head_size + tail_size);
+    ring[(ring_start + ring_count) % ring_capacity] = (LogEntry){last_seq, size, data};
+    ring_count++;
+    log_bytes += size;
+
+    // A standby that falls this far behind catches up from a snapshot
+    while (log_bytes > LOG_MAX_BYTES && ring_count > 1) {
+        free_oldest();
+    }
+    pthread_cond_broadcast(&log_cond);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+void log_shipping_begin_mutation() {
+    pthread_mutex_lock(&order_mutex);
+}
+
+void log_shipping_end_mutation() {
+    pthread_mutex_unlock(&order_mutex);
+}
+
+static void fill_placement(LogPlacement *placement, const char *path, const char *ip, uint16_t port,
+                           uint64_t size, uint32_t permissions) {
+    memset(placement, 0, sizeof(*placement));
+    strncpy(placement->path, path, sizeof(placement->path) - 1);
+    if (ip) strncpy(placement->ip, ip, sizeof(placement->ip) - 1);
+    placement->port = htons(port);
+    placement->size = network_hton64(size);
+    placement->permissions = htonl(permissions);
+}
+
+void log_shipping_append_placement(LogOp op, const char *path, const char *ip, uint16_t port,
+                                   uint64_t size, uint32_t permissions) {
+    LogPlacement placement;
+    fill_placement(&placement, path, ip, port, size, permissions);
+    append_record(op, &placement, sizeof(placement), NULL, 0);
+}
+
+void log_shipping_append_rename(const char *source, const char *destination) {
+    LogRename rename;
+    memset(&rename, 0, sizeof(rename));
+    strncpy(rename.source, source, sizeof(rename.source) - 1);
+    strncpy(rename.destination, destination, sizeof(rename.destination) - 1);
+    append_record(LOG_OP_RENAME, &rename, sizeof(rename), NULL, 0);
+}
+
+void log_shipping_append_inventory(const char *ip, const uint8_t *blob, size_t blob_size) {
+    char server_ip[INET_ADDRSTRLEN] = {0};
+    strncpy(server_ip, ip, sizeof(server_ip) - 1);
+    append_record(LOG_OP_INVENTORY, server_ip, sizeof(server_ip), blob, blob_size);
+}
+
+static int buffer_append(LogBuffer *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) capacity *= 2;
+        uint8_t *grown = realloc(buffer->data, capacity);
+        if (!grown) return -1;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+// Send the records batched so far as one LOG_RECORDS frame
+static void flush_frame(Shipper *shipper) {
+    LogBuffer *frame = &shipper->frame;
+    if (shipper->failed || frame->size <= sizeof(MessageHeader)) return;
+    MessageHeader *header = (MessageHeader *)frame->data;
+    header->request_id = 0;
+    header->type = MSG_TYPE_LOG_RECORDS;
+    header->payload_size = htonl(frame->size - sizeof(MessageHeader));
+    if (network_socket_send(shipper->sock, frame->data, frame->size) != (ssize_t)frame->size) {
+        shipper->failed = 1;
+    }
+    frame->size = sizeof(MessageHeader);
+}
+
+// Add an encoded record to the frame, sending the frame first if the record
+// would take it past LOG_FRAME_BYTES
+static void add_encoded(Shipper *shipper, const uint8_t *record, size_t size) {
+    if (shipper->failed) return;
+    if (shipper->frame.size > sizeof(MessageHeader) && shipper->frame.size + size > LOG_FRAME_BYTES) {
+        flush_frame(shipper);
+    }
+    if (buffer_append(&shipper->frame, record, size) != 0) shipper->failed = 1;
+}
+
+static size_t encode_record(uint8_t *record, uint64_t seq, LogOp op, const void *body, size_t length) {
+    LogRecordHeader *header = (LogRecordHeader *)record;
+    header->seq = network_hton64(seq);
+    header->op = op;
+    header->length = htonl(length);
+    memcpy(record + sizeof(LogRecordHeader), body, length);
+    return sizeof(LogRecordHeader) + length;
+}
+
+static void add_record(Shipper *shipper, uint64_t seq, LogOp op, const void *body, size_t length) {
+    uint8_t record[sizeof(LogRecordHeader) + sizeof(LogPlacement)];
+    add_encoded(shipper, record, encode_record(record, seq, op, body, length));
+}
+
+static void add_placement(Shipper *shipper, LogOp op, const char *path, const char *ip, uint16_t port,
+                          uint64_t size, uint32_t permissions) {
+    LogPlacement placement;
+    fill_placement(&placement, path, ip, port, size, permissions);
+    uint8_t record[sizeof(LogRecordHeader) + sizeof(LogPlacement)];
+    size_t record_size = encode_record(record, 0, op, &placement, sizeof(placement));
+    if (buffer_append(&shipper->snapshot, record, record_size) != 0) shipper->failed = 1;
+}
+
+// Snapshot one entry: its delegation, then its primary and copies, or the
+// directory itself so empty ones survive
+static void snapshot_entry(const char *path, DirectoryEntry *entry, void *ctx) {
+    Shipper *shipper = ctx;
+    if (entry->delegation) {
+        add_placement(shipper, LOG_OP_DELEGATE, path[0] ? path : "/", entry->delegation->storage_server_ip,
+                      entry->delegation->storage_server_port, 0, 0);
+    }
+
+    FileMetadata *metadata = entry->metadata;
+    if (metadata && metadata->storage_server_ip) {
+        add_placement(shipper, LOG_OP_POPULATE, path, metadata->storage_server_ip, metadata->storage_server_port,
+                      metadata->size, metadata->permissions);
+        for (uint32_t i = 0; i < metadata->replica_count; i++) {
+            add_placement(shipper, LOG_OP_POPULATE, path, metadata->replicas[i].ip, metadata->replicas[i].port,
+                          metadata->size, metadata->permissions);
+        }
+    } else if (entry->is_directory && path[0]) {
+        add_placement(shipper, LOG_OP_MKDIR, path, NULL, 0, 0, 0);
+    }
+}
+
+// Send the whole tree and the inventory generations of the registry. The
+// snapshot stands for every record up to the one current when it began;
+// records applied to the tree meanwhile may be in it and are sent again
+// after it, which replaying them tolerates.
+static ErrorCode send_snapshot(Shipper *shipper) {
+    pthread_mutex_lock(&log_mutex);
+    uint64_t at = last_seq;
+    uint64_t snapshot_epoch = network_hton64(epoch);
+    pthread_mutex_unlock(&log_mutex);
+
+    add_record(shipper, 0, LOG_OP_SNAPSHOT_BEGIN, &snapshot_epoch, sizeof(snapshot_epoch));
+
+    // Nothing is sent during the walk, so a slow standby cannot hold the
+    // tree's locks
+    shipper->snapshot.size = 0;
+    directory_walk(snapshot_entry, shipper);
+    for (size_t offset = 0; offset < shipper->snapshot.size;) {
+        LogRecordHeader header;
+        memcpy(&header, shipper->snapshot.data + offset, sizeof(header));
+        size_t record_size = sizeof(header) + ntohl(header.length);
+        add_encoded(shipper, shipper->snapshot.data + offset, record_size);
+        offset += record_size;
+    }
+
+    StorageServer *servers = NULL;
+    int server_count = 0;
+    if (health_get_servers(&servers, &server_count) == ERR_SUCCESS) {
+        for (int i = 0; i < server_count; i++) {
+            if (servers[i].inventory_generation == 0) continue;
+            LogGeneration generation;
+            memset(&generation, 0, sizeof(generation));
+            strncpy(generation.ip, servers[i].host, sizeof(generation.ip) - 1);
+            strncpy(generation.port, servers[i].port, sizeof(generation.port) - 1);
+            generation.generation = network_hton64(servers[i].inventory_generation);
+            add_record(shipper, 0, LOG_OP_GENERATION, &generation, sizeof(generation));
+        }
+        free(servers);
+    }
+
+    add_record(shipper, at, LOG_OP_SNAPSHOT_END, NULL, 0);
+    flush_frame(shipper);
+    shipper->position = at;
+    printf("Sent snapshot up to log record %llu to standby\n", (unsigned long long)at);
+    return shipper->failed ? ERR_NETWORK_FAILURE : ERR_SUCCESS;
+}
+
+// Whether the records after position are all still in the log. Caller holds
+// log_mutex.
+static int log_holds(uint64_t position) {
+    if (position > last_seq) return 0;
+    if (position == last_seq) return 1;
+    return ring_count > 0 && position + 1 >= ring[ring_start].seq;
+}
+
+static void *ship_log(void *arg) {
+    Shipper *shipper = arg;
+
+    while (!shipper->failed) {
+        pthread_mutex_lock(&log_mutex);
+        if (shipping && shipper->position == last_seq) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_KEEPALIVE_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&log_cond, &log_mutex, &deadline);
+        }
+        if (!shipping) {
+            pthread_mutex_unlock(&log_mutex);
+            break;
+        }
+        if (!log_holds(shipper->position)) {
+            pthread_mutex_unlock(&log_mutex);
+            send_snapshot(shipper);
+            continue;
+        }
+
+        // Copy out one frame's worth of records, so sending happens
+        // without the lock
+        size_t index = ring_count - (last_seq - shipper->position);
+        while (shipper->position < last_seq && !shipper->failed) {
+            LogEntry *entry = &ring[(ring_start + index) % ring_capacity];
+            if (shipper->frame.size > sizeof(MessageHeader) && shipper->frame.size + entry->size > LOG_FRAME_BYTES) break;
+            add_encoded(shipper, entry->data, entry->size);
+            shipper->position++;
+            index++;
+        }
+        uint64_t position = shipper->position;
+        pthread_mutex_unlock(&log_mutex);
+
+        if (shipper->frame.size == sizeof(MessageHeader)) {
+            add_record(shipper, position, LOG_OP_KEEPALIVE, NULL, 0);
+        }
+        flush_frame(shipper);
+    }
+
+    printf("Standby %s:%s stopped following\n", shipper->standby.host, shipper->standby.port);
+    pthread_mutex_lock(&log_mutex);
+    if (standby_token == shipper->token) standby_subscribed = 0;
+    pthread_mutex_unlock(&log_mutex);
+
+    network_socket_close(shipper->sock);
+    free(shipper->frame.data);
+    free(shipper->snapshot.data);
+    free(shipper);
+    return NULL;
+}
+
+ErrorCode log_shipping_adopt(NetworkSocket *sock, MessageHeader *header, const char *ip) {
+    LogSubscribe request;
+    if (ntohl(header->payload_size) != sizeof(request) ||
+        network_socket_receive(sock, &request, sizeof(request)) != sizeof(request)) {
+        fprintf(stderr, "Malformed log subscription from %s\n", ip);
+        return ERR_PROTOCOL_ERROR;
+    }
+
+    Shipper *shipper = calloc(1, sizeof(Shipper));
+    if (!shipper) return ERR_INTERNAL_ERROR;
+    shipper->sock = sock;
+    MessageHeader frame_header = {0};
+    if (buffer_append(&shipper->frame, &frame_header, sizeof(frame_header)) != 0) {
+        free(shipper);
+        return ERR_INTERNAL_ERROR;
+    }
+
+    strncpy(shipper->standby.host, ip, sizeof(shipper->standby.host) - 1);
+    snprintf(shipper->standby.port, sizeof(shipper->standby.port), "%u", ntohs(request.client_port));
+
+    pthread_mutex_lock(&log_mutex);
+    // Records only continue the history the standby already has
+    shipper->position = network_ntoh64(request.epoch) == epoch ? network_ntoh64(request.last_seq) : UINT64_MAX;
+    shipper->token = ++standby_token;
+    standby_address = shipper->standby;
+    standby_subscribed = 1;
+    pthread_mutex_unlock(&log_mutex);
+
+    printf("Standby %s:%u subscribed after log record %llu\n", ip, ntohs(request.client_port),
+           (unsigned long long)network_ntoh64(request.last_seq));
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, ship_log, shipper) != 0) {
+        pthread_mutex_lock(&log_mutex);
+        if (standby_token == shipper->token) standby_subscribed = 0;
+        pthread_mutex_unlock(&log_mutex);
+        free(shipper->frame.data);
+        free(shipper);
+        return ERR_INTERNAL_ERROR;
+    }
+    pthread_detach(thread);
+    return ERR_SUCCESS;
+}
+
+// Standby side: what has been applied so far
+typedef struct {
+    uint64_t epoch;
+    uint64_t last_seq;
+    int synced;                 // A complete snapshot has been applied
+} FollowState;
+
+static void apply_placement(LogOp op, const LogPlacement *placement) {
+    char path[sizeof(placement->path) + 1];
+    char ip[INET_ADDRSTRLEN];
+    memcpy(path, placement->path, sizeof(placement->path));
+    path[sizeof(placement->path)] = '\0';
+    memcpy(ip, placement->ip, sizeof(ip));
+    ip[sizeof(ip) - 1] = '\0';
+    uint16_t port = ntohs(placement->port);
+
+    switch (op) {
+        case LOG_OP_POPULATE:
+            directory_populate(path, ip, port, network_ntoh64(placement->size), ntohl(placement->permissions));
+            break;
+        case LOG_OP_DELETE:
+            directory_delete(path);
+            break;
+        case LOG_OP_MKDIR:
+            directory_create(path);
+            break;
+        case LOG_OP_DELEGATE:
+            directory_delegate(path, ip, port);
+            break;
+        case LOG_OP_DROP_COPY:
+            directory_drop_copy(path, ip, port);
+            break;
+        case LOG_OP_PROMOTE:
+            directory_promote(path, ip, port);
+            break;
+        default:
+            break;
+    }
+}
+
+static ErrorCode apply_inventory(const uint8_t *body, size_t length) {
+    if (length < INET_ADDRSTRLEN) return ERR_PROTOCOL_ERROR;
+    char ip[INET_ADDRSTRLEN];
+    memcpy(ip, body, sizeof(ip));
+    ip[sizeof(ip) - 1] = '\0';
+
+    InventoryReader reader;
+    ErrorCode err = inventory_reader_init(&reader, body + INET_ADDRSTRLEN, length - INET_ADDRSTRLEN);
+    if (err != ERR_SUCCESS) return err;
+    // The primary logged it after loading it, so only a local failure can
+    // stop it here; refusing the record would stall the stream for good
+    err = directory_bulk_load(&reader, ip, NULL, NULL);
+    if (err != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to load logged inventory from %s\n", ip);
+        return ERR_SUCCESS;
+    }
+
+    char port[32];
+    snprintf(port, sizeof(port), "%u", reader.client_port);
+    health_set_generation(ip, port, reader.generation);
+    return ERR_SUCCESS;
+}
+
+static ErrorCode apply_record(uint64_t seq, LogOp op, const uint8_t *body, size_t length, FollowState *state) {
+    switch (op) {
+        case LOG_OP_POPULATE:
+        case LOG_OP_DELETE:
+        case LOG_OP_MKDIR:
+        case LOG_OP_DELEGATE:
+        case LOG_OP_DROP_COPY:
+        case LOG_OP_PROMOTE:
+            if (length != sizeof(LogPlacement)) return ERR_PROTOCOL_ERROR;
+            apply_placement(op, (const LogPlacement *)body);
+            break;
+        case LOG_OP_RENAME: {
+            if (length != sizeof(LogRename)) return ERR_PROTOCOL_ERROR;
+            LogRename rename;
+            memcpy(&rename, body, sizeof(rename));
+            rename.source[sizeof(rename.source) - 1] = '\0';
+            rename.destination[sizeof(rename.destination) - 1] = '\0';
+            if (directory_rename(rename.source, rename.destination) == ERR_SUCCESS) {
+                lease_invalidate_prefix(rename.source);
+            }
+            break;
+        }
+        case LOG_OP_INVENTORY: {
+            ErrorCode err = apply_inventory(body, length);
+            if (err != ERR_SUCCESS) return err;
+            break;
+        }
+        case LOG_OP_GENERATION: {
+            if (length != sizeof(LogGeneration)) return ERR_PROTOCOL_ERROR;
+            LogGeneration generation;
+            memcpy(&generation, body, sizeof(generation));
+            generation.ip[sizeof(generation.ip) - 1] = '\0';
+            generation.port[sizeof(generation.port) - 1] = '\0';
+            health_set_generation(generation.ip, generation.port, network_ntoh64(generation.generation));
+            break;
+        }
+        case LOG_OP_SNAPSHOT_BEGIN: {
+            if (length != sizeof(uint64_t)) return ERR_PROTOCOL_ERROR;
+            uint64_t snapshot_epoch;
+            memcpy(&snapshot_epoch, body, sizeof(snapshot_epoch));
+            state->epoch = network_ntoh64(snapshot_epoch);
+            directory_reset();
+            break;
+        }
+        case LOG_OP_SNAPSHOT_END:
+            if (!state->synced) printf("Standby caught up with the primary at log record %llu\n", (unsigned long long)seq);
+            state->synced = 1;
+            break;
+        case LOG_OP_KEEPALIVE:
+            break;
+        default:
+            return ERR_PROTOCOL_ERROR;
+    }
+
+    // Snapshot contents carry no sequence number of their own
+    if (seq != 0) state->last_seq = seq;
+    return ERR_SUCCESS;
+}
+
+static ErrorCode apply_frame(const uint8_t *payload, size_t size, FollowState *state) {
+    size_t offset = 0;
+    while (offset < size) {
+        LogRecordHeader header;
+        if (size - offset < sizeof(header)) return ERR_PROTOCOL_ERROR;
+        memcpy(&header, payload + offset, sizeof(header));
+        offset += sizeof(header);
+        uint32_t length = ntohl(header.length);
+        if (size - offset < length) return ERR_PROTOCOL_ERROR;
+
+        ErrorCode err = apply_record(network_ntoh64(header.seq), header.op, payload + offset, length, state);
+        if (err != ERR_SUCCESS) return err;
+        offset += length;
+    }
+    return ERR_SUCCESS;
+}
+
+// Subscribe on sock and apply what the primary sends until it goes quiet
+// for LOG_TAKEOVER_MS or the connection breaks
+static void follow_connection(NetworkSocket *sock, FollowState *state, uint64_t *last_heard) {
+    struct {
+        MessageHeader header;
+        LogSubscribe body;
+    } __attribute__((packed)) request;
+    request.header.request_id = 0;
+    request.header.type = MSG_TYPE_LOG_SUBSCRIBE;
+    request.header.payload_size = htonl(sizeof(LogSubscribe));
+    request.body.epoch = network_hton64(state->epoch);
+    request.body.last_seq = network_hton64(state->last_seq);
+    request.body.client_port = htons(follow_client_port);
+    if (network_socket_send(sock, &request, sizeof(request)) != sizeof(request)) return;
+
+    struct pollfd pfd = {.fd = network_socket_get_fd(sock), .events = POLLIN};
+    while (__atomic_load_n(&following, __ATOMIC_ACQUIRE)) {
+        if (poll(&pfd, 1, LOG_TAKEOVER_MS) <= 0) return;
+
+        MessageHeader header;
+        if (network_socket_receive(sock, &header, sizeof(header)) != sizeof(header) ||
+            header.type != MSG_TYPE_LOG_RECORDS) return;
+        // A frame holds at most one record past LOG_FRAME_BYTES, and the
+        // largest record is an inventory
+        uint32_t payload_size = ntohl(header.payload_size);
+        if (payload_size > LOG_FRAME_BYTES + MAX_INVENTORY_PAYLOAD) {
+            fprintf(stderr, "Oversized log records from primary\n");
+            return;
+        }
+        uint8_t *payload = malloc(payload_size ? payload_size : 1);
+        if (!payload) return;
+        if (network_socket_receive(sock, payload, payload_size) != payload_size) {
+            free(payload);
+            return;
+        }
+
+        ErrorCode err = apply_frame(payload, payload_size, state);
+        free(payload);
+        if (err != ERR_SUCCESS) {
+            fprintf(stderr, "Malformed log records from primary\n");
+            return;
+        }
+        if (state->synced) *last_heard = now_ms();
+    }
+}
+
+static void *follow_primary(void *arg) {
+    (void)arg;
+    FollowState state = {0, 0, 0};
+    uint64_t last_heard = 0;    // Takeover is only armed once synced
+
+    while (__atomic_load_n(&following, __ATOMIC_ACQUIRE)) {
+        NetworkSocket *sock = network_socket_create(primary_address.host, primary_address.port);
+        if (sock) {
+            follow_connection(sock, &state, &last_heard);
+            network_socket_close(sock);
+        }
+
+        if (last_heard != 0 && now_ms() - last_heard >= LOG_TAKEOVER_MS) {
+            printf("Primary %s:%s silent for %d ms, taking over at log record %llu\n", primary_address.host,
+                   primary_address.port, LOG_TAKEOVER_MS, (unsigned long long)state.last_seq);
+            __atomic_store_n(&following, 0, __ATOMIC_RELEASE);
+            break;
+        }
+        usleep(LOG_RETRY_MS * 1000);
+    }
+    return NULL;
+}
+
+ErrorCode log_shipping_follow(const char *host, const char *port, uint16_t client_port) {
+    if (!host || !port) return ERR_INVALID_ARGUMENT;
+    memset(&primary_address, 0, sizeof(primary_address));
+    strncpy(primary_address.host, host, sizeof(primary_address.host) - 1);
+    strncpy(primary_address.port, port, sizeof(primary_address.port) - 1);
+    follow_client_port = client_port;
+    __atomic_store_n(&following, 1, __ATOMIC_RELEASE);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, follow_primary, NULL) != 0) {
+        __atomic_store_n(&following, 0, __ATOMIC_RELEASE);
+        return ERR_INTERNAL_ERROR;
+    }
+    pthread_detach(thread);
+    return ERR_SUCCESS;
+}
+
+int log_shipping_is_standby() {
+    return __atomic_load_n(&following, __ATOMIC_ACQUIRE);
+}
+
+ErrorCode log_shipping_get_peer(ShardPeer *peer) {
+    memset(peer, 0, sizeof(*peer));
+    if (log_shipping_is_standby()) {
+        peer->standby = 1;
+        peer->peer = primary_address;
+        return ERR_SUCCESS;
+    }
+
+    pthread_mutex_lock(&log_mutex);
+    ErrorCode err = ERR_NOT_FOUND;
+    if (standby_subscribed) {
+        peer->peer = standby_address;
+        err = ERR_SUCCESS;
+    }
+    pthread_mutex_unlock(&log_mutex);
+    return err;
+}
+
+ErrorCode log_shipping_init() {
+    pthread_mutex_lock(&log_mutex);
+    // Zero is what a standby that never synced reports
+    do {
+        epoch = ((uint64_t)time(NULL) << 32) ^ ((uint64_t)getpid() << 16) ^ (uint64_t)now_ms();
+    } while (epoch == 0);
+    shipping = 1;
+    pthread_mutex_unlock(&log_mutex);
+    return ERR_SUCCESS;
+}
+
+void log_shipping_cleanup() {
+    pthread_mutex_lock(&log_mutex);
+    shipping = 0;
+    while (ring_count > 0) {
+        free_oldest();
+    }
+    free(ring);
+    ring = NULL;
+    ring_capacity = 0;
+    pthread_cond_broadcast(&log_cond);
+    pthread_mutex_unlock(&log_mutex);
+    __atomic_store_n(&following, 0, __ATOMIC_RELEASE);
+}
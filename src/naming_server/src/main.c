@@ -5,6 +5,21 @@
 #include "protocol.h"
 #include "health.h"
 #include "router.h"
+#include "lease.h"
+#include "placement.h"
+#include "heartbeat_channel.h"
+#include "command_channel.h"
+#include "connection_pool.h"
+#include "shard.h"
+#include "log_shipping.h"
+#include "hotspot.h"
+#include "operation_table.h"
+#include "copy_job.h"
+#include "name_index.h"
+#include "repair.h"
+#include "request_log.h"
+#include "hash.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -14,11 +29,14 @@
 #include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <time.h>
 #include <errno.h>
 #include <fcntl.h>
 
 #define DEFAULT_CACHE_SIZE 1024
 #define MAX_CLIENTS 100
+#define MAX_RENAME_HOLDERS 256
 
 // typedef struct {
 //     char ip[INET_ADDRSTRLEN];
@@ -37,6 +55,12 @@ static pthread_t thread_ids[MAX_CLIENTS];
 static int thread_count = 0;
 static pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Naming servers sharing the namespace, this one at shard_index. Empty when
+// this server holds all of it.
+static ShardAddress shards[MAX_SHARDS];
+static uint32_t shard_count = 0;
+static uint32_t shard_index = 0;
+
 static void handle_signal(int sig) {
     printf("\nReceived signal %d, shutting down...\n", sig);
     running = 0;
@@ -61,7 +85,15 @@ static void print_usage(const char *prog) {
             "Options:\n"
             "  -p, --port PORT       Port to listen on (required)\n"
             "  -c, --cache-size N    Cache size in entries (default: 1024)\n"
-            "  -h, --help            Show this help\n", prog);
+            "  -s, --shards LIST     Every naming server sharing the namespace, as\n"
+            "                        host:port,host:port (the same list on each)\n"
+            "  -i, --shard-index N   Position of this server in --shards\n"
+            "  -f, --follow HOST:PORT\n"
+            "                        Run as the hot standby of that naming server\n"
+            "  -l, --log FILE        Binary request log (default: naming_server_PORT.log)\n"
+            "  -r, --replicas N      Live copies to restore files to after a storage\n"
+            "                        server fails (default: %d)\n"
+            "  -h, --help            Show this help\n", prog, REPAIR_TARGET_COPIES);
 }
 
 // static void handle_client_connection(NetworkSocket *client_sock) {
@@ -124,61 +156,990 @@ static void print_usage(const char *prog) {
 //     }
 // }
 
+// Send an error reply for request_id carrying the given code
+static void send_error_reply(NetworkSocket *sock, uint32_t request_id, ErrorCode code) {
+    // One send per frame, so lease invalidations pushed by other threads
+    // cannot land in the middle of it
+    struct {
+        MessageHeader header;
+        uint32_t code;
+    } __attribute__((packed)) reply;
+    reply.header.request_id = request_id;
+    reply.header.type = MSG_TYPE_ERROR;
+    reply.header.payload_size = htonl(sizeof(uint32_t));
+    reply.code = htonl(code);
+
+    network_socket_send(sock, &reply, sizeof(reply));
+}
+
+// Refuse a payload too big to buffer. Its bytes are never read, so the
+// connection cannot be parsed any further and is shut down.
+static void reject_payload(NetworkSocket *sock, uint32_t request_id, uint32_t payload_size) {
+    fprintf(stderr, "Refusing a %u byte payload\n", payload_size);
+    send_error_reply(sock, request_id, ERR_INVALID_ARGUMENT);
+    shutdown(network_socket_get_fd(sock), SHUT_RD);
+}
+
+// Whether path belongs to this naming server's part of the namespace
+static int owns_path(const char *path) {
+    return shard_count < 2 || shard_is_root(path) || shard_for_path(path, shard_count) == shard_index;
+}
+
+// Paths a delegate recently said it does not hold. Lookups of a missing
+// file under a delegation skip the probe until the miss expires, so a file
+// the owner gains outside the naming server shows up within the TTL.
+#define DELEGATE_MISS_SLOTS 4096
+#define DELEGATE_MISS_TTL_MS 1000
+
+typedef struct {
+    char path[256];
+    uint64_t expires_ms;
+} DelegateMiss;
+
+static DelegateMiss delegate_misses[DELEGATE_MISS_SLOTS];
+static pthread_mutex_t delegate_miss_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int delegate_missed(const char *path) {
+    DelegateMiss *miss = &delegate_misses[fnv_hash(path) % DELEGATE_MISS_SLOTS];
+    pthread_mutex_lock(&delegate_miss_mutex);
+    int missed = miss->expires_ms > now_ms() && strcmp(miss->path, path) == 0;
+    pthread_mutex_unlock(&delegate_miss_mutex);
+    return missed;
+}
+
+// A colliding path simply takes over the slot
+static void remember_delegate_miss(const char *path) {
+    if (strlen(path) >= sizeof(delegate_misses[0].path)) return;
+    DelegateMiss *miss = &delegate_misses[fnv_hash(path) % DELEGATE_MISS_SLOTS];
+    pthread_mutex_lock(&delegate_miss_mutex);
+    strcpy(miss->path, path);
+    miss->expires_ms = now_ms() + DELEGATE_MISS_TTL_MS;
+    pthread_mutex_unlock(&delegate_miss_mutex);
+}
+
+// Populate the entry of a path that has none yet through the delegated
+// subtree that contains it, if the owner really holds the file
+static ErrorCode populate_from_delegate(const char *path) {
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;
+    ErrorCode err = directory_find_delegate(path, ip, &port);
+    if (err != ERR_SUCCESS) return ERR_FILE_NOT_FOUND;
+    if (delegate_missed(path)) return ERR_FILE_NOT_FOUND;
+
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%u", port);
+    uint64_t size;
+    uint32_t permissions;
+    err = router_probe_file(ip, port_str, path, &size, &permissions);
+    if (err == ERR_FILE_NOT_FOUND) remember_delegate_miss(path);
+    if (err != ERR_SUCCESS) return ERR_FILE_NOT_FOUND;
+
+    log_shipping_begin_mutation();
+    err = directory_populate(path, ip, port, size, permissions);
+    if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_POPULATE, path, ip, port, size, permissions);
+    log_shipping_end_mutation();
+    return err;
+}
+
+// Copy the location of a registered file out of its entry
+static ErrorCode read_location(const char *path, char *ip, uint16_t *port, uint64_t *version) {
+    DirectoryEntry *entry = NULL;
+    if (directory_lookup(path, &entry) != ERR_SUCCESS) return ERR_FILE_NOT_FOUND;
+
+    ErrorCode err = ERR_FILE_NOT_FOUND;
+    pthread_rwlock_rdlock(&entry->lock);
+    if (entry->metadata) {
+        strncpy(ip, entry->metadata->storage_server_ip, INET_ADDRSTRLEN - 1);
+        ip[INET_ADDRSTRLEN - 1] = '\0';
+        *port = entry->metadata->storage_server_port;
+        *version = entry->metadata->version;
+        err = ERR_SUCCESS;
+    }
+    pthread_rwlock_unlock(&entry->lock);
+    return err;
+}
+
+// Look up the storage server holding path, falling back to delegations
+static ErrorCode resolve_location(const char *path, char *ip, uint16_t *port, uint64_t *version) {
+    if (read_location(path, ip, port, version) == ERR_SUCCESS) return ERR_SUCCESS;
+    if (populate_from_delegate(path) != ERR_SUCCESS) return ERR_FILE_NOT_FOUND;
+    return read_location(path, ip, port, version);
+}
+
+// Fill out with every server holding path, the primary included, ordered
+// for readers: healthy servers first, then the least loaded. Returns the
+// number of records.
+static uint16_t list_replicas(const char *path, const char *primary_ip, uint16_t primary_port, LocationReplica *out) {
+    FileReplica holders[MAX_FILE_REPLICAS + 1];
+    memset(holders, 0, sizeof(holders));
+    strncpy(holders[0].ip, primary_ip, INET_ADDRSTRLEN - 1);
+    holders[0].port = primary_port;
+    uint32_t count = 1;
+
+    DirectoryEntry *entry;
+    if (directory_lookup(path, &entry) == ERR_SUCCESS) {
+        pthread_rwlock_rdlock(&entry->lock);
+        for (uint32_t i = 0; entry->metadata && i < entry->metadata->replica_count && count < MAX_FILE_REPLICAS + 1; i++) {
+            holders[count++] = entry->metadata->replicas[i];
+        }
+        pthread_rwlock_unlock(&entry->lock);
+    }
+
+    double costs[MAX_FILE_REPLICAS + 1];
+    for (uint32_t i = 0; i < count; i++) {
+        char port[16];
+        snprintf(port, sizeof(port), "%u", holders[i].port);
+        StorageServer server;
+        int known = health_get_server(holders[i].ip, port, &server) == ERR_SUCCESS;
+        double cost = known ? health_server_cost(&server) : HEALTH_COST_EXCLUDED;
+        int healthy = known && server.active && cost < HEALTH_COST_EXCLUDED;
+
+        // Insertion sort keeps the primary ahead of equally good copies
+        LocationReplica replica;
+        memset(&replica, 0, sizeof(replica));
+        memcpy(replica.ip, holders[i].ip, INET_ADDRSTRLEN);
+        replica.port = htons(holders[i].port);
+        replica.healthy = healthy;
+        replica.load = htonl(cost * 1000 < UINT32_MAX ? (uint32_t)(cost * 1000) : UINT32_MAX);
+        uint32_t pos = i;
+        while (pos > 0 && (out[pos - 1].healthy < replica.healthy ||
+                           (out[pos - 1].healthy == replica.healthy && costs[pos - 1] > cost))) {
+            out[pos] = out[pos - 1];
+            costs[pos] = costs[pos - 1];
+            pos--;
+        }
+        out[pos] = replica;
+        costs[pos] = cost;
+    }
+    return (uint16_t)count;
+}
+
 void handle_client_request(NetworkSocket *sock, MessageHeader *header) {
     uint32_t request_id = header->request_id;
 
     // Receive the payload (file path)
     uint32_t payload_size = ntohl(header->payload_size);
+    if (payload_size > MAX_PATH_PAYLOAD) {
+        reject_payload(sock, request_id, payload_size);
+        return;
+    }
     char *path = malloc(payload_size + 1);
+    if (!path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
     if (network_socket_receive(sock, path, payload_size) != payload_size) {
         fprintf(stderr, "Failed to receive path\n");
         free(path);
         return;
     }
     path[payload_size] = '\0';
-    printf("path: %s\n", path); //!debug
-    fflush(stdout);
+
+    if (!owns_path(path)) {
+        REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_LOOKUP, request_id, path, ERR_WRONG_SHARD, 0);
+        send_error_reply(sock, request_id, ERR_WRONG_SHARD);
+        free(path);
+        return;
+    }
 
     // Lookup the directory entry
-    DirectoryEntry *entry = NULL;
-    ErrorCode err = directory_lookup(path, &entry);
-    printf("dir lookup response: %d\n", err); //!debug
-    if (err == ERR_SUCCESS && entry != NULL && entry->metadata != NULL) {
-        FileMetadata *metadata = entry->metadata;
-
-        // Prepare response header
-        MessageHeader resp_header = {
-            .request_id = request_id,
-            .type = MSG_TYPE_LOCATION,
-            .payload_size = htonl(INET_ADDRSTRLEN + sizeof(uint16_t))
-        };
-
-        // Send response header
-        printf("Sending response of size %d\n", resp_header.payload_size); //!debug
-        network_socket_send(sock, &resp_header, sizeof(resp_header));
-
-        // Send Storage Server IP and port
-        network_socket_send(sock, metadata->storage_server_ip, INET_ADDRSTRLEN);
-        uint16_t port_net = htons(metadata->storage_server_port);
-        network_socket_send(sock, &port_net, sizeof(port_net));
-
-        printf("Provided storage server info for path: %d\n", metadata->storage_server_port); //!debug
+    char ip[INET_ADDRSTRLEN] = {0};
+    uint16_t port = 0;
+    uint64_t version = 0;
+    ErrorCode err = resolve_location(path, ip, &port, &version);
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_LOOKUP, request_id, path, err, port);
+    if (err == ERR_SUCCESS) {
+        hotspot_record(path);
+        struct {
+            MessageHeader header;
+            char ip[INET_ADDRSTRLEN];
+            uint16_t port;
+            LocationLease lease;
+            uint16_t replica_count;
+            LocationReplica replicas[MAX_FILE_REPLICAS + 1];
+        } __attribute__((packed)) reply;
+        memset(&reply, 0, sizeof(reply));
+        uint16_t replica_count = list_replicas(path, ip, port, reply.replicas);
+        size_t reply_size = offsetof(__typeof__(reply), replicas) + replica_count * sizeof(LocationReplica);
+        reply.header.request_id = request_id;
+        reply.header.type = MSG_TYPE_LOCATION;
+        reply.header.payload_size = htonl(reply_size - sizeof(MessageHeader));
+        memcpy(reply.ip, ip, INET_ADDRSTRLEN);
+        reply.port = htons(port);
+        reply.replica_count = htons(replica_count);
+
+        // Lease first, so an invalidation can only ever follow the reply
+        reply.lease.ttl_ms = htonl(lease_grant(path, sock, ip, port, version));
+        reply.lease.version = network_hton64(version);
+        network_socket_send(sock, &reply, reply_size);
     } else {
-        // Send error response
-        MessageHeader err_header;
-        err_header.request_id = request_id;
-        err_header.type = MSG_TYPE_ERROR;
-        err_header.payload_size = htonl(sizeof(uint32_t));
+        send_error_reply(sock, request_id, ERR_FILE_NOT_FOUND);
+    }
 
-        network_socket_send(sock, &err_header, sizeof(err_header));
+    free(path);
+}
 
-        uint32_t error_code = htonl(ERR_FILE_NOT_FOUND);
-        network_socket_send(sock, &error_code, sizeof(error_code));
+// Reply to a CREATE or DELETE: an empty frame of the request's type on
+// success, an error frame otherwise
+static void send_mutation_reply(NetworkSocket *sock, MessageHeader *header, ErrorCode err) {
+    if (err != ERR_SUCCESS) {
+        send_error_reply(sock, header->request_id, err);
+        return;
+    }
+    MessageHeader reply = {
+        .request_id = header->request_id,
+        .type = header->type,
+        .payload_size = 0,
+    };
+    network_socket_send(sock, &reply, sizeof(reply));
+}
 
-        fprintf(stderr, "File not found: %s\n", path);
+// The storage server removed the file of a failed CREATE; only now is the
+// path free for another create
+static void create_undone(ErrorCode status, void *arg) {
+    Operation *operation = arg;
+    if (status != ERR_SUCCESS && status != ERR_FILE_NOT_FOUND) {
+        fprintf(stderr, "Could not remove %s from %s:%s; its next inventory will list it\n", operation->path,
+                operation->host, operation->port);
     }
+    operation_finish(operation, operation->status);
+}
 
-    free(path);
+// A storage server finished creating operation's file: record it and tell
+// the client. If the server may hold a file the tree does not list, it is
+// told to delete it before the path is released.
+static void create_done(ErrorCode status, void *arg) {
+    Operation *operation = arg;
+    uint16_t port = (uint16_t)atoi(operation->port);
+    int undo = status == ERR_TIMEOUT;
+    if (status == ERR_SUCCESS) {
+        log_shipping_begin_mutation();
+        status = directory_populate(operation->path, operation->host, port, 0, operation->mode & 0777);
+        if (status == ERR_SUCCESS) {
+            log_shipping_append_placement(LOG_OP_POPULATE, operation->path, operation->host, port, 0,
+                                          operation->mode & 0777);
+        }
+        log_shipping_end_mutation();
+        undo = status != ERR_SUCCESS;
+    }
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_CREATE, operation->request_id, operation->path, status, 0);
+
+    if (undo) {
+        StorageCommand command;
+        memset(&command, 0, sizeof(command));
+        command.op = STORAGE_COMMAND_DELETE;
+        strncpy(command.path, operation->path, sizeof(command.path) - 1);
+        operation->status = status;
+        if (command_submit(operation->host, operation->port, &command, create_undone, operation) == ERR_SUCCESS) {
+            return;
+        }
+    }
+    operation_finish(operation, status);
+}
+
+// A delete waiting on every server holding the file
+typedef struct DeleteJob DeleteJob;
+
+typedef struct {
+    DeleteJob *job;
+    FileReplica holder;
+    ErrorCode status;
+} DeleteSlot;
+
+struct DeleteJob {
+    Operation *operation;
+    DeleteSlot slots[MAX_FILE_REPLICAS + 1];    // The primary first
+    uint32_t holder_count;
+    uint32_t pending;
+    pthread_mutex_t mutex;
+};
+
+// One holder finished deleting operation's file. Once all have, the file
+// leaves the tree if its primary no longer has it, and the client is told.
+static void delete_done(ErrorCode status, void *arg) {
+    DeleteSlot *slot = arg;
+    DeleteJob *job = slot->job;
+    pthread_mutex_lock(&job->mutex);
+    slot->status = status;
+    uint32_t pending = --job->pending;
+    pthread_mutex_unlock(&job->mutex);
+    if (pending > 0) return;
+
+    // Already gone from a server is as good as deleted
+    Operation *operation = job->operation;
+    status = job->slots[0].status;
+    if (status == ERR_SUCCESS || status == ERR_FILE_NOT_FOUND) {
+        log_shipping_begin_mutation();
+        status = directory_delete(operation->path);
+        if (status == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_DELETE, operation->path, NULL, 0, 0, 0);
+        log_shipping_end_mutation();
+    }
+    for (uint32_t i = 1; i < job->holder_count; i++) {
+        ErrorCode copy_status = job->slots[i].status;
+        if (copy_status != ERR_SUCCESS && copy_status != ERR_FILE_NOT_FOUND) {
+            fprintf(stderr, "Failed to delete the copy of %s on %s:%u: %s\n", operation->path,
+                    job->slots[i].holder.ip, job->slots[i].holder.port, error_string(copy_status));
+        }
+    }
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_DELETE, operation->request_id, operation->path, status,
+                job->holder_count);
+    operation_finish(operation, status);
+    pthread_mutex_destroy(&job->mutex);
+    free(job);
+}
+
+// Accept operation and hand command to its storage server; the outcome
+// reaches the client through done
+static void dispatch_operation(Operation *operation, const StorageCommand *command, command_callback_t done) {
+    operation_accept(operation);
+    ErrorCode err = command_submit(operation->host, operation->port, command, done, operation);
+    if (err != ERR_SUCCESS) done(err, operation);
+}
+
+// Place a new file and have the chosen storage server create it. The client
+// is answered with OP_ACCEPTED at once and OP_COMPLETE once it exists.
+void handle_create(NetworkSocket *sock, MessageHeader *header) {
+    CreateRequest request;
+    size_t body_size = sizeof(request) - sizeof(MessageHeader);
+    if (network_socket_receive(sock, (uint8_t *)&request + sizeof(MessageHeader), body_size) != (ssize_t)body_size) {
+        fprintf(stderr, "Failed to receive create request\n");
+        return;
+    }
+    request.filepath[sizeof(request.filepath) - 1] = '\0';
+    const char *path = request.filepath;
+
+    if (path[0] == '\0') {
+        send_mutation_reply(sock, header, ERR_INVALID_ARGUMENT);
+        return;
+    }
+    if (!owns_path(path)) {
+        send_mutation_reply(sock, header, ERR_WRONG_SHARD);
+        return;
+    }
+    if (log_shipping_is_standby()) {
+        send_mutation_reply(sock, header, ERR_READ_ONLY);
+        return;
+    }
+
+    // Claim the path before looking, so no other create can slip in between
+    Operation *operation;
+    ErrorCode err = operation_begin(sock, header->request_id, MSG_TYPE_CREATE, path, NULL, &operation);
+    if (err != ERR_SUCCESS) {
+        send_mutation_reply(sock, header, err);
+        return;
+    }
+
+    // Anything already in the tree, file or directory, or held under a
+    // delegation is taken
+    DirectoryEntry *existing;
+    if (directory_lookup(path, &existing) == ERR_SUCCESS || populate_from_delegate(path) == ERR_SUCCESS) {
+        err = ERR_ALREADY_EXISTS;
+    } else {
+        err = router_select_server(path, operation->host, sizeof(operation->host), operation->port,
+                                   sizeof(operation->port));
+    }
+    if (err != ERR_SUCCESS) {
+        operation_abandon(operation);
+        send_mutation_reply(sock, header, err);
+        return;
+    }
+    operation->mode = request.mode;
+
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_CREATE;
+    command.mode = htonl(request.mode);
+    strncpy(command.path, path, sizeof(command.path) - 1);
+    dispatch_operation(operation, &command, create_done);
+}
+
+// Have every storage server holding a file delete it, then drop it from
+// the tree, answering like a create. Directories hold no data, so an empty one only
+// leaves the tree and is answered at once.
+void handle_delete(NetworkSocket *sock, MessageHeader *header) {
+    DeleteRequest request;
+    size_t body_size = sizeof(request) - sizeof(MessageHeader);
+    if (network_socket_receive(sock, (uint8_t *)&request + sizeof(MessageHeader), body_size) != (ssize_t)body_size) {
+        fprintf(stderr, "Failed to receive delete request\n");
+        return;
+    }
+    request.filepath[sizeof(request.filepath) - 1] = '\0';
+    const char *path = request.filepath;
+    if (!owns_path(path)) {
+        send_mutation_reply(sock, header, ERR_WRONG_SHARD);
+        return;
+    }
+    if (log_shipping_is_standby()) {
+        send_mutation_reply(sock, header, ERR_READ_ONLY);
+        return;
+    }
+
+    Operation *operation;
+    ErrorCode err = operation_begin(sock, header->request_id, MSG_TYPE_DELETE, path, NULL, &operation);
+    if (err != ERR_SUCCESS) {
+        send_mutation_reply(sock, header, err);
+        return;
+    }
+
+    // Every holder deletes its copy, replicas and copies made for hot
+    // files or repairs included, so none comes back with an inventory
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;
+    uint64_t version;
+    if (resolve_location(path, ip, &port, &version) == ERR_SUCCESS) {
+        DeleteJob *job = calloc(1, sizeof(DeleteJob));
+        if (!job) {
+            operation_abandon(operation);
+            send_mutation_reply(sock, header, ERR_INTERNAL_ERROR);
+            return;
+        }
+        FileReplica holders[MAX_FILE_REPLICAS + 1];
+        if (directory_get_holders(path, holders, &job->holder_count) != ERR_SUCCESS) {
+            memset(holders, 0, sizeof(holders));
+            snprintf(holders[0].ip, sizeof(holders[0].ip), "%s", ip);
+            holders[0].port = port;
+            job->holder_count = 1;
+        }
+        for (uint32_t i = 0; i < job->holder_count; i++) {
+            job->slots[i].job = job;
+            job->slots[i].holder = holders[i];
+        }
+        job->operation = operation;
+        job->pending = job->holder_count;
+        pthread_mutex_init(&job->mutex, NULL);
+        snprintf(operation->host, sizeof(operation->host), "%s", holders[0].ip);
+        snprintf(operation->port, sizeof(operation->port), "%u", holders[0].port);
+        operation_accept(operation);
+
+        // The last answer frees the job, so nothing here may touch it after
+        // the last submit
+        uint32_t holder_count = job->holder_count;
+        for (uint32_t i = 0; i < holder_count; i++) {
+            DeleteSlot *slot = &job->slots[i];
+            char holder_port[16];
+            snprintf(holder_port, sizeof(holder_port), "%u", slot->holder.port);
+            StorageCommand command;
+            memset(&command, 0, sizeof(command));
+            command.op = STORAGE_COMMAND_DELETE;
+            strncpy(command.path, path, sizeof(command.path) - 1);
+            err = command_submit(slot->holder.ip, holder_port, &command, delete_done, slot);
+            if (err != ERR_SUCCESS) delete_done(err, slot);
+        }
+        return;
+    }
+
+    DirectoryEntry *entry;
+    log_shipping_begin_mutation();
+    err = directory_lookup(path, &entry) == ERR_SUCCESS ? directory_delete(path) : ERR_FILE_NOT_FOUND;
+    if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_DELETE, path, NULL, 0, 0, 0);
+    log_shipping_end_mutation();
+    operation_abandon(operation);
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_DELETE, header->request_id, path, err, 0);
+    send_mutation_reply(sock, header, err);
+}
+
+// Whether path is base or lies below it
+static int path_within(const char *path, const char *base) {
+    while (*path == '/') path++;
+    while (*base == '/') base++;
+    size_t length = strlen(base);
+    return length == 0 || (strncmp(path, base, length) == 0 && (path[length] == '\0' || path[length] == '/'));
+}
+
+// Copy a file or directory tree to a new path, answering like a create.
+// The storage servers move the data; see copy_job.h.
+void handle_copy(NetworkSocket *sock, MessageHeader *header) {
+    CopyRequest request;
+    size_t body_size = sizeof(request) - sizeof(MessageHeader);
+    if (network_socket_receive(sock, (uint8_t *)&request + sizeof(MessageHeader), body_size) != (ssize_t)body_size) {
+        fprintf(stderr, "Failed to receive copy request\n");
+        return;
+    }
+    request.source[sizeof(request.source) - 1] = '\0';
+    request.destination[sizeof(request.destination) - 1] = '\0';
+    const char *source = request.source;
+    const char *destination = request.destination;
+
+    // A tree cannot be copied into itself
+    if (source[0] == '\0' || destination[0] == '\0' || path_within(destination, source)) {
+        send_mutation_reply(sock, header, ERR_INVALID_ARGUMENT);
+        return;
+    }
+    if (!owns_path(source) || !owns_path(destination)) {
+        send_mutation_reply(sock, header, ERR_WRONG_SHARD);
+        return;
+    }
+    if (log_shipping_is_standby()) {
+        send_mutation_reply(sock, header, ERR_READ_ONLY);
+        return;
+    }
+
+    Operation *operation;
+    ErrorCode err = operation_begin(sock, header->request_id, MSG_TYPE_COPY, destination, source, &operation);
+    if (err != ERR_SUCCESS) {
+        send_mutation_reply(sock, header, err);
+        return;
+    }
+
+    DirectoryEntry *existing;
+    if (directory_lookup(destination, &existing) == ERR_SUCCESS || populate_from_delegate(destination) == ERR_SUCCESS) {
+        err = ERR_ALREADY_EXISTS;
+    } else {
+        // A source file under a delegation gets its entry first, like a lookup
+        char ip[INET_ADDRSTRLEN];
+        uint16_t port;
+        uint64_t version;
+        resolve_location(source, ip, &port, &version);
+        err = copy_job_start(operation, source);
+    }
+    if (err != ERR_SUCCESS) {
+        operation_abandon(operation);
+        REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_COPY, header->request_id, destination, err, 0);
+        send_mutation_reply(sock, header, err);
+    }
+}
+
+void handle_location_batch(NetworkSocket *sock, MessageHeader *header) {
+    uint32_t request_id = header->request_id;
+    uint32_t payload_size = ntohl(header->payload_size);
+
+    if (payload_size < sizeof(uint32_t)) {
+        fprintf(stderr, "Malformed location batch\n");
+        return;
+    }
+    if (payload_size > MAX_LOCATION_BATCH_PAYLOAD) {
+        reject_payload(sock, request_id, payload_size);
+        return;
+    }
+
+    uint8_t *payload = malloc(payload_size);
+    if (!payload) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    if (network_socket_receive(sock, payload, payload_size) != payload_size) {
+        fprintf(stderr, "Failed to receive location batch\n");
+        free(payload);
+        return;
+    }
+
+    uint32_t count_net;
+    memcpy(&count_net, payload, sizeof(count_net));
+    uint32_t count = ntohl(count_net);
+    if (count == 0 || count > MAX_LOCATION_BATCH) {
+        send_error_reply(sock, request_id, ERR_INVALID_ARGUMENT);
+        free(payload);
+        return;
+    }
+
+    // Split the payload into NUL-terminated paths
+    char **paths = calloc(count, sizeof(char *));
+    DirectoryEntry **entries = malloc(sizeof(DirectoryEntry *) * count);
+    ErrorCode *results = malloc(sizeof(ErrorCode) * count);
+    if (!paths || !entries || !results) {
+        send_error_reply(sock, request_id, ERR_INTERNAL_ERROR);
+        goto out;
+    }
+
+    size_t offset = sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t len_net;
+        if (offset + sizeof(len_net) > payload_size) break;
+        memcpy(&len_net, payload + offset, sizeof(len_net));
+        offset += sizeof(len_net);
+        uint16_t len = ntohs(len_net);
+        if (offset + len > payload_size) break;
+        paths[i] = strndup((const char *)payload + offset, len);
+        offset += len;
+    }
+
+    directory_lookup_batch((const char **)paths, count, entries, results);
+
+    // Build the whole reply so it goes out as a single frame
+    size_t reply_size = sizeof(MessageHeader) + sizeof(uint32_t) + count * sizeof(LocationBatchEntry);
+    uint8_t *reply = calloc(1, reply_size);
+    if (!reply) {
+        send_error_reply(sock, request_id, ERR_INTERNAL_ERROR);
+        goto out;
+    }
+
+    MessageHeader *resp_header = (MessageHeader *)reply;
+    resp_header->request_id = request_id;
+    resp_header->type = MSG_TYPE_LOCATION_BATCH;
+    resp_header->payload_size = htonl(reply_size - sizeof(MessageHeader));
+    memcpy(reply + sizeof(MessageHeader), &count_net, sizeof(count_net));
+
+    LocationBatchEntry *out_entries = (LocationBatchEntry *)(reply + sizeof(MessageHeader) + sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        ErrorCode err = !paths[i] ? ERR_INVALID_ARGUMENT : owns_path(paths[i]) ? results[i] : ERR_WRONG_SHARD;
+        char ip[INET_ADDRSTRLEN] = {0};
+        uint16_t port = 0;
+        uint64_t version = 0;
+        if (err == ERR_SUCCESS) {
+            pthread_rwlock_rdlock(&entries[i]->lock);
+            FileMetadata *metadata = entries[i]->metadata;
+            if (metadata) {
+                strncpy(ip, metadata->storage_server_ip, INET_ADDRSTRLEN - 1);
+                port = metadata->storage_server_port;
+                version = metadata->version;
+            } else {
+                err = ERR_FILE_NOT_FOUND;
+            }
+            pthread_rwlock_unlock(&entries[i]->lock);
+        } else if (err == ERR_NOT_FOUND) {
+            err = ERR_FILE_NOT_FOUND;
+        }
+
+        if (err == ERR_FILE_NOT_FOUND) {
+            err = resolve_location(paths[i], ip, &port, &version);
+        }
+
+        out_entries[i].status = htonl(err);
+        if (err == ERR_SUCCESS) {
+            memcpy(out_entries[i].storage_server_ip, ip, INET_ADDRSTRLEN);
+            out_entries[i].storage_server_port = htons(port);
+            out_entries[i].lease.ttl_ms = htonl(lease_grant(paths[i], sock, ip, port, version));
+            out_entries[i].lease.version = network_hton64(version);
+        }
+    }
+
+    network_socket_send(sock, reply, reply_size);
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_LOOKUP_BATCH, request_id, NULL, ERR_SUCCESS, count);
+    free(reply);
+
+out:
+    if (paths) {
+        for (uint32_t i = 0; i < count; i++) free(paths[i]);
+    }
+    free(paths);
+    free(entries);
+    free(results);
+    free(payload);
+}
+
+void handle_list(NetworkSocket *sock, MessageHeader *header) {
+    uint32_t request_id = header->request_id;
+
+    if (ntohl(header->payload_size) != sizeof(ListRequest)) {
+        fprintf(stderr, "Malformed list request\n");
+        return;
+    }
+
+    ListRequest request;
+    if (network_socket_receive(sock, &request, sizeof(request)) != sizeof(request)) {
+        fprintf(stderr, "Failed to receive list request\n");
+        return;
+    }
+    request.path[sizeof(request.path) - 1] = '\0';
+    request.cursor[sizeof(request.cursor) - 1] = '\0';
+
+    uint32_t max_entries = ntohl(request.max_entries);
+    if (max_entries == 0 || max_entries > LIST_MAX_PAGE) max_entries = LIST_MAX_PAGE;
+
+    // Every shard lists its own part of the root; clients merge the pages
+    if (!owns_path(request.path)) {
+        send_error_reply(sock, request_id, ERR_WRONG_SHARD);
+        return;
+    }
+
+    // One page is the most this request can ever hold in memory
+    size_t reply_size = sizeof(MessageHeader) + sizeof(ListPageHeader) + max_entries * sizeof(ListEntry);
+    uint8_t *reply = calloc(1, reply_size);
+    if (!reply) {
+        send_error_reply(sock, request_id, ERR_INTERNAL_ERROR);
+        return;
+    }
+    ListPageHeader *page = (ListPageHeader *)(reply + sizeof(MessageHeader));
+    ListEntry *entries = (ListEntry *)(reply + sizeof(MessageHeader) + sizeof(ListPageHeader));
+
+    uint32_t count = 0;
+    int has_more = 0;
+    ErrorCode err = directory_list(request.path[0] ? request.path : "/", request.recursive, request.cursor,
+                                   entries, max_entries, &count, page->next_cursor,
+                                   sizeof(page->next_cursor), &has_more);
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_LIST, request_id, request.path, err, count);
+    if (err != ERR_SUCCESS) {
+        send_error_reply(sock, request_id, err == ERR_NOT_FOUND ? ERR_FILE_NOT_FOUND : err);
+        free(reply);
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].size = network_hton64(entries[i].size);
+        entries[i].permissions = htonl(entries[i].permissions);
+        entries[i].storage_server_port = htons(entries[i].storage_server_port);
+    }
+    page->count = htonl(count);
+    page->has_more = has_more;
+
+    size_t payload_size = sizeof(ListPageHeader) + count * sizeof(ListEntry);
+    MessageHeader *resp_header = (MessageHeader *)reply;
+    resp_header->request_id = request_id;
+    resp_header->type = MSG_TYPE_LIST_PAGE;
+    resp_header->payload_size = htonl(payload_size);
+
+    network_socket_send(sock, reply, sizeof(MessageHeader) + payload_size);
+    free(reply);
+}
+
+void handle_search(NetworkSocket *sock, MessageHeader *header) {
+    uint32_t request_id = header->request_id;
+
+    if (ntohl(header->payload_size) != sizeof(SearchRequest)) {
+        fprintf(stderr, "Malformed search request\n");
+        return;
+    }
+
+    SearchRequest request;
+    if (network_socket_receive(sock, &request, sizeof(request)) != sizeof(request)) {
+        fprintf(stderr, "Failed to receive search request\n");
+        return;
+    }
+    request.pattern[sizeof(request.pattern) - 1] = '\0';
+    request.cursor[sizeof(request.cursor) - 1] = '\0';
+
+    uint32_t max_entries = ntohl(request.max_entries);
+    if (max_entries == 0 || max_entries > LIST_MAX_PAGE) max_entries = LIST_MAX_PAGE;
+
+    size_t reply_size = sizeof(MessageHeader) + sizeof(ListPageHeader) + max_entries * sizeof(ListEntry);
+    uint8_t *reply = calloc(1, reply_size);
+    if (!reply) {
+        send_error_reply(sock, request_id, ERR_INTERNAL_ERROR);
+        return;
+    }
+    ListPageHeader *page = (ListPageHeader *)(reply + sizeof(MessageHeader));
+    ListEntry *entries = (ListEntry *)(reply + sizeof(MessageHeader) + sizeof(ListPageHeader));
+
+    // Each shard indexes only its own paths; clients ask every one of them
+    uint32_t count = 0, next_cursor = 0;
+    int has_more = 0;
+    ErrorCode err = name_index_search(request.pattern, (SearchMode)request.mode,
+                                      (uint32_t)strtoul(request.cursor, NULL, 10), entries, max_entries,
+                                      &count, &next_cursor, &has_more);
+    if (err != ERR_SUCCESS) {
+        REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_SEARCH, request_id, request.pattern, err, 0);
+        send_error_reply(sock, request_id, err);
+        free(reply);
+        return;
+    }
+
+    // The index only knows names; attributes come from the tree, and
+    // entries gone since the index was read are left out
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        ListEntry found;
+        if (directory_stat(entries[i].path, &found) != ERR_SUCCESS) continue;
+        entries[kept] = found;
+        entries[kept].size = network_hton64(found.size);
+        entries[kept].permissions = htonl(found.permissions);
+        entries[kept].storage_server_port = htons(found.storage_server_port);
+        kept++;
+    }
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_SEARCH, request_id, request.pattern, ERR_SUCCESS, kept);
+
+    page->count = htonl(kept);
+    page->has_more = has_more;
+    snprintf(page->next_cursor, sizeof(page->next_cursor), "%u", next_cursor);
+
+    size_t payload_size = sizeof(ListPageHeader) + kept * sizeof(ListEntry);
+    MessageHeader *resp_header = (MessageHeader *)reply;
+    resp_header->request_id = request_id;
+    resp_header->type = MSG_TYPE_LIST_PAGE;
+    resp_header->payload_size = htonl(payload_size);
+
+    network_socket_send(sock, reply, sizeof(MessageHeader) + payload_size);
+    free(reply);
+}
+
+// A rename waiting on the storage servers holding files below its source
+typedef struct RenameJob RenameJob;
+
+typedef struct {
+    RenameJob *job;
+    FileReplica holder;
+    ErrorCode status;
+} RenameSlot;
+
+struct RenameJob {
+    Operation *operation;
+    char source[256];
+    RenameSlot slots[MAX_RENAME_HOLDERS];
+    uint32_t holder_count;
+    uint32_t pending;
+    pthread_mutex_t mutex;
+};
+
+// Move source to destination in the tree, ship it and revoke the leases
+// handed out below source
+static ErrorCode apply_rename(const char *source, const char *destination) {
+    log_shipping_begin_mutation();
+    ErrorCode err = directory_rename(source, destination);
+    if (err == ERR_SUCCESS) log_shipping_append_rename(source, destination);
+    log_shipping_end_mutation();
+    if (err != ERR_SUCCESS) return err;
+    lease_invalidate_prefix(source);
+    return ERR_SUCCESS;
+}
+
+static ErrorCode submit_rename(const FileReplica *holder, const char *source, const char *destination,
+                               command_callback_t done, void *arg) {
+    char port[16];
+    snprintf(port, sizeof(port), "%u", holder->port);
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_RENAME;
+    strncpy(command.path, destination, sizeof(command.path) - 1);
+    strncpy(command.source_path, source, sizeof(command.source_path) - 1);
+    return command_submit(holder->ip, port, &command, done, arg);
+}
+
+static void rename_undone(ErrorCode status, void *arg) {
+    (void)arg;
+    if (status != ERR_SUCCESS) fprintf(stderr, "Failed to undo a rename: %s\n", error_string(status));
+}
+
+// One holder answered. Once all have, the tree follows them, or the servers
+// that did move their files move them back.
+static void rename_done(ErrorCode status, void *arg) {
+    RenameSlot *slot = arg;
+    RenameJob *job = slot->job;
+    pthread_mutex_lock(&job->mutex);
+    slot->status = status;
+    uint32_t pending = --job->pending;
+    pthread_mutex_unlock(&job->mutex);
+    if (pending > 0) return;
+
+    // A holder without the files had nothing to move
+    Operation *operation = job->operation;
+    ErrorCode err = ERR_SUCCESS;
+    for (uint32_t i = 0; i < job->holder_count; i++) {
+        if (job->slots[i].status != ERR_SUCCESS && job->slots[i].status != ERR_FILE_NOT_FOUND) {
+            err = job->slots[i].status;
+        }
+    }
+    if (err == ERR_SUCCESS) err = apply_rename(job->source, operation->path);
+    if (err != ERR_SUCCESS) {
+        for (uint32_t i = 0; i < job->holder_count; i++) {
+            if (job->slots[i].status != ERR_SUCCESS) continue;
+            if (submit_rename(&job->slots[i].holder, operation->path, job->source, rename_undone, NULL) != ERR_SUCCESS) {
+                fprintf(stderr, "Failed to undo the rename of %s on %s:%u\n", job->source,
+                        job->slots[i].holder.ip, job->slots[i].holder.port);
+            }
+        }
+    }
+
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_RENAME, operation->request_id, operation->path, err,
+                job->holder_count);
+    operation_finish(operation, err);
+    pthread_mutex_destroy(&job->mutex);
+    free(job);
+}
+
+// Move a file or directory tree to a new path, answering like a create.
+// The tree only relinks the moved entry and every server holding files
+// below it does a single rename, so the cost does not grow with the tree.
+void handle_rename(NetworkSocket *sock, MessageHeader *header) {
+    RenameRequest request;
+    size_t body_size = sizeof(request) - sizeof(MessageHeader);
+    if (network_socket_receive(sock, (uint8_t *)&request + sizeof(MessageHeader), body_size) != (ssize_t)body_size) {
+        fprintf(stderr, "Failed to receive rename request\n");
+        return;
+    }
+    request.source[sizeof(request.source) - 1] = '\0';
+    request.destination[sizeof(request.destination) - 1] = '\0';
+    const char *source = request.source;
+    const char *destination = request.destination;
+
+    if (source[0] == '\0' || destination[0] == '\0' || path_within(destination, source)) {
+        send_mutation_reply(sock, header, ERR_INVALID_ARGUMENT);
+        return;
+    }
+    if (!owns_path(source) || !owns_path(destination)) {
+        send_mutation_reply(sock, header, ERR_WRONG_SHARD);
+        return;
+    }
+    if (log_shipping_is_standby()) {
+        send_mutation_reply(sock, header, ERR_READ_ONLY);
+        return;
+    }
+
+    Operation *operation;
+    ErrorCode err = operation_begin(sock, header->request_id, MSG_TYPE_RENAME, destination, source, &operation);
+    if (err != ERR_SUCCESS) {
+        send_mutation_reply(sock, header, err);
+        return;
+    }
+
+    RenameJob *job = calloc(1, sizeof(RenameJob));
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;
+    uint64_t version;
+    DirectoryEntry *existing;
+    if (!job) {
+        err = ERR_INTERNAL_ERROR;
+    } else if (directory_lookup(destination, &existing) == ERR_SUCCESS || populate_from_delegate(destination) == ERR_SUCCESS) {
+        err = ERR_ALREADY_EXISTS;
+    } else if (directory_lookup(source, &existing) != ERR_SUCCESS && resolve_location(source, ip, &port, &version) != ERR_SUCCESS) {
+        err = ERR_FILE_NOT_FOUND;
+    } else {
+        FileReplica holders[MAX_RENAME_HOLDERS];
+        err = directory_holders(source, holders, MAX_RENAME_HOLDERS, &job->holder_count);
+
+        // Files under a delegation above source have no entries yet, but
+        // the owner holds them on disk. A delegation is not moved along, so
+        // both paths must fall under the same one.
+        char dest_ip[INET_ADDRSTRLEN];
+        uint16_t dest_port;
+        int delegated = directory_find_delegate(source, ip, &port) == ERR_SUCCESS;
+        int dest_delegated = directory_find_delegate(destination, dest_ip, &dest_port) == ERR_SUCCESS;
+        if (delegated != dest_delegated || (delegated && (port != dest_port || strcmp(ip, dest_ip) != 0))) {
+            err = ERR_INVALID_ARGUMENT;
+        }
+        for (uint32_t i = 0; err == ERR_SUCCESS && i < job->holder_count; i++) {
+            job->slots[i].holder = holders[i];
+        }
+        int listed = 0;
+        for (uint32_t i = 0; i < job->holder_count; i++) {
+            if (job->slots[i].holder.port == port && strcmp(job->slots[i].holder.ip, ip) == 0) listed = 1;
+        }
+        if (err == ERR_SUCCESS && delegated && !listed && job->holder_count < MAX_RENAME_HOLDERS) {
+            FileReplica *owner = &job->slots[job->holder_count++].holder;
+            snprintf(owner->ip, sizeof(owner->ip), "%s", ip);
+            owner->port = port;
+        }
+    }
+    if (err != ERR_SUCCESS || job->holder_count == 0) {
+        // Nothing on disk below source, such as empty directories: only
+        // the tree changes
+        if (err == ERR_SUCCESS) err = apply_rename(source, destination);
+        operation_abandon(operation);
+        free(job);
+        REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_RENAME, header->request_id, destination, err, 0);
+        send_mutation_reply(sock, header, err);
+        return;
+    }
+
+    job->operation = operation;
+    snprintf(job->source, sizeof(job->source), "%s", source);
+    job->pending = job->holder_count;
+    pthread_mutex_init(&job->mutex, NULL);
+    operation_accept(operation);
+
+    // The last answer frees the job, so nothing here may touch it after
+    // the last submit
+    uint32_t holder_count = job->holder_count;
+    for (uint32_t i = 0; i < holder_count; i++) {
+        RenameSlot *slot = &job->slots[i];
+        slot->job = job;
+        err = submit_rename(&slot->holder, source, destination, rename_done, slot);
+        if (err != ERR_SUCCESS) rename_done(err, slot);
+    }
 }
 
 void handle_storage_server_registration(NetworkSocket *sock, MessageHeader *header, const char *ip) {
@@ -195,16 +1156,22 @@ void handle_storage_server_registration(NetworkSocket *sock, MessageHeader *head
 
     printf("Received registration from %s:%d with %d paths\n", ip, reg_msg.port, reg_msg.num_paths);
 
+    // A standby still reads the paths, so the connection stays in step
+    int read_only = log_shipping_is_standby();
+
     // Receive the paths
     // char **paths = malloc(reg_msg.num_paths * sizeof(char *));
     for (uint32_t i = 0; i < reg_msg.num_paths; i++) {
-        printf("Receiving path %d\n", i); //!debug
         uint32_t path_len_net;
         if (network_socket_receive(sock, &path_len_net, sizeof(path_len_net)) != sizeof(path_len_net)) {
             fprintf(stderr, "Failed to receive path length\n");
             return;
         }
         uint32_t path_len = ntohl(path_len_net);
+        if (path_len > MAX_PATH_PAYLOAD) {
+            reject_payload(sock, request_id, path_len);
+            return;
+        }
         char *path = malloc(path_len+1);
         if (!path) {
             fprintf(stderr, "Memory allocation failed\n");
@@ -216,25 +1183,36 @@ void handle_storage_server_registration(NetworkSocket *sock, MessageHeader *head
             return;
         }
         path[path_len] = '\0';
-        printf("Received path: %s\n", path); //!debug
+        if (read_only || !owns_path(path)) {
+            free(path);
+            continue;
+        }
 
         // Create or update the directory entry
-        FileMetadata *metadata = malloc(sizeof(FileMetadata));
+        FileMetadata *metadata = calloc(1, sizeof(FileMetadata));
         metadata->storage_server_ip = strdup(ip);
         metadata->storage_server_port = reg_msg.port;
         // Initialize other metadata fields if necessary
-        printf("Registering path: %s\n", path); //!debug
 
+        log_shipping_begin_mutation();
         ErrorCode err = directory_register_file(path, metadata);
         if (err != ERR_SUCCESS) {
             fprintf(stderr, "Failed to register path: %s\n", path);
             // Handle error if needed
+        } else {
+            log_shipping_append_placement(LOG_OP_POPULATE, path, ip, reg_msg.port, 0, 0);
         }
+        log_shipping_end_mutation();
 
-        printf("Done registering path: %s\n", path); //! debug
+        REQUEST_LOG(REQUEST_LOG_DEBUG, REQUEST_EVENT_REGISTER_PATH, request_id, path, err, 0);
         free(path);
     }
 
+    if (read_only) {
+        send_error_reply(sock, header->request_id, ERR_READ_ONLY);
+        return;
+    }
+
     // Send acknowledgment
     MessageHeader ack_header = {
         .request_id = header->request_id,
@@ -245,34 +1223,275 @@ void handle_storage_server_registration(NetworkSocket *sock, MessageHeader *head
         fprintf(stderr, "Failed to send ack to storage server\n");
         return;
     }
-    printf("request_id: %d\n", request_id); //!debug
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_REGISTER, request_id, NULL, ERR_SUCCESS, reg_msg.num_paths);
     printf("Registered Storage Server %s:%d\n", ip, reg_msg.port);
 }
 
-void handle_heartbeat(NetworkSocket *sock, MessageHeader *header, const char *ip) {
+void handle_storage_server_delegation(NetworkSocket *sock, MessageHeader *header, const char *ip) {
+    DelegationRequest request;
+    if (ntohl(header->payload_size) != sizeof(request) ||
+        network_socket_receive(sock, &request, sizeof(request)) != sizeof(request)) {
+        fprintf(stderr, "Malformed delegation from %s\n", ip);
+        return;
+    }
+    request.prefix[sizeof(request.prefix) - 1] = '\0';
+    uint16_t client_port = ntohs(request.client_port);
+    if (log_shipping_is_standby()) {
+        send_error_reply(sock, header->request_id, ERR_READ_ONLY);
+        return;
+    }
+
+    // Storage servers delegate to every shard; a prefix held by another
+    // shard is acknowledged and left to it
+    ErrorCode err = ERR_SUCCESS;
+    if (owns_path(request.prefix)) {
+        log_shipping_begin_mutation();
+        err = directory_delegate(request.prefix, ip, client_port);
+        if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_DELEGATE, request.prefix, ip, client_port, 0, 0);
+        log_shipping_end_mutation();
+    }
+    if (err != ERR_SUCCESS) {
+        send_error_reply(sock, header->request_id, err);
+        return;
+    }
+
+    MessageHeader ack_header = {
+        .request_id = header->request_id,
+        .type = MSG_TYPE_SS_REGISTER_ACK,
+        .payload_size = 0
+    };
+    network_socket_send(sock, &ack_header, sizeof(ack_header));
+    printf("Delegated %s to Storage Server %s:%u\n", request.prefix, ip, client_port);
+}
+
+// Full (SS_REGISTER_BULK) or incremental (SS_REGISTER_DELTA) inventory registration
+void handle_storage_server_bulk_registration(NetworkSocket *sock, MessageHeader *header, const char *ip) {
+    uint32_t blob_size = ntohl(header->payload_size);
+    if (blob_size > MAX_INVENTORY_PAYLOAD) {
+        reject_payload(sock, header->request_id, blob_size);
+        return;
+    }
+    uint8_t *blob = malloc(blob_size);
+    if (!blob) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    if (network_socket_receive(sock, blob, blob_size) != blob_size) {
+        fprintf(stderr, "Failed to receive inventory from %s\n", ip);
+        free(blob);
+        return;
+    }
+
+    if (log_shipping_is_standby()) {
+        send_error_reply(sock, header->request_id, ERR_READ_ONLY);
+        free(blob);
+        return;
+    }
+
+    InventoryReader reader;
+    ErrorCode err = inventory_reader_init(&reader, blob, blob_size);
+    if (err != ERR_SUCCESS) {
+        fprintf(stderr, "Malformed inventory from %s\n", ip);
+        send_error_reply(sock, header->request_id, err);
+        free(blob);
+        return;
+    }
+
+    char port[32];
+    snprintf(port, sizeof(port), "%u", reader.client_port);
+    int is_delta = header->type == MSG_TYPE_SS_REGISTER_DELTA;
+
+    MessageHeader ack_header = {
+        .request_id = header->request_id,
+        .type = MSG_TYPE_SS_REGISTER_ACK,
+        .payload_size = 0
+    };
+
+    // A delta only applies on top of the exact generation we hold for this
+    // server; after a restart of either side ask for the full inventory
+    if (is_delta) {
+        uint64_t known = health_get_generation(ip, port);
+        if (reader.base_generation == 0 || known != reader.base_generation) {
+            printf("Delta from %s:%s based on generation %llu, have %llu, requesting resync\n", ip, port,
+                   (unsigned long long)reader.base_generation, (unsigned long long)known);
+            free(blob);
+            ack_header.type = MSG_TYPE_SS_REGISTER_RESYNC;
+            network_socket_send(sock, &ack_header, sizeof(ack_header));
+            return;
+        }
+    }
+
+    printf("Received %s from %s:%s with %u paths (generation %llu)\n", is_delta ? "delta" : "inventory",
+           ip, port, reader.count, (unsigned long long)reader.generation);
+
+    uint32_t loaded = 0;
+    uint32_t dropped = 0;
+    log_shipping_begin_mutation();
+    err = directory_bulk_load(&reader, ip, &loaded, &dropped);
+    if (err == ERR_SUCCESS) log_shipping_append_inventory(ip, blob, blob_size);
+    log_shipping_end_mutation();
+    free(blob);
+    if (err != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to load inventory from %s after %u paths\n", ip, loaded);
+        send_error_reply(sock, header->request_id, err);
+        return;
+    }
+    health_set_generation(ip, port, reader.generation);
+
+    if (network_socket_send(sock, &ack_header, sizeof(ack_header)) != sizeof(ack_header)) {
+        fprintf(stderr, "Failed to send ack to storage server\n");
+        return;
+    }
+    REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_REGISTER, header->request_id, NULL, ERR_SUCCESS, loaded);
+    printf("Registered Storage Server %s:%s (%u paths, %u no longer held)\n", ip, port, loaded, dropped);
+}
+
+// Tell a client or storage server which naming servers share the namespace,
+// and this server's primary or standby if it has one
+void handle_get_shard_map(NetworkSocket *sock, MessageHeader *header) {
+    struct {
+        MessageHeader header;
+        uint32_t count;
+        ShardAddress shards[MAX_SHARDS];
+        ShardPeer peer;
+    } __attribute__((packed)) reply;
+    size_t reply_size = offsetof(__typeof__(reply), shards) + shard_count * sizeof(ShardAddress);
+    reply.count = htonl(shard_count);
+    memcpy(reply.shards, shards, shard_count * sizeof(ShardAddress));
+
+    ShardPeer peer;
+    if (log_shipping_get_peer(&peer) == ERR_SUCCESS) {
+        memcpy((uint8_t *)&reply + reply_size, &peer, sizeof(peer));
+        reply_size += sizeof(peer);
+    }
+    reply.header.request_id = header->request_id;
+    reply.header.type = MSG_TYPE_SHARD_MAP;
+    reply.header.payload_size = htonl(reply_size - sizeof(MessageHeader));
+    network_socket_send(sock, &reply, reply_size);
+}
+
+// Apply the first heartbeat of a connection. Returns 1 if the connection
+// was handed to the heartbeat channel and must not be touched again.
+int handle_heartbeat(NetworkSocket *sock, MessageHeader *header, const char *ip) {
     // Receive the heartbeat message
     HeartbeatMessage hb;
     if (network_socket_receive(sock, &hb, sizeof(hb)) != sizeof(hb)) {
         fprintf(stderr, "Failed to receive heartbeat message from storage server %s\n", ip);
-        return;
+        return 0;
     }
 
-    printf("Received heartbeat from %s:%s\n", hb.host, hb.port);
+    // Key by the peer address, as registration does, so both land on the
+    // same server record
+    health_receive_heartbeat(ip, hb.port, &hb);
+
+    // Keep the connection for the heartbeats that follow
+    return heartbeat_channel_adopt(sock, ip, hb.port) == ERR_SUCCESS;
+}
+
+// A copy may take over as primary if its server is up and not excluded
+static int holder_usable(const char *ip, uint16_t port) {
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%u", port);
+    StorageServer server;
+    return health_get_server(ip, port_str, &server) == ERR_SUCCESS && server.active &&
+           health_server_cost(&server) < HEALTH_COST_EXCLUDED;
+}
+
+static void log_promotion(const char *path, const char *ip, uint16_t port, void *ctx) {
+    (void)ctx;
+    log_shipping_append_placement(LOG_OP_PROMOTE, path, ip, port, 0, 0);
+}
+
+static void log_drop(const char *path, const char *ip, uint16_t port, void *ctx) {
+    (void)ctx;
+    log_shipping_append_placement(LOG_OP_DROP_COPY, path, ip, port, 0, 0);
+}
 
-    // Update the health of the storage server
-    health_receive_heartbeat(hb.host, hb.port, hb.load);
+// A storage server reported a write, or lost its command channel. Hot
+// copies and repair copies both fall behind on writes.
+static void file_written(const char *host, const char *port, const char *path) {
+    hotspot_file_written(host, port, path);
+    repair_file_written(host, port, path);
+}
+
+// A storage server stopped sending heartbeats
+static void handle_server_failure(const char *host, const char *port) {
+    lease_invalidate_server(host, port);
+    command_channel_drop(host, port);
+    connection_pool_drop_host(host, port);
+
+    // Files it was primary of move to a live copy, found through the
+    // server's reverse index rather than a walk of the tree. A standby
+    // replays the primary's moves instead.
+    if (log_shipping_is_standby()) return;
+    DirectoryFailover failover;
+    uint16_t server_port = (uint16_t)atoi(port);
+    uint32_t held = server_index_count(host, server_port);
+    if (held == 0) return;
+    log_shipping_begin_mutation();
+    ErrorCode err = directory_fail_over(host, server_port, holder_usable, log_promotion, NULL, &failover);
+    log_shipping_end_mutation();
+    if (err != ERR_SUCCESS) return;
+    printf("Storage server %s:%s held %u files: %u moved to a copy, %u left without one, %u lost a copy\n",
+           host, port, held, failover.promoted, failover.stranded, failover.copies_lost);
+
+    // Then the files left short of copies get new ones
+    repair_server_lost(host, server_port);
+
+    // Its copies, including those of the files that just moved off it,
+    // would miss every write made until it returns, so they are no longer
+    // listed; repair makes fresh ones elsewhere
+    uint32_t dropped = 0;
+    log_shipping_begin_mutation();
+    directory_drop_server(host, server_port, log_drop, NULL, &dropped);
+    log_shipping_end_mutation();
+    if (dropped > 0) printf("Dropped the copies %s:%s held of %u files\n", host, port, dropped);
+}
+
+void handle_repair_status(NetworkSocket *sock, MessageHeader *header) {
+    if (ntohl(header->payload_size) != 0) {
+        fprintf(stderr, "Malformed repair status request\n");
+        return;
+    }
+
+    struct {
+        MessageHeader header;
+        RepairStatus body;
+    } __attribute__((packed)) reply;
+    RepairStatus status;
+    repair_get_status(&status);
+    reply.header.request_id = header->request_id;
+    reply.header.type = MSG_TYPE_REPAIR_STATUS;
+    reply.header.payload_size = htonl(sizeof(reply.body));
+    reply.body.target_copies = htonl(status.target_copies);
+    reply.body.queued = htonl(status.queued);
+    reply.body.critical = htonl(status.critical);
+    reply.body.copying = htonl(status.copying);
+    reply.body.copies_made = htonl(status.copies_made);
+    reply.body.restored = htonl(status.restored);
+    reply.body.failed = htonl(status.failed);
+    reply.body.unrecoverable = htonl(status.unrecoverable);
+    network_socket_send(sock, &reply, sizeof(reply));
 }
 
 void *client_handler(void *arg) {
     NetworkSocket *client_sock = (NetworkSocket *)arg;
     char client_ip[INET_ADDRSTRLEN] = "Unknown";
+    uint16_t client_port = 0;
 
     // Retrieve client IP address
     struct sockaddr_in addr;
     socklen_t addr_len = sizeof(addr);
     if (getpeername(network_socket_get_fd(client_sock), (struct sockaddr *)&addr, &addr_len) == 0) {
         inet_ntop(AF_INET, &addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+        client_port = ntohs(addr.sin_port);
     }
+    request_log_set_peer(client_ip, client_port);
+
+    // OP_COMPLETE follows OP_ACCEPTED with nothing from the client in
+    // between, so Nagle would hold it back for the client's delayed ACK
+    int nodelay = 1;
+    setsockopt(network_socket_get_fd(client_sock), IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
     while (running) {
         MessageHeader header;
@@ -286,11 +1505,60 @@ void *client_handler(void *arg) {
             case MSG_TYPE_GET_LOCATION:
                 handle_client_request(client_sock, &header);
                 break;
+            case MSG_TYPE_GET_LOCATION_BATCH:
+                handle_location_batch(client_sock, &header);
+                break;
+            case MSG_TYPE_LIST:
+                handle_list(client_sock, &header);
+                break;
+            case MSG_TYPE_SEARCH:
+                handle_search(client_sock, &header);
+                break;
+            case MSG_TYPE_CREATE:
+                handle_create(client_sock, &header);
+                break;
+            case MSG_TYPE_DELETE:
+                handle_delete(client_sock, &header);
+                break;
+            case MSG_TYPE_COPY:
+                handle_copy(client_sock, &header);
+                break;
+            case MSG_TYPE_RENAME:
+                handle_rename(client_sock, &header);
+                break;
+            case MSG_TYPE_READ:
+            case MSG_TYPE_WRITE:
+                // Relayed to the file's primary for clients that cannot
+                // reach storage servers themselves
+                if (router_forward_request(client_sock, &header) != ERR_SUCCESS) {
+                    goto disconnect;
+                }
+                break;
+            case MSG_TYPE_GET_SHARD_MAP:
+                handle_get_shard_map(client_sock, &header);
+                break;
+            case MSG_TYPE_REPAIR_STATUS:
+                handle_repair_status(client_sock, &header);
+                break;
             case MSG_TYPE_SS_REGISTER:
                 handle_storage_server_registration(client_sock, &header, client_ip);
                 break;
+            case MSG_TYPE_SS_REGISTER_BULK:
+            case MSG_TYPE_SS_REGISTER_DELTA:
+                handle_storage_server_bulk_registration(client_sock, &header, client_ip);
+                break;
+            case MSG_TYPE_SS_REGISTER_PREFIX:
+                handle_storage_server_delegation(client_sock, &header, client_ip);
+                break;
             case MSG_TYPE_HEARTBEAT:
-                handle_heartbeat(client_sock, &header, client_ip);
+                if (handle_heartbeat(client_sock, &header, client_ip)) {
+                    return NULL;
+                }
+                break;
+            case MSG_TYPE_LOG_SUBSCRIBE:
+                if (log_shipping_adopt(client_sock, &header, client_ip) == ERR_SUCCESS) {
+                    return NULL;
+                }
                 break;
             default:
                 // Handle unknown message types
@@ -298,6 +1566,9 @@ void *client_handler(void *arg) {
         }
     }
 
+disconnect:
+    lease_release_holder(client_sock);
+    operation_release_holder(client_sock);
     network_socket_close(client_sock);
     return NULL;
 }
@@ -310,12 +1581,21 @@ int main(int argc, char *argv[]) {
     static struct option long_options[] = {
         {"port", required_argument, 0, 'p'},
         {"cache-size", required_argument, 0, 'c'},
+        {"shards", required_argument, 0, 's'},
+        {"shard-index", required_argument, 0, 'i'},
+        {"follow", required_argument, 0, 'f'},
+        {"log", required_argument, 0, 'l'},
+        {"replicas", required_argument, 0, 'r'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "p:c:h", long_options, NULL)) != -1) {
+    const char *shard_list = NULL;
+    const char *follow = NULL;
+    const char *log_path = NULL;
+    uint32_t target_copies = REPAIR_TARGET_COPIES;
+    while ((opt = getopt_long(argc, argv, "p:c:s:i:f:l:r:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'p':
                 port = optarg;
@@ -323,6 +1603,21 @@ int main(int argc, char *argv[]) {
             case 'c':
                 cache_size = atoi(optarg);
                 break;
+            case 's':
+                shard_list = optarg;
+                break;
+            case 'i':
+                shard_index = atoi(optarg);
+                break;
+            case 'f':
+                follow = optarg;
+                break;
+            case 'l':
+                log_path = optarg;
+                break;
+            case 'r':
+                target_copies = (uint32_t)atoi(optarg);
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -338,9 +1633,33 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if (shard_list && (shard_parse_list(shard_list, shards, MAX_SHARDS, &shard_count) != ERR_SUCCESS ||
+                       shard_index >= shard_count)) {
+        fprintf(stderr, "Error: Invalid shard list or index\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ShardAddress primary;
+    uint32_t primary_count = 0;
+    if (follow && shard_parse_list(follow, &primary, 1, &primary_count) != ERR_SUCCESS) {
+        fprintf(stderr, "Error: Invalid primary address\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Requests are still served if the log cannot be opened
+    char default_log_path[64];
+    if (!log_path) {
+        snprintf(default_log_path, sizeof(default_log_path), "naming_server_%s.log", port);
+        log_path = default_log_path;
+    }
+    request_log_init(log_path);
+
     // Set up signal handlers
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN); // Pushes to a departed client must not kill us
 
     // Initialize subsystems
     if (directory_init() != ERR_SUCCESS) {
@@ -369,7 +1688,32 @@ int main(int argc, char *argv[]) {
     // Start router
     router_init();
 
+    // Revoke client location leases when paths move or servers fail
+    lease_init();
+    directory_set_change_callback(lease_invalidate);
+    directory_set_path_filter(owns_path);
+    health_set_failure_callback(handle_server_failure);
+    command_channel_init();
+
+    if (heartbeat_channel_init() != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to start heartbeat channel\n");
+    }
+
+    log_shipping_init();
+    if (follow && log_shipping_follow(primary.host, primary.port, (uint16_t)atoi(port)) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to start following %s\n", follow);
+    }
+    hotspot_init();
+    command_channel_set_write_notice(file_written);
+    repair_init(target_copies);
+
     printf("Naming server started on port %s\n", port);
+    if (shard_count > 0) {
+        printf("Serving shard %u of %u\n", shard_index, shard_count);
+    }
+    if (follow) {
+        printf("Standing by for %s\n", follow);
+    }
 
     // Main server loop
     while (running) {
@@ -400,6 +1744,11 @@ int main(int argc, char *argv[]) {
 
     // Cleanup
     network_socket_close(server_sock);
+    hotspot_cleanup();
+    repair_cleanup();
+    log_shipping_cleanup();
+    heartbeat_channel_cleanup();
+    command_channel_cleanup();
     printf("Socket closed\n");
     cache_cleanup();
     printf("Cache cleaned up\n");
@@ -408,6 +1757,9 @@ int main(int argc, char *argv[]) {
     health_cleanup();
     printf("Health monitoring cleaned up\n");
     router_cleanup();
+    placement_cleanup();
+    lease_cleanup();
+    request_log_cleanup();
     printf("Naming server shut down cleanly\n");
     return 0;
 }
\ No newline at end of file
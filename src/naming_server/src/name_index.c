@@ -0,0 +1,358 @@
+// src/naming_server/src/name_index.c
+
+#include "name_index.h"
+#include "directory.h"
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_INDEX_NONE UINT32_MAX              // Entry the index could not take
+#define MAX_PATH_DEPTH 128                      // A 255-byte path has at most this many components
+#define MAX_QUERY_TRIGRAMS 256
+
+typedef struct {
+    char *name;                 // NULL once removed
+    uint32_t parent;
+    DirectoryEntry *entry;
+} IndexNode;
+
+// Ids of the nodes whose name contains one trigram, ascending
+typedef struct Posting {
+    uint32_t trigram;
+    uint32_t *ids;
+    uint32_t count;
+    uint32_t capacity;
+    struct Posting *next;
+} Posting;
+
+static IndexNode *nodes = NULL;
+static uint32_t node_count = 0;
+static uint32_t node_capacity = 0;
+static uint32_t removed_count = 0;
+static Posting *postings[NAME_INDEX_BUCKETS];
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t trigram_at(const char *s) {
+    const unsigned char *p = (const unsigned char *)s;
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static Posting *find_posting(uint32_t trigram, int create) {
+    uint32_t bucket = ((trigram * 2654435761u) >> 8) % NAME_INDEX_BUCKETS;
+    for (Posting *posting = postings[bucket]; posting; posting = posting->next) {
+        if (posting->trigram == trigram) return posting;
+    }
+    if (!create) return NULL;
+    Posting *posting = calloc(1, sizeof(Posting));
+    if (!posting) return NULL;
+    posting->trigram = trigram;
+    posting->next = postings[bucket];
+    postings[bucket] = posting;
+    return posting;
+}
+
+// Index of the first id in posting greater than id
+static uint32_t upper_bound(const Posting *posting, uint32_t id) {
+    uint32_t lo = 0, hi = posting->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (posting->ids[mid] <= id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int posting_contains(const Posting *posting, uint32_t id) {
+    uint32_t pos = upper_bound(posting, id);
+    return pos > 0 && posting->ids[pos - 1] == id;
+}
+
+static void posting_insert(Posting *posting, uint32_t id) {
+    // New nodes always append; only renames land in the middle
+    uint32_t pos = posting->count;
+    if (pos > 0 && posting->ids[pos - 1] >= id) {
+        pos = upper_bound(posting, id);
+        if (pos > 0 && posting->ids[pos - 1] == id) return;
+    }
+    if (posting->count == posting->capacity) {
+        uint32_t capacity = posting->capacity ? posting->capacity * 2 : 4;
+        uint32_t *ids = realloc(posting->ids, capacity * sizeof(uint32_t));
+        if (!ids) return;
+        posting->ids = ids;
+        posting->capacity = capacity;
+    }
+    memmove(&posting->ids[pos + 1], &posting->ids[pos], (posting->count - pos) * sizeof(uint32_t));
+    posting->ids[pos] = id;
+    posting->count++;
+}
+
+static void index_name(uint32_t id) {
+    const char *name = nodes[id].name;
+    size_t length = strlen(name);
+    for (size_t i = 0; i + 3 <= length; i++) {
+        Posting *posting = find_posting(trigram_at(name + i), 1);
+        if (posting) posting_insert(posting, id);
+    }
+}
+
+static void free_postings() {
+    for (int i = 0; i < NAME_INDEX_BUCKETS; i++) {
+        Posting *posting = postings[i];
+        while (posting) {
+            Posting *next = posting->next;
+            free(posting->ids);
+            free(posting);
+            posting = next;
+        }
+        postings[i] = NULL;
+    }
+}
+
+// Renumber the live nodes densely and index them afresh, dropping the
+// removed nodes and the postings stale names left behind
+static void rebuild() {
+    uint32_t *remap = malloc(node_count * sizeof(uint32_t));
+    if (!remap) return;
+    uint32_t live = 0;
+    for (uint32_t id = 0; id < node_count; id++) {
+        remap[id] = (id == NAME_INDEX_ROOT || nodes[id].name) ? live++ : NAME_INDEX_NONE;
+    }
+    for (uint32_t id = 0; id < node_count; id++) {
+        if (remap[id] == NAME_INDEX_NONE) continue;
+        IndexNode node = nodes[id];
+        if (id != NAME_INDEX_ROOT) {
+            node.parent = node.parent < node_count ? remap[node.parent] : NAME_INDEX_NONE;
+            node.entry->name_id = remap[id];
+        }
+        nodes[remap[id]] = node;
+    }
+    free(remap);
+    node_count = live;
+    removed_count = 0;
+
+    free_postings();
+    for (uint32_t id = 1; id < node_count; id++) index_name(id);
+}
+
+void name_index_init() {
+    pthread_mutex_lock(&index_mutex);
+    if (!nodes) {
+        nodes = calloc(1, sizeof(IndexNode));
+        node_capacity = nodes ? 1 : 0;
+    }
+    node_count = nodes ? 1 : 0;
+    removed_count = 0;
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void name_index_cleanup() {
+    pthread_mutex_lock(&index_mutex);
+    for (uint32_t id = 1; id < node_count; id++) free(nodes[id].name);
+    free(nodes);
+    nodes = NULL;
+    node_count = 0;
+    node_capacity = 0;
+    removed_count = 0;
+    free_postings();
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void name_index_add(DirectoryEntry *entry, DirectoryEntry *parent) {
+    pthread_mutex_lock(&index_mutex);
+    entry->name_id = NAME_INDEX_NONE;
+    if (!nodes || node_count == NAME_INDEX_NONE) {
+        pthread_mutex_unlock(&index_mutex);
+        return;
+    }
+    if (node_count == node_capacity) {
+        uint32_t capacity = node_capacity * 2;
+        IndexNode *grown = realloc(nodes, capacity * sizeof(IndexNode));
+        if (!grown) {
+            pthread_mutex_unlock(&index_mutex);
+            return;
+        }
+        nodes = grown;
+        node_capacity = capacity;
+    }
+    char *name = strdup(entry->name);
+    if (!name) {
+        pthread_mutex_unlock(&index_mutex);
+        return;
+    }
+    uint32_t id = node_count++;
+    nodes[id].name = name;
+    nodes[id].parent = parent ? parent->name_id : NAME_INDEX_ROOT;
+    nodes[id].entry = entry;
+    entry->name_id = id;
+    index_name(id);
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void name_index_remove(DirectoryEntry *entry) {
+    pthread_mutex_lock(&index_mutex);
+    uint32_t id = entry->name_id;
+    if (id != NAME_INDEX_ROOT && id < node_count && nodes[id].entry == entry) {
+        free(nodes[id].name);
+        nodes[id].name = NULL;
+        nodes[id].entry = NULL;
+        removed_count++;
+        if (removed_count >= NAME_INDEX_MIN_REBUILD && removed_count > node_count - removed_count) rebuild();
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void name_index_move(DirectoryEntry *entry) {
+    pthread_mutex_lock(&index_mutex);
+    uint32_t id = entry->name_id;
+    if (id != NAME_INDEX_ROOT && id < node_count && nodes[id].entry == entry) {
+        nodes[id].parent = entry->parent ? entry->parent->name_id : NAME_INDEX_ROOT;
+        // The old name's postings stay behind; matching filters them out
+        if (strcmp(nodes[id].name, entry->name) != 0) {
+            char *name = strdup(entry->name);
+            if (name) {
+                free(nodes[id].name);
+                nodes[id].name = name;
+                index_name(id);
+            }
+        }
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+// Rebuild the path of a node from its ancestors; 0 if it has none any more
+static int build_path(uint32_t id, char *path, size_t size) {
+    const char *names[MAX_PATH_DEPTH];
+    size_t depth = 0;
+    for (uint32_t up = id; up != NAME_INDEX_ROOT; up = nodes[up].parent) {
+        if (up >= node_count || !nodes[up].name || depth == MAX_PATH_DEPTH) return 0;
+        names[depth++] = nodes[up].name;
+    }
+    size_t length = 0;
+    while (depth > 0) {
+        const char *name = names[--depth];
+        size_t name_length = strlen(name);
+        size_t sep = length > 0 ? 1 : 0;
+        if (length + sep + name_length >= size) return 0;
+        if (sep) path[length] = '/';
+        memcpy(path + length + sep, name, name_length + 1);
+        length += sep + name_length;
+    }
+    return length > 0;
+}
+
+int name_index_path(DirectoryEntry *entry, char *path, size_t size) {
+    pthread_mutex_lock(&index_mutex);
+    uint32_t id = entry->name_id;
+    int found = id != NAME_INDEX_ROOT && id < node_count && nodes[id].entry == entry && build_path(id, path, size);
+    pthread_mutex_unlock(&index_mutex);
+    return found;
+}
+
+// Collect the trigrams every match must contain: those of the whole
+// pattern, or for a glob those of each run of literal characters
+static size_t pattern_trigrams(const char *pattern, SearchMode mode, uint32_t *trigrams, size_t max) {
+    size_t count = 0;
+    char run[256];
+    size_t run_length = 0;
+
+    for (const char *p = pattern;; p++) {
+        int literal = *p != '\0';
+        char c = *p;
+        if (mode == SEARCH_GLOB && literal) {
+            if (*p == '*' || *p == '?') {
+                literal = 0;
+            } else if (*p == '[') {
+                // Skip the bracket expression; "[]" and "[!]" start with a literal ']'
+                const char *end = p + 1;
+                if (*end == '!' || *end == '^') end++;
+                if (*end == ']') end++;
+                while (*end && *end != ']') end++;
+                if (*end) {
+                    p = end;
+                    literal = 0;
+                }
+            } else if (*p == '\\' && p[1]) {
+                c = *++p;
+            }
+        }
+        if (literal) {
+            if (run_length < sizeof(run)) run[run_length++] = c;
+            continue;
+        }
+        for (size_t i = 0; i + 3 <= run_length && count < max; i++) {
+            trigrams[count++] = trigram_at(run + i);
+        }
+        run_length = 0;
+        if (*p == '\0') break;
+    }
+    return count;
+}
+
+static int name_matches(const char *name, const char *pattern, size_t pattern_length, SearchMode mode) {
+    switch (mode) {
+        case SEARCH_SUBSTRING:
+            return strstr(name, pattern) != NULL;
+        case SEARCH_PREFIX:
+            return strncmp(name, pattern, pattern_length) == 0;
+        case SEARCH_GLOB:
+            return fnmatch(pattern, name, 0) == 0;
+    }
+    return 0;
+}
+
+ErrorCode name_index_search(const char *pattern, SearchMode mode, uint32_t cursor, ListEntry *entries,
+                            uint32_t max_entries, uint32_t *count, uint32_t *next_cursor, int *has_more) {
+    if (!pattern || !pattern[0] || !entries || !count || !next_cursor || !has_more) return ERR_INVALID_ARGUMENT;
+    if (mode != SEARCH_SUBSTRING && mode != SEARCH_PREFIX && mode != SEARCH_GLOB) return ERR_INVALID_ARGUMENT;
+
+    *count = 0;
+    *next_cursor = cursor;
+    *has_more = 0;
+    size_t pattern_length = strlen(pattern);
+    uint32_t trigrams[MAX_QUERY_TRIGRAMS];
+    size_t trigram_count = pattern_trigrams(pattern, mode, trigrams, MAX_QUERY_TRIGRAMS);
+
+    pthread_mutex_lock(&index_mutex);
+
+    // Walk the shortest posting and probe the others; a trigram nobody has
+    // means nothing can match
+    Posting *lists[MAX_QUERY_TRIGRAMS];
+    Posting *driver = NULL;
+    for (size_t i = 0; i < trigram_count; i++) {
+        lists[i] = find_posting(trigrams[i], 0);
+        if (!lists[i]) {
+            pthread_mutex_unlock(&index_mutex);
+            return ERR_SUCCESS;
+        }
+        if (!driver || lists[i]->count < driver->count) driver = lists[i];
+    }
+
+    // Too short a pattern to narrow anything down scans every node
+    uint32_t pos = driver ? upper_bound(driver, cursor) : cursor + 1;
+    uint32_t end = driver ? driver->count : node_count;
+    uint32_t budget = NAME_INDEX_SCAN_BUDGET;
+    for (; pos < end; pos++) {
+        if (*count == max_entries || budget == 0) {
+            *has_more = 1;
+            break;
+        }
+        budget--;
+        uint32_t id = driver ? driver->ids[pos] : pos;
+        *next_cursor = id;
+        if (id >= node_count || !nodes[id].name) continue;
+
+        int candidate = 1;
+        for (size_t i = 0; i < trigram_count && candidate; i++) {
+            if (lists[i] != driver) candidate = posting_contains(lists[i], id);
+        }
+        if (!candidate || !name_matches(nodes[id].name, pattern, pattern_length, mode)) continue;
+
+        ListEntry *out = &entries[*count];
+        memset(out, 0, sizeof(*out));
+        if (build_path(id, out->path, sizeof(out->path))) (*count)++;
+    }
+
+    pthread_mutex_unlock(&index_mutex);
+    return ERR_SUCCESS;
+}
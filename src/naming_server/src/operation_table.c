@@ -0,0 +1,170 @@
+// src/naming_server/src/operation_table.c
+
+#include "operation_table.h"
+#include "hash.h"
+#include "protocol.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define OPERATION_BUCKETS 4096
+
+// Operations on single paths in flight, chained by the hash of their path.
+// Copies and renames claim whole trees and are few, so they sit in one list
+// that every claim is checked against.
+static Operation *buckets[OPERATION_BUCKETS];
+static Operation *tree_operations = NULL;
+static uint64_t next_id = 1;
+static pthread_mutex_t operation_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Paths are keyed without leading slashes, the way the tree splits them
+static const char *operation_key(const char *path) {
+    while (*path == '/') path++;
+    return path;
+}
+
+static uint32_t hash_path(const char *path) {
+    return fnv_hash(path) % OPERATION_BUCKETS;
+}
+
+static int claims_tree(uint8_t type) {
+    return type == MSG_TYPE_COPY || type == MSG_TYPE_RENAME;
+}
+
+// Whether key is base or lies below it
+static int key_within(const char *key, const char *base) {
+    size_t length = strlen(base);
+    while (length > 0 && base[length - 1] == '/') length--;
+    return length == 0 || (strncmp(key, base, length) == 0 && (key[length] == '\0' || key[length] == '/'));
+}
+
+// Whether a claim on key, and everything below it if tree, overlaps one
+// of other's
+static int overlaps(const char *key, int tree, const Operation *other) {
+    const char *claimed[2] = {operation_key(other->path), other->source[0] ? operation_key(other->source) : NULL};
+    int other_tree = claims_tree(other->type);
+    for (int i = 0; i < 2 && claimed[i]; i++) {
+        if (strcmp(key, claimed[i]) == 0) return 1;
+        if (other_tree && key_within(key, claimed[i])) return 1;
+        if (tree && key_within(claimed[i], key)) return 1;
+    }
+    return 0;
+}
+
+// Caller holds operation_mutex. Only a tree claim has to visit every bucket.
+static int is_claimed(const char *key, int tree) {
+    for (Operation *other = tree_operations; other; other = other->next) {
+        if (overlaps(key, tree, other)) return 1;
+    }
+    uint32_t first = tree ? 0 : hash_path(key);
+    uint32_t last = tree ? OPERATION_BUCKETS - 1 : first;
+    for (uint32_t bucket = first; bucket <= last; bucket++) {
+        for (Operation *other = buckets[bucket]; other; other = other->next) {
+            if (overlaps(key, tree, other)) return 1;
+        }
+    }
+    return 0;
+}
+
+ErrorCode operation_begin(NetworkSocket *holder, uint32_t request_id, uint8_t type, const char *path,
+                          const char *source, Operation **operation) {
+    if (!holder || !path || !operation) return ERR_INVALID_ARGUMENT;
+    const char *key = operation_key(path);
+    int tree = claims_tree(type);
+
+    pthread_mutex_lock(&operation_mutex);
+    if (is_claimed(key, tree) || (source && is_claimed(operation_key(source), tree))) {
+        pthread_mutex_unlock(&operation_mutex);
+        return ERR_BUSY;
+    }
+    Operation *claimed = calloc(1, sizeof(Operation));
+    if (!claimed) {
+        pthread_mutex_unlock(&operation_mutex);
+        return ERR_INTERNAL_ERROR;
+    }
+    claimed->id = next_id++;
+    claimed->request_id = request_id;
+    claimed->type = type;
+    snprintf(claimed->path, sizeof(claimed->path), "%s", path);
+    if (source) snprintf(claimed->source, sizeof(claimed->source), "%s", source);
+    claimed->holder = holder;
+    Operation **list = tree ? &tree_operations : &buckets[hash_path(key)];
+    claimed->next = *list;
+    *list = claimed;
+    pthread_mutex_unlock(&operation_mutex);
+
+    *operation = claimed;
+    return ERR_SUCCESS;
+}
+
+ErrorCode operation_accept(Operation *operation) {
+    struct {
+        MessageHeader header;
+        OperationAccepted body;
+    } __attribute__((packed)) frame;
+    frame.header.request_id = operation->request_id;
+    frame.header.type = MSG_TYPE_OP_ACCEPTED;
+    frame.header.payload_size = htonl(sizeof(frame.body));
+    frame.body.operation_id = network_hton64(operation->id);
+
+    // Only the holder's own thread accepts, so it cannot close meanwhile
+    ssize_t sent = network_socket_send(operation->holder, &frame, sizeof(frame));
+    return sent == sizeof(frame) ? ERR_SUCCESS : ERR_NETWORK_FAILURE;
+}
+
+// Unlink operation and free it; caller holds operation_mutex
+static void remove_operation(Operation *operation) {
+    Operation **link = claims_tree(operation->type) ? &tree_operations
+                                                    : &buckets[hash_path(operation_key(operation->path))];
+    while (*link && *link != operation) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = operation->next;
+    free(operation);
+}
+
+void operation_finish(Operation *operation, ErrorCode status) {
+    struct {
+        MessageHeader header;
+        OperationResult body;
+    } __attribute__((packed)) frame;
+    frame.header.request_id = operation->request_id;
+    frame.header.type = MSG_TYPE_OP_COMPLETE;
+    frame.header.payload_size = htonl(sizeof(frame.body));
+    frame.body.operation_id = network_hton64(operation->id);
+    frame.body.status = htonl((uint32_t)status);
+
+    // A hold taken under operation_mutex keeps the holder open for the
+    // push, which is sent after the lock is released
+    pthread_mutex_lock(&operation_mutex);
+    NetworkSocket *holder = operation->holder;
+    if (holder) network_socket_hold(holder);
+    remove_operation(operation);
+    pthread_mutex_unlock(&operation_mutex);
+
+    if (holder) {
+        network_socket_send_within(holder, &frame, sizeof(frame), OPERATION_PUSH_TIMEOUT_MS);
+        network_socket_close(holder);
+    }
+}
+
+void operation_abandon(Operation *operation) {
+    pthread_mutex_lock(&operation_mutex);
+    remove_operation(operation);
+    pthread_mutex_unlock(&operation_mutex);
+}
+
+void operation_release_holder(NetworkSocket *holder) {
+    pthread_mutex_lock(&operation_mutex);
+    for (int i = 0; i < OPERATION_BUCKETS; i++) {
+        for (Operation *operation = buckets[i]; operation; operation = operation->next) {
+            if (operation->holder == holder) operation->holder = NULL;
+        }
+    }
+    for (Operation *operation = tree_operations; operation; operation = operation->next) {
+        if (operation->holder == holder) operation->holder = NULL;
+    }
+    pthread_mutex_unlock(&operation_mutex);
+}
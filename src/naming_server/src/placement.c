@@ -0,0 +1,216 @@
+// src/naming_server/src/placement.c
+
+#include "placement.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t hash;
+    int server;                 // Index into the servers the ring was built from
+} VirtualNode;
+
+struct PlacementRing {
+    VirtualNode *nodes;         // Sorted by hash
+    size_t node_count;
+    int server_count;
+};
+
+// Ring cached by placement_select along with the servers it was built from
+static PlacementRing *cached_ring = NULL;
+static StorageServer *cached_servers = NULL;
+static int cached_count = 0;
+static uint64_t cached_signature = 0;
+static pthread_rwlock_t ring_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// FNV-1a followed by a 64-bit finalizer so nearby keys spread over the ring
+static uint64_t hash_bytes(const char *data, uint64_t seed) {
+    uint64_t hash = 14695981039346656037ULL ^ seed;
+    for (const unsigned char *p = (const unsigned char *)data; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Capacity units of a server; an unreported capacity counts as one unit
+static uint32_t server_units(const StorageServer *server) {
+    uint32_t units = (server->capacity_mb + PLACEMENT_CAPACITY_UNIT_MB - 1) / PLACEMENT_CAPACITY_UNIT_MB;
+    if (units == 0) units = 1;
+    if (units > PLACEMENT_MAX_UNITS) units = PLACEMENT_MAX_UNITS;
+    return units;
+}
+
+static int vnode_compare(const void *a, const void *b) {
+    uint64_t x = ((const VirtualNode *)a)->hash, y = ((const VirtualNode *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+PlacementRing *placement_ring_build(const StorageServer *servers, int count) {
+    PlacementRing *ring = calloc(1, sizeof(PlacementRing));
+    if (!ring) return NULL;
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (servers[i].active) total += server_units(&servers[i]) * PLACEMENT_VNODES_PER_UNIT;
+    }
+    ring->nodes = malloc((total ? total : 1) * sizeof(VirtualNode));
+    if (!ring->nodes) {
+        free(ring);
+        return NULL;
+    }
+    ring->server_count = count;
+
+    // Virtual node k of a server sits at hash("host:port", k), so it keeps
+    // its position however the rest of the membership changes
+    for (int i = 0; i < count; i++) {
+        if (!servers[i].active) continue;
+        char id[sizeof(servers[i].host) + sizeof(servers[i].port) + 1];
+        snprintf(id, sizeof(id), "%s:%s", servers[i].host, servers[i].port);
+        uint32_t vnodes = server_units(&servers[i]) * PLACEMENT_VNODES_PER_UNIT;
+        for (uint32_t k = 0; k < vnodes; k++) {
+            ring->nodes[ring->node_count].hash = hash_bytes(id, k + 1);
+            ring->nodes[ring->node_count].server = i;
+            ring->node_count++;
+        }
+    }
+    qsort(ring->nodes, ring->node_count, sizeof(VirtualNode), vnode_compare);
+    return ring;
+}
+
+void placement_ring_free(PlacementRing *ring) {
+    if (!ring) return;
+    free(ring->nodes);
+    free(ring);
+}
+
+// Position of the first virtual node clockwise from key
+static size_t ring_successor(const PlacementRing *ring, const char *key) {
+    uint64_t hash = hash_bytes(key, 0);
+    size_t lo = 0, hi = ring->node_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ring->nodes[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == ring->node_count ? 0 : lo;
+}
+
+int placement_ring_lookup(const PlacementRing *ring, const char *key) {
+    if (!ring || ring->node_count == 0) return -1;
+    return ring->nodes[ring_successor(ring, key)].server;
+}
+
+int placement_ring_candidates(const PlacementRing *ring, const char *key, int *out, int max) {
+    if (!ring || ring->node_count == 0) return 0;
+
+    // Keep walking until max distinct servers have shown up or the ring is
+    // exhausted, skipping further virtual nodes of servers already taken
+    int found = 0;
+    size_t start = ring_successor(ring, key);
+    for (size_t i = 0; i < ring->node_count && found < max; i++) {
+        int server = ring->nodes[(start + i) % ring->node_count].server;
+        int seen = 0;
+        for (int j = 0; j < found; j++) {
+            if (out[j] == server) {
+                seen = 1;
+                break;
+            }
+        }
+        if (!seen) out[found++] = server;
+    }
+    return found;
+}
+
+// Identity of a membership: which servers are active and their weights
+static uint64_t membership_signature(const StorageServer *servers, int count) {
+    uint64_t signature = (uint64_t)count;
+    for (int i = 0; i < count; i++) {
+        char id[sizeof(servers[i].host) + sizeof(servers[i].port) + 16];
+        snprintf(id, sizeof(id), "%s:%s/%u", servers[i].host, servers[i].port, server_units(&servers[i]));
+        // Order independent, as health_get_servers gives no ordering guarantee
+        signature += hash_bytes(id, 0x9e3779b97f4a7c15ULL);
+    }
+    return signature;
+}
+
+ErrorCode placement_select(const char *path, char *host, size_t host_size, char *port, size_t port_size) {
+    StorageServer *servers = NULL;
+    int count = 0;
+    ErrorCode err = health_get_servers(&servers, &count);
+    if (err != ERR_SUCCESS) return err;
+
+    uint64_t signature = membership_signature(servers, count);
+
+    pthread_rwlock_rdlock(&ring_lock);
+    if (!cached_ring || cached_signature != signature) {
+        pthread_rwlock_unlock(&ring_lock);
+
+        PlacementRing *ring = placement_ring_build(servers, count);
+        if (!ring) {
+            free(servers);
+            return ERR_INTERNAL_ERROR;
+        }
+
+        pthread_rwlock_wrlock(&ring_lock);
+        placement_ring_free(cached_ring);
+        free(cached_servers);
+        cached_ring = ring;
+        cached_servers = servers;
+        cached_count = count;
+        cached_signature = signature;
+        servers = NULL;
+    }
+
+    // The ring's copy of the servers only changes with membership, so take
+    // load from the list just fetched when the ring was not rebuilt
+    int candidates[PLACEMENT_CHOICES];
+    int found = placement_ring_candidates(cached_ring, path, candidates, PLACEMENT_CHOICES);
+    int index = -1;
+    double best_cost = 0;
+    for (int i = 0; i < found; i++) {
+        const StorageServer *server = &cached_servers[candidates[i]];
+        for (int j = 0; servers && j < count; j++) {
+            if (strcmp(servers[j].host, server->host) == 0 && strcmp(servers[j].port, server->port) == 0) {
+                server = &servers[j];
+                break;
+            }
+        }
+        // Ties keep the ring's first choice so an idle cluster places as before
+        double cost = health_server_cost(server);
+        if (index < 0 || cost < best_cost) {
+            index = candidates[i];
+            best_cost = cost;
+        }
+    }
+    if (index >= 0 && index < cached_count) {
+        snprintf(host, host_size, "%s", cached_servers[index].host);
+        snprintf(port, port_size, "%s", cached_servers[index].port);
+        err = ERR_SUCCESS;
+    } else {
+        err = ERR_NOT_FOUND;
+    }
+    pthread_rwlock_unlock(&ring_lock);
+
+    free(servers);
+    return err;
+}
+
+void placement_cleanup() {
+    pthread_rwlock_wrlock(&ring_lock);
+    placement_ring_free(cached_ring);
+    free(cached_servers);
+    cached_ring = NULL;
+    cached_servers = NULL;
+    cached_count = 0;
+    pthread_rwlock_unlock(&ring_lock);
+}
@@ -0,0 +1,857 @@
+// src/naming_server/src/repair.c
+
+#include "repair.h"
+#include "hash.h"
+#include "directory.h"
+#include "name_index.h"
+#include "server_index.h"
+#include "health.h"
+#include "command_channel.h"
+#include "log_shipping.h"
+#include "hotspot.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define JOB_BUCKETS 4096
+#define MAX_TRACKED_SERVERS 256
+#define SWEEP_BUCKETS 16        // Buckets of repair copies checked per tick
+
+// A file short of copies, queued or being copied
+typedef struct RepairJob {
+    char path[256];
+    uint32_t live;              // Live copies when last looked at
+    uint32_t attempts;          // Failed copies so far
+    int copied;                 // Got at least one copy from us
+    FileReplica source;         // Of the copy under way
+    FileReplica destination;
+    FileReplica primary;        // Watched for writes while it is copied
+    int stale;                  // Written since the copy began
+    ErrorCode status;           // Its outcome, set by the command callback
+    struct RepairJob *next;     // Queue, batch or completion list
+    struct RepairJob *hash_next;
+} RepairJob;
+
+typedef struct {
+    RepairJob *head;
+    RepairJob *tail;
+} JobQueue;
+
+// One queue per number of live copies, so the files closest to being lost
+// go first. A file with none left has nothing to copy from.
+static JobQueue queues[MAX_FILE_REPLICAS + 1];
+static RepairJob *jobs_by_path[JOB_BUCKETS];  // Every job, so a file is queued once
+static RepairJob *completed = NULL;
+
+// A listed copy made by repair. Nothing keeps it in step with the primary,
+// so the first write reported for its file drops it and the file is looked
+// at again.
+typedef struct RepairCopy {
+    char path[256];
+    FileReplica server;
+    FileReplica primary;        // Copied from the file of
+    int written;                // On the written list
+    struct RepairCopy *written_next;
+    struct RepairCopy *hash_next;
+} RepairCopy;
+
+static RepairCopy *copies_by_path[JOB_BUCKETS];
+static RepairCopy *written_copies = NULL;
+static uint32_t sweep_bucket = 0;               // Scheduler thread only
+
+typedef enum {
+    SUBSCRIBE_NONE = 0,
+    SUBSCRIBE_PENDING,          // WATCH of every path submitted
+    SUBSCRIBE_ARMED,            // The server reports each write
+} SubscribeState;
+
+// A primary repair copies from, watched for writes to any of its files
+typedef struct {
+    FileReplica server;
+    int state;                  // SubscribeState
+    uint32_t epoch;             // Bumped when its command channel closes
+    int lost;                   // Writes went unreported since
+    int recheck;                // Resubscribed after a loss
+} Subscription;
+
+// What a WATCH of every path was submitted for
+typedef struct {
+    Subscription *subscription;
+    uint32_t epoch;
+} SubscribeArm;
+
+static Subscription subscriptions[MAX_TRACKED_SERVERS];
+static uint32_t subscription_count = 0;
+
+static RepairStatus progress;                 // Host order
+static pthread_mutex_t repair_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t repair_wake = PTHREAD_COND_INITIALIZER;   // Work queued or a copy finished
+
+// Copies reading from and writing to one server; only the scheduler
+// thread touches these
+typedef struct {
+    FileReplica server;
+    uint32_t reading;
+    uint32_t writing;
+} ServerLoad;
+
+static ServerLoad loads[MAX_TRACKED_SERVERS];
+static uint32_t load_count = 0;
+
+static uint32_t target_copies = REPAIR_TARGET_COPIES;
+static pthread_t scheduler;
+static int running = 0;
+
+static uint32_t hash_path(const char *path) {
+    return fnv_hash(path) % JOB_BUCKETS;
+}
+
+static int same_server(const FileReplica *a, const char *ip, uint16_t port) {
+    return a->port == port && strcmp(a->ip, ip) == 0;
+}
+
+static int server_active(const StorageServer *servers, int server_count, const FileReplica *holder) {
+    for (int i = 0; i < server_count; i++) {
+        if (servers[i].active && same_server(holder, servers[i].host, (uint16_t)atoi(servers[i].port))) return 1;
+    }
+    return 0;
+}
+
+static Subscription *subscription_of(const char *ip, uint16_t port, int create) {
+    for (uint32_t i = 0; i < subscription_count; i++) {
+        if (same_server(&subscriptions[i].server, ip, port)) return &subscriptions[i];
+    }
+    if (!create || subscription_count == MAX_TRACKED_SERVERS) return NULL;
+    Subscription *subscription = &subscriptions[subscription_count++];
+    memset(subscription, 0, sizeof(*subscription));
+    snprintf(subscription->server.ip, sizeof(subscription->server.ip), "%s", ip);
+    subscription->server.port = port;
+    return subscription;
+}
+
+static int holds(const FileReplica *holders, uint32_t count, const char *ip, uint16_t port) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (same_server(&holders[i], ip, port)) return 1;
+    }
+    return 0;
+}
+
+// Caller holds repair_mutex. Jobs are only queued short of copies.
+static void push_job(RepairJob *job) {
+    JobQueue *queue = &queues[job->live];
+    job->next = NULL;
+    if (queue->tail) queue->tail->next = job;
+    else queue->head = job;
+    queue->tail = job;
+    progress.queued++;
+    if (job->live == 1) progress.critical++;
+}
+
+// Caller holds repair_mutex
+static RepairJob *pop_job() {
+    for (uint32_t live = 1; live < target_copies; live++) {
+        JobQueue *queue = &queues[live];
+        RepairJob *job = queue->head;
+        if (!job) continue;
+        queue->head = job->next;
+        if (!queue->head) queue->tail = NULL;
+        progress.queued--;
+        if (live == 1) progress.critical--;
+        return job;
+    }
+    return NULL;
+}
+
+// The job is done with, one way or another; it must not be queued
+static void finish_job(RepairJob *job) {
+    pthread_mutex_lock(&repair_mutex);
+    RepairJob **link = &jobs_by_path[hash_path(job->path)];
+    while (*link && *link != job) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = job->hash_next;
+    pthread_mutex_unlock(&repair_mutex);
+    free(job);
+}
+
+// Live holders of path among holders, counted into *live; ERR_NOT_FOUND
+// once the file is gone. Hot copies come and go with lookups, so they are
+// not counted.
+static ErrorCode read_live_holders(const char *path, const StorageServer *servers, int server_count,
+                                   FileReplica *holders, uint32_t *holder_count,
+                                   FileReplica *live_holders, uint32_t *live) {
+    ErrorCode err = directory_get_holders(path, holders, holder_count);
+    if (err != ERR_SUCCESS) return err;
+    *live = 0;
+    for (uint32_t i = 0; i < *holder_count; i++) {
+        if (!server_active(servers, server_count, &holders[i])) continue;
+        if (i > 0 && hotspot_holds_copy(path, holders[i].ip, holders[i].port)) continue;
+        live_holders[(*live)++] = holders[i];
+    }
+    return ERR_SUCCESS;
+}
+
+static void drop_listed_copy(const char *path, const FileReplica *copy) {
+    log_shipping_begin_mutation();
+    if (directory_drop_copy(path, copy->ip, copy->port) == ERR_SUCCESS) {
+        log_shipping_append_placement(LOG_OP_DROP_COPY, path, copy->ip, copy->port, 0, 0);
+    }
+    log_shipping_end_mutation();
+}
+
+// Queue path if it is short of live copies and not queued already.
+// Returns 1 if it was queued.
+static int queue_path(const char *path, const StorageServer *servers, int server_count) {
+    FileReplica holders[MAX_FILE_REPLICAS + 1], live_holders[MAX_FILE_REPLICAS + 1];
+    uint32_t holder_count = 0, live = 0;
+    if (read_live_holders(path, servers, server_count, holders, &holder_count, live_holders, &live) != ERR_SUCCESS ||
+        live >= target_copies) {
+        return 0;
+    }
+
+    uint32_t bucket = hash_path(path);
+    pthread_mutex_lock(&repair_mutex);
+    for (RepairJob *job = jobs_by_path[bucket]; job; job = job->hash_next) {
+        if (strcmp(job->path, path) == 0) {
+            pthread_mutex_unlock(&repair_mutex);
+            return 0;
+        }
+    }
+    if (live == 0) {
+        progress.unrecoverable++;
+        pthread_mutex_unlock(&repair_mutex);
+        return 0;
+    }
+    RepairJob *job = calloc(1, sizeof(RepairJob));
+    if (!job) {
+        pthread_mutex_unlock(&repair_mutex);
+        return 0;
+    }
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->live = live;
+    job->hash_next = jobs_by_path[bucket];
+    jobs_by_path[bucket] = job;
+    push_job(job);
+    pthread_cond_signal(&repair_wake);
+    pthread_mutex_unlock(&repair_mutex);
+    return 1;
+}
+
+// Paths of the files a failed server held
+typedef struct {
+    char (*paths)[256];
+    size_t count;
+    size_t capacity;
+} LostFiles;
+
+static void collect_lost(DirectoryEntry *entry, void *ctx) {
+    LostFiles *lost = ctx;
+    if (lost->count == lost->capacity) {
+        size_t capacity = lost->capacity ? lost->capacity * 2 : 256;
+        char (*grown)[256] = realloc(lost->paths, capacity * sizeof(*grown));
+        if (!grown) return;
+        lost->paths = grown;
+        lost->capacity = capacity;
+    }
+    if (name_index_path(entry, lost->paths[lost->count], sizeof(lost->paths[0]))) lost->count++;
+}
+
+void repair_server_lost(const char *ip, uint16_t port) {
+    if (!ip || !__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+
+    // Its files move to other primaries; it is watched again if it returns
+    // and is copied from
+    pthread_mutex_lock(&repair_mutex);
+    Subscription *subscription = subscription_of(ip, port, 0);
+    if (subscription) subscription->lost = 0;
+    pthread_mutex_unlock(&repair_mutex);
+
+    // Paths first, so no tree lock is held while the files are weighed
+    LostFiles lost = {NULL, 0, 0};
+    server_index_visit(ip, port, collect_lost, &lost);
+
+    StorageServer *servers = NULL;
+    int server_count = 0;
+    uint32_t queued = 0;
+    if (lost.count > 0 && health_get_servers(&servers, &server_count) == ERR_SUCCESS) {
+        for (size_t i = 0; i < lost.count; i++) {
+            queued += queue_path(lost.paths[i], servers, server_count);
+        }
+    }
+    free(servers);
+    free(lost.paths);
+    if (queued > 0) printf("Queued %u files that lost a copy on %s:%u for repair\n", queued, ip, port);
+}
+
+static void copy_done(ErrorCode status, void *arg) {
+    RepairJob *job = arg;
+    pthread_mutex_lock(&repair_mutex);
+    job->status = status;
+    job->next = completed;
+    completed = job;
+    pthread_cond_signal(&repair_wake);
+    pthread_mutex_unlock(&repair_mutex);
+}
+
+static void discard_done(ErrorCode status, void *arg) {
+    (void)arg;
+    if (status != ERR_SUCCESS && status != ERR_FILE_NOT_FOUND) {
+        fprintf(stderr, "Failed to delete a repair copy of a deleted file: %s\n", error_string(status));
+    }
+}
+
+static void delete_copy(const char *path, const FileReplica *copy) {
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_DELETE;
+    strncpy(command.path, path, sizeof(command.path) - 1);
+    char port[16];
+    snprintf(port, sizeof(port), "%u", copy->port);
+    command_submit(copy->ip, port, &command, discard_done, NULL);
+}
+
+static void subscribe_done(ErrorCode status, void *arg) {
+    SubscribeArm *arm = arg;
+    Subscription *subscription = arm->subscription;
+    pthread_mutex_lock(&repair_mutex);
+    if (subscription->state == SUBSCRIBE_PENDING && subscription->epoch == arm->epoch) {
+        subscription->state = status == ERR_SUCCESS ? SUBSCRIBE_ARMED : SUBSCRIBE_NONE;
+        if (status == ERR_SUCCESS && subscription->lost) {
+            subscription->lost = 0;
+            subscription->recheck = 1;
+            pthread_cond_signal(&repair_wake);
+        }
+    }
+    pthread_mutex_unlock(&repair_mutex);
+    if (status != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to watch %s:%u for writes: %s\n", subscription->server.ip, subscription->server.port,
+                error_string(status));
+    }
+    free(arm);
+}
+
+// Copies are only made from a primary that reports every write, so a copy
+// that falls behind is dropped. Returns 1 once that is so, subscribing
+// otherwise.
+static int subscribed(const FileReplica *primary) {
+    pthread_mutex_lock(&repair_mutex);
+    Subscription *subscription = subscription_of(primary->ip, primary->port, 1);
+    if (!subscription || subscription->state != SUBSCRIBE_NONE) {
+        int armed = subscription && subscription->state == SUBSCRIBE_ARMED;
+        pthread_mutex_unlock(&repair_mutex);
+        return armed;
+    }
+    subscription->state = SUBSCRIBE_PENDING;
+    uint32_t epoch = subscription->epoch;
+    pthread_mutex_unlock(&repair_mutex);
+
+    SubscribeArm *arm = malloc(sizeof(SubscribeArm));
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_WATCH;
+    char port[16];
+    snprintf(port, sizeof(port), "%u", primary->port);
+    if (arm) {
+        arm->subscription = subscription;
+        arm->epoch = epoch;
+    }
+    if (!arm || command_submit(primary->ip, port, &command, subscribe_done, arm) != ERR_SUCCESS) {
+        free(arm);
+        pthread_mutex_lock(&repair_mutex);
+        if (subscription->epoch == epoch) subscription->state = SUBSCRIBE_NONE;
+        pthread_mutex_unlock(&repair_mutex);
+    }
+    return 0;
+}
+
+// Caller holds repair_mutex
+static void mark_written(RepairCopy *copy) {
+    if (copy->written) return;
+    copy->written = 1;
+    copy->written_next = written_copies;
+    written_copies = copy;
+}
+
+// Caller holds repair_mutex
+static void unlink_copy(RepairCopy *copy) {
+    RepairCopy **link = &copies_by_path[hash_path(copy->path)];
+    while (*link && *link != copy) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = copy->hash_next;
+}
+
+// Caller holds repair_mutex. Remember a copy just listed, already written
+// if the file was.
+static void record_copy(const RepairJob *job) {
+    uint32_t bucket = hash_path(job->path);
+    RepairCopy *copy = copies_by_path[bucket];
+    while (copy && (strcmp(copy->path, job->path) != 0 ||
+                    !same_server(&copy->server, job->destination.ip, job->destination.port))) {
+        copy = copy->hash_next;
+    }
+    if (!copy) {
+        copy = calloc(1, sizeof(RepairCopy));
+        if (!copy) return;
+        snprintf(copy->path, sizeof(copy->path), "%s", job->path);
+        copy->server = job->destination;
+        copy->hash_next = copies_by_path[bucket];
+        copies_by_path[bucket] = copy;
+    }
+    copy->primary = job->primary;
+    if (job->stale) mark_written(copy);
+}
+
+void repair_file_written(const char *host, const char *port, const char *path) {
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+    uint16_t port_number = (uint16_t)atoi(port);
+    pthread_mutex_lock(&repair_mutex);
+    if (!path) {
+        // Writes go unreported until it is watched again
+        Subscription *subscription = subscription_of(host, port_number, 0);
+        if (subscription && subscription->state != SUBSCRIBE_NONE) {
+            subscription->state = SUBSCRIBE_NONE;
+            subscription->epoch++;
+            subscription->lost = 1;
+            for (uint32_t b = 0; b < JOB_BUCKETS; b++) {
+                for (RepairJob *job = jobs_by_path[b]; job; job = job->hash_next) {
+                    if (same_server(&job->primary, host, port_number)) job->stale = 1;
+                }
+            }
+        }
+        pthread_mutex_unlock(&repair_mutex);
+        return;
+    }
+
+    while (*path == '/') path++;
+    uint32_t bucket = hash_path(path);
+    int marked = 0;
+    for (RepairJob *job = jobs_by_path[bucket]; job; job = job->hash_next) {
+        if (strcmp(job->path, path) == 0) job->stale = 1;
+    }
+    for (RepairCopy *copy = copies_by_path[bucket]; copy; copy = copy->hash_next) {
+        if (strcmp(copy->path, path) == 0 && !copy->written) {
+            mark_written(copy);
+            marked = 1;
+        }
+    }
+    if (marked) pthread_cond_signal(&repair_wake);
+    pthread_mutex_unlock(&repair_mutex);
+}
+
+// Drop repair copies of files written since the last look, treating every
+// file copied from a primary watched again after a loss as written, and
+// queue the files that fall short
+static void retire_written() {
+    pthread_mutex_lock(&repair_mutex);
+    for (uint32_t i = 0; i < subscription_count; i++) {
+        Subscription *subscription = &subscriptions[i];
+        if (!subscription->recheck) continue;
+        subscription->recheck = 0;
+        for (uint32_t b = 0; b < JOB_BUCKETS; b++) {
+            for (RepairCopy *copy = copies_by_path[b]; copy; copy = copy->hash_next) {
+                if (same_server(&copy->primary, subscription->server.ip, subscription->server.port)) mark_written(copy);
+            }
+        }
+    }
+    RepairCopy *written = written_copies;
+    written_copies = NULL;
+    for (RepairCopy *copy = written; copy; copy = copy->written_next) {
+        unlink_copy(copy);
+    }
+    pthread_mutex_unlock(&repair_mutex);
+    if (!written) return;
+
+    StorageServer *servers = NULL;
+    int server_count = 0;
+    if (health_get_servers(&servers, &server_count) != ERR_SUCCESS) servers = NULL;
+    uint32_t queued = 0;
+    while (written) {
+        RepairCopy *copy = written;
+        written = copy->written_next;
+        FileReplica holders[MAX_FILE_REPLICAS + 1];
+        uint32_t holder_count = 0;
+        if (directory_get_holders(copy->path, holders, &holder_count) == ERR_SUCCESS &&
+            holder_count > 1 && holds(holders + 1, holder_count - 1, copy->server.ip, copy->server.port)) {
+            drop_listed_copy(copy->path, &copy->server);
+            delete_copy(copy->path, &copy->server);
+            printf("Repair copy of %s on %s:%u may be behind its primary: dropped\n", copy->path, copy->server.ip,
+                   copy->server.port);
+            if (servers) queued += queue_path(copy->path, servers, server_count);
+        }
+        free(copy);
+    }
+    free(servers);
+    if (queued > 0) printf("Queued %u written files for repair\n", queued);
+}
+
+// Watch primaries again whose command channel closed, so the files copied
+// from them can be looked at again
+static void resubscribe() {
+    FileReplica lost[MAX_TRACKED_SERVERS];
+    uint32_t lost_count = 0;
+    pthread_mutex_lock(&repair_mutex);
+    for (uint32_t i = 0; i < subscription_count; i++) {
+        if (subscriptions[i].lost && subscriptions[i].state == SUBSCRIBE_NONE) lost[lost_count++] = subscriptions[i].server;
+    }
+    pthread_mutex_unlock(&repair_mutex);
+    if (lost_count == 0) return;
+
+    StorageServer *servers = NULL;
+    int server_count = 0;
+    if (health_get_servers(&servers, &server_count) != ERR_SUCCESS) return;
+    for (uint32_t i = 0; i < lost_count; i++) {
+        if (server_active(servers, server_count, &lost[i])) subscribed(&lost[i]);
+    }
+    free(servers);
+}
+
+// Forget repair copies that left their file some other way, and drop those
+// whose file moved to a primary not watched for writes: a few buckets a
+// tick, so the list never outgrows the copies still listed
+static void sweep_copies() {
+    for (uint32_t n = 0; n < SWEEP_BUCKETS; n++) {
+        uint32_t bucket = sweep_bucket;
+        sweep_bucket = (sweep_bucket + 1) % JOB_BUCKETS;
+
+        // Only this thread frees copies, so they outlive the unlocked look
+        pthread_mutex_lock(&repair_mutex);
+        RepairCopy *copy = copies_by_path[bucket];
+        pthread_mutex_unlock(&repair_mutex);
+        while (copy) {
+            FileReplica holders[MAX_FILE_REPLICAS + 1];
+            uint32_t holder_count = 0;
+            int listed = directory_get_holders(copy->path, holders, &holder_count) == ERR_SUCCESS &&
+                         holder_count > 1 && holds(holders + 1, holder_count - 1, copy->server.ip, copy->server.port);
+            pthread_mutex_lock(&repair_mutex);
+            RepairCopy *next = copy->hash_next;
+            int forget = !listed && !copy->written;
+            if (forget) unlink_copy(copy);
+            if (listed && !same_server(&copy->primary, holders[0].ip, holders[0].port)) {
+                Subscription *subscription = subscription_of(holders[0].ip, holders[0].port, 0);
+                copy->primary = holders[0];
+                if (!subscription || subscription->state != SUBSCRIBE_ARMED) mark_written(copy);
+            }
+            pthread_mutex_unlock(&repair_mutex);
+            if (forget) free(copy);
+            copy = next;
+        }
+    }
+}
+
+static ServerLoad *load_of(const FileReplica *server) {
+    for (uint32_t i = 0; i < load_count; i++) {
+        if (same_server(&loads[i].server, server->ip, server->port)) return &loads[i];
+    }
+    if (load_count == MAX_TRACKED_SERVERS) return NULL;
+    ServerLoad *load = &loads[load_count++];
+    memset(load, 0, sizeof(*load));
+    load->server = *server;
+    return load;
+}
+
+// List finished copies and put the files back in line for another look.
+// A copy of a file written while it was made is deleted and made again.
+static void complete_copies() {
+    pthread_mutex_lock(&repair_mutex);
+    RepairJob *done = completed;
+    completed = NULL;
+    pthread_mutex_unlock(&repair_mutex);
+
+    while (done) {
+        RepairJob *job = done;
+        done = job->next;
+        ServerLoad *source = load_of(&job->source);
+        ServerLoad *destination = load_of(&job->destination);
+        if (source) source->reading--;
+        if (destination) destination->writing--;
+
+        pthread_mutex_lock(&repair_mutex);
+        int stale = job->stale;
+        pthread_mutex_unlock(&repair_mutex);
+
+        const FileReplica *copy = &job->destination;
+        int requeue = 1, listed = 0;
+        ErrorCode err = job->status;
+        if (err == ERR_SUCCESS && !stale) {
+            log_shipping_begin_mutation();
+            err = directory_add_copy(job->path, copy->ip, copy->port);
+            if (err == ERR_SUCCESS) log_shipping_append_placement(LOG_OP_POPULATE, job->path, copy->ip, copy->port, 0, 0);
+            log_shipping_end_mutation();
+        }
+        if (job->status != ERR_SUCCESS) {
+            fprintf(stderr, "Repair copy of %s to %s:%u failed: %s\n", job->path, copy->ip, copy->port,
+                    error_string(job->status));
+            requeue = ++job->attempts < REPAIR_MAX_ATTEMPTS;
+        } else if (stale) {
+            delete_copy(job->path, copy);
+        } else if (err == ERR_SUCCESS) {
+            job->copied = 1;
+            listed = 1;
+        } else {
+            // Deleted while it was being copied, or no room left to list it
+            delete_copy(job->path, copy);
+            requeue = 0;
+        }
+
+        pthread_mutex_lock(&repair_mutex);
+        progress.copying--;
+        if (listed) {
+            progress.copies_made++;
+            job->live++;
+            record_copy(job);
+            if (job->live >= target_copies) {
+                progress.restored++;
+                requeue = 0;
+            }
+        }
+        if (job->status != ERR_SUCCESS && !requeue) progress.failed++;
+        if (requeue) push_job(job);
+        pthread_mutex_unlock(&repair_mutex);
+        if (!requeue) finish_job(job);
+    }
+}
+
+// What dispatch_job did with a job
+typedef enum {
+    DISPATCH_WAIT,              // No room on its servers; back in the queue
+    DISPATCH_FINISHED,          // Restored, gone or lost; the job is freed
+    DISPATCH_COPYING,
+} DispatchOutcome;
+
+// Start a copy of job's file if a source and a destination have room
+static DispatchOutcome dispatch_job(RepairJob *job, const StorageServer *servers, int server_count) {
+    FileReplica holders[MAX_FILE_REPLICAS + 1], live_holders[MAX_FILE_REPLICAS + 1];
+    uint32_t holder_count = 0, live = 0;
+    if (read_live_holders(job->path, servers, server_count, holders, &holder_count, live_holders, &live) != ERR_SUCCESS) {
+        finish_job(job);
+        return DISPATCH_FINISHED;
+    }
+    job->live = live;
+    if (live >= target_copies || live == 0) {
+        pthread_mutex_lock(&repair_mutex);
+        if (live == 0) progress.unrecoverable++;
+        else if (job->copied) progress.restored++;
+        pthread_mutex_unlock(&repair_mutex);
+        finish_job(job);
+        return DISPATCH_FINISHED;
+    }
+    if (holder_count >= MAX_FILE_REPLICAS + 1) {
+        // No room for another copy: make some by forgetting a dead one, or
+        // give the file up while every copy it lists is live
+        for (uint32_t i = 1; i < holder_count; i++) {
+            if (server_active(servers, server_count, &holders[i])) continue;
+            drop_listed_copy(job->path, &holders[i]);
+            return DISPATCH_WAIT;
+        }
+        pthread_mutex_lock(&repair_mutex);
+        progress.failed++;
+        pthread_mutex_unlock(&repair_mutex);
+        finish_job(job);
+        return DISPATCH_FINISHED;
+    }
+    // Any live holder may become the primary, so all are watched
+    for (uint32_t i = 1; i < live; i++) {
+        subscribed(&live_holders[i]);
+    }
+    if (!server_active(servers, server_count, &holders[0]) || !subscribed(&holders[0])) return DISPATCH_WAIT;
+
+    // The least busy live holder reads
+    ServerLoad *source = NULL;
+    const FileReplica *from = NULL;
+    for (uint32_t i = 0; i < live; i++) {
+        ServerLoad *load = load_of(&live_holders[i]);
+        if (load && load->reading < REPAIR_PER_SOURCE && (!source || load->reading < source->reading)) {
+            source = load;
+            from = &live_holders[i];
+        }
+    }
+    if (!from) return DISPATCH_WAIT;
+
+    // The cheapest server without the file and with room writes
+    ServerLoad *destination = NULL;
+    int best = -1;
+    double best_cost = HEALTH_COST_EXCLUDED;
+    for (int i = 0; i < server_count; i++) {
+        uint16_t port = (uint16_t)atoi(servers[i].port);
+        if (!servers[i].active || holds(holders, holder_count, servers[i].host, port)) continue;
+        FileReplica candidate;
+        memset(&candidate, 0, sizeof(candidate));
+        strncpy(candidate.ip, servers[i].host, sizeof(candidate.ip) - 1);
+        candidate.port = port;
+        ServerLoad *load = load_of(&candidate);
+        double cost = health_server_cost(&servers[i]);
+        if (load && load->writing < REPAIR_PER_DESTINATION && cost < best_cost) {
+            best = i;
+            best_cost = cost;
+            destination = load;
+        }
+    }
+    if (best < 0) return DISPATCH_WAIT;
+
+    StorageCommand command;
+    memset(&command, 0, sizeof(command));
+    command.op = STORAGE_COMMAND_COPY;
+    strncpy(command.path, job->path, sizeof(command.path) - 1);
+    memcpy(command.source_ip, from->ip, INET_ADDRSTRLEN);
+    command.source_port = htons(from->port);
+    strncpy(command.source_path, job->path, sizeof(command.source_path) - 1);
+
+    job->source = *from;
+    job->destination = destination->server;
+    source->reading++;
+    destination->writing++;
+    pthread_mutex_lock(&repair_mutex);
+    job->primary = holders[0];
+    job->stale = 0;
+    progress.copying++;
+    pthread_mutex_unlock(&repair_mutex);
+    if (command_submit(servers[best].host, servers[best].port, &command, copy_done, job) != ERR_SUCCESS) {
+        source->reading--;
+        destination->writing--;
+        pthread_mutex_lock(&repair_mutex);
+        progress.copying--;
+        pthread_mutex_unlock(&repair_mutex);
+        return DISPATCH_WAIT;
+    }
+    return DISPATCH_COPYING;
+}
+
+static void dispatch_copies() {
+    pthread_mutex_lock(&repair_mutex);
+    uint32_t room = progress.copying < REPAIR_MAX_COPYING ? REPAIR_MAX_COPYING - progress.copying : 0;
+    int waiting = progress.queued > 0;
+    pthread_mutex_unlock(&repair_mutex);
+    if (room == 0 || !waiting) return;
+
+    StorageServer *servers = NULL;
+    int server_count = 0;
+    if (health_get_servers(&servers, &server_count) != ERR_SUCCESS) return;
+
+    // Jobs leave the queue while they are looked at, most urgent first; those
+    // with no room on their servers go back to the end of their queue
+    RepairJob *deferred = NULL, **deferred_tail = &deferred;
+    for (uint32_t scanned = 0; scanned < REPAIR_SCAN_LIMIT && room > 0; scanned++) {
+        pthread_mutex_lock(&repair_mutex);
+        RepairJob *job = pop_job();
+        pthread_mutex_unlock(&repair_mutex);
+        if (!job) break;
+
+        DispatchOutcome outcome = dispatch_job(job, servers, server_count);
+        if (outcome == DISPATCH_COPYING) room--;
+        if (outcome != DISPATCH_WAIT) continue;
+        job->next = NULL;
+        *deferred_tail = job;
+        deferred_tail = &job->next;
+    }
+    free(servers);
+
+    pthread_mutex_lock(&repair_mutex);
+    while (deferred) {
+        RepairJob *job = deferred;
+        deferred = job->next;
+        push_job(job);
+    }
+    pthread_mutex_unlock(&repair_mutex);
+}
+
+static void *scheduler_thread(void *arg) {
+    (void)arg;
+    int reporting = 0;
+    struct timespec last_report;
+    clock_gettime(CLOCK_MONOTONIC, &last_report);
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        // A finished copy frees room at once; the tick only retries files
+        // that found none
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (REPAIR_TICK_MS % 1000) * 1000000L;
+        deadline.tv_sec += REPAIR_TICK_MS / 1000 + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_mutex_lock(&repair_mutex);
+        if (!completed && !written_copies) pthread_cond_timedwait(&repair_wake, &repair_mutex, &deadline);
+        pthread_mutex_unlock(&repair_mutex);
+
+        // A standby's files are repaired by its primary
+        if (log_shipping_is_standby()) continue;
+        complete_copies();
+        resubscribe();
+        sweep_copies();
+        retire_written();
+        dispatch_copies();
+
+        struct timespec now_time;
+        clock_gettime(CLOCK_MONOTONIC, &now_time);
+        if ((now_time.tv_sec - last_report.tv_sec) * 1000 + (now_time.tv_nsec - last_report.tv_nsec) / 1000000 <
+            REPAIR_PROGRESS_MS) {
+            continue;
+        }
+        last_report = now_time;
+        RepairStatus now;
+        repair_get_status(&now);
+        if (now.queued > 0 || now.copying > 0) {
+            printf("Repair: %u files queued (%u down to one copy), %u copying, %u copies made, "
+                   "%u files restored, %u failed, %u unrecoverable\n",
+                   now.queued, now.critical, now.copying, now.copies_made, now.restored, now.failed,
+                   now.unrecoverable);
+            reporting = 1;
+        } else if (reporting) {
+            printf("Repair finished: %u copies made, %u files restored, %u failed, %u unrecoverable\n",
+                   now.copies_made, now.restored, now.failed, now.unrecoverable);
+            reporting = 0;
+        }
+    }
+    return NULL;
+}
+
+void repair_init(uint32_t copies) {
+    target_copies = copies < 2 ? 2 : copies > MAX_FILE_REPLICAS + 1 ? MAX_FILE_REPLICAS + 1 : copies;
+    pthread_mutex_lock(&repair_mutex);
+    progress.target_copies = target_copies;
+    pthread_mutex_unlock(&repair_mutex);
+
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&scheduler, NULL, scheduler_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to start repair scheduler\n");
+        running = 0;
+    }
+}
+
+void repair_cleanup() {
+    if (!__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL)) return;
+    pthread_mutex_lock(&repair_mutex);
+    pthread_cond_signal(&repair_wake);
+    pthread_mutex_unlock(&repair_mutex);
+    pthread_join(scheduler, NULL);
+
+    // Jobs still copying belong to their command callbacks
+    pthread_mutex_lock(&repair_mutex);
+    RepairJob *job;
+    while ((job = pop_job()) || (job = completed)) {
+        if (job == completed) completed = job->next;
+        RepairJob **link = &jobs_by_path[hash_path(job->path)];
+        while (*link && *link != job) {
+            link = &(*link)->hash_next;
+        }
+        if (*link) *link = job->hash_next;
+        free(job);
+    }
+    for (uint32_t b = 0; b < JOB_BUCKETS; b++) {
+        while (copies_by_path[b]) {
+            RepairCopy *copy = copies_by_path[b];
+            copies_by_path[b] = copy->hash_next;
+            free(copy);
+        }
+    }
+    written_copies = NULL;
+    pthread_mutex_unlock(&repair_mutex);
+}
+
+void repair_get_status(RepairStatus *status) {
+    pthread_mutex_lock(&repair_mutex);
+    *status = progress;
+    pthread_mutex_unlock(&repair_mutex);
+}
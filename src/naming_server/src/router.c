@@ -1,127 +1,57 @@
 // src/naming_server/src/router.c
 
 #include "router.h"
+#include "directory.h"
 #include "health.h"
+#include "placement.h"
+#include "connection_pool.h"
 #include "network.h"
 #include "protocol.h"
 #include "errors.h"
-#include <pthread.h>
 #include <string.h>
-#include <stdlib.h>
 #include <stdio.h>
-
-#define MAX_CONNECTIONS 100
-
-typedef struct StorageConnection {
-    char host[256];
-    char port[32];
-    NetworkSocket *sock;
-    int in_use;
-    pthread_mutex_t lock;
-} StorageConnection;
+#include <arpa/inet.h>
 
 static void send_error_response(NetworkSocket *client_sock, ErrorCode code);
 
-static StorageConnection connections[MAX_CONNECTIONS];
-static int connection_count = 0;
-static pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 // Initialize the router
 void router_init() {
-    pthread_mutex_init(&connections_mutex, NULL);
-    for (int i = 0; i < MAX_CONNECTIONS; i++) {
-        connections[i].sock = NULL;
-        connections[i].in_use = 0;
-        pthread_mutex_init(&connections[i].lock, NULL);
-    }
+    connection_pool_init();
 }
 
 // Clean up the router
 void router_cleanup() {
-    pthread_mutex_lock(&connections_mutex);
-    for (int i = 0; i < MAX_CONNECTIONS; i++) {
-        if (connections[i].sock) {
-            network_socket_close(connections[i].sock);
-            connections[i].sock = NULL;
-        }
-        pthread_mutex_destroy(&connections[i].lock);
-    }
-    pthread_mutex_unlock(&connections_mutex);
-    pthread_mutex_destroy(&connections_mutex);
+    connection_pool_cleanup();
 }
 
-// Get a storage connection from the pool or create a new one
-static StorageConnection *get_storage_connection(const char *host, const char *port) {
-    pthread_mutex_lock(&connections_mutex);
-    // Search for an existing connection
-    for (int i = 0; i < connection_count; i++) {
-        StorageConnection *conn = &connections[i];
-        if (strcmp(conn->host, host) == 0 && strcmp(conn->port, port) == 0 && !conn->in_use) {
-            conn->in_use = 1;
-            pthread_mutex_unlock(&connections_mutex);
+// Check out a connection to host:port and send it a request in two parts.
+// A pooled connection can still fail the send if the server closed it just
+// as it was checked out, so the request is tried once more on another.
+static PooledConnection *send_request(const char *host, const char *port, const void *header, size_t header_size,
+                                      const void *body, size_t body_size) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        PooledConnection *conn = connection_pool_checkout(host, port);
+        if (!conn) return NULL;
+        NetworkSocket *sock = connection_pool_socket(conn);
+        if (network_socket_send(sock, header, header_size) == (ssize_t)header_size &&
+            network_socket_send(sock, body, body_size) == (ssize_t)body_size) {
             return conn;
         }
+        connection_pool_release(conn, 0);
     }
-
-    // If no existing connection, create a new one
-    if (connection_count >= MAX_CONNECTIONS) {
-        pthread_mutex_unlock(&connections_mutex);
-        return NULL;
-    }
-
-    StorageConnection *conn = &connections[connection_count++];
-    strncpy(conn->host, host, sizeof(conn->host) - 1);
-    strncpy(conn->port, port, sizeof(conn->port) - 1);
-    conn->sock = network_socket_create(host, port);
-    if (!conn->sock) {
-        connection_count--;
-        pthread_mutex_unlock(&connections_mutex);
-        return NULL;
-    }
-    conn->in_use = 1;
-    pthread_mutex_unlock(&connections_mutex);
-    return conn;
+    return NULL;
 }
 
-// Release a storage connection back to the pool
-static void release_storage_connection(StorageConnection *conn) {
-    pthread_mutex_lock(&conn->lock);
-    conn->in_use = 0;
-    pthread_mutex_unlock(&conn->lock);
+// Select the storage server for path through consistent-hash placement
+ErrorCode router_select_server(const char *path, char *host, size_t host_size, char *port, size_t port_size) {
+    return placement_select(path, host, host_size, port, port_size);
 }
 
-// Select a storage server using load balancing
-static ErrorCode select_storage_server(char *host, char *port) {
-    StorageServer *servers = NULL;
-    int server_count = 0;
-    ErrorCode err = health_get_servers(&servers, &server_count);
-    if (err != ERR_SUCCESS || server_count == 0) {
-        if (servers) free(servers);
-        return ERR_NOT_FOUND;
-    }
-
-    // Simple load balancing: select the server with the lowest load
-    int min_load = -1;
-    int selected_index = -1;
-    for (int i = 0; i < server_count; i++) {
-        if (servers[i].active) {
-            if (min_load == -1 || servers[i].load < min_load) {
-                min_load = servers[i].load;
-                selected_index = i;
-            }
-        }
-    }
-
-    if (selected_index == -1) {
-        free(servers);
-        return ERR_NOT_FOUND;
-    }
-
-    strncpy(host, servers[selected_index].host, sizeof(servers[selected_index].host) - 1);
-    strncpy(port, servers[selected_index].port, sizeof(servers[selected_index].port) - 1);
-
-    free(servers);
-    return ERR_SUCCESS;
+// Answer a request the router could not forward. A WRITE's body is still
+// unread, so its connection is out of step and the caller must close it.
+static ErrorCode answer_error(NetworkSocket *client_sock, const MessageHeader *header, ErrorCode code) {
+    send_error_response(client_sock, code);
+    return header->type == MSG_TYPE_WRITE ? ERR_PROTOCOL_ERROR : ERR_SUCCESS;
 }
 
 // Forward a client request to a storage server
@@ -129,142 +59,120 @@ ErrorCode router_forward_request(NetworkSocket *client_sock, MessageHeader *head
     ErrorCode err;
     char host[256], port[32];
 
-    // Select a storage server
-    err = select_storage_server(host, port);
-    if (err != ERR_SUCCESS) {
-        send_error_response(client_sock, err);
-        return err;
+    // Read the request body first: its path decides where the request goes
+    ReadRequest read_request;
+    WriteRequest write_request;
+    const char *path;
+    switch (header->type) {
+        case MSG_TYPE_READ:
+            if (network_socket_receive(client_sock, &read_request, sizeof(ReadRequest)) != sizeof(ReadRequest))
+                return ERR_PROTOCOL_ERROR;
+            read_request.filepath[sizeof(read_request.filepath) - 1] = '\0';
+            path = read_request.filepath;
+            break;
+        case MSG_TYPE_WRITE:
+            if (network_socket_receive(client_sock, &write_request, sizeof(WriteRequest)) != sizeof(WriteRequest))
+                return ERR_PROTOCOL_ERROR;
+            write_request.filepath[sizeof(write_request.filepath) - 1] = '\0';
+            path = write_request.filepath;
+            break;
+        default:
+            return ERR_PROTOCOL_ERROR;
+    }
+
+    // The file lives wherever the tree records it, which placement only
+    // decides for new files; reads and writes both go to the primary
+    FileReplica holders[MAX_FILE_REPLICAS + 1];
+    uint32_t holder_count = 0;
+    err = directory_get_holders(path, holders, &holder_count);
+    if (err != ERR_SUCCESS) return answer_error(client_sock, header, ERR_FILE_NOT_FOUND);
+    snprintf(host, sizeof(host), "%s", holders[0].ip);
+    snprintf(port, sizeof(port), "%u", holders[0].port);
+
+    // Forward the request on a pooled connection. Bodies move socket to
+    // socket through the kernel, so memory use does not grow with the
+    // transfer size.
+    const void *request = header->type == MSG_TYPE_READ ? (const void *)&read_request : (const void *)&write_request;
+    size_t request_size = header->type == MSG_TYPE_READ ? sizeof(ReadRequest) : sizeof(WriteRequest);
+    PooledConnection *storage_conn = send_request(host, port, header, sizeof(MessageHeader), request, request_size);
+    if (!storage_conn) return answer_error(client_sock, header, ERR_NETWORK_FAILURE);
+    NetworkSocket *storage_sock = connection_pool_socket(storage_conn);
+    if (header->type == MSG_TYPE_WRITE) {
+        uint64_t length = ntohl(write_request.length);
+        if (network_socket_relay(client_sock, storage_sock, length) != (ssize_t)length) {
+            connection_pool_release(storage_conn, 0);
+            return ERR_NETWORK_FAILURE;
+        }
     }
 
-    // Get a connection to the storage server
-    StorageConnection *storage_conn = get_storage_connection(host, port);
-    if (!storage_conn) {
-        send_error_response(client_sock, ERR_NETWORK_FAILURE);
+    // Relay the response: a header, then the data or an error code
+    MessageHeader response_header;
+    if (network_socket_receive(storage_sock, &response_header, sizeof(MessageHeader)) != sizeof(MessageHeader) ||
+        network_socket_send(client_sock, &response_header, sizeof(MessageHeader)) != sizeof(MessageHeader)) {
+        connection_pool_release(storage_conn, 0);
         return ERR_NETWORK_FAILURE;
     }
-
-    // Forward the request header
-    ssize_t sent = network_socket_send(storage_conn->sock, header, sizeof(MessageHeader));
-    if (sent != sizeof(MessageHeader)) {
-        release_storage_connection(storage_conn);
-        send_error_response(client_sock, ERR_NETWORK_FAILURE);
+    uint64_t body_size = ntohl(response_header.payload_size);
+    if (body_size > 0 && network_socket_relay(storage_sock, client_sock, body_size) != (ssize_t)body_size) {
+        connection_pool_release(storage_conn, 0);
         return ERR_NETWORK_FAILURE;
     }
 
-    // Forward the request and response based on the message type
-    switch (header->type) {
-        case MSG_TYPE_READ: {
-            // Forward ReadRequest
-            ReadRequest request;
-            ssize_t received = network_socket_receive(client_sock, &request, sizeof(ReadRequest));
-            if (received != sizeof(ReadRequest)) {
-                release_storage_connection(storage_conn);
-                return ERR_PROTOCOL_ERROR;
-            }
-            sent = network_socket_send(storage_conn->sock, &request, sizeof(ReadRequest));
-            if (sent != sizeof(ReadRequest)) {
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-
-            // Relay response
-            MessageHeader response_header;
-            received = network_socket_receive(storage_conn->sock, &response_header, sizeof(MessageHeader));
-            if (received != sizeof(MessageHeader)) {
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-            sent = network_socket_send(client_sock, &response_header, sizeof(MessageHeader));
-            if (sent != sizeof(MessageHeader)) {
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-
-            // Relay data
-            if (response_header.payload_size > 0) {
-                uint8_t buffer[4096];
-                size_t total_received = 0;
-                while (total_received < response_header.payload_size) {
-                    size_t to_receive = sizeof(buffer);
-                    if (response_header.payload_size - total_received < to_receive) {
-                        to_receive = response_header.payload_size - total_received;
-                    }
-                    received = network_socket_receive(storage_conn->sock, buffer, to_receive);
-                    if (received <= 0) {
-                        release_storage_connection(storage_conn);
-                        return ERR_NETWORK_FAILURE;
-                    }
-                    sent = network_socket_send(client_sock, buffer, received);
-                    if (sent != received) {
-                        release_storage_connection(storage_conn);
-                        return ERR_NETWORK_FAILURE;
-                    }
-                    total_received += received;
-                }
-            }
-            break;
-        }
-        case MSG_TYPE_WRITE: {
-            // Forward WriteRequest
-            WriteRequest request;
-            ssize_t received = network_socket_receive(client_sock, &request, sizeof(WriteRequest));
-            if (received != sizeof(WriteRequest)) {
-                release_storage_connection(storage_conn);
-                return ERR_PROTOCOL_ERROR;
-            }
-            uint8_t *data = malloc(request.length);
-            if (!data) {
-                release_storage_connection(storage_conn);
-                return ERR_INTERNAL_ERROR;
-            }
-            received = network_socket_receive(client_sock, data, request.length);
-            if (received != request.length) {
-                free(data);
-                release_storage_connection(storage_conn);
-                return ERR_PROTOCOL_ERROR;
-            }
-            sent = network_socket_send(storage_conn->sock, &request, sizeof(WriteRequest));
-            if (sent != sizeof(WriteRequest)) {
-                free(data);
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-            sent = network_socket_send(storage_conn->sock, data, request.length);
-            if (sent != request.length) {
-                free(data);
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-            free(data);
+    // The exchange completed cleanly, so the connection can serve another
+    connection_pool_release(storage_conn, 1);
+    return ERR_SUCCESS;
+}
 
-            // Relay response
-            ErrorCode response_code;
-            received = network_socket_receive(storage_conn->sock, &response_code, sizeof(ErrorCode));
-            if (received != sizeof(ErrorCode)) {
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-            sent = network_socket_send(client_sock, &response_code, sizeof(ErrorCode));
-            if (sent != sizeof(ErrorCode)) {
-                release_storage_connection(storage_conn);
-                return ERR_NETWORK_FAILURE;
-            }
-            break;
-        }
-        default:
-            release_storage_connection(storage_conn);
-            return ERR_PROTOCOL_ERROR;
+// Ask a storage server whether it holds path and fetch its size and permissions
+ErrorCode router_probe_file(const char *host, const char *port, const char *path, uint64_t *size, uint32_t *permissions) {
+    MessageHeader header = {
+        .request_id = 0,
+        .type = MSG_TYPE_GET_FILE_INFO,
+        .payload_size = htonl(sizeof(GetFileInfoRequest))
+    };
+    GetFileInfoRequest request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.filepath, path, sizeof(request.filepath) - 1);
+
+    PooledConnection *conn = send_request(host, port, &header, sizeof(header), &request, sizeof(request));
+    if (!conn) return ERR_NETWORK_FAILURE;
+    NetworkSocket *sock = connection_pool_socket(conn);
+
+    MessageHeader response_header;
+    if (network_socket_receive(sock, &response_header, sizeof(response_header)) != sizeof(response_header)) {
+        connection_pool_release(conn, 0);
+        return ERR_NETWORK_FAILURE;
     }
 
-    // Release the connection back to the pool
-    release_storage_connection(storage_conn);
+    if (response_header.type != MSG_TYPE_GET_FILE_INFO_RESPONSE) {
+        // Drain the error body so the connection can go back to the pool
+        uint32_t code;
+        int reusable = ntohl(response_header.payload_size) == sizeof(code) &&
+                       network_socket_receive(sock, &code, sizeof(code)) == sizeof(code);
+        connection_pool_release(conn, reusable);
+        return ERR_FILE_NOT_FOUND;
+    }
 
+    GetFileInfoResponse response;
+    if (network_socket_receive(sock, &response, sizeof(response)) != sizeof(response)) {
+        connection_pool_release(conn, 0);
+        return ERR_NETWORK_FAILURE;
+    }
+    connection_pool_release(conn, 1);
+    *size = network_ntoh64(response.file_size);
+    *permissions = ntohl(response.permissions);
     return ERR_SUCCESS;
 }
 
 // Function to send an error response to the client
 static void send_error_response(NetworkSocket *client_sock, ErrorCode code) {
-    MessageHeader response = {.type = MSG_TYPE_ERROR, .payload_size = sizeof(ErrorCode)};
+    struct {
+        MessageHeader header;
+        uint32_t code;
+    } __attribute__((packed)) response;
+    memset(&response, 0, sizeof(response));
+    response.header.type = MSG_TYPE_ERROR;
+    response.header.payload_size = htonl(sizeof(response.code));
+    response.code = htonl((uint32_t)code);
     network_socket_send(client_sock, &response, sizeof(response));
-    network_socket_send(client_sock, &code, sizeof(code));
 }
\ No newline at end of file
@@ -0,0 +1,196 @@
+// src/naming_server/src/server_index.c
+
+#include "server_index.h"
+#include "directory.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// How long server_index_visit waits before retrying entries busy elsewhere
+#define VISIT_RETRY_US 1000
+
+// The files one server holds, as a circular list through head
+typedef struct ServerFiles {
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;
+    HolderLink head;
+    uint32_t count;
+    struct ServerFiles *next;
+} ServerFiles;
+
+// Servers are few and never forgotten, so a list is enough
+static ServerFiles *servers = NULL;
+static uint32_t visit_pass = 0;
+static uint32_t mark_stamp = 0;
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ServerFiles *find_server(const char *ip, uint16_t port, int create) {
+    for (ServerFiles *server = servers; server; server = server->next) {
+        if (server->port == port && strcmp(server->ip, ip) == 0) return server;
+    }
+    if (!create) return NULL;
+    ServerFiles *server = calloc(1, sizeof(ServerFiles));
+    if (!server) return NULL;
+    strncpy(server->ip, ip, sizeof(server->ip) - 1);
+    server->port = port;
+    server->head.prev = &server->head;
+    server->head.next = &server->head;
+    server->next = servers;
+    servers = server;
+    return server;
+}
+
+static int link_is(const HolderLink *link, const char *ip, uint16_t port) {
+    return link->server->port == port && strcmp(link->server->ip, ip) == 0;
+}
+
+static void add_link(DirectoryEntry *entry, const char *ip, uint16_t port) {
+    if (!ip) return;
+    for (HolderLink *link = entry->holders; link; link = link->entry_next) {
+        if (link_is(link, ip, port)) return;
+    }
+    ServerFiles *server = find_server(ip, port, 1);
+    HolderLink *link = server ? calloc(1, sizeof(HolderLink)) : NULL;
+    if (!link) return;
+    link->entry = entry;
+    link->server = server;
+    link->entry_next = entry->holders;
+    entry->holders = link;
+    link->prev = server->head.prev;
+    link->next = &server->head;
+    server->head.prev->next = link;
+    server->head.prev = link;
+    server->count++;
+}
+
+static void drop_link(HolderLink *link) {
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->server->count--;
+    free(link);
+}
+
+static int metadata_names(const FileMetadata *metadata, const HolderLink *link) {
+    if (!metadata) return 0;
+    if (metadata->storage_server_ip && link_is(link, metadata->storage_server_ip, metadata->storage_server_port)) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < metadata->replica_count; i++) {
+        if (link_is(link, metadata->replicas[i].ip, metadata->replicas[i].port)) return 1;
+    }
+    return 0;
+}
+
+void server_index_sync(DirectoryEntry *entry) {
+    FileMetadata *metadata = entry->metadata;
+
+    pthread_mutex_lock(&index_mutex);
+    HolderLink **link = &entry->holders;
+    while (*link) {
+        if (metadata_names(metadata, *link)) {
+            link = &(*link)->entry_next;
+            continue;
+        }
+        HolderLink *gone = *link;
+        *link = gone->entry_next;
+        drop_link(gone);
+    }
+    if (metadata) {
+        add_link(entry, metadata->storage_server_ip, metadata->storage_server_port);
+        for (uint32_t i = 0; i < metadata->replica_count; i++) {
+            add_link(entry, metadata->replicas[i].ip, metadata->replicas[i].port);
+        }
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void server_index_remove(DirectoryEntry *entry) {
+    if (!entry->holders) return;
+    pthread_mutex_lock(&index_mutex);
+    while (entry->holders) {
+        HolderLink *gone = entry->holders;
+        entry->holders = gone->entry_next;
+        drop_link(gone);
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+uint32_t server_index_count(const char *ip, uint16_t port) {
+    pthread_mutex_lock(&index_mutex);
+    ServerFiles *server = find_server(ip, port, 0);
+    uint32_t count = server ? server->count : 0;
+    pthread_mutex_unlock(&index_mutex);
+    return count;
+}
+
+// Visit the files ip:port holds, skipping those marked with skip_mark
+// when it is not 0
+static void visit_links(const char *ip, uint16_t port, uint32_t skip_mark, server_index_visit_t visit, void *ctx) {
+    pthread_mutex_lock(&index_mutex);
+    ServerFiles *server = find_server(ip, port, 0);
+    uint32_t pass = ++visit_pass;
+
+    // Holding index_mutex keeps every listed entry from being freed, but
+    // the entry locks come before it elsewhere, so a busy entry is skipped
+    // and retried rather than waited for
+    while (server) {
+        int busy = 0;
+        for (HolderLink *link = server->head.next; link != &server->head; link = link->next) {
+            if (link->visit == pass || (skip_mark && link->mark == skip_mark)) continue;
+            if (pthread_rwlock_trywrlock(&link->entry->lock) != 0) {
+                busy = 1;
+                continue;
+            }
+            link->visit = pass;
+            visit(link->entry, ctx);
+            pthread_rwlock_unlock(&link->entry->lock);
+        }
+        if (!busy) break;
+        pthread_mutex_unlock(&index_mutex);
+        usleep(VISIT_RETRY_US);
+        pthread_mutex_lock(&index_mutex);
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void server_index_visit(const char *ip, uint16_t port, server_index_visit_t visit, void *ctx) {
+    visit_links(ip, port, 0, visit, ctx);
+}
+
+uint32_t server_index_new_stamp() {
+    pthread_mutex_lock(&index_mutex);
+    if (++mark_stamp == 0) mark_stamp = 1;
+    uint32_t stamp = mark_stamp;
+    pthread_mutex_unlock(&index_mutex);
+    return stamp;
+}
+
+void server_index_mark(DirectoryEntry *entry, const char *ip, uint16_t port, uint32_t stamp) {
+    pthread_mutex_lock(&index_mutex);
+    for (HolderLink *link = entry->holders; link; link = link->entry_next) {
+        if (link_is(link, ip, port)) link->mark = stamp;
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void server_index_visit_unmarked(const char *ip, uint16_t port, uint32_t stamp, server_index_visit_t visit, void *ctx) {
+    visit_links(ip, port, stamp, visit, ctx);
+}
+
+void server_index_cleanup() {
+    pthread_mutex_lock(&index_mutex);
+    while (servers) {
+        ServerFiles *next = servers->next;
+        HolderLink *link = servers->head.next;
+        while (link != &servers->head) {
+            HolderLink *following = link->next;
+            link->entry->holders = NULL;
+            free(link);
+            link = following;
+        }
+        free(servers);
+        servers = next;
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
@@ -0,0 +1,145 @@
+// src/naming_server/src/timer_wheel.c
+
+#include "timer_wheel.h"
+#include <stdlib.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+struct TimerWheel {
+    TimerEntry slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // List heads
+    uint64_t tick_ms;
+    uint64_t current_tick;      // Last tick that has been run
+};
+
+static void slot_append(TimerEntry *head, TimerEntry *entry) {
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+static void entry_unlink(TimerEntry *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = entry->prev = NULL;
+}
+
+// File entry by how far its deadline is from the current tick: the finest
+// level whose turn still reaches it
+static void place(TimerWheel *wheel, TimerEntry *entry) {
+    uint64_t delta = entry->expires_tick - wheel->current_tick;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t span = 1ULL << (TIMER_WHEEL_BITS * (level + 1));
+        if (delta < span || level == TIMER_WHEEL_LEVELS - 1) {
+            if (delta >= span) {
+                // Beyond the outermost turn; park it as far out as we reach
+                // and it will be placed again when cascaded
+                delta = span - 1;
+            }
+            uint64_t tick = wheel->current_tick + delta;
+            int slot = (int)((tick >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+            slot_append(&wheel->slots[level][slot], entry);
+            return;
+        }
+    }
+}
+
+TimerWheel *timer_wheel_create(uint64_t tick_ms, uint64_t now_ms) {
+    TimerWheel *wheel = malloc(sizeof(TimerWheel));
+    if (!wheel) return NULL;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            TimerEntry *head = &wheel->slots[level][slot];
+            head->next = head->prev = head;
+        }
+    }
+    wheel->tick_ms = tick_ms ? tick_ms : 1;
+    wheel->current_tick = now_ms / wheel->tick_ms;
+    return wheel;
+}
+
+void timer_wheel_destroy(TimerWheel *wheel) {
+    // Entries belong to their owners; only detach them
+    if (!wheel) return;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            TimerEntry *head = &wheel->slots[level][slot];
+            while (head->next != head) {
+                entry_unlink(head->next);
+            }
+        }
+    }
+    free(wheel);
+}
+
+int timer_wheel_pending(const TimerEntry *entry) {
+    return entry->next != NULL;
+}
+
+void timer_wheel_schedule(TimerWheel *wheel, TimerEntry *entry, uint64_t expires_ms) {
+    if (timer_wheel_pending(entry)) {
+        entry_unlink(entry);
+    }
+
+    // Round up so a timer never fires early, and never into a tick that has
+    // already been run
+    uint64_t tick = (expires_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if (tick <= wheel->current_tick) {
+        tick = wheel->current_tick + 1;
+    }
+    entry->expires_tick = tick;
+    place(wheel, entry);
+}
+
+void timer_wheel_cancel(TimerWheel *wheel, TimerEntry *entry) {
+    (void)wheel;
+    if (timer_wheel_pending(entry)) {
+        entry_unlink(entry);
+    }
+}
+
+// Re-place everything in a coarse slot now that its turn has come round
+static void cascade(TimerWheel *wheel, int level) {
+    int slot = (int)((wheel->current_tick >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+    TimerEntry pending = { &pending, &pending, 0, NULL };
+    TimerEntry *head = &wheel->slots[level][slot];
+
+    // Move the list aside first, as placing may land back in this slot
+    if (head->next == head) return;
+    pending.next = head->next;
+    pending.prev = head->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    head->next = head->prev = head;
+
+    while (pending.next != &pending) {
+        TimerEntry *entry = pending.next;
+        entry_unlink(entry);
+        place(wheel, entry);
+    }
+}
+
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms, timer_expired_t expired, void *arg) {
+    uint64_t target = now_ms / wheel->tick_ms;
+    while (wheel->current_tick < target) {
+        wheel->current_tick++;
+
+        // Whenever a level wraps, the next slot of the level above comes due
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            uint64_t below = wheel->current_tick >> (TIMER_WHEEL_BITS * (level - 1));
+            if ((below & SLOT_MASK) != 0) break;
+            cascade(wheel, level);
+        }
+
+        TimerEntry *head = &wheel->slots[0][wheel->current_tick & SLOT_MASK];
+        while (head->next != head) {
+            TimerEntry *entry = head->next;
+            entry_unlink(entry);
+            if (entry->expires_tick > wheel->current_tick) {
+                place(wheel, entry); // Parked beyond the outermost turn
+                continue;
+            }
+            expired(entry, arg);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+// src/storage_server/include/commands.h
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "network.h"
+#include "protocol.h"
+#include "errors.h"
+
+// Serve the naming server's command channel: create, delete and copy
+// batches arrive on one long-lived connection. Creates and deletes are
+// answered with one SS_COMMAND_RESULTS frame per batch; copies run on
+// COPY_WORKERS workers and are answered one by one as they finish.
+//
+// A copy pulls the file from the source server in COPY_RANGE_SIZE ranges
+// over up to COPY_STREAMS_PER_FILE connections, never holding more than
+// COPY_STREAMS_PER_LINK open to one source across all copies.
+//
+// A WATCH is answered once it is in place; the next write to its path is
+// then reported with SS_FILE_WRITTEN on the channel that asked. A WATCH of
+// the empty path has every write reported until the channel closes. Each
+// write is reported at most once per channel, and watches go away with
+// their channel.
+
+#define COPY_WORKERS 16                     // Files copied at once
+#define COPY_RANGE_SIZE (8 * 1024 * 1024)   // Bytes asked for by one FETCH_RANGE
+#define COPY_STREAMS_PER_FILE 4
+#define COPY_STREAMS_PER_LINK 8
+#define MAX_WATCHES 4096                    // Watched paths across all channels
+
+// Directory commands are resolved against
+void commands_init(const char *data_dir);
+
+// Take over a connection whose first SS_COMMAND_BATCH header has been read
+// and serve it on a thread of its own
+ErrorCode commands_serve(NetworkSocket *sock, const MessageHeader *first);
+
+// A client or peer wrote path: report it to the channels watching it
+void commands_file_written(const char *path);
+
+// Take over a peer's connection whose first FETCH_RANGE header has been
+// read and answer its ranges on a thread of its own
+ErrorCode commands_serve_ranges(NetworkSocket *sock, const MessageHeader *first);
+
+#endif // COMMANDS_H
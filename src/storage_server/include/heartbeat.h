@@ -5,6 +5,8 @@
 
 #include "network.h"
 
-// Start the heartbeat thread
-void start_heartbeat(const char *naming_server_host, const char *naming_server_port, const char *host, const char *port);
+// Start a heartbeat thread to one naming server; call once per shard.
+// data_dir is where the reported capacity is measured
+void start_heartbeat(const char *naming_server_host, const char *naming_server_port, const char *host, const char *port,
+                     const char *data_dir);
 #endif // HEARTBEAT_H
\ No newline at end of file
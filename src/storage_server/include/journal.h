@@ -0,0 +1,45 @@
+// src/storage_server/include/journal.h
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "errors.h"
+#include <stdint.h>
+
+// One namespace change since the last acknowledged registration
+// Record flag of a subtree moved away from path. Its files are not listed
+// one by one, so no delta can carry the move.
+#define JOURNAL_FLAG_MOVED 0x80
+
+typedef struct {
+    char *path;                 // Relative to the data directory
+    uint8_t flags;              // INVENTORY_FLAG_* (DELETED for removals) or JOURNAL_FLAG_MOVED
+    uint64_t size;
+    uint32_t permissions;
+} JournalRecord;
+
+// Load the persisted generation and change journal from data_dir
+ErrorCode journal_init(const char *data_dir);
+
+// Release the in-memory journal
+void journal_cleanup();
+
+// Record a path created or deleted on this server
+void journal_record_create(const char *path, uint8_t flags, uint64_t size, uint32_t permissions);
+void journal_record_delete(const char *path);
+
+// Record a file or directory renamed on this server; the next registration
+// sends a full inventory
+void journal_record_move(const char *path);
+
+// Copy the current journal; *generation is the last acknowledged generation
+// (0 if this server never registered) and *full is set if the journal holds
+// a move. Free with journal_free_snapshot.
+ErrorCode journal_snapshot(JournalRecord **records, uint32_t *count, uint64_t *generation, int *full);
+void journal_free_snapshot(JournalRecord *records, uint32_t count);
+
+// The naming server acknowledged generation after seeing the first count
+// records: persist it and drop those records
+ErrorCode journal_commit(uint64_t generation, uint32_t count);
+
+#endif // JOURNAL_H
@@ -46,9 +46,19 @@ ErrorCode storage_stream(const char *filepath, void (*callback)(const uint8_t *d
 // Register a new file in storage
 ErrorCode storage_register_file(const char *filepath, FileMetadata *metadata);
 
+// Create the missing parent directories of filepath (mkdir -p)
+ErrorCode storage_make_parents(const char *filepath);
+
+// Create an empty file with the given permissions, along with any missing
+// parent directories. Fails with ERR_ALREADY_EXISTS if it is already there.
+ErrorCode storage_create_file(const char *filepath, uint32_t mode);
+
 // Delete a file from storage
 ErrorCode storage_delete_file(const char *filepath);
 
+// Size and permission bits of a file
+ErrorCode storage_get_file_info(const char *filepath, uint64_t *file_size, uint32_t *permissions);
+
 // Load tracking functions
 void increment_load();
 void decrement_load();
@@ -0,0 +1,36 @@
+// src/storage_server/include/telemetry.h
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+// Storage server load telemetry. Every recorder is a handful of atomic
+// operations, so the I/O paths never take a lock to report.
+
+// Weight of a new latency sample in the moving averages (1/2^shift)
+#define TELEMETRY_EWMA_SHIFT 3
+
+// Monotonic clock in microseconds, for timing operations
+uint64_t telemetry_now_us();
+
+// Completed reads (bytes sent) and writes (bytes received)
+void telemetry_record_read(uint64_t bytes, uint64_t latency_us);
+void telemetry_record_write(uint64_t bytes, uint64_t latency_us);
+
+// Bytes sent by a stream as they go out
+void telemetry_add_bytes_out(uint64_t bytes);
+
+// Open streams gauge
+void telemetry_stream_opened();
+void telemetry_stream_closed();
+
+// Listening socket whose accept backlog is reported as the queue depth
+void telemetry_set_listen_fd(int fd);
+
+// Fill the telemetry fields of a heartbeat. Rates cover the time since the
+// previous call, so only the heartbeat thread should call this.
+void telemetry_fill_heartbeat(HeartbeatMessage *hb, const char *data_dir);
+
+#endif // TELEMETRY_H
@@ -1,9 +1,13 @@
 #include "storage.h"
 #include "replication.h"
+#include "telemetry.h"
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 // Head of the storage files linked list
@@ -11,29 +15,21 @@ static StorageFile *storage_files = NULL;
 static pthread_mutex_t storage_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Global variable to track the number of active storage operations
-static pthread_mutex_t load_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int current_load = 0;
 
 // Function to increment load
 void increment_load() {
-    pthread_mutex_lock(&load_mutex);
-    current_load++;
-    pthread_mutex_unlock(&load_mutex);
+    __atomic_add_fetch(&current_load, 1, __ATOMIC_RELAXED);
 }
 
 // Function to decrement load
 void decrement_load() {
-    pthread_mutex_lock(&load_mutex);
-    current_load--;
-    pthread_mutex_unlock(&load_mutex);
+    __atomic_sub_fetch(&current_load, 1, __ATOMIC_RELAXED);
 }
 
 // Function to get current load
 int storage_get_load() {
-    pthread_mutex_lock(&load_mutex);
-    int load = current_load;
-    pthread_mutex_unlock(&load_mutex);
-    return load;
+    return __atomic_load_n(&current_load, __ATOMIC_RELAXED);
 }
 
 // Initialize the storage system
@@ -78,7 +74,6 @@ static ErrorCode get_storage_file(const char *filepath, StorageFile **file, int
     StorageFile *prev = NULL;
     while (current) {
         if (strcmp(current->filepath, filepath) == 0) {
-            printf("[DEBUG] Found existing file: %s\n", filepath); // Debug log
             *file = current;
             pthread_mutex_unlock(&storage_lock);
             return ERR_SUCCESS;
@@ -88,7 +83,6 @@ static ErrorCode get_storage_file(const char *filepath, StorageFile **file, int
     }
     if (create) {
         // Create new storage file
-        printf("[DEBUG] Creating new storage file: %s\n", filepath); // Debug log
         StorageFile *new_file = malloc(sizeof(StorageFile));
         if (!new_file) {
             printf("[ERROR] Memory allocation failed for file: %s\n", filepath);
@@ -114,11 +108,9 @@ static ErrorCode get_storage_file(const char *filepath, StorageFile **file, int
             storage_files = new_file;
         }
         *file = new_file;
-        printf("[DEBUG] New storage file created: %s\n", filepath); // Debug log
         pthread_mutex_unlock(&storage_lock);
         return ERR_SUCCESS;
     } else {
-        printf("[DEBUG] File not found and `create` flag is false: %s\n", filepath); // Debug log
         pthread_mutex_unlock(&storage_lock);
         return ERR_NOT_FOUND;
     }
@@ -133,8 +125,35 @@ ErrorCode storage_register_file(const char *filepath, FileMetadata *metadata) {
         return ERR_IO_ERROR;
     }
     fclose(file);
-    
-    printf("[DEBUG] storage_register_file: Successfully registered file: %s\n", filepath);
+    return ERR_SUCCESS;
+}
+
+ErrorCode storage_make_parents(const char *filepath) {
+    // Existing directories along the way are fine
+    char parent[512];
+    snprintf(parent, sizeof(parent), "%s", filepath);
+    for (char *slash = strchr(parent + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(parent, 0755) != 0 && errno != EEXIST) {
+            perror("mkdir");
+            return ERR_IO_ERROR;
+        }
+        *slash = '/';
+    }
+    return ERR_SUCCESS;
+}
+
+ErrorCode storage_create_file(const char *filepath, uint32_t mode) {
+    ErrorCode err = storage_make_parents(filepath);
+    if (err != ERR_SUCCESS) return err;
+
+    int fd = open(filepath, O_WRONLY | O_CREAT | O_EXCL, mode ? mode & 0777 : 0644);
+    if (fd < 0) {
+        if (errno == EEXIST) return ERR_ALREADY_EXISTS;
+        perror("open");
+        return ERR_IO_ERROR;
+    }
+    close(fd);
     return ERR_SUCCESS;
 }
 
@@ -147,16 +166,13 @@ ErrorCode storage_delete_file(const char *filepath) {
 
     // Replicate the delete to secondary servers
     replication_replicate_delete(filepath);
-
-    printf("[DEBUG] storage_delete_file: Successfully deleted file: %s\n", filepath);
     return ERR_SUCCESS;
 }
 
 // Read data from a file at a given offset
 ErrorCode storage_read(const char *filepath, uint64_t offset, uint8_t *buffer, size_t length, size_t *bytes_read) {
-    printf("[DEBUG] Attempting to read from file: %s at offset %lu for length %zu\n", filepath, offset, length);
-    
     increment_load();
+    uint64_t start_us = telemetry_now_us();
 
     FILE *file = fopen(filepath, "rb");
     if (!file) {
@@ -182,7 +198,7 @@ ErrorCode storage_read(const char *filepath, uint64_t offset, uint8_t *buffer, s
 
     fclose(file);
     *bytes_read = read;
-    printf("[DEBUG] storage_read: Successfully read %zu bytes from file: %s\n", *bytes_read, filepath);
+    telemetry_record_read(read, telemetry_now_us() - start_us);
 
     decrement_load();
     return ERR_SUCCESS;
@@ -191,6 +207,7 @@ ErrorCode storage_read(const char *filepath, uint64_t offset, uint8_t *buffer, s
 // Write data to a file at a given offset
 ErrorCode storage_write(const char *filepath, uint64_t offset, const uint8_t *buffer, size_t length) {
     increment_load();
+    uint64_t start_us = telemetry_now_us();
 
     FILE *file = fopen(filepath, "r+b");
     if (!file) {
@@ -220,12 +237,12 @@ ErrorCode storage_write(const char *filepath, uint64_t offset, const uint8_t *bu
 
     fflush(file);
     fclose(file);
+    telemetry_record_write(written, telemetry_now_us() - start_us);
 
     // Replicate the write to secondary servers
     replication_replicate_write(filepath, offset, buffer, length);
 
     decrement_load();
-    printf("[DEBUG] storage_write: Successfully wrote %zu bytes to file: %s\n", written, filepath);
     return ERR_SUCCESS;
 }
 
@@ -246,9 +263,12 @@ ErrorCode storage_stream(const char *filepath, void (*callback)(const uint8_t *d
     size_t bytes_read;
     ErrorCode result = ERR_SUCCESS;
 
+    telemetry_stream_opened();
     while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
         callback(buffer, bytes_read, user_data);
+        telemetry_add_bytes_out(bytes_read);
     }
+    telemetry_stream_closed();
 
     if (ferror(file)) {
         result = ERR_IO_ERROR;
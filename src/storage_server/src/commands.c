@@ -0,0 +1,704 @@
+// src/storage_server/src/commands.c
+
+#include "commands.h"
+#include "storage.h"
+#include "journal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+static char commands_data_dir[256];
+
+// A command channel, shared by its serving thread and the copies it queued
+typedef struct {
+    NetworkSocket *sock;
+    int refs;
+} Channel;
+
+typedef struct {
+    NetworkSocket *sock;
+    MessageHeader first;
+} ServeArgs;
+
+// A COPY waiting for a worker
+typedef struct CopyTask {
+    StorageCommand command;
+    Channel *channel;
+    struct CopyTask *next;
+} CopyTask;
+
+static CopyTask *copy_head = NULL;
+static CopyTask *copy_tail = NULL;
+static pthread_mutex_t copy_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t copy_cond = PTHREAD_COND_INITIALIZER;
+
+// Fetch connections open to one source server
+typedef struct Link {
+    char ip[INET_ADDRSTRLEN];
+    uint16_t port;
+    int streams;
+    struct Link *next;
+} Link;
+
+static Link *links = NULL;
+static pthread_mutex_t link_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t link_cond = PTHREAD_COND_INITIALIZER;
+
+// A path whose next write a channel asked to hear about
+typedef struct Watch {
+    char path[256];             // As the naming server gave it; empty for every path
+    Channel *channel;           // Holds a reference
+    struct Watch *next;
+} Watch;
+
+static Watch *watches = NULL;
+static uint32_t watch_count = 0;
+static pthread_mutex_t watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// One file being pulled in ranges by several streams
+typedef struct {
+    const char *ip;
+    uint16_t port;
+    const char *path;
+    int fd;                     // Temporary file, sized up front
+    uint64_t size;
+    uint32_t ranges;
+    uint32_t next_range;        // Claimed atomically by the streams
+    ErrorCode status;           // First failure
+} RangeCopy;
+
+static ErrorCode execute_command(const StorageCommand *command);
+static void *copy_worker(void *arg);
+
+void commands_init(const char *data_dir) {
+    snprintf(commands_data_dir, sizeof(commands_data_dir), "%s", data_dir);
+
+    for (int i = 0; i < COPY_WORKERS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, copy_worker, NULL) != 0) {
+            fprintf(stderr, "Failed to start copy worker\n");
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+static void channel_release(Channel *channel) {
+    if (__atomic_sub_fetch(&channel->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        printf("Command channel from naming server closed\n");
+        network_socket_close(channel->sock);
+        free(channel);
+    }
+}
+
+// Connect to a peer storage server with a blocking socket
+static NetworkSocket *connect_peer(const char *ip, uint16_t port) {
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%u", port);
+    NetworkSocket *sock = network_socket_create(ip, port_str);
+    if (!sock) return NULL;
+    int fd = network_socket_get_fd(sock);
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags != -1) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    return sock;
+}
+
+// Ask the source server for the size and permissions of path
+static ErrorCode peer_file_info(const char *ip, uint16_t port, const char *path, uint64_t *size,
+                                uint32_t *permissions) {
+    NetworkSocket *sock = connect_peer(ip, port);
+    if (!sock) return ERR_NETWORK_FAILURE;
+
+    struct {
+        MessageHeader header;
+        GetFileInfoRequest body;
+    } __attribute__((packed)) request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = MSG_TYPE_GET_FILE_INFO;
+    request.header.payload_size = htonl(sizeof(request.body));
+    strncpy(request.body.filepath, path, sizeof(request.body.filepath) - 1);
+
+    ErrorCode err = ERR_NETWORK_FAILURE;
+    MessageHeader reply;
+    if (network_socket_send(sock, &request, sizeof(request)) == sizeof(request) &&
+        network_socket_receive(sock, &reply, sizeof(reply)) == sizeof(reply)) {
+        if (reply.type == MSG_TYPE_GET_FILE_INFO_RESPONSE) {
+            GetFileInfoResponse info;
+            if (network_socket_receive(sock, &info, sizeof(info)) == sizeof(info)) {
+                *size = network_ntoh64(info.file_size);
+                *permissions = ntohl(info.permissions) & 0777;
+                err = ERR_SUCCESS;
+            }
+        } else {
+            uint32_t code;
+            err = network_socket_receive(sock, &code, sizeof(code)) == sizeof(code) ? (ErrorCode)(int32_t)ntohl(code)
+                                                                                    : ERR_PROTOCOL_ERROR;
+        }
+    }
+    network_socket_close(sock);
+    return err;
+}
+
+// Wait for a free stream to the source server
+static Link *link_acquire(const char *ip, uint16_t port) {
+    pthread_mutex_lock(&link_mutex);
+    Link *link = links;
+    while (link && (link->port != port || strcmp(link->ip, ip) != 0)) {
+        link = link->next;
+    }
+    if (!link) {
+        link = calloc(1, sizeof(Link));
+        if (!link) {
+            pthread_mutex_unlock(&link_mutex);
+            return NULL;
+        }
+        snprintf(link->ip, sizeof(link->ip), "%s", ip);
+        link->port = port;
+        link->next = links;
+        links = link;
+    }
+    while (link->streams >= COPY_STREAMS_PER_LINK) {
+        pthread_cond_wait(&link_cond, &link_mutex);
+    }
+    link->streams++;
+    pthread_mutex_unlock(&link_mutex);
+    return link;
+}
+
+static void link_release(Link *link) {
+    pthread_mutex_lock(&link_mutex);
+    link->streams--;
+    pthread_cond_broadcast(&link_cond);
+    pthread_mutex_unlock(&link_mutex);
+}
+
+// Fetch one range of copy->path into the temporary file at the same offset
+static ErrorCode fetch_range(NetworkSocket *sock, RangeCopy *copy, uint64_t offset, uint32_t length,
+                             uint8_t *buffer) {
+    struct {
+        MessageHeader header;
+        FetchRangeRequest body;
+    } __attribute__((packed)) request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = MSG_TYPE_FETCH_RANGE;
+    request.header.payload_size = htonl(sizeof(request.body));
+    strncpy(request.body.path, copy->path, sizeof(request.body.path) - 1);
+    request.body.offset = network_hton64(offset);
+    request.body.length = htonl(length);
+
+    MessageHeader reply;
+    if (network_socket_send(sock, &request, sizeof(request)) != sizeof(request) ||
+        network_socket_receive(sock, &reply, sizeof(reply)) != sizeof(reply)) {
+        return ERR_NETWORK_FAILURE;
+    }
+    // An error carries just its code; anything else leaves the stream out
+    // of step, and the caller drops it on any failure
+    if (reply.type != MSG_TYPE_FETCH_RANGE) {
+        uint32_t code;
+        if (reply.type != MSG_TYPE_ERROR || ntohl(reply.payload_size) != sizeof(code) ||
+            network_socket_receive(sock, &code, sizeof(code)) != sizeof(code)) {
+            return ERR_PROTOCOL_ERROR;
+        }
+        return (ErrorCode)(int32_t)ntohl(code);
+    }
+    // A short range means the source changed size under us
+    if (ntohl(reply.payload_size) != length) return ERR_IO_ERROR;
+
+    uint32_t done = 0;
+    while (done < length) {
+        size_t want = length - done < COPY_BUFFER_SIZE ? length - done : COPY_BUFFER_SIZE;
+        if (network_socket_receive(sock, buffer, want) != (ssize_t)want) return ERR_NETWORK_FAILURE;
+        if (pwrite(copy->fd, buffer, want, (off_t)(offset + done)) != (ssize_t)want) return ERR_IO_ERROR;
+        done += want;
+    }
+    return ERR_SUCCESS;
+}
+
+// Claim ranges of copy until none are left, over one connection to the source
+static void *fetch_ranges(void *arg) {
+    RangeCopy *copy = arg;
+    Link *link = link_acquire(copy->ip, copy->port);
+    NetworkSocket *sock = link ? connect_peer(copy->ip, copy->port) : NULL;
+    uint8_t *buffer = malloc(COPY_BUFFER_SIZE);
+    ErrorCode err = !sock ? ERR_NETWORK_FAILURE : buffer ? ERR_SUCCESS : ERR_INTERNAL_ERROR;
+
+    while (err == ERR_SUCCESS && __atomic_load_n(&copy->status, __ATOMIC_RELAXED) == ERR_SUCCESS) {
+        uint32_t range = __atomic_fetch_add(&copy->next_range, 1, __ATOMIC_RELAXED);
+        if (range >= copy->ranges) break;
+        uint64_t offset = (uint64_t)range * COPY_RANGE_SIZE;
+        uint32_t length = copy->size - offset < COPY_RANGE_SIZE ? (uint32_t)(copy->size - offset) : COPY_RANGE_SIZE;
+        err = fetch_range(sock, copy, offset, length, buffer);
+    }
+    if (err != ERR_SUCCESS) {
+        ErrorCode expected = ERR_SUCCESS;
+        __atomic_compare_exchange_n(&copy->status, &expected, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+
+    free(buffer);
+    network_socket_close(sock);
+    if (link) link_release(link);
+    return NULL;
+}
+
+// Pull source_path from a peer into a temporary file next to full_path and
+// move it into place once complete. Large files are split into ranges
+// fetched over several connections at once.
+static ErrorCode copy_from_peer(const StorageCommand *command, const char *full_path) {
+    uint16_t port = ntohs(command->source_port);
+    uint64_t size = 0;
+    uint32_t permissions = 0644;
+    ErrorCode err = peer_file_info(command->source_ip, port, command->source_path, &size, &permissions);
+    if (err != ERR_SUCCESS) return err;
+
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.nfs_copy", full_path);
+    int fd = storage_make_parents(full_path) == ERR_SUCCESS
+                 ? open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, permissions ? permissions : 0644)
+                 : -1;
+    if (fd < 0) return ERR_IO_ERROR;
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        remove(temp_path);
+        return ERR_IO_ERROR;
+    }
+
+    RangeCopy copy = {
+        .ip = command->source_ip,
+        .port = port,
+        .path = command->source_path,
+        .fd = fd,
+        .size = size,
+        .ranges = (uint32_t)((size + COPY_RANGE_SIZE - 1) / COPY_RANGE_SIZE),
+        .next_range = 0,
+        .status = ERR_SUCCESS,
+    };
+
+    // The worker is one of the streams itself
+    pthread_t threads[COPY_STREAMS_PER_FILE];
+    int started = 0;
+    while (started + 1 < COPY_STREAMS_PER_FILE && (uint32_t)started + 1 < copy.ranges &&
+           pthread_create(&threads[started], NULL, fetch_ranges, &copy) == 0) {
+        started++;
+    }
+    if (copy.ranges > 0) fetch_ranges(&copy);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    err = copy.status;
+
+    if (close(fd) != 0 && err == ERR_SUCCESS) err = ERR_IO_ERROR;
+    if (err == ERR_SUCCESS && rename(temp_path, full_path) != 0) err = ERR_IO_ERROR;
+    if (err != ERR_SUCCESS) remove(temp_path);
+    return err;
+}
+
+// Run queued copies, answering each in an SS_COMMAND_RESULTS frame of its own
+static void *copy_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&copy_mutex);
+        while (!copy_head) {
+            pthread_cond_wait(&copy_cond, &copy_mutex);
+        }
+        CopyTask *task = copy_head;
+        copy_head = task->next;
+        if (!copy_head) copy_tail = NULL;
+        pthread_mutex_unlock(&copy_mutex);
+
+        struct {
+            MessageHeader header;
+            uint32_t count;
+            StorageCommandResult result;
+        } __attribute__((packed)) reply;
+        reply.header.request_id = 0;
+        reply.header.type = MSG_TYPE_SS_COMMAND_RESULTS;
+        reply.header.payload_size = htonl(sizeof(reply) - sizeof(reply.header));
+        reply.count = htonl(1);
+        reply.result.command_id = task->command.command_id;
+        reply.result.status = htonl((uint32_t)execute_command(&task->command));
+        network_socket_send(task->channel->sock, &reply, sizeof(reply));
+
+        channel_release(task->channel);
+        free(task);
+    }
+    return NULL;
+}
+
+// Hand a COPY to the workers; 0 if it has to run in place instead
+static int queue_copy(const StorageCommand *command, Channel *channel) {
+    CopyTask *task = malloc(sizeof(CopyTask));
+    if (!task) return 0;
+    task->command = *command;
+    task->channel = channel;
+    task->next = NULL;
+    __atomic_add_fetch(&channel->refs, 1, __ATOMIC_ACQ_REL);
+
+    pthread_mutex_lock(&copy_mutex);
+    if (copy_tail) {
+        copy_tail->next = task;
+    } else {
+        copy_head = task;
+    }
+    copy_tail = task;
+    pthread_cond_signal(&copy_cond);
+    pthread_mutex_unlock(&copy_mutex);
+    return 1;
+}
+
+// Move a file or directory within the data directory. A single rename(2)
+// whatever the size of the tree, and a single journal record: the next
+// registration sends a full inventory rather than listing the moved files.
+static ErrorCode rename_path(const char *source, const char *destination) {
+    char source_full[512], full_path[512];
+    snprintf(source_full, sizeof(source_full), "%s/%s", commands_data_dir, source);
+    snprintf(full_path, sizeof(full_path), "%s/%s", commands_data_dir, destination);
+
+    if (access(source_full, F_OK) != 0) return ERR_FILE_NOT_FOUND;
+    if (access(full_path, F_OK) == 0) return ERR_ALREADY_EXISTS;
+    if (storage_make_parents(full_path) != ERR_SUCCESS || rename(source_full, full_path) != 0) return ERR_IO_ERROR;
+
+    journal_record_move(source);
+    return ERR_SUCCESS;
+}
+
+// Paths are named with or without a leading slash
+static const char *watch_key(const char *path) {
+    while (*path == '/') path++;
+    return path;
+}
+
+static ErrorCode add_watch(const StorageCommand *command, Channel *channel) {
+    Watch *watch = calloc(1, sizeof(Watch));
+    if (!watch) return ERR_INTERNAL_ERROR;
+    memcpy(watch->path, command->path, sizeof(watch->path));
+    watch->path[sizeof(watch->path) - 1] = '\0';
+    watch->channel = channel;
+
+    pthread_mutex_lock(&watch_mutex);
+    for (Watch *other = watches; other; other = other->next) {
+        if (other->channel == channel && strcmp(watch_key(other->path), watch_key(watch->path)) == 0) {
+            pthread_mutex_unlock(&watch_mutex);
+            free(watch);
+            return ERR_SUCCESS;
+        }
+    }
+    if (watch_count >= MAX_WATCHES) {
+        pthread_mutex_unlock(&watch_mutex);
+        free(watch);
+        return ERR_BUSY;
+    }
+    __atomic_add_fetch(&channel->refs, 1, __ATOMIC_ACQ_REL);
+    watch->next = watches;
+    watches = watch;
+    watch_count++;
+    pthread_mutex_unlock(&watch_mutex);
+    return ERR_SUCCESS;
+}
+
+// Forget the watches of a channel that stopped serving
+static void drop_watches(Channel *channel) {
+    Watch *dropped = NULL;
+    pthread_mutex_lock(&watch_mutex);
+    Watch **link = &watches;
+    while (*link) {
+        Watch *watch = *link;
+        if (watch->channel == channel) {
+            *link = watch->next;
+            watch->next = dropped;
+            dropped = watch;
+            watch_count--;
+        } else {
+            link = &watch->next;
+        }
+    }
+    pthread_mutex_unlock(&watch_mutex);
+
+    while (dropped) {
+        Watch *watch = dropped;
+        dropped = watch->next;
+        channel_release(watch->channel);
+        free(watch);
+    }
+}
+
+// Caller holds watch_mutex. Whether a report to channel is already due.
+static int reporting_to(const Watch *due, const Channel *channel) {
+    for (; due; due = due->next) {
+        if (due->channel == channel) return 1;
+    }
+    return 0;
+}
+
+void commands_file_written(const char *path) {
+    const char *key = watch_key(path);
+    Watch *fired = NULL;
+    pthread_mutex_lock(&watch_mutex);
+    Watch **link = &watches;
+    while (*link) {
+        Watch *watch = *link;
+        if (watch->path[0] != '\0' && strcmp(watch_key(watch->path), key) == 0) {
+            *link = watch->next;
+            watch->next = fired;
+            fired = watch;
+            watch_count--;
+        } else {
+            link = &watch->next;
+        }
+    }
+
+    // Channels watching every path stay subscribed and get one report each
+    for (Watch *watch = watches; watch; watch = watch->next) {
+        if (watch->path[0] != '\0' || reporting_to(fired, watch->channel)) continue;
+        Watch *report = calloc(1, sizeof(Watch));
+        if (!report) continue;
+        snprintf(report->path, sizeof(report->path), "%s", path);
+        report->channel = watch->channel;
+        __atomic_add_fetch(&report->channel->refs, 1, __ATOMIC_ACQ_REL);
+        report->next = fired;
+        fired = report;
+    }
+    pthread_mutex_unlock(&watch_mutex);
+
+    while (fired) {
+        Watch *watch = fired;
+        fired = watch->next;
+        struct {
+            MessageHeader header;
+            FileWritten body;
+        } __attribute__((packed)) notice;
+        memset(&notice, 0, sizeof(notice));
+        notice.header.type = MSG_TYPE_SS_FILE_WRITTEN;
+        notice.header.payload_size = htonl(sizeof(notice.body));
+        memcpy(notice.body.path, watch->path, sizeof(notice.body.path));
+        network_socket_send(watch->channel->sock, &notice, sizeof(notice));
+        channel_release(watch->channel);
+        free(watch);
+    }
+}
+
+static ErrorCode execute_command(const StorageCommand *command) {
+    char path[sizeof(command->path)];
+    memcpy(path, command->path, sizeof(path));
+    path[sizeof(path) - 1] = '\0';
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), "%s/%s", commands_data_dir, path);
+
+    ErrorCode err;
+    switch (command->op) {
+        case STORAGE_COMMAND_CREATE: {
+            uint32_t mode = ntohl(command->mode) & 0777;
+            err = storage_create_file(full_path, mode);
+            if (err == ERR_SUCCESS) journal_record_create(path, 0, 0, mode ? mode : 0644);
+            break;
+        }
+        case STORAGE_COMMAND_DELETE:
+            if (access(full_path, F_OK) != 0) {
+                err = ERR_FILE_NOT_FOUND;
+                break;
+            }
+            err = storage_delete_file(full_path);
+            if (err == ERR_SUCCESS) journal_record_delete(path);
+            break;
+        case STORAGE_COMMAND_COPY: {
+            StorageCommand copy = *command;
+            copy.source_ip[sizeof(copy.source_ip) - 1] = '\0';
+            copy.source_path[sizeof(copy.source_path) - 1] = '\0';
+            err = copy_from_peer(&copy, full_path);
+            struct stat st;
+            if (err == ERR_SUCCESS && stat(full_path, &st) == 0) {
+                journal_record_create(path, 0, (uint64_t)st.st_size, st.st_mode & 0777);
+            }
+            break;
+        }
+        case STORAGE_COMMAND_RENAME: {
+            char source[sizeof(command->source_path)];
+            memcpy(source, command->source_path, sizeof(source));
+            source[sizeof(source) - 1] = '\0';
+            err = rename_path(source, path);
+            break;
+        }
+        default:
+            err = ERR_INVALID_ARGUMENT;
+            break;
+    }
+    return err;
+}
+
+static void *serve_channel(void *arg) {
+    ServeArgs *args = arg;
+    NetworkSocket *sock = args->sock;
+    MessageHeader header = args->first;
+    free(args);
+
+    Channel *channel = malloc(sizeof(Channel));
+    if (!channel) {
+        network_socket_close(sock);
+        return NULL;
+    }
+    channel->sock = sock;
+    channel->refs = 1;
+
+    size_t max_payload = sizeof(uint32_t) + MAX_COMMAND_BATCH * sizeof(StorageCommand);
+    uint8_t *payload = malloc(max_payload);
+    uint8_t *reply = malloc(sizeof(MessageHeader) + sizeof(uint32_t) + MAX_COMMAND_BATCH * sizeof(StorageCommandResult));
+    if (!payload || !reply) goto out;
+
+    while (1) {
+        uint32_t payload_size = ntohl(header.payload_size);
+        if (header.type != MSG_TYPE_SS_COMMAND_BATCH || payload_size < sizeof(uint32_t) || payload_size > max_payload) {
+            fprintf(stderr, "Malformed command batch from naming server\n");
+            break;
+        }
+        if (network_socket_receive(sock, payload, payload_size) != payload_size) break;
+
+        uint32_t count;
+        memcpy(&count, payload, sizeof(count));
+        count = ntohl(count);
+        if (sizeof(uint32_t) + (size_t)count * sizeof(StorageCommand) > payload_size) {
+            fprintf(stderr, "Truncated command batch from naming server\n");
+            break;
+        }
+
+        // Creates and deletes run in order, so a delete queued after a
+        // create of the same path sees it. Copies go to the workers and are
+        // answered as they finish; the naming server never queues a path
+        // behind its own copy.
+        uint8_t *cursor = reply + sizeof(MessageHeader) + sizeof(uint32_t);
+        uint32_t answered = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            StorageCommand command;
+            memcpy(&command, payload + sizeof(uint32_t) + i * sizeof(command), sizeof(command));
+            if (command.op == STORAGE_COMMAND_COPY && queue_copy(&command, channel)) continue;
+            ErrorCode err = command.op == STORAGE_COMMAND_WATCH ? add_watch(&command, channel)
+                                                                : execute_command(&command);
+            StorageCommandResult result;
+            result.command_id = command.command_id;
+            result.status = htonl((uint32_t)err);
+            memcpy(cursor, &result, sizeof(result));
+            cursor += sizeof(result);
+            answered++;
+        }
+
+        MessageHeader *reply_header = (MessageHeader *)reply;
+        reply_header->request_id = header.request_id;
+        reply_header->type = MSG_TYPE_SS_COMMAND_RESULTS;
+        reply_header->payload_size = htonl((uint32_t)(cursor - reply - sizeof(MessageHeader)));
+        uint32_t answered_net = htonl(answered);
+        memcpy(reply + sizeof(MessageHeader), &answered_net, sizeof(answered_net));
+        size_t reply_size = cursor - reply;
+        if (answered > 0 && network_socket_send(sock, reply, reply_size) != (ssize_t)reply_size) break;
+        printf("Executed %u commands from naming server, %u copies queued\n", answered, count - answered);
+
+        if (network_socket_receive(sock, &header, sizeof(header)) != sizeof(header)) break;
+    }
+
+out:
+    free(payload);
+    free(reply);
+    drop_watches(channel);
+    channel_release(channel);
+    return NULL;
+}
+
+// Hand a connection to a thread running serve
+static ErrorCode serve_on_thread(NetworkSocket *sock, const MessageHeader *first, void *(*serve)(void *)) {
+    ServeArgs *args = malloc(sizeof(ServeArgs));
+    if (!args) return ERR_INTERNAL_ERROR;
+    args->sock = sock;
+    args->first = *first;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serve, args) != 0) {
+        free(args);
+        return ERR_INTERNAL_ERROR;
+    }
+    pthread_detach(thread);
+    return ERR_SUCCESS;
+}
+
+ErrorCode commands_serve(NetworkSocket *sock, const MessageHeader *first) {
+    return serve_on_thread(sock, first, serve_channel);
+}
+
+// Answer one FETCH_RANGE, handing the file to the socket with sendfile.
+// Anything but a network failure leaves the connection usable.
+static ErrorCode send_range(NetworkSocket *sock, uint32_t request_id, FetchRangeRequest *request) {
+    request->path[sizeof(request->path) - 1] = '\0';
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), "%s/%s", commands_data_dir, request->path);
+
+    struct stat st;
+    int fd = open(full_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        ErrorCode code = errno == ENOENT ? ERR_FILE_NOT_FOUND : ERR_IO_ERROR;
+        if (fd >= 0) close(fd);
+        struct {
+            MessageHeader header;
+            uint32_t code;
+        } __attribute__((packed)) error;
+        error.header.request_id = request_id;
+        error.header.type = MSG_TYPE_ERROR;
+        error.header.payload_size = htonl(sizeof(error.code));
+        error.code = htonl((uint32_t)code);
+        if (network_socket_send(sock, &error, sizeof(error)) != sizeof(error)) return ERR_NETWORK_FAILURE;
+        return code;
+    }
+
+    off_t offset = (off_t)network_ntoh64(request->offset);
+    size_t length = ntohl(request->length);
+    if (offset > st.st_size) offset = st.st_size;
+    if ((off_t)length > st.st_size - offset) length = (size_t)(st.st_size - offset);
+
+    MessageHeader reply = {
+        .request_id = request_id,
+        .type = MSG_TYPE_FETCH_RANGE,
+        .payload_size = htonl((uint32_t)length),
+    };
+    ErrorCode err = network_socket_send(sock, &reply, sizeof(reply)) == sizeof(reply) ? ERR_SUCCESS
+                                                                                       : ERR_NETWORK_FAILURE;
+    int out = network_socket_get_fd(sock);
+    while (err == ERR_SUCCESS && length > 0) {
+        ssize_t sent = sendfile(out, fd, &offset, length);
+        if (sent > 0) {
+            length -= (size_t)sent;
+        } else if (sent < 0 && errno == EAGAIN) {
+            struct pollfd pfd = {.fd = out, .events = POLLOUT};
+            poll(&pfd, 1, -1);
+        } else if (!(sent < 0 && errno == EINTR)) {
+            // The file shrank or the peer went away mid-range
+            err = ERR_NETWORK_FAILURE;
+        }
+    }
+    close(fd);
+    return err;
+}
+
+static void *serve_ranges(void *arg) {
+    ServeArgs *args = arg;
+    NetworkSocket *sock = args->sock;
+    MessageHeader header = args->first;
+    free(args);
+
+    while (header.type == MSG_TYPE_FETCH_RANGE && ntohl(header.payload_size) == sizeof(FetchRangeRequest)) {
+        FetchRangeRequest request;
+        if (network_socket_receive(sock, &request, sizeof(request)) != sizeof(request)) break;
+        if (send_range(sock, header.request_id, &request) == ERR_NETWORK_FAILURE) break;
+        if (network_socket_receive(sock, &header, sizeof(header)) != sizeof(header)) break;
+    }
+    network_socket_close(sock);
+    return NULL;
+}
+
+ErrorCode commands_serve_ranges(NetworkSocket *sock, const MessageHeader *first) {
+    return serve_on_thread(sock, first, serve_ranges);
+}
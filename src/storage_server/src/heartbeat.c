@@ -5,24 +5,58 @@
 #include "protocol.h"
 #include "errors.h"
 #include "storage.h"
+#include "telemetry.h"
+#include <errno.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-#define HEARTBEAT_INTERVAL 5  // Interval in seconds
+#define HEARTBEAT_BACKOFF_MIN_MS 100
+#define HEARTBEAT_BACKOFF_MAX_MS 10000
+
+// One heartbeat thread runs per naming server
+typedef struct {
+    char host[256];
+    char port[32];
+} HeartbeatTarget;
 
-static char ns_host[256];
-static char ns_port[32];
 static char server_host[256];
 static char server_port[32];
+static char server_data_dir[256];
 
-static pthread_mutex_t heartbeat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void sleep_ms(uint64_t ms) {
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+// Connect to the naming server, retrying with exponential backoff. Each wait
+// is drawn from the upper half of the current backoff so servers cut off by
+// the same outage do not all come back in the same instant.
+static NetworkSocket *connect_with_backoff(const HeartbeatTarget *target, unsigned int *seed) {
+    uint64_t backoff = HEARTBEAT_BACKOFF_MIN_MS;
+    while (1) {
+        NetworkSocket *sock = network_socket_create(target->host, target->port);
+        if (sock) return sock;
+
+        uint64_t wait = backoff / 2 + rand_r(seed) % (backoff / 2 + 1);
+        fprintf(stderr, "Failed to connect to Naming Server for heartbeat at %s:%s, retrying in %lu ms\n",
+                target->host, target->port, (unsigned long)wait);
+        sleep_ms(wait);
+        backoff = backoff * 2 > HEARTBEAT_BACKOFF_MAX_MS ? HEARTBEAT_BACKOFF_MAX_MS : backoff * 2;
+    }
+}
 
 static void *send_heartbeat(void *arg) {
+    HeartbeatTarget *target = arg;
+    unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)getpid() ^ (unsigned int)(uintptr_t)target;
+    NetworkSocket *ns_sock = NULL;
+
     while (1) {
-        sleep(HEARTBEAT_INTERVAL);
+        sleep_ms(HEARTBEAT_INTERVAL_MS);
 
         // Prepare heartbeat message
         HeartbeatMessage hb;
@@ -30,56 +64,49 @@ static void *send_heartbeat(void *arg) {
         strncpy(hb.host, server_host, sizeof(hb.host) - 1);
         strncpy(hb.port, server_port, sizeof(hb.port) - 1);
         hb.load = storage_get_load();  // Get current load
+        telemetry_fill_heartbeat(&hb, server_data_dir);
 
-        // Prepare message header
+        // Header and payload go out in one send on the long-lived channel
         MessageHeader header;
         memset(&header, 0, sizeof(header));
         header.type = MSG_TYPE_HEARTBEAT;
         header.payload_size = htonl(sizeof(hb));
+        uint8_t frame[sizeof(header) + sizeof(hb)];
+        memcpy(frame, &header, sizeof(header));
+        memcpy(frame + sizeof(header), &hb, sizeof(hb));
 
-        // Send heartbeat to naming server
-        pthread_mutex_lock(&heartbeat_mutex);
-
-        // Establish a new connection for heartbeat
-        NetworkSocket *ns_sock = network_socket_create(ns_host, ns_port);
         if (!ns_sock) {
-            fprintf(stderr, "Failed to connect to Naming Server for heartbeat at %s:%s\n", ns_host, ns_port);
-            pthread_mutex_unlock(&heartbeat_mutex);
-            continue;
-        }
-
-        ssize_t sent = network_socket_send(ns_sock, &header, sizeof(header));
-        if (sent != sizeof(header)) {
-            fprintf(stderr, "Failed to send heartbeat header to naming server\n");
-            network_socket_close(ns_sock);
-            pthread_mutex_unlock(&heartbeat_mutex);
-            continue;
+            ns_sock = connect_with_backoff(target, &seed);
         }
 
-        sent = network_socket_send(ns_sock, &hb, sizeof(hb));
-        if (sent != sizeof(hb)) {
-            fprintf(stderr, "Failed to send heartbeat payload to naming server\n");
+        if (network_socket_send(ns_sock, frame, sizeof(frame)) != sizeof(frame)) {
+            // The naming server went away; reconnect on the next beat
+            fprintf(stderr, "Lost heartbeat channel to naming server %s:%s\n", target->host, target->port);
             network_socket_close(ns_sock);
-            pthread_mutex_unlock(&heartbeat_mutex);
-            continue;
+            ns_sock = NULL;
         }
-
-        // Close the connection after sending the heartbeat
-        network_socket_close(ns_sock);
-        pthread_mutex_unlock(&heartbeat_mutex);
     }
     return NULL;
 }
 
-void start_heartbeat(const char *naming_server_host, const char *naming_server_port, const char *host, const char *port) {
-    strncpy(ns_host, naming_server_host, sizeof(ns_host) - 1);
-    strncpy(ns_port, naming_server_port, sizeof(ns_port) - 1);
+void start_heartbeat(const char *naming_server_host, const char *naming_server_port, const char *host, const char *port,
+                     const char *data_dir) {
     strncpy(server_host, host, sizeof(server_host) - 1);
     strncpy(server_port, port, sizeof(server_port) - 1);
+    strncpy(server_data_dir, data_dir, sizeof(server_data_dir) - 1);
+
+    HeartbeatTarget *target = calloc(1, sizeof(HeartbeatTarget));
+    if (!target) {
+        fprintf(stderr, "Failed to create heartbeat thread\n");
+        return;
+    }
+    strncpy(target->host, naming_server_host, sizeof(target->host) - 1);
+    strncpy(target->port, naming_server_port, sizeof(target->port) - 1);
 
     pthread_t thread;
-    if (pthread_create(&thread, NULL, send_heartbeat, NULL) != 0) {
+    if (pthread_create(&thread, NULL, send_heartbeat, target) != 0) {
         fprintf(stderr, "Failed to create heartbeat thread\n");
+        free(target);
     } else {
         pthread_detach(thread);
     }
@@ -0,0 +1,205 @@
+// src/storage_server/src/journal.c
+
+#include "journal.h"
+#include "inventory.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Both files live in the data directory; the leading dot keeps them out of
+// the inventory
+#define GENERATION_FILE ".nfs_generation"
+#define JOURNAL_FILE ".nfs_journal"
+
+static char generation_path[512];
+static char journal_path[512];
+static uint64_t generation = 0;
+static JournalRecord *records = NULL;
+static uint32_t record_count = 0;
+static uint32_t record_capacity = 0;
+static FILE *journal_file = NULL;
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *strip_slashes(const char *path) {
+    while (*path == '/') path++;
+    return path;
+}
+
+static ErrorCode append_record(const char *path, uint8_t flags, uint64_t size, uint32_t permissions) {
+    if (record_count == record_capacity) {
+        uint32_t new_capacity = record_capacity ? record_capacity * 2 : 64;
+        JournalRecord *new_records = realloc(records, new_capacity * sizeof(JournalRecord));
+        if (!new_records) return ERR_INTERNAL_ERROR;
+        records = new_records;
+        record_capacity = new_capacity;
+    }
+    records[record_count].path = strdup(path);
+    if (!records[record_count].path) return ERR_INTERNAL_ERROR;
+    records[record_count].flags = flags;
+    records[record_count].size = size;
+    records[record_count].permissions = permissions;
+    record_count++;
+    return ERR_SUCCESS;
+}
+
+static void write_record(FILE *file, const JournalRecord *record) {
+    if (record->flags & JOURNAL_FLAG_MOVED) {
+        fprintf(file, "M %s\n", record->path);
+    } else if (record->flags & INVENTORY_FLAG_DELETED) {
+        fprintf(file, "D %s\n", record->path);
+    } else {
+        fprintf(file, "C %u %llu %o %s\n", record->flags, (unsigned long long)record->size,
+                record->permissions, record->path);
+    }
+}
+
+ErrorCode journal_init(const char *data_dir) {
+    snprintf(generation_path, sizeof(generation_path), "%s/%s", data_dir, GENERATION_FILE);
+    snprintf(journal_path, sizeof(journal_path), "%s/%s", data_dir, JOURNAL_FILE);
+
+    pthread_mutex_lock(&journal_mutex);
+
+    FILE *file = fopen(generation_path, "r");
+    if (file) {
+        unsigned long long value;
+        if (fscanf(file, "%llu", &value) == 1) generation = value;
+        fclose(file);
+    }
+
+    // Replay the journal left by the previous run
+    file = fopen(journal_path, "r");
+    if (file) {
+        char line[INVENTORY_MAX_PATH + 64];
+        while (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\n")] = '\0';
+            unsigned flags, permissions;
+            unsigned long long size;
+            int offset = 0;
+            if (line[0] == 'D' && line[1] == ' ') {
+                append_record(line + 2, INVENTORY_FLAG_DELETED, 0, 0);
+            } else if (line[0] == 'M' && line[1] == ' ') {
+                append_record(line + 2, JOURNAL_FLAG_MOVED, 0, 0);
+            } else if (sscanf(line, "C %u %llu %o %n", &flags, &size, &permissions, &offset) == 3 && offset > 0) {
+                append_record(line + offset, flags, size, permissions);
+            }
+        }
+        fclose(file);
+    }
+
+    journal_file = fopen(journal_path, "a");
+    pthread_mutex_unlock(&journal_mutex);
+
+    if (!journal_file) {
+        perror("fopen journal");
+        return ERR_IO_ERROR;
+    }
+    printf("Inventory generation %llu, %u journaled changes\n", (unsigned long long)generation, record_count);
+    return ERR_SUCCESS;
+}
+
+void journal_cleanup() {
+    pthread_mutex_lock(&journal_mutex);
+    if (journal_file) fclose(journal_file);
+    journal_file = NULL;
+    for (uint32_t i = 0; i < record_count; i++) free(records[i].path);
+    free(records);
+    records = NULL;
+    record_count = 0;
+    record_capacity = 0;
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+static void journal_record(const char *path, uint8_t flags, uint64_t size, uint32_t permissions) {
+    path = strip_slashes(path);
+    if (path[0] == '\0' || strlen(path) >= INVENTORY_MAX_PATH) return;
+
+    pthread_mutex_lock(&journal_mutex);
+    if (append_record(path, flags, size, permissions) == ERR_SUCCESS && journal_file) {
+        write_record(journal_file, &records[record_count - 1]);
+        fflush(journal_file);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+void journal_record_create(const char *path, uint8_t flags, uint64_t size, uint32_t permissions) {
+    journal_record(path, flags & ~INVENTORY_FLAG_DELETED, size, permissions);
+}
+
+void journal_record_delete(const char *path) {
+    journal_record(path, INVENTORY_FLAG_DELETED, 0, 0);
+}
+
+void journal_record_move(const char *path) {
+    journal_record(path, JOURNAL_FLAG_MOVED, 0, 0);
+}
+
+ErrorCode journal_snapshot(JournalRecord **records_out, uint32_t *count_out, uint64_t *generation_out, int *full_out) {
+    pthread_mutex_lock(&journal_mutex);
+
+    JournalRecord *copy = NULL;
+    if (record_count > 0) {
+        copy = calloc(record_count, sizeof(JournalRecord));
+        if (!copy) {
+            pthread_mutex_unlock(&journal_mutex);
+            return ERR_INTERNAL_ERROR;
+        }
+    }
+    int full = 0;
+    for (uint32_t i = 0; i < record_count; i++) {
+        if (records[i].flags & JOURNAL_FLAG_MOVED) full = 1;
+        copy[i] = records[i];
+        copy[i].path = strdup(records[i].path);
+        if (!copy[i].path) {
+            journal_free_snapshot(copy, i);
+            pthread_mutex_unlock(&journal_mutex);
+            return ERR_INTERNAL_ERROR;
+        }
+    }
+
+    *records_out = copy;
+    *count_out = record_count;
+    *generation_out = generation;
+    *full_out = full;
+    pthread_mutex_unlock(&journal_mutex);
+    return ERR_SUCCESS;
+}
+
+void journal_free_snapshot(JournalRecord *snapshot, uint32_t count) {
+    if (!snapshot) return;
+    for (uint32_t i = 0; i < count; i++) free(snapshot[i].path);
+    free(snapshot);
+}
+
+ErrorCode journal_commit(uint64_t new_generation, uint32_t count) {
+    pthread_mutex_lock(&journal_mutex);
+
+    // Persist the generation first: replaying already applied changes on
+    // top of it is harmless, losing the generation forces a full sync
+    char tmp_path[520];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", generation_path);
+    FILE *file = fopen(tmp_path, "w");
+    if (!file || fprintf(file, "%llu\n", (unsigned long long)new_generation) < 0 ||
+        fclose(file) != 0 || rename(tmp_path, generation_path) != 0) {
+        perror("persist generation");
+        pthread_mutex_unlock(&journal_mutex);
+        return ERR_IO_ERROR;
+    }
+    generation = new_generation;
+
+    // Keep only the changes made after the snapshot that was acknowledged
+    if (count > record_count) count = record_count;
+    for (uint32_t i = 0; i < count; i++) free(records[i].path);
+    memmove(records, records + count, (record_count - count) * sizeof(JournalRecord));
+    record_count -= count;
+
+    if (journal_file) fclose(journal_file);
+    journal_file = fopen(journal_path, "w");
+    if (journal_file) {
+        for (uint32_t i = 0; i < record_count; i++) write_record(journal_file, &records[i]);
+        fflush(journal_file);
+    }
+
+    pthread_mutex_unlock(&journal_mutex);
+    return journal_file ? ERR_SUCCESS : ERR_IO_ERROR;
+}
@@ -4,9 +4,16 @@
 #include "protocol.h"
 #include "network.h"
 #include "heartbeat.h"
+#include "inventory.h"
+#include "journal.h"
+#include "telemetry.h"
+#include "commands.h"
+#include "shard.h"
+#include "request_log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <string.h>
 #include <getopt.h>
@@ -15,6 +22,7 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #define MAX_BUFFER_SIZE 4096
 
@@ -41,43 +49,62 @@ static void print_usage(const char *prog) {
             "  -N, --ns-port PORT          Naming server port\n"
             "  -d, --data-dir DIR          Data directory path\n"
             "  -b, --backup HOST:PORT      Backup server (can be specified multiple times)\n"
+            "  -m, --mount PREFIX          Delegate PREFIX (\"/\" for all) instead of registering every file\n"
+            "  -l, --log FILE              Binary request log (default: storage_server_PORT.log)\n"
             "  -h, --help                  Show this help\n", prog);
 }
 
 // Helper to send error response
 static void send_error_response(NetworkSocket *sock, ErrorCode code) {
-    MessageHeader response = {.type = MSG_TYPE_ERROR};
+    struct {
+        MessageHeader header;
+        uint32_t code;
+    } __attribute__((packed)) response;
+    memset(&response, 0, sizeof(response));
+    response.header.type = MSG_TYPE_ERROR;
+    response.header.payload_size = htonl(sizeof(response.code));
+    response.code = htonl((uint32_t)code);
     network_socket_send(sock, &response, sizeof(response));
-    network_socket_send(sock, &code, sizeof(code));
 }
 
 // Stream callback for forwarding data to client
+// Journal a file this server just created so the next registration can
+// send it as a delta
+static void journal_new_file(const char *rel_path, const char *full_path) {
+    struct stat st;
+    if (stat(full_path, &st) == 0) {
+        journal_record_create(rel_path, 0, (uint64_t)st.st_size, st.st_mode & 0777);
+    }
+}
+
 static void stream_to_client(const uint8_t *data, size_t length, void *user_data) {
     NetworkSocket *sock = (NetworkSocket *)user_data;
     network_socket_send(sock, data, length);
 }
 
-static void handle_client_request(NetworkSocket *sock) {
+// What becomes of a connection once a request on it has been served
+typedef enum {
+    CONNECTION_KEEP,        // Answered in full; the next request may follow
+    CONNECTION_CLOSE,       // Out of step with the peer or done; close it
+    CONNECTION_HANDED_OFF   // Owned by another thread now; leave it alone
+} ConnectionState;
+
+// Serve one request and report whether the connection can serve another
+static ConnectionState handle_client_request(NetworkSocket *sock) {
     MessageHeader header;
     ssize_t received = network_socket_receive(sock, &header, sizeof(header));
-    if (received != sizeof(header)) return;
-
-    printf("Received message type: %d\n", header.type);
+    if (received != sizeof(header)) return CONNECTION_CLOSE;
 
     switch (header.type) {
         case MSG_TYPE_READ: {
             ReadRequest request;
-            printf("Size of request: %ld\n", sizeof(request)); //!debug
             received = network_socket_receive(sock, &request, sizeof(request));
             if (received != sizeof(request)) {
                 printf("Failed to receive complete ReadRequest. Received: %ld bytes\n", received);
-                break;
+                return CONNECTION_CLOSE;
             }
             request.length = ntohl(request.length);
-            request.offset = ntohl(request.offset);
-            printf("ReadRequest - Filepath: %s, Offset: %lu, Length: %zu\n", 
-                   request.filepath, request.offset, request.length);
-
+            request.offset = network_ntoh64(request.offset);
 
             uint8_t buffer[MAX_BUFFER_SIZE];
             size_t bytes_read;
@@ -87,15 +114,14 @@ static void handle_client_request(NetworkSocket *sock) {
             
             // Update the storage_read function call with the full filepath
             ErrorCode result = storage_read(full_filepath, request.offset, buffer, request.length, &bytes_read);
-            printf("storage_read result: %d, bytes_read: %zu\n", result, bytes_read);
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_READ, header.request_id, request.filepath, result,
+                        result == ERR_SUCCESS ? bytes_read : 0);
 
             if (result == ERR_SUCCESS) {
-                MessageHeader response = {.type = MSG_TYPE_READ};
+                MessageHeader response = {.type = MSG_TYPE_READ, .payload_size = htonl(bytes_read)};
                 network_socket_send(sock, &response, sizeof(response));
                 network_socket_send(sock, buffer, bytes_read);
-                printf("Read response sent successfully\n");
             } else {
-                printf("Read error occurred: %d\n", result);
                 send_error_response(sock, result);
             }
             break;
@@ -107,42 +133,43 @@ static void handle_client_request(NetworkSocket *sock) {
             received = network_socket_receive(sock, &request, sizeof(request));
             if (received != sizeof(request)) {
                 printf("Failed to receive complete WriteRequest. Received: %ld bytes\n", received);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             request.length = ntohl(request.length);
             request.offset = ntohl(request.offset);
+            request.filepath[sizeof(request.filepath) - 1] = '\0';
             
             uint8_t *buffer = malloc(request.length);
             if (!buffer) {
                 printf("Failed to allocate write buffer\n");
                 send_error_response(sock, ERR_INTERNAL_ERROR);
-                break;
+                return CONNECTION_CLOSE;
             }
 
-            printf("debug\n");
-
             received = network_socket_receive(sock, buffer, request.length);
             if (received != request.length) {
                 printf("Failed to receive write data. Expected: %u, Received: %ld\n", request.length, received);
                 free(buffer);
                 send_error_response(sock, ERR_NETWORK_FAILURE);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             // Prepend server_data_dir
             char full_filepath[256];
             snprintf(full_filepath, sizeof(full_filepath), "%s/%s", server_data_dir, request.filepath);
 
+            int existed = access(full_filepath, F_OK) == 0;
             ErrorCode result = storage_write(full_filepath, request.offset, buffer, request.length);
-            printf("storage_write result: %d\n", result);
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_WRITE, header.request_id, request.filepath, result,
+                        request.length);
 
             if (result == ERR_SUCCESS) {
+                if (!existed) journal_new_file(request.filepath, full_filepath);
+                commands_file_written(request.filepath);
                 MessageHeader response = {.type = MSG_TYPE_WRITE};
                 network_socket_send(sock, &response, sizeof(response));
-                printf("Write response sent successfully\n");
             } else {
-                printf("Write error occurred: %d\n", result);
                 send_error_response(sock, result);
             }
 
@@ -156,7 +183,7 @@ static void handle_client_request(NetworkSocket *sock) {
             if (received != sizeof(request)) {
                 printf("Failed to receive complete StreamRequest\n");
                 send_error_response(sock, ERR_PROTOCOL_ERROR);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             // Construct full filepath
@@ -180,11 +207,12 @@ static void handle_client_request(NetworkSocket *sock) {
 
             // Start streaming
             ErrorCode result = storage_stream(full_filepath, stream_to_client, sock);
-            
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_STREAM, header.request_id, request.filepath, result, 0);
             if (result != ERR_SUCCESS) {
                 send_error_response(sock, result);
             }
-            break;
+            // The client reads a stream until the connection closes
+            return CONNECTION_CLOSE;
         }
 
         case MSG_TYPE_REPLICATE_WRITE: {
@@ -192,31 +220,36 @@ static void handle_client_request(NetworkSocket *sock) {
             received = network_socket_receive(sock, &request, sizeof(request));
             if (received != sizeof(request)) {
                 printf("Failed to receive complete Replicate WriteRequest. Received: %ld bytes\n", received);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             request.length = ntohl(request.length);
             request.offset = ntohl(request.offset);
+            request.filepath[sizeof(request.filepath) - 1] = '\0';
 
             uint8_t *buffer = malloc(request.length);
             if (!buffer) {
                 printf("Failed to allocate replicate write buffer\n");
-                break;
+                return CONNECTION_CLOSE;
             }
 
             received = network_socket_receive(sock, buffer, request.length);
             if (received != request.length) {
                 printf("Failed to receive replicate write data. Expected: %u, Received: %ld\n", request.length, received);
                 free(buffer);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             // Prepend server_data_dir
             char full_filepath[256];
             snprintf(full_filepath, sizeof(full_filepath), "%s/%s", server_data_dir, request.filepath);
 
+            int existed = access(full_filepath, F_OK) == 0;
             ErrorCode result = storage_write(full_filepath, request.offset, buffer, request.length);
-            printf("Replicate storage_write result: %d\n", result);
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_REPLICATE_WRITE, header.request_id, request.filepath, result,
+                        request.length);
+            if (result == ERR_SUCCESS && !existed) journal_new_file(request.filepath, full_filepath);
+            if (result == ERR_SUCCESS) commands_file_written(request.filepath);
 
             free(buffer);
             break;
@@ -227,7 +260,7 @@ static void handle_client_request(NetworkSocket *sock) {
             received = network_socket_receive(sock, &request, sizeof(request));
             if (received != sizeof(request)) {
                 printf("Failed to receive complete Replicate DeleteRequest. Received: %ld bytes\n", received);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             // Prepend server_data_dir
@@ -235,10 +268,9 @@ static void handle_client_request(NetworkSocket *sock) {
             snprintf(full_filepath, sizeof(full_filepath), "%s/%s", server_data_dir, request.filepath);
 
             ErrorCode result = storage_delete_file(full_filepath);
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_REPLICATE_DELETE, header.request_id, request.filepath, result, 0);
             if (result == ERR_SUCCESS) {
-                printf("Replicated delete successful for file: %s\n", full_filepath);
-            } else {
-                printf("Replicated delete failed for file: %s with error code: %d\n", full_filepath, result);
+                journal_record_delete(request.filepath);
             }
             break;
         }
@@ -248,7 +280,7 @@ static void handle_client_request(NetworkSocket *sock) {
             received = network_socket_receive(sock, &request, sizeof(request));
             if (received != sizeof(request)) {
                 printf("Failed to receive complete DeleteRequest. Received: %ld bytes\n", received);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             // Prepend server_data_dir
@@ -256,12 +288,12 @@ static void handle_client_request(NetworkSocket *sock) {
             snprintf(full_filepath, sizeof(full_filepath), "%s/%s", server_data_dir, request.filepath);
 
             ErrorCode result = storage_delete_file(full_filepath);
+            REQUEST_LOG(REQUEST_LOG_INFO, REQUEST_EVENT_DELETE, header.request_id, request.filepath, result, 0);
             if (result == ERR_SUCCESS) {
+                journal_record_delete(request.filepath);
                 MessageHeader response = {.type = MSG_TYPE_DELETE};
                 network_socket_send(sock, &response, sizeof(response));
-                printf("Delete response sent successfully\n");
             } else {
-                printf("Delete error occurred: %d\n", result);
                 send_error_response(sock, result);
             }
             break;
@@ -272,7 +304,7 @@ static void handle_client_request(NetworkSocket *sock) {
             ssize_t received = network_socket_receive(sock, &request, sizeof(request));
             if (received != sizeof(request)) {
                 send_error_response(sock, ERR_PROTOCOL_ERROR);
-                break;
+                return CONNECTION_CLOSE;
             }
 
             char filepath[512];
@@ -294,7 +326,7 @@ static void handle_client_request(NetworkSocket *sock) {
             };
 
             GetFileInfoResponse response;
-            response.file_size = htonl(file_size);
+            response.file_size = network_hton64(file_size);
             response.permissions = htonl(permissions);
 
             network_socket_send(sock, &response_header, sizeof(response_header));
@@ -302,135 +334,416 @@ static void handle_client_request(NetworkSocket *sock) {
             break;
         }
 
+        case MSG_TYPE_SS_COMMAND_BATCH:
+            // The naming server keeps this connection for all its commands
+            return commands_serve(sock, &header) == ERR_SUCCESS ? CONNECTION_HANDED_OFF : CONNECTION_CLOSE;
+
+        case MSG_TYPE_FETCH_RANGE:
+            // A peer copying from us keeps this connection for its ranges
+            return commands_serve_ranges(sock, &header) == ERR_SUCCESS ? CONNECTION_HANDED_OFF : CONNECTION_CLOSE;
+
         default:
-            // Unknown message type
+            // Unknown message type; its body cannot be skipped
             send_error_response(sock, ERR_PROTOCOL_ERROR);
-            break;
+            return CONNECTION_CLOSE;
     }
+    return CONNECTION_KEEP;
 }
 
-static ErrorCode register_with_naming_server(const char *host, const char *port, const char *data_dir, uint16_t client_port) {
-    printf("Attempting to register with naming server...\n");
-
-    ns_sock = network_socket_create(host, port);
-    if (!ns_sock){
-        fprintf(stderr, "Failed to connect to Naming Server at %s:%s\n", host, port);
-        return ERR_NETWORK_FAILURE;
+// Serve requests on one client connection until it closes or falls out of
+// step. Connections stay open so the naming server can pool them.
+static void *serve_connection(void *arg) {
+    NetworkSocket *conn = (NetworkSocket *)arg;
+    char peer_ip[INET_ADDRSTRLEN] = "Unknown";
+    uint16_t peer_port = 0;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(network_socket_get_fd(conn), (struct sockaddr *)&addr, &addr_len) == 0) {
+        inet_ntop(AF_INET, &addr.sin_addr, peer_ip, INET_ADDRSTRLEN);
+        peer_port = ntohs(addr.sin_port);
     }
+    request_log_set_peer(peer_ip, peer_port);
+
+    ConnectionState state;
+    do {
+        state = handle_client_request(conn);
+    } while (state == CONNECTION_KEEP && running);
+    if (state != CONNECTION_HANDED_OFF) network_socket_close(conn);
+    return NULL;
+}
 
-    printf("Connected to naming server, scanning directory %s...\n", data_dir);
+// One path found while scanning the data directory
+typedef struct {
+    char *path;
+    uint8_t flags;
+    uint64_t size;
+    uint32_t permissions;
+} InventoryItem;
+
+typedef struct {
+    InventoryItem *items;
+    size_t count;
+    size_t capacity;
+} InventoryList;
+
+static int inventory_item_compare(const void *a, const void *b) {
+    return inventory_path_compare(((const InventoryItem *)a)->path, ((const InventoryItem *)b)->path);
+}
+
+// Recursively collect the paths below data_dir/rel, skipping hidden entries
+static ErrorCode scan_data_dir(const char *data_dir, const char *rel, InventoryList *list) {
+    char dir_path[512];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", data_dir, rel);
 
-    // Prepare the list of accessible paths
-    DIR *dir = opendir(data_dir);
+    DIR *dir = opendir(dir_path);
     if (!dir) {
         perror("opendir");
-        network_socket_close(ns_sock);
-        return ERR_INTERNAL_ERROR;
+        return ERR_IO_ERROR;
     }
 
-    char **paths = NULL;
-    uint32_t num_paths = 0;
+    ErrorCode err = ERR_SUCCESS;
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
         if (entry->d_name[0] == '.')
             continue; // Skip hidden files
-        printf("Found file: %s\n", entry->d_name); //!debug
 
-        if (strlen(entry->d_name) > 255) {
-            fprintf(stderr, "Path too long: %s\n", entry->d_name);
+        char rel_path[INVENTORY_MAX_PATH];
+        int len = snprintf(rel_path, sizeof(rel_path), "%s%s%s", rel, rel[0] ? "/" : "", entry->d_name);
+        if (len < 0 || len >= (int)sizeof(rel_path)) {
+            fprintf(stderr, "Path too long: %s/%s\n", rel, entry->d_name);
             continue;
         }
 
-        paths = realloc(paths, (num_paths + 1) * sizeof(char *));
-        if (!paths) {
-            fprintf(stderr, "Memory allocation failed\n");
-            closedir(dir);
-            network_socket_close(ns_sock);
-            return ERR_INTERNAL_ERROR;
+        char full_path[768];
+        snprintf(full_path, sizeof(full_path), "%s/%s", data_dir, rel_path);
+        struct stat st;
+        if (lstat(full_path, &st) != 0 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)))
+            continue;
+
+        if (list->count == list->capacity) {
+            size_t new_capacity = list->capacity ? list->capacity * 2 : 64;
+            InventoryItem *new_items = realloc(list->items, new_capacity * sizeof(InventoryItem));
+            if (!new_items) {
+                err = ERR_INTERNAL_ERROR;
+                break;
+            }
+            list->items = new_items;
+            list->capacity = new_capacity;
         }
-        
-        paths[num_paths] = strdup(entry->d_name);
-        if (!paths[num_paths]) {
-            fprintf(stderr, "String duplication failed\n");
-            closedir(dir);
-            network_socket_close(ns_sock);
-            return ERR_INTERNAL_ERROR;
+
+        InventoryItem *item = &list->items[list->count];
+        item->path = strdup(rel_path);
+        if (!item->path) {
+            err = ERR_INTERNAL_ERROR;
+            break;
+        }
+        item->flags = S_ISDIR(st.st_mode) ? INVENTORY_FLAG_DIRECTORY : 0;
+        item->size = S_ISDIR(st.st_mode) ? 0 : (uint64_t)st.st_size;
+        item->permissions = st.st_mode & 0777;
+        list->count++;
+
+        if (S_ISDIR(st.st_mode)) {
+            err = scan_data_dir(data_dir, rel_path, list);
+            if (err != ERR_SUCCESS) break;
         }
-        num_paths++;
     }
     closedir(dir);
+    return err;
+}
 
-    printf("Found %d files to register\n", num_paths);
+// Build the sorted, front-coded inventory blob of data_dir
+static ErrorCode build_inventory(const char *data_dir, uint16_t client_port, uint64_t generation,
+                                 uint8_t **blob, size_t *blob_size, uint32_t *num_paths) {
+    InventoryList list = {0};
+    ErrorCode err = scan_data_dir(data_dir, "", &list);
 
-    // Initialize request_id (use a static variable)
-    static uint32_t request_id_counter = 1;
-    uint32_t request_id = request_id_counter++;
-
-    // Send registration message header
-    printf("Sending header to naming server...\n"); //!debug
-    MessageHeader header = {request_id, MSG_TYPE_SS_REGISTER, sizeof(SSRegisterMessage)};
-    if (network_socket_send(ns_sock, &header, sizeof(header)) != sizeof(header)) {
-        fprintf(stderr, "Failed to send header to Naming Server\n");
-        network_socket_close(ns_sock);
-        return ERR_NETWORK_FAILURE;
+    InventoryWriter writer;
+    if (err == ERR_SUCCESS) {
+        err = inventory_writer_init(&writer, client_port, 0, generation);
+    }
+    if (err == ERR_SUCCESS) {
+        qsort(list.items, list.count, sizeof(InventoryItem), inventory_item_compare);
+        for (size_t i = 0; i < list.count && err == ERR_SUCCESS; i++) {
+            err = inventory_writer_add(&writer, list.items[i].path, list.items[i].flags,
+                                       list.items[i].size, list.items[i].permissions);
+        }
+        if (err == ERR_SUCCESS) {
+            *num_paths = writer.count;
+            err = inventory_writer_finish(&writer, blob, blob_size);
+        }
+        inventory_writer_free(&writer);
     }
 
-    // Send registration message
-    printf("Sending registration message...\n"); //!debug
-    SSRegisterMessage reg_msg = {htons(client_port), htonl(num_paths)};
-    if (network_socket_send(ns_sock, &reg_msg, sizeof(reg_msg)) != sizeof(reg_msg)) {
-        fprintf(stderr, "Failed to send registration message to Naming Server\n");
-        network_socket_close(ns_sock);
-        return -1;
+    for (size_t i = 0; i < list.count; i++) free(list.items[i].path);
+    free(list.items);
+    return err;
+}
+
+// Journal record tagged with its position, so sorting keeps the latest
+// change of each path last
+typedef struct {
+    JournalRecord *record;
+    uint32_t seq;
+} DeltaItem;
+
+static int delta_item_compare(const void *a, const void *b) {
+    const DeltaItem *x = a, *y = b;
+    int cmp = inventory_path_compare(x->record->path, y->record->path);
+    if (cmp != 0) return cmp;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// Build a delta blob holding the latest journaled change of each path
+static ErrorCode build_delta(JournalRecord *records, uint32_t count, uint16_t client_port, uint64_t base_generation,
+                             uint8_t **blob, size_t *blob_size, uint32_t *num_paths) {
+    DeltaItem *items = malloc((count ? count : 1) * sizeof(DeltaItem));
+    if (!items) return ERR_INTERNAL_ERROR;
+    for (uint32_t i = 0; i < count; i++) {
+        items[i].record = &records[i];
+        items[i].seq = i;
+    }
+    qsort(items, count, sizeof(DeltaItem), delta_item_compare);
+
+    InventoryWriter writer;
+    ErrorCode err = inventory_writer_init(&writer, client_port, base_generation, base_generation + 1);
+    for (uint32_t i = 0; i < count && err == ERR_SUCCESS; i++) {
+        if (i + 1 < count && strcmp(items[i].record->path, items[i + 1].record->path) == 0)
+            continue; // Superseded by a later change
+        JournalRecord *record = items[i].record;
+        err = inventory_writer_add(&writer, record->path, record->flags, record->size, record->permissions);
     }
+    if (err == ERR_SUCCESS) {
+        *num_paths = writer.count;
+        err = inventory_writer_finish(&writer, blob, blob_size);
+    }
+    inventory_writer_free(&writer);
+    free(items);
+    return err;
+}
 
-    // Send the paths
-    printf("Sending %d paths...\n", num_paths); //!debug
-    for (uint32_t i = 0; i < num_paths; i++) {
-        uint32_t path_len = htonl(strlen(paths[i]) + 1);
-        printf("Sending path %d: %s (len=%d)\n", i, paths[i], ntohl(path_len)); //!debug
+// Send one registration blob and wait for the reply type
+static ErrorCode send_registration(MessageType type, const uint8_t *blob, size_t blob_size, MessageType *reply) {
+    static uint32_t request_id_counter = 1;
+    uint32_t request_id = request_id_counter++;
 
-        if (network_socket_send(ns_sock, &path_len, sizeof(path_len)) != sizeof(path_len)) {
-            fprintf(stderr, "Failed to send path length\n");
-            network_socket_close(ns_sock);
-            return -1;
-        }
-        if (network_socket_send(ns_sock, paths[i], strlen(paths[i]) + 1) != strlen(paths[i]) + 1) {
-            fprintf(stderr, "Failed to send path\n");
-            network_socket_close(ns_sock);
-            return -1;
-        }
-        free(paths[i]);
+    // Send the whole inventory as one framed payload
+    MessageHeader header = {request_id, type, htonl(blob_size)};
+    if (network_socket_send(ns_sock, &header, sizeof(header)) != sizeof(header) ||
+        network_socket_send(ns_sock, blob, blob_size) != (ssize_t)blob_size) {
+        fprintf(stderr, "Failed to send inventory to Naming Server\n");
+        return ERR_NETWORK_FAILURE;
     }
-    free(paths);
 
     // Receive acknowledgment
-    printf("Waiting for acknowledgment...\n"); //!debug
     MessageHeader ack_header;
     int rec = network_socket_receive(ns_sock, &ack_header, sizeof(ack_header));
     if (rec != sizeof(ack_header)) {
         fprintf(stderr, "Failed to receive acknowledgment\n");
-        printf("Size of ack_header: %ld\n", sizeof(ack_header)); //!debug
-        printf("Size of received: %ld\n", rec); //!debug
-        network_socket_close(ns_sock);
-        return -1;
+        return ERR_NETWORK_FAILURE;
     }
-    if (ack_header.request_id != request_id || ack_header.type != MSG_TYPE_SS_REGISTER_ACK) {
+    if (ack_header.request_id != request_id ||
+        (ack_header.type != MSG_TYPE_SS_REGISTER_ACK && ack_header.type != MSG_TYPE_SS_REGISTER_RESYNC)) {
         fprintf(stderr, "Invalid acknowledgment from Naming Server\n");
-        network_socket_close(ns_sock);
-        return -1;
+        return ERR_PROTOCOL_ERROR;
     }
+    *reply = ack_header.type;
+    return ERR_SUCCESS;
+}
 
-    printf("Successfully registered with Naming Server\n");
-    network_socket_close(ns_sock);
+// Hand the whole subtree at prefix to this server without listing it; the
+// naming server discovers files on first access
+static ErrorCode delegate_to_naming_server(const char *prefix, uint16_t client_port) {
+    DelegationRequest request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.prefix, prefix, sizeof(request.prefix) - 1);
+    request.client_port = htons(client_port);
+
+    MessageHeader header = {1, MSG_TYPE_SS_REGISTER_PREFIX, htonl(sizeof(request))};
+    if (network_socket_send(ns_sock, &header, sizeof(header)) != sizeof(header) ||
+        network_socket_send(ns_sock, &request, sizeof(request)) != sizeof(request)) {
+        fprintf(stderr, "Failed to send delegation to Naming Server\n");
+        return ERR_NETWORK_FAILURE;
+    }
+
+    MessageHeader ack_header;
+    if (network_socket_receive(ns_sock, &ack_header, sizeof(ack_header)) != sizeof(ack_header)) {
+        fprintf(stderr, "Failed to receive acknowledgment\n");
+        return ERR_NETWORK_FAILURE;
+    }
+    if (ack_header.type != MSG_TYPE_SS_REGISTER_ACK) {
+        fprintf(stderr, "Naming Server refused delegation of %s\n", prefix);
+        return ERR_PROTOCOL_ERROR;
+    }
+
+    printf("Delegated %s to this server\n", prefix);
+    return ERR_SUCCESS;
+}
+
+// Learn which naming servers share the namespace from the configured one.
+// An unsharded naming server is the only one to register with.
+static ErrorCode fetch_shard_map(const char *host, const char *port, ShardAddress *shards, uint32_t *count) {
+    NetworkSocket *sock = network_socket_create(host, port);
+    if (!sock) {
+        fprintf(stderr, "Failed to connect to Naming Server at %s:%s\n", host, port);
+        return ERR_NETWORK_FAILURE;
+    }
+    ErrorCode err = shard_fetch_map(sock, 1, shards, MAX_SHARDS, count, NULL);
+    network_socket_close(sock);
+    if (err != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to fetch shard map from Naming Server at %s:%s\n", host, port);
+        return err;
+    }
+
+    if (*count == 0) {
+        memset(&shards[0], 0, sizeof(shards[0]));
+        strncpy(shards[0].host, host, sizeof(shards[0].host) - 1);
+        strncpy(shards[0].port, port, sizeof(shards[0].port) - 1);
+        *count = 1;
+    } else {
+        printf("Namespace is split across %u naming servers\n", *count);
+    }
     return ERR_SUCCESS;
 }
 
+// Ask each shard for its partner. Only a primary takes registrations, so a
+// shard address naming a standby is swapped for its primary; standbys are
+// collected in standbys to get heartbeats of their own.
+static void find_standbys(ShardAddress *shards, uint32_t count, ShardAddress *standbys, uint32_t *standby_count) {
+    *standby_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        NetworkSocket *sock = network_socket_create(shards[i].host, shards[i].port);
+        if (!sock) continue;
+        ShardAddress listed[MAX_SHARDS];
+        uint32_t listed_count;
+        ShardPeer peer;
+        ErrorCode err = shard_fetch_map(sock, 1, listed, MAX_SHARDS, &listed_count, &peer);
+        network_socket_close(sock);
+        if (err != ERR_SUCCESS || peer.peer.host[0] == '\0') continue;
+
+        if (peer.standby) {
+            printf("Naming server %s:%s is a standby of %s:%s\n", shards[i].host, shards[i].port,
+                   peer.peer.host, peer.peer.port);
+            standbys[(*standby_count)++] = shards[i];
+            shards[i] = peer.peer;
+        } else {
+            printf("Naming server %s:%s has standby %s:%s\n", shards[i].host, shards[i].port,
+                   peer.peer.host, peer.peer.port);
+            standbys[(*standby_count)++] = peer.peer;
+        }
+    }
+}
+
+// Register with one naming server: the delta since generation if there was
+// a previous registration, and the full inventory if it asks for one. The
+// full inventory is built on first use and kept in *full for the next shard.
+static ErrorCode register_with_shard(const ShardAddress *shard, const char *data_dir, uint16_t client_port,
+                                     const uint8_t *delta, size_t delta_size, uint64_t generation,
+                                     uint8_t **full, size_t *full_size) {
+    printf("Attempting to register with naming server %s:%s...\n", shard->host, shard->port);
+
+    ns_sock = network_socket_create(shard->host, shard->port);
+    if (!ns_sock){
+        fprintf(stderr, "Failed to connect to Naming Server at %s:%s\n", shard->host, shard->port);
+        return ERR_NETWORK_FAILURE;
+    }
+
+    ErrorCode err = ERR_SUCCESS;
+    MessageType reply = MSG_TYPE_SS_REGISTER_RESYNC;
+
+    // After a previous registration only the changes since then are sent
+    if (delta) {
+        err = send_registration(MSG_TYPE_SS_REGISTER_DELTA, delta, delta_size, &reply);
+    }
+
+    // First registration, or the naming server lost track of our generation
+    if (err == ERR_SUCCESS && reply == MSG_TYPE_SS_REGISTER_RESYNC) {
+        if (!*full) {
+            uint32_t num_paths = 0;
+            printf("Scanning directory %s for full registration...\n", data_dir);
+            err = build_inventory(data_dir, client_port, generation + 1, full, full_size, &num_paths);
+            if (err != ERR_SUCCESS) {
+                fprintf(stderr, "Failed to build inventory of %s\n", data_dir);
+            } else {
+                printf("Found %u paths to register (%zu byte inventory)\n", num_paths, *full_size);
+            }
+        }
+        if (err == ERR_SUCCESS) {
+            err = send_registration(MSG_TYPE_SS_REGISTER_BULK, *full, *full_size, &reply);
+            if (err == ERR_SUCCESS && reply != MSG_TYPE_SS_REGISTER_ACK) err = ERR_PROTOCOL_ERROR;
+        }
+    }
+
+    network_socket_close(ns_sock);
+    ns_sock = NULL;
+    return err;
+}
+
+// Register with every naming server sharing the namespace. Each keeps only
+// the paths of its own shard. The journal moves on to the next generation
+// only once all of them hold it.
+static ErrorCode register_with_naming_servers(const ShardAddress *shards, uint32_t shard_count, const char *data_dir,
+                                              uint16_t client_port, const char *mount_prefix) {
+    JournalRecord *records = NULL;
+    uint32_t record_count = 0;
+    uint64_t generation = 0;
+    int full_needed = 0;
+    ErrorCode err = journal_snapshot(&records, &record_count, &generation, &full_needed);
+
+    if (err == ERR_SUCCESS && mount_prefix) {
+        // Nothing is listed, so the journal has nothing to report either
+        for (uint32_t i = 0; i < shard_count && err == ERR_SUCCESS; i++) {
+            ns_sock = network_socket_create(shards[i].host, shards[i].port);
+            if (!ns_sock) {
+                fprintf(stderr, "Failed to connect to Naming Server at %s:%s\n", shards[i].host, shards[i].port);
+                err = ERR_NETWORK_FAILURE;
+                break;
+            }
+            err = delegate_to_naming_server(mount_prefix, client_port);
+            network_socket_close(ns_sock);
+            ns_sock = NULL;
+        }
+        if (err == ERR_SUCCESS) err = journal_commit(generation, record_count);
+        journal_free_snapshot(records, record_count);
+        return err;
+    }
+
+    uint8_t *delta = NULL;
+    size_t delta_size = 0;
+    // A rename moved files the journal does not list, so only a full
+    // inventory can report it
+    if (err == ERR_SUCCESS && generation > 0 && !full_needed) {
+        uint32_t num_paths = 0;
+        err = build_delta(records, record_count, client_port, generation, &delta, &delta_size, &num_paths);
+        if (err == ERR_SUCCESS) {
+            printf("Sending %u changed paths since generation %llu (%zu byte delta)\n",
+                   num_paths, (unsigned long long)generation, delta_size);
+        }
+    }
+
+    uint8_t *full = NULL;
+    size_t full_size = 0;
+    for (uint32_t i = 0; i < shard_count && err == ERR_SUCCESS; i++) {
+        err = register_with_shard(&shards[i], data_dir, client_port, delta, delta_size, generation, &full, &full_size);
+    }
+    free(delta);
+    free(full);
+
+    if (err == ERR_SUCCESS) {
+        err = journal_commit(generation + 1, record_count);
+        printf("Successfully registered with Naming Server (generation %llu)\n", (unsigned long long)generation + 1);
+    }
+
+    journal_free_snapshot(records, record_count);
+    return err;
+}
+
 int main(int argc, char *argv[]) {
     char *port = NULL;
     char *ns_host = NULL;
     char *ns_port = NULL;
     char *data_dir = NULL;
+    char *mount_prefix = NULL;
+    char *log_path = NULL;
     char *backup_servers[10] = {NULL};
     int backup_count = 0;
 
@@ -440,12 +753,14 @@ int main(int argc, char *argv[]) {
         {"ns-port", required_argument, 0, 'N'},
         {"data-dir", required_argument, 0, 'd'},
         {"backup", required_argument, 0, 'b'},
+        {"mount", required_argument, 0, 'm'},
+        {"log", required_argument, 0, 'l'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "p:n:N:d:b:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:n:N:d:b:m:l:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'p':
                 port = optarg;
@@ -464,6 +779,12 @@ int main(int argc, char *argv[]) {
                     backup_servers[backup_count++] = optarg;
                 }
                 break;
+            case 'm':
+                mount_prefix = optarg;
+                break;
+            case 'l':
+                log_path = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -481,8 +802,17 @@ int main(int argc, char *argv[]) {
 
     server_data_dir = data_dir;
 
+    // Requests are still served if the log cannot be opened
+    char default_log_path[64];
+    if (!log_path) {
+        snprintf(default_log_path, sizeof(default_log_path), "storage_server_%s.log", port);
+        log_path = default_log_path;
+    }
+    request_log_init(log_path);
+
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN); // A dropped heartbeat channel must not kill us
 
     // Initialize storage system
     if (storage_init() != ERR_SUCCESS) {
@@ -508,14 +838,36 @@ int main(int argc, char *argv[]) {
         free(host);
     }
 
-    // Register with naming server
-    if (register_with_naming_server(ns_host, ns_port, data_dir, atoi(port)) != ERR_SUCCESS) {
+    if (journal_init(data_dir) != ERR_SUCCESS) {
+        fprintf(stderr, "Failed to open inventory journal in %s\n", data_dir);
+        replication_cleanup();
+        storage_cleanup();
+        return 1;
+    }
+    commands_init(data_dir);
+
+    // Register with every naming server
+    ShardAddress shards[MAX_SHARDS];
+    ShardAddress standbys[MAX_SHARDS];
+    uint32_t shard_count = 0;
+    uint32_t standby_count = 0;
+    if (fetch_shard_map(ns_host, ns_port, shards, &shard_count) == ERR_SUCCESS) {
+        find_standbys(shards, shard_count, standbys, &standby_count);
+    }
+    if (shard_count == 0 ||
+        register_with_naming_servers(shards, shard_count, data_dir, atoi(port), mount_prefix) != ERR_SUCCESS) {
         fprintf(stderr, "Failed to register with naming server\n");
         goto cleanup;
     }
 
-    // Start heartbeat thread
-    start_heartbeat(ns_host, ns_port, "localhost", port);
+    // Each naming server tracks our health on its own, standbys included so
+    // they take over with a live view
+    for (uint32_t i = 0; i < shard_count; i++) {
+        start_heartbeat(shards[i].host, shards[i].port, "localhost", port, data_dir);
+    }
+    for (uint32_t i = 0; i < standby_count; i++) {
+        start_heartbeat(standbys[i].host, standbys[i].port, "localhost", port, data_dir);
+    }
 
     // Create client socket
     client_sock = network_socket_create(NULL, port);
@@ -524,6 +876,8 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
 
+    telemetry_set_listen_fd(network_socket_get_fd(client_sock));
+
     printf("Storage server started on port %s\n", port);
     printf("Connected to naming server at %s:%s\n", ns_host, ns_port);
     printf("Using data directory: %s\n", data_dir);
@@ -540,8 +894,13 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "Accept failed\n");
             continue;
         }
-        handle_client_request(conn);
-        network_socket_close(conn);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_connection, conn) != 0) {
+            fprintf(stderr, "Failed to start connection thread\n");
+            network_socket_close(conn);
+            continue;
+        }
+        pthread_detach(thread);
     }
 
 cleanup:
@@ -549,9 +908,11 @@ cleanup:
     printf("Client socket closed\n");
     if (ns_sock) network_socket_close(ns_sock);
     printf("Naming server socket closed\n");
+    journal_cleanup();
     replication_cleanup();
     printf("Replication system shut down\n");
     storage_cleanup();
+    request_log_cleanup();
     printf("Storage server shut down cleanly\n");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+// src/storage_server/src/telemetry.c
+
+#include "telemetry.h"
+#include "storage.h"
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+
+static uint64_t read_latency_us = 0;       // EWMA
+static uint64_t write_latency_us = 0;      // EWMA
+static uint64_t bytes_in = 0;              // Totals since start
+static uint64_t bytes_out = 0;
+static uint32_t open_streams = 0;
+static int listen_fd = -1;
+
+// Previous totals, owned by the heartbeat thread
+static uint64_t last_bytes_in = 0;
+static uint64_t last_bytes_out = 0;
+static uint64_t last_sample_us = 0;
+
+uint64_t telemetry_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// avg += (sample - avg) / 2^shift, retried until no other thread raced us
+static void ewma_update(uint64_t *average, uint64_t sample) {
+    uint64_t old = __atomic_load_n(average, __ATOMIC_RELAXED);
+    uint64_t updated;
+    do {
+        if (old == 0) {
+            updated = sample; // First sample seeds the average
+        } else if (sample >= old) {
+            updated = old + ((sample - old) >> TELEMETRY_EWMA_SHIFT);
+        } else {
+            updated = old - ((old - sample) >> TELEMETRY_EWMA_SHIFT);
+        }
+    } while (!__atomic_compare_exchange_n(average, &old, updated, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void telemetry_record_read(uint64_t bytes, uint64_t latency_us) {
+    __atomic_add_fetch(&bytes_out, bytes, __ATOMIC_RELAXED);
+    ewma_update(&read_latency_us, latency_us);
+}
+
+void telemetry_record_write(uint64_t bytes, uint64_t latency_us) {
+    __atomic_add_fetch(&bytes_in, bytes, __ATOMIC_RELAXED);
+    ewma_update(&write_latency_us, latency_us);
+}
+
+void telemetry_add_bytes_out(uint64_t bytes) {
+    __atomic_add_fetch(&bytes_out, bytes, __ATOMIC_RELAXED);
+}
+
+void telemetry_stream_opened() {
+    __atomic_add_fetch(&open_streams, 1, __ATOMIC_RELAXED);
+}
+
+void telemetry_stream_closed() {
+    __atomic_sub_fetch(&open_streams, 1, __ATOMIC_RELAXED);
+}
+
+void telemetry_set_listen_fd(int fd) {
+    __atomic_store_n(&listen_fd, fd, __ATOMIC_RELAXED);
+}
+
+void telemetry_fill_heartbeat(HeartbeatMessage *hb, const char *data_dir) {
+    uint64_t now = telemetry_now_us();
+    uint64_t in = __atomic_load_n(&bytes_in, __ATOMIC_RELAXED);
+    uint64_t out = __atomic_load_n(&bytes_out, __ATOMIC_RELAXED);
+
+    if (last_sample_us != 0 && now > last_sample_us) {
+        uint64_t elapsed = now - last_sample_us;
+        hb->bytes_in_per_sec = (in - last_bytes_in) * 1000000 / elapsed;
+        hb->bytes_out_per_sec = (out - last_bytes_out) * 1000000 / elapsed;
+    }
+    last_sample_us = now;
+    last_bytes_in = in;
+    last_bytes_out = out;
+
+    hb->read_latency_us = (uint32_t)__atomic_load_n(&read_latency_us, __ATOMIC_RELAXED);
+    hb->write_latency_us = (uint32_t)__atomic_load_n(&write_latency_us, __ATOMIC_RELAXED);
+
+    // For a listening socket Linux reports the accept backlog as unacked
+    struct tcp_info info;
+    socklen_t info_len = sizeof(info);
+    int fd = __atomic_load_n(&listen_fd, __ATOMIC_RELAXED);
+    if (fd >= 0 && getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0) {
+        hb->queue_depth = info.tcpi_unacked;
+    }
+    hb->open_streams = __atomic_load_n(&open_streams, __ATOMIC_RELAXED);
+
+    struct statvfs fs;
+    if (statvfs(data_dir, &fs) == 0) {
+        hb->capacity_mb = (uint32_t)((uint64_t)fs.f_blocks * fs.f_frsize / (1024 * 1024));
+        hb->free_mb = (uint32_t)((uint64_t)fs.f_bavail * fs.f_frsize / (1024 * 1024));
+    }
+}
@@ -0,0 +1,78 @@
+// src/tools/log_dump.c
+//
+// Print a binary request log, as written by the naming and storage servers,
+// one record per line. Build with `make log_dump`.
+//
+// Usage: log_dump <log file>...
+
+#include "request_log.h"
+#include <stdio.h>
+#include <time.h>
+
+static const char *event_name(uint16_t event) {
+    switch (event) {
+        case REQUEST_EVENT_LOOKUP: return "lookup";
+        case REQUEST_EVENT_LOOKUP_BATCH: return "lookup_batch";
+        case REQUEST_EVENT_LIST: return "list";
+        case REQUEST_EVENT_CREATE: return "create";
+        case REQUEST_EVENT_DELETE: return "delete";
+        case REQUEST_EVENT_REGISTER: return "register";
+        case REQUEST_EVENT_REGISTER_PATH: return "register_path";
+        case REQUEST_EVENT_READ: return "read";
+        case REQUEST_EVENT_WRITE: return "write";
+        case REQUEST_EVENT_STREAM: return "stream";
+        case REQUEST_EVENT_REPLICATE_WRITE: return "replicate_write";
+        case REQUEST_EVENT_REPLICATE_DELETE: return "replicate_delete";
+        case REQUEST_EVENT_DROPPED: return "dropped";
+        case REQUEST_EVENT_COPY: return "copy";
+        case REQUEST_EVENT_RENAME: return "rename";
+        case REQUEST_EVENT_SEARCH: return "search";
+        default: return "unknown";
+    }
+}
+
+static int dump(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+
+    RequestLogFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != REQUEST_LOG_MAGIC ||
+        header.version != REQUEST_LOG_VERSION || header.record_size != sizeof(RequestLogRecord)) {
+        fprintf(stderr, "%s: not a request log\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    RequestLogRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        time_t seconds = record.timestamp_us / 1000000;
+        struct tm tm;
+        char when[32];
+        localtime_r(&seconds, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        record.ip[sizeof(record.ip) - 1] = '\0';
+        record.path[sizeof(record.path) - 1] = '\0';
+
+        printf("%s.%06llu t%u %-16s %s:%u #%u status=%d value=%llu %s\n", when,
+               (unsigned long long)(record.timestamp_us % 1000000), record.thread, event_name(record.event),
+               record.ip[0] ? record.ip : "-", record.port, record.request_id, record.status,
+               (unsigned long long)record.value, record.path);
+    }
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <log file>...\n", argv[0]);
+        return 1;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        failed |= dump(argv[i]);
+    }
+    return failed;
+}
@@ -0,0 +1,129 @@
+// src/tools/placement_sim.c
+//
+// Simulation benchmark for consistent-hash placement: balance against the
+// capacity weights, lookup cost, and how many placements move when a server
+// joins or leaves. Build with `make placement_sim`.
+//
+// Usage: placement_sim [servers] [keys]
+
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Server i gets 1 to 4 capacity units so the weighting shows
+static void make_server(StorageServer *server, int i) {
+    memset(server, 0, sizeof(*server));
+    snprintf(server->host, sizeof(server->host), "10.0.0.%d", i + 1);
+    snprintf(server->port, sizeof(server->port), "%d", 9000 + i);
+    server->capacity_mb = PLACEMENT_CAPACITY_UNIT_MB * (1 + i % 4);
+    server->active = 1;
+}
+
+static int *place_all(const PlacementRing *ring, char **keys, int key_count) {
+    int *owners = malloc(sizeof(int) * key_count);
+    if (!owners) exit(1);
+    for (int k = 0; k < key_count; k++) owners[k] = placement_ring_lookup(ring, keys[k]);
+    return owners;
+}
+
+static void report_balance(const StorageServer *servers, int count, const int *owners, int key_count) {
+    double total_weight = 0;
+    for (int i = 0; i < count; i++) {
+        if (servers[i].active) total_weight += servers[i].capacity_mb;
+    }
+
+    int *placed = calloc(count, sizeof(int));
+    if (!placed) exit(1);
+    for (int k = 0; k < key_count; k++) placed[owners[k]]++;
+
+    double worst = 0;
+    printf("  %-16s %8s %8s %8s\n", "server", "expected", "actual", "error");
+    for (int i = 0; i < count; i++) {
+        if (!servers[i].active) continue;
+        double expected = servers[i].capacity_mb / total_weight;
+        double actual = (double)placed[i] / key_count;
+        double error = (actual - expected) / expected;
+        if (error < 0) error = -error;
+        if (error > worst) worst = error;
+        printf("  %-10s:%-5s %7.2f%% %7.2f%% %7.1f%%\n", servers[i].host, servers[i].port,
+               expected * 100, actual * 100, error * 100);
+    }
+    printf("  worst relative deviation from capacity share: %.1f%%\n", worst * 100);
+    free(placed);
+}
+
+static void report_moves(const char *what, const int *before, const int *after, int key_count, double ideal) {
+    int moved = 0;
+    for (int k = 0; k < key_count; k++) {
+        if (before[k] != after[k]) moved++;
+    }
+    printf("%s: %.2f%% of placements moved (ideal %.2f%%)\n", what, 100.0 * moved / key_count, ideal * 100);
+}
+
+int main(int argc, char *argv[]) {
+    int server_count = argc > 1 ? atoi(argv[1]) : 8;
+    int key_count = argc > 2 ? atoi(argv[2]) : 200000;
+    if (server_count < 2 || key_count < 1) {
+        fprintf(stderr, "Usage: %s [servers >= 2] [keys]\n", argv[0]);
+        return 1;
+    }
+
+    // One extra slot for the server that joins later
+    StorageServer *servers = calloc(server_count + 1, sizeof(StorageServer));
+    char **keys = malloc(sizeof(char *) * key_count);
+    if (!servers || !keys) return 1;
+    for (int i = 0; i <= server_count; i++) make_server(&servers[i], i);
+    for (int k = 0; k < key_count; k++) {
+        char key[64];
+        snprintf(key, sizeof(key), "dir%d/file%d.dat", k % 97, k);
+        keys[k] = strdup(key);
+    }
+
+    double start = now_seconds();
+    PlacementRing *ring = placement_ring_build(servers, server_count);
+    double built = now_seconds();
+    int *base = place_all(ring, keys, key_count);
+    double placed = now_seconds();
+
+    printf("%d servers, %d keys\n", server_count, key_count);
+    printf("ring build %.3f ms, %.0f ns per placement\n", (built - start) * 1e3, (placed - built) * 1e9 / key_count);
+    report_balance(servers, server_count, base, key_count);
+
+    // A server joins: only the keys it takes over should move
+    PlacementRing *grown = placement_ring_build(servers, server_count + 1);
+    int *after_join = place_all(grown, keys, key_count);
+    double total = 0;
+    for (int i = 0; i <= server_count; i++) total += servers[i].capacity_mb;
+    report_moves("join", base, after_join, key_count, servers[server_count].capacity_mb / total);
+
+    // Server 0 leaves: only its keys should move
+    servers[0].active = 0;
+    PlacementRing *shrunk = placement_ring_build(servers, server_count);
+    int *after_leave = place_all(shrunk, keys, key_count);
+    int strays = 0;
+    for (int k = 0; k < key_count; k++) {
+        if (base[k] != 0 && after_leave[k] != base[k]) strays++;
+    }
+    total -= servers[server_count].capacity_mb;
+    report_moves("leave", base, after_leave, key_count, servers[0].capacity_mb / total);
+    printf("leave: %d placements moved off surviving servers (ideal 0)\n", strays);
+
+    placement_ring_free(ring);
+    placement_ring_free(grown);
+    placement_ring_free(shrunk);
+    free(base);
+    free(after_join);
+    free(after_leave);
+    for (int k = 0; k < key_count; k++) free(keys[k]);
+    free(keys);
+    free(servers);
+    return 0;
+}
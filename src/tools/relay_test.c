@@ -0,0 +1,191 @@
+// src/tools/relay_test.c
+//
+// Check network_socket_relay over loopback TCP: a transfer many times the
+// pipe size arrives intact and exactly, bytes past the requested length
+// stay on the source, and a source that closes early gives a short count.
+// Build and run with `make relay_test`.
+
+#include "network.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define LARGE_LENGTH (8 * 1024 * 1024 + 12345)  // Not a multiple of the pipe size
+#define TRAILER "next request"
+#define SHORT_SENT 100000
+
+// The relay reads from one connected pair and writes to another:
+// writer -> source ... relay ... sink -> reader
+typedef struct {
+    NetworkSocket *writer;
+    NetworkSocket *source;
+    NetworkSocket *sink;
+    NetworkSocket *reader;
+} RelayPair;
+
+typedef struct {
+    NetworkSocket *sock;
+    uint64_t length;
+    int close_after;
+    uint64_t received;
+    int intact;
+} Transfer;
+
+static uint8_t pattern_byte(uint64_t i) {
+    return (uint8_t)(i * 31 + (i >> 12));
+}
+
+static NetworkSocket *connect_pair(NetworkSocket **accepted) {
+    NetworkSocket *listener = network_socket_create(NULL, "0");
+    if (!listener) return NULL;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    getsockname(network_socket_get_fd(listener), (struct sockaddr *)&addr, &addr_len);
+    uint16_t bound = addr.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&addr)->sin6_port :
+                                                  ((struct sockaddr_in *)&addr)->sin_port;
+    char port[16];
+    snprintf(port, sizeof(port), "%u", ntohs(bound));
+
+    NetworkSocket *connected = network_socket_create("localhost", port);
+    *accepted = connected ? network_socket_accept(listener) : NULL;
+    network_socket_close(listener);
+    if (!*accepted) {
+        if (connected) network_socket_close(connected);
+        return NULL;
+    }
+    return connected;
+}
+
+static int open_pair(RelayPair *pair) {
+    memset(pair, 0, sizeof(*pair));
+    pair->writer = connect_pair(&pair->source);
+    pair->sink = connect_pair(&pair->reader);
+    return pair->writer && pair->sink;
+}
+
+static void close_pair(RelayPair *pair) {
+    NetworkSocket *socks[] = {pair->writer, pair->source, pair->sink, pair->reader};
+    for (size_t i = 0; i < sizeof(socks) / sizeof(socks[0]); i++) {
+        if (socks[i]) network_socket_close(socks[i]);
+    }
+}
+
+// Send length pattern bytes, then the trailer unless the socket is to be
+// closed instead
+static void *write_pattern(void *arg) {
+    Transfer *transfer = arg;
+    uint8_t chunk[64 * 1024];
+    uint64_t sent = 0;
+    while (sent < transfer->length) {
+        size_t n = transfer->length - sent < sizeof(chunk) ? (size_t)(transfer->length - sent) : sizeof(chunk);
+        for (size_t i = 0; i < n; i++) chunk[i] = pattern_byte(sent + i);
+        if (network_socket_send(transfer->sock, chunk, n) != (ssize_t)n) break;
+        sent += n;
+    }
+    if (transfer->close_after) {
+        shutdown(network_socket_get_fd(transfer->sock), SHUT_WR);
+    } else {
+        network_socket_send(transfer->sock, TRAILER, strlen(TRAILER));
+    }
+    return NULL;
+}
+
+// Receive up to length bytes and check them against the pattern
+static void *read_pattern(void *arg) {
+    Transfer *transfer = arg;
+    uint8_t chunk[64 * 1024];
+    transfer->intact = 1;
+    while (transfer->received < transfer->length) {
+        size_t n = transfer->length - transfer->received < sizeof(chunk) ?
+                   (size_t)(transfer->length - transfer->received) : sizeof(chunk);
+        ssize_t got = network_socket_receive(transfer->sock, chunk, n);
+        if (got <= 0) break;
+        for (ssize_t i = 0; i < got; i++) {
+            if (chunk[i] != pattern_byte(transfer->received + i)) transfer->intact = 0;
+        }
+        transfer->received += got;
+    }
+    return NULL;
+}
+
+static int check(int ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    return ok ? 0 : 1;
+}
+
+// A large relay arrives intact and stops at exactly length bytes
+static int test_large_relay() {
+    RelayPair pair;
+    if (!open_pair(&pair)) {
+        close_pair(&pair);
+        return check(0, "loopback connections");
+    }
+
+    Transfer out = {.sock = pair.writer, .length = LARGE_LENGTH};
+    Transfer in = {.sock = pair.reader, .length = LARGE_LENGTH};
+    pthread_t writer, reader;
+    pthread_create(&writer, NULL, write_pattern, &out);
+    pthread_create(&reader, NULL, read_pattern, &in);
+    ssize_t relayed = network_socket_relay(pair.source, pair.sink, LARGE_LENGTH);
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    char trailer[sizeof(TRAILER)] = {0};
+    ssize_t got = network_socket_receive(pair.source, trailer, strlen(TRAILER));
+
+    int failed = 0;
+    failed |= check(relayed == LARGE_LENGTH, "large relay returns its length");
+    failed |= check(in.received == LARGE_LENGTH && in.intact, "large relay arrives intact");
+    failed |= check(got == (ssize_t)strlen(TRAILER) && strcmp(trailer, TRAILER) == 0,
+                    "bytes past the length stay on the source");
+    close_pair(&pair);
+    return failed;
+}
+
+// A source that closes before length bytes gives a short count, and
+// everything it did send is delivered
+static int test_early_close() {
+    RelayPair pair;
+    if (!open_pair(&pair)) {
+        close_pair(&pair);
+        return check(0, "loopback connections");
+    }
+
+    Transfer out = {.sock = pair.writer, .length = SHORT_SENT, .close_after = 1};
+    Transfer in = {.sock = pair.reader, .length = SHORT_SENT};
+    pthread_t writer, reader;
+    pthread_create(&writer, NULL, write_pattern, &out);
+    pthread_create(&reader, NULL, read_pattern, &in);
+    ssize_t relayed = network_socket_relay(pair.source, pair.sink, LARGE_LENGTH);
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    int failed = 0;
+    failed |= check(relayed == SHORT_SENT, "early close returns a short count");
+    failed |= check(in.received == SHORT_SENT && in.intact, "early close delivers what was sent");
+    close_pair(&pair);
+    return failed;
+}
+
+// Nothing to relay returns at once without touching either socket
+static int test_empty_relay() {
+    RelayPair pair;
+    if (!open_pair(&pair)) {
+        close_pair(&pair);
+        return check(0, "loopback connections");
+    }
+    int failed = check(network_socket_relay(pair.source, pair.sink, 0) == 0, "empty relay returns 0");
+    close_pair(&pair);
+    return failed;
+}
+
+int main() {
+    int failed = 0;
+    failed |= test_large_relay();
+    failed |= test_early_close();
+    failed |= test_empty_relay();
+    printf("%s\n", failed ? "relay_test FAILED" : "relay_test passed");
+    return failed;
+}